@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * ZcUser:
+ * One per nick per network, shared by every channel the user is in. Nick
+ * changes rename it in place. The client keeps a user while it shares a
+ * channel with us; take a reference to keep one beyond that.
+ */
+typedef struct _ZcUser ZcUser;
+
+ZcUser *zc_user_ref(ZcUser *user);
+void zc_user_unref(ZcUser *user);
+const gchar *zc_user_get_nick(const ZcUser *user);
+/* "user@host" from JOIN, CHGHOST or userhost-in-names; %NULL until seen. */
+const gchar *zc_user_get_userhost(const ZcUser *user);
+/* Channels we share with the user (0 once the client let go of it). */
+guint zc_user_get_n_channels(const ZcUser *user);
+
+/**
+ * ZcChannelState:
+ * Members of a channel we are in. A membership is the user plus a mask of
+ * the prefix modes they hold: bit i is the i'th mode of the server's
+ * ISUPPORT PREFIX, highest rank first, so with "(qaohv)~&@%+" bit 0 is
+ * owner and bit 4 voice. Owned by the client; valid until we leave the
+ * channel or disconnect.
+ */
+typedef struct _ZcChannelState ZcChannelState;
+
+typedef void (*ZcMemberFunc)(ZcUser *user, guint modes, gpointer user_data);
+
+const gchar *zc_channel_state_get_name(const ZcChannelState *chan);
+guint zc_channel_state_get_n_members(const ZcChannelState *chan);
+/* Returns %FALSE if @nick is not on @chan. */
+gboolean zc_channel_state_lookup(const ZcChannelState *chan, const gchar *nick, ZcUser **user, guint *modes);
+void zc_channel_state_foreach(const ZcChannelState *chan, ZcMemberFunc func, gpointer user_data);
+
+G_END_DECLS
@@ -6,6 +6,51 @@ G_BEGIN_DECLS
 
 typedef struct _ZcIrcMessage ZcIrcMessage;
 
+/**
+ * ZcIrcCommand:
+ * Command identifier assigned at parse time. Three-digit numerics map to
+ * their own value (1..999); known verbs follow from 1000. Anything else is
+ * %ZC_IRC_CMD_UNKNOWN. Use it to index handler tables of size
+ * %ZC_IRC_CMD_LAST instead of comparing command strings.
+ */
+typedef enum {
+  ZC_IRC_CMD_UNKNOWN = 0,
+  ZC_IRC_CMD_NUMERIC_MAX = 999,
+
+  ZC_IRC_CMD_PRIVMSG = 1000,
+  ZC_IRC_CMD_NOTICE,
+  ZC_IRC_CMD_JOIN,
+  ZC_IRC_CMD_PART,
+  ZC_IRC_CMD_QUIT,
+  ZC_IRC_CMD_NICK,
+  ZC_IRC_CMD_KICK,
+  ZC_IRC_CMD_MODE,
+  ZC_IRC_CMD_TOPIC,
+  ZC_IRC_CMD_INVITE,
+  ZC_IRC_CMD_PING,
+  ZC_IRC_CMD_PONG,
+  ZC_IRC_CMD_ERROR,
+  ZC_IRC_CMD_KILL,
+  ZC_IRC_CMD_WALLOPS,
+  ZC_IRC_CMD_CAP,
+  ZC_IRC_CMD_AUTHENTICATE,
+  ZC_IRC_CMD_ACCOUNT,
+  ZC_IRC_CMD_AWAY,
+  ZC_IRC_CMD_CHGHOST,
+  ZC_IRC_CMD_SETNAME,
+  ZC_IRC_CMD_BATCH,
+  ZC_IRC_CMD_TAGMSG,
+  ZC_IRC_CMD_FAIL,
+  ZC_IRC_CMD_WARN,
+  ZC_IRC_CMD_NOTE,
+
+  ZC_IRC_CMD_LAST
+} ZcIrcCommand;
+
+#define ZC_IRC_COMMAND_IS_NUMERIC(id) ((id) > ZC_IRC_CMD_UNKNOWN && (id) <= ZC_IRC_CMD_NUMERIC_MAX)
+
+ZcIrcCommand zc_irc_command_lookup(const gchar *command, gssize len);
+
 /**
  * ZcIrcMessage:
  * @prefix: Optional message prefix (nick!user@host or server name), may be %NULL
@@ -13,12 +58,32 @@ typedef struct _ZcIrcMessage ZcIrcMessage;
  * @params: Array of parameters (strings). For commands with a trailing parameter,
  *          @trailing contains that value and it is not duplicated in @params.
  * @trailing: Trailing parameter (after ':'), may be %NULL
+ * @command_id: #ZcIrcCommand for @command, assigned by the parser
+ * @tags: Raw IRCv3 message-tags block (without the leading '@'), may be %NULL.
+ *        Still escaped; use zc_irc_message_get_tag() to read single tags.
+ *
+ * Always allocate with zc_irc_message_new() (or one of the parse/copy
+ * functions): the private fields hold the reference count and the cache of
+ * decoded tags, which only those set up and zc_irc_message_unref() frees.
+ *
+ * Messages are reference counted. The boxed type's copy (g_boxed_copy(),
+ * #GValue storage, signal marshalling) is zc_irc_message_ref(), so copies
+ * share one instance: treat it as read-only once emitted. Only
+ * zc_irc_message_copy() duplicates the strings, for a caller that needs a
+ * private message to modify. zc_irc_message_free() is an alias for
+ * zc_irc_message_unref().
  */
 struct _ZcIrcMessage {
   gchar *prefix;
   gchar *command;
   GPtrArray *params; /* char* */
   gchar *trailing;
+  ZcIrcCommand command_id;
+  gchar *tags;
+
+  /*< private >*/
+  gatomicrefcount ref_count;
+  GHashTable *tag_cache; /* key -> unescaped value, set once on first lookup */
 };
 
 #define ZC_TYPE_IRC_MESSAGE (zc_irc_message_get_type())
@@ -27,11 +92,112 @@ GType zc_irc_message_get_type(void);
 
 ZcIrcMessage *zc_irc_message_new(void);
 ZcIrcMessage *zc_irc_message_parse_line(const gchar *line);
+ZcIrcMessage *zc_irc_message_ref(ZcIrcMessage *msg);
+void zc_irc_message_unref(ZcIrcMessage *msg);
 ZcIrcMessage *zc_irc_message_copy(const ZcIrcMessage *msg);
 void zc_irc_message_free(ZcIrcMessage *msg);
 
 const gchar *zc_irc_message_param(const ZcIrcMessage *msg, guint idx);
 
+/* IRCv3 message-tags. The first lookup decodes/unescapes the tag block and
+ * caches it on the message, so untagged consumers pay nothing for them;
+ * lookups are safe from several threads at once. A repeated key yields its
+ * last value. Returns %NULL if the tag is absent and "" for a tag without a
+ * value.
+ */
+const gchar *zc_irc_message_get_tag(const ZcIrcMessage *msg, const gchar *key);
+gboolean zc_irc_message_has_tag(const ZcIrcMessage *msg, const gchar *key);
+
 gchar *zc_irc_extract_nick(const gchar *prefix);
 
+/**
+ * ZcIrcMessageView:
+ * A parsed IRC line stored in a single allocation: a copy of the line bytes,
+ * tokenized in place, plus an offset/length table for prefix, command,
+ * params and trailing. Accessors return pointers into that block, so parsing
+ * costs one malloc regardless of the number of params.
+ *
+ * Views are immutable. Use zc_irc_message_view_to_message() when a caller
+ * needs an owned #ZcIrcMessage (e.g. to keep or modify the fields).
+ */
+typedef struct _ZcIrcMessageView ZcIrcMessageView;
+
+#define ZC_TYPE_IRC_MESSAGE_VIEW (zc_irc_message_view_get_type())
+
+GType zc_irc_message_view_get_type(void);
+
+ZcIrcMessageView *zc_irc_message_view_parse(const gchar *line, gssize len);
+ZcIrcMessageView *zc_irc_message_view_copy(const ZcIrcMessageView *view);
+void zc_irc_message_view_free(ZcIrcMessageView *view);
+
+const gchar *zc_irc_message_view_get_tags(const ZcIrcMessageView *view);
+gchar *zc_irc_message_view_dup_tag(const ZcIrcMessageView *view, const gchar *key);
+const gchar *zc_irc_message_view_get_prefix(const ZcIrcMessageView *view);
+const gchar *zc_irc_message_view_get_command(const ZcIrcMessageView *view);
+ZcIrcCommand zc_irc_message_view_get_command_id(const ZcIrcMessageView *view);
+const gchar *zc_irc_message_view_get_trailing(const ZcIrcMessageView *view);
+guint zc_irc_message_view_get_n_params(const ZcIrcMessageView *view);
+const gchar *zc_irc_message_view_param(const ZcIrcMessageView *view, guint idx);
+gsize zc_irc_message_view_param_len(const ZcIrcMessageView *view, guint idx);
+
+ZcIrcMessage *zc_irc_message_view_to_message(const ZcIrcMessageView *view);
+
+/* RFC 1459 line limit, CRLF included, and the IRCv3 limit on the tag
+ * section a client may send, '@' and the separating space included. */
+#define ZC_IRC_LINE_MAX 512
+#define ZC_IRC_CLIENT_TAGS_MAX 4096
+
+/**
+ * ZcIrcBuildStatus:
+ * @ZC_IRC_BUILD_OK: the line is valid so far
+ * @ZC_IRC_BUILD_TOO_LONG: over %ZC_IRC_LINE_MAX, or too many tag bytes
+ * @ZC_IRC_BUILD_INVALID: CR, LF or NUL in a field, an empty middle
+ *   parameter or one with a space or leading ':', or no command
+ *
+ * The first problem sticks; later calls on a failed builder do nothing.
+ */
+typedef enum {
+  ZC_IRC_BUILD_OK,
+  ZC_IRC_BUILD_TOO_LONG,
+  ZC_IRC_BUILD_INVALID
+} ZcIrcBuildStatus;
+
+/**
+ * ZcIrcMessageBuilder:
+ * Serializes an outgoing line into a fixed buffer, usually on the stack,
+ * so building one costs no allocation. Call in wire order: tags, then the
+ * command, then middle params, then the trailing param. Tag values are
+ * escaped; everything else is checked and copied as is.
+ *
+ * |[
+ * ZcIrcMessageBuilder b;
+ * zc_irc_message_builder_init(&b);
+ * zc_irc_message_builder_set_command(&b, "PRIVMSG");
+ * zc_irc_message_builder_add_param(&b, "#chan", -1);
+ * zc_irc_message_builder_add_trailing(&b, text, -1);
+ * zc_client_send_message(client, &b, ZC_SEND_PRIORITY_USER, &error);
+ * ]|
+ */
+typedef struct {
+  /*< private >*/
+  gchar buf[ZC_IRC_CLIENT_TAGS_MAX + ZC_IRC_LINE_MAX + 1];
+  guint len;
+  guint body;   /* offset of the command */
+  guint8 state;
+  guint8 status;
+} ZcIrcMessageBuilder;
+
+void zc_irc_message_builder_init(ZcIrcMessageBuilder *b);
+/* @value NULL or "" sends the bare key. */
+void zc_irc_message_builder_add_tag(ZcIrcMessageBuilder *b, const gchar *key, const gchar *value);
+void zc_irc_message_builder_set_command(ZcIrcMessageBuilder *b, const gchar *command);
+void zc_irc_message_builder_add_param(ZcIrcMessageBuilder *b, const gchar *param, gssize len);
+/* Starts the trailing param (always sent with ':'); _append() extends it. */
+void zc_irc_message_builder_add_trailing(ZcIrcMessageBuilder *b, const gchar *text, gssize len);
+void zc_irc_message_builder_append(ZcIrcMessageBuilder *b, const gchar *text, gssize len);
+ZcIrcBuildStatus zc_irc_message_builder_get_status(const ZcIrcMessageBuilder *b);
+/* The NUL-terminated line without CRLF, or %NULL unless the status is OK
+ * and a command was set. Points into @b. */
+const gchar *zc_irc_message_builder_get_line(const ZcIrcMessageBuilder *b, gsize *length);
+
 G_END_DECLS
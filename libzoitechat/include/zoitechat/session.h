@@ -0,0 +1,98 @@
+#pragma once
+
+#include <gio/gio.h>
+#include "zoitechat.h"
+
+G_BEGIN_DECLS
+
+/**
+ * ZcNetworkConfig:
+ * @name: Unique network name, used as the key in a #ZcSession
+ * @host: Server host name
+ * @port: Server port
+ * @tls: Whether to negotiate TLS
+ * @nick: Nick name
+ * @user: User name
+ * @realname: Real name
+ * @auto_join: Channels to join after registration ("#a,#b" or "#a #b")
+ * @sasl_account: SASL PLAIN account, %NULL or "" for none
+ * @sasl_password: SASL PLAIN password
+ * @autoconnect: Whether zc_session_connect_all() connects this network
+ * @charset: Charset for incoming lines that aren't UTF-8, %NULL to repair
+ *   them instead (see zc_client_set_fallback_charset())
+ */
+typedef struct {
+  gchar *name;
+  gchar *host;
+  guint16 port;
+  gboolean tls;
+  gchar *nick;
+  gchar *user;
+  gchar *realname;
+  gchar *auto_join;
+  gchar *sasl_account;
+  gchar *sasl_password;
+  gboolean autoconnect;
+  gchar *charset;
+} ZcNetworkConfig;
+
+ZcNetworkConfig *zc_network_config_new(const gchar *name);
+ZcNetworkConfig *zc_network_config_copy(const ZcNetworkConfig *config);
+void zc_network_config_free(ZcNetworkConfig *config);
+
+/**
+ * ZcSessionStats:
+ * Totals over every network in the session.
+ */
+typedef struct {
+  guint n_networks;
+  guint n_connected;
+  guint queued;
+  guint64 sent;
+  guint64 delayed;
+  guint64 cancelled;
+  gsize write_queue_bytes;
+} ZcSessionStats;
+
+#define ZC_TYPE_SESSION (zc_session_get_type())
+G_DECLARE_FINAL_TYPE(ZcSession, zc_session, ZC, SESSION, GObject)
+
+/**
+ * ZcSession:
+ * Owns one #ZcClient per network, all driven from the same main context.
+ * Clients share one GSocketClient and one TLS database; resolved addresses
+ * are cached process-wide, so they are shared as well.
+ *
+ * Signals:
+ * - "connect-failed" (ZcClient* client, gchar* message): a connect started
+ *   through the session failed before "connected"
+ */
+ZcSession *zc_session_new(void);
+
+/* Returns the new network's client (owned by the session), or %NULL if a
+ * network with that name already exists.
+ */
+ZcClient *zc_session_add_network(ZcSession *self, const ZcNetworkConfig *config);
+gboolean zc_session_remove_network(ZcSession *self, const gchar *name);
+
+/* Replaces the stored config of the network with the same name. Identity
+ * changes apply to the client right away, host/port/TLS on the next connect.
+ */
+gboolean zc_session_update_network(ZcSession *self, const ZcNetworkConfig *config);
+
+guint zc_session_get_n_networks(ZcSession *self);
+const ZcNetworkConfig *zc_session_get_nth_config(ZcSession *self, guint index);
+const ZcNetworkConfig *zc_session_get_config(ZcSession *self, const gchar *name);
+ZcClient *zc_session_get_client(ZcSession *self, const gchar *name);
+
+gboolean zc_session_connect(ZcSession *self, const gchar *name);
+/* Starts every autoconnect network at once; the connects run in parallel. */
+void zc_session_connect_all(ZcSession *self);
+void zc_session_disconnect_all(ZcSession *self);
+
+void zc_session_get_stats(ZcSession *self, ZcSessionStats *stats);
+
+GSocketClient *zc_session_get_socket_client(ZcSession *self);
+GTlsDatabase *zc_session_get_tls_database(ZcSession *self);
+
+G_END_DECLS
@@ -2,9 +2,243 @@
 
 #include <gio/gio.h>
 #include "irc_message.h"
+#include "channel_state.h"
 
 G_BEGIN_DECLS
 
+/**
+ * ZcSendPriority:
+ * @ZC_SEND_PRIORITY_KEEPALIVE: PONG, registration; never paced
+ * @ZC_SEND_PRIORITY_USER: things the user typed
+ * @ZC_SEND_PRIORITY_BULK: automatic traffic (JOIN/NAMES/WHO, CTCP replies)
+ *
+ * Outbound lanes for flood control, drained in this order.
+ */
+typedef enum {
+  ZC_SEND_PRIORITY_KEEPALIVE,
+  ZC_SEND_PRIORITY_USER,
+  ZC_SEND_PRIORITY_BULK
+} ZcSendPriority;
+
+/**
+ * ZcSendStats:
+ * @queued: lines currently waiting for a flood-control token
+ * @sent: lines released to the socket since the client was created
+ * @delayed: released lines that had to wait for a token
+ * @cancelled: lines dropped by zc_client_cancel_queued()
+ * @submitted: lines sent from other threads and handed over to the owner
+ * @dropped: lines sent from other threads that arrived after a disconnect
+ */
+typedef struct {
+  guint queued;
+  guint64 sent;
+  guint64 delayed;
+  guint64 cancelled;
+  guint64 submitted;
+  guint64 dropped;
+} ZcSendStats;
+
+/**
+ * ZcReconnectPolicy:
+ * @initial_delay_ms: wait before the first retry
+ * @max_delay_ms: cap on the wait between retries
+ * @multiplier: growth of the wait per failed attempt
+ * @jitter: fraction (0..1) of each wait that is randomised, so clients
+ *   dropped by the same netsplit don't all come back in the same second
+ * @max_attempts: give up after this many attempts; 0 retries forever
+ */
+typedef struct {
+  guint initial_delay_ms;
+  guint max_delay_ms;
+  gdouble multiplier;
+  gdouble jitter;
+  guint max_attempts;
+} ZcReconnectPolicy;
+
+/**
+ * ZcReconnectStats:
+ * @attempts: reconnect attempts started
+ * @recoveries: drops that ended with the client registered again
+ * @last_ms: drop-to-registered time of the last recovery
+ * @max_ms: longest recovery so far
+ * @total_ms: sum over all recoveries (divide by @recoveries for the mean)
+ */
+typedef struct {
+  guint64 attempts;
+  guint64 recoveries;
+  guint64 last_ms;
+  guint64 max_ms;
+  guint64 total_ms;
+} ZcReconnectStats;
+
+/**
+ * ZcConnectTimings:
+ * Phases of the last successful connect, in microseconds.
+ * @resolve_us: name lookup until the first usable answer; 0 when cached
+ * @tcp_us: first TCP attempt started until one connected
+ * @tls_us: TLS handshake; 0 for plain connections
+ * @total_us: connect started until "connected"
+ * @attempts: TCP attempts started (IPv6 and IPv4 addresses are raced)
+ * @dns_cached: addresses came from the in-process DNS cache
+ * @tls_session_offered: the handshake offered a cached session from an
+ *   earlier connection to the same host:port (see zc_client_set_tls_session_cache()).
+ *   GIO does not say whether the server accepted it; compare @tls_us.
+ */
+typedef struct {
+  gint64 resolve_us;
+  gint64 tcp_us;
+  gint64 tls_us;
+  gint64 total_us;
+  guint attempts;
+  gboolean dns_cached;
+  gboolean tls_session_offered;
+} ZcConnectTimings;
+
+/**
+ * ZcRegistrationPhase:
+ * @ZC_REGISTRATION_PHASE_SENT: the login burst was queued as one write
+ * @ZC_REGISTRATION_PHASE_CAPS: CAP END sent
+ * @ZC_REGISTRATION_PHASE_SASL: the SASL exchange finished, either way
+ * @ZC_REGISTRATION_PHASE_WELCOME: 001 received
+ * @ZC_REGISTRATION_PHASE_JOINED: every auto-join channel was joined
+ */
+typedef enum {
+  ZC_REGISTRATION_PHASE_SENT,
+  ZC_REGISTRATION_PHASE_CAPS,
+  ZC_REGISTRATION_PHASE_SASL,
+  ZC_REGISTRATION_PHASE_WELCOME,
+  ZC_REGISTRATION_PHASE_JOINED
+} ZcRegistrationPhase;
+
+/**
+ * ZcRegistrationTimings:
+ * When each #ZcRegistrationPhase of the current (or last) connection was
+ * reached, in microseconds after "connected"; 0 if it was not (yet).
+ * @sasl_succeeded: the server answered the SASL exchange with 903
+ */
+typedef struct {
+  gint64 sent_us;
+  gint64 caps_us;
+  gint64 sasl_us;
+  gint64 welcome_us;
+  gint64 joined_us;
+  gboolean sasl_succeeded;
+} ZcRegistrationTimings;
+
+/**
+ * ZcLinkHealth:
+ * @ZC_LINK_HEALTH_UNKNOWN: not registered, or no probe answered yet
+ * @ZC_LINK_HEALTH_OK: lag below the warning threshold
+ * @ZC_LINK_HEALTH_LAGGING: lag (or an unanswered probe) past the warning threshold
+ * @ZC_LINK_HEALTH_DEAD: a probe went unanswered past the dead threshold; the
+ *   connection is dropped right after this is reported
+ */
+typedef enum {
+  ZC_LINK_HEALTH_UNKNOWN,
+  ZC_LINK_HEALTH_OK,
+  ZC_LINK_HEALTH_LAGGING,
+  ZC_LINK_HEALTH_DEAD
+} ZcLinkHealth;
+
+#define ZC_TYPE_LINK_HEALTH (zc_link_health_get_type())
+GType zc_link_health_get_type(void);
+
+/**
+ * ZcLagStats:
+ * Lag probes on the current connection, times in microseconds.
+ * @last_us: round-trip time of the last answered probe
+ * @srtt_us: smoothed round-trip time
+ * @jitter_us: smoothed deviation of the round-trip time
+ * @probes: probes sent
+ * @pongs: probes answered
+ * @timeouts: probes that hit the dead threshold
+ */
+typedef struct {
+  gint64 last_us;
+  gint64 srtt_us;
+  gint64 jitter_us;
+  guint64 probes;
+  guint64 pongs;
+  guint64 timeouts;
+} ZcLagStats;
+
+#define ZC_STATS_PARSE_BUCKETS 8
+
+/**
+ * ZcClientStats:
+ * Counters since the client was created (across reconnects), plus a few
+ * current values. See zc_client_get_stats().
+ * @lines_in: lines read and handed to the parser
+ * @bytes_in: bytes read from the connection
+ * @lines_out: lines written (including CRLF-terminated protocol lines)
+ * @bytes_out: bytes written, CRLF included
+ * @malformed: lines dropped as unparsable or longer than the line limit
+ * @parse_ns_total: time spent parsing, in nanoseconds
+ * @parse_hist: lines per parse-time bucket; bucket i holds lines that took
+ *   at most zc_client_stats_parse_bucket_le_ns(i)
+ * @dispatches: socket reads handed to listeners
+ * @dispatch_us_total: time spent in signal emission for those reads
+ * @dispatch_us_max: longest single one
+ * @write_queue_depth: lines not yet accepted by the stream (current)
+ * @write_queue_bytes: bytes not yet accepted by the stream (current)
+ * @flood_queued: lines waiting for a flood-control token (current)
+ * @rtt_us: smoothed PING round trip on this connection (current), 0 if unknown
+ * @rtt_jitter_us: its smoothed deviation (current)
+ * @reconnects: reconnect attempts
+ * @ping_timeouts: connections dropped by the lag check
+ * @pongs_sent: server PINGs answered
+ * @lines_transcoded: lines that weren't UTF-8 and were decoded from the
+ *   fallback charset (see zc_client_set_fallback_charset())
+ */
+typedef struct {
+  guint64 lines_in;
+  guint64 bytes_in;
+  guint64 lines_out;
+  guint64 bytes_out;
+  guint64 malformed;
+  guint64 parse_ns_total;
+  guint64 parse_hist[ZC_STATS_PARSE_BUCKETS];
+  guint64 dispatches;
+  guint64 dispatch_us_total;
+  guint64 dispatch_us_max;
+  guint write_queue_depth;
+  gsize write_queue_bytes;
+  guint flood_queued;
+  gint64 rtt_us;
+  gint64 rtt_jitter_us;
+  guint64 reconnects;
+  guint64 ping_timeouts;
+  guint64 pongs_sent;
+  guint64 lines_transcoded;
+} ZcClientStats;
+
+/* Priority of ingest slices: just below GDK_PRIORITY_REDRAW
+ * (G_PRIORITY_HIGH_IDLE + 20), so a frame can be drawn between slices.
+ */
+#define ZC_INGEST_PRIORITY (G_PRIORITY_HIGH_IDLE + 30)
+
+/**
+ * ZcIngestStats:
+ * How incoming lines were sliced under the ingest budget. See
+ * zc_client_set_ingest_budget().
+ * @slices: slices run (socket reads, or parts of one)
+ * @yields: slices cut short by the budget, with lines left over
+ * @max_slice_us: longest slice, including listener time
+ * @backlog_bytes: bytes buffered but not handled yet (current)
+ * @max_backlog_bytes: largest such backlog
+ * @paused_us: time reads were held back while a backlog drained
+ * @io_stalls: times the I/O thread stopped reading because the ring was full
+ */
+typedef struct {
+  guint64 slices;
+  guint64 yields;
+  guint64 max_slice_us;
+  gsize backlog_bytes;
+  gsize max_backlog_bytes;
+  guint64 paused_us;
+  guint64 io_stalls;
+} ZcIngestStats;
+
 #define ZC_TYPE_CLIENT (zc_client_get_type())
 G_DECLARE_FINAL_TYPE(ZcClient, zc_client, ZC, CLIENT, GObject)
 
@@ -17,6 +251,45 @@ G_DECLARE_FINAL_TYPE(ZcClient, zc_client, ZC, CLIENT, GObject)
  * - "disconnected" (gint code, gchar* message): emitted on disconnect or fatal IO error
  * - "raw-line" (gchar* line): emitted for each raw IRC line read
  * - "irc-message" (ZcIrcMessage* msg): emitted for each parsed IRC message
+ * - "irc-messages" (GPtrArray* views): every ZcIrcMessageView parsed from one
+ *   socket read (or one ingest slice of it), in order, emitted once after
+ *   the chunk has been processed
+ * - "batch-end" (): emitted after all lines of a socket read (or slice) were
+ *   delivered
+ * - "reconnecting" (guint attempt, guint delay_ms): the connection dropped
+ *   and attempt number @attempt will start in @delay_ms
+ * - "reconnect-failed" (guint attempts): the policy's attempt limit was hit
+ * - "cap-changed" (gchar* cap, gboolean enabled): an IRCv3 capability was
+ *   acknowledged, or removed by CAP ACK -cap / CAP DEL
+ * - "registration-phase" (guint phase, gint64 elapsed_us): a
+ *   #ZcRegistrationPhase was reached @elapsed_us after "connected"
+ * - "health-changed" (ZcLinkHealth health): the link health changed
+ * - "send-job-progress" (guint job, gchar* target, guint sent, guint total):
+ *   lines of a zc_client_send_text() job were handed to the send queue
+ * - "send-job-finished" (guint job, gchar* target, gboolean completed):
+ *   the job is over; @completed is FALSE if it was cancelled or the
+ *   connection went away
+ *
+ * Properties (read-only, with notify): "lag" (guint, ms) and "health"
+ * (#ZcLinkHealth).
+ *
+ * "raw-line", "irc-message" and "irc-messages" pass their argument with
+ * static scope: it is only valid during the emission. Use
+ * zc_irc_message_ref(), zc_irc_message_view_copy() or g_strdup() to keep it.
+ * The per-line signals cost nothing when no handler is connected.
+ *
+ * Threads: a client belongs to the thread that created it and to the
+ * #GMainContext that was thread-default there (the owner). Every signal is
+ * emitted on that context, also with zc_client_set_io_thread(), and every
+ * function must be called on that thread except the following, which any
+ * thread holding a reference may call:
+ * zc_client_send_raw(), zc_client_send_message(), zc_client_join(),
+ * zc_client_privmsg(), zc_client_quit(), zc_client_get_write_queue_depth()
+ * and zc_client_get_write_queue_bytes(). Sends from another thread are
+ * checked like any other, then copied onto a lock-free queue and written
+ * the next time the owner context runs, in order per thread and subject to
+ * flood control. Lines whose link goes down before then are dropped and
+ * counted in #ZcSendStats.
  */
 ZcClient *zc_client_new(void);
 
@@ -34,16 +307,183 @@ void zc_client_connect_async(
 
 gboolean zc_client_connect_finish(ZcClient *self, GAsyncResult *res, GError **error);
 
+/* Peer of the current (or last) connection as "addr:port", e.g.
+ * "[2001:db8::1]:6697"; %NULL before the first connect.
+ */
+const gchar *zc_client_get_remote_address(ZcClient *self);
+void zc_client_get_connect_timings(ZcClient *self, ZcConnectTimings *timings);
+
 gboolean zc_client_is_connected(ZcClient *self);
 
-gboolean zc_client_send_raw(ZcClient *self, const gchar *line, GError **error);
+/* Reconnect after an unexpected drop (EOF, I/O error), never after
+ * zc_client_disconnect() or once a QUIT has been sent on the connection
+ * (through any send function). @policy NULL disables it (the default). A network
+ * change reported by GNetworkMonitor retries a pending reconnect at once.
+ *
+ * While resuming the client registers by itself and, once welcomed,
+ * re-joins the channels it was in with as few JOIN lines as possible.
+ */
+void zc_client_set_reconnect_policy(ZcClient *self, const ZcReconnectPolicy *policy);
+/* TRUE from a reconnect's "connected" until the server's welcome. */
+gboolean zc_client_is_resuming(ZcClient *self);
+void zc_client_get_reconnect_stats(ZcClient *self, ZcReconnectStats *stats);
+
+/* Lag probes, sent once registered. @interval_ms 0 disables them (minimum
+ * 1000). Health turns LAGGING at @warn_ms and DEAD at @dead_ms, when the
+ * connection is dropped as a ping timeout (and the reconnect policy, if
+ * any, takes over). 0 disables either threshold. Defaults: 30 s / 10 s / 90 s.
+ */
+void zc_client_set_lag_check(ZcClient *self, guint interval_ms, guint warn_ms, guint dead_ms);
+guint zc_client_get_lag(ZcClient *self);
+ZcLinkHealth zc_client_get_health(ZcClient *self);
+void zc_client_get_lag_stats(ZcClient *self, ZcLagStats *stats);
+
+/* Cheap enough to poll: a struct copy and one short lock. */
+void zc_client_get_stats(ZcClient *self, ZcClientStats *stats);
+/* Upper bound of parse-time bucket @bucket in ns; G_MAXUINT64 for the last. */
+guint64 zc_client_stats_parse_bucket_le_ns(guint bucket);
 
+/* Handle incoming lines in slices of at most @budget_us (0: unlimited, the
+ * default). Once a slice runs over, the rest waits for an idle source at
+ * %ZC_INGEST_PRIORITY and no more is read from the socket until it is
+ * handled, so a burst yields to redraws and backs up into the TCP window
+ * instead of memory. With zc_client_set_io_thread() slices are cut the same
+ * way, and the I/O thread stops reading while a few reads' worth of parsed
+ * lines still wait for the owner.
+ */
+void zc_client_set_ingest_budget(ZcClient *self, guint budget_us);
+void zc_client_get_ingest_stats(ZcClient *self, ZcIngestStats *stats);
+
+/* IRCv3 capabilities. zc_client_login() negotiates them with CAP LS 302 and
+ * requests the wanted ones the server offers; registration waits for the
+ * answers. @caps NULL restores the defaults (account-notify, account-tag,
+ * away-notify, cap-notify, chghost, echo-message, extended-join,
+ * multi-prefix, server-time, userhost-in-names); an empty list skips CAP.
+ * Applies from the next login.
+ */
+void zc_client_set_wanted_caps(ZcClient *self, const gchar *const *caps);
+gboolean zc_client_has_cap(ZcClient *self, const gchar *cap);
+/* Sorted, %NULL-terminated; free with g_strfreev(). */
+gchar **zc_client_dup_enabled_caps(ZcClient *self);
+/* Value the server advertised for @cap ("" if none), %NULL if not offered. */
+const gchar *zc_client_get_cap_value(ZcClient *self, const gchar *cap);
+
+/* Opt-in: read, decrypt and parse on a dedicated thread. Parsed lines are
+ * handed back in per-read batches and all signals are still emitted on the
+ * main context the client was created on. Writes are issued from the
+ * thread too, so server PINGs are answered even while the main context is
+ * blocked. Call while disconnected.
+ */
+void zc_client_set_io_thread(ZcClient *self, gboolean enable);
+gboolean zc_client_get_io_thread(ZcClient *self);
+
+/* Lines longer than this (excluding CRLF) are dropped. Defaults to 8703
+ * (IRCv3 tags + 512); applies from the next connect.
+ */
+void zc_client_set_max_line_length(ZcClient *self, gsize max_len);
+gsize zc_client_get_max_line_length(ZcClient *self);
+
+/* Incoming lines are checked for UTF-8 before anything sees them; a line
+ * that isn't is decoded from @charset (e.g. "CP1252", "ISO-8859-15") so
+ * listeners only ever get UTF-8. %NULL replaces invalid bytes with U+FFFD
+ * instead. Returns %FALSE, leaving the setting alone, if @charset is not
+ * supported. Applies from the next connect.
+ */
+gboolean zc_client_set_fallback_charset(ZcClient *self, const gchar *charset);
+const gchar *zc_client_get_fallback_charset(ZcClient *self);
+
+/* Shared resources (see ZcSession). Both apply from the next connect; TLS is
+ * negotiated per connection, so one socket client can serve every network.
+ */
+void zc_client_set_socket_client(ZcClient *self, GSocketClient *sock_client);
+void zc_client_set_tls_database(ZcClient *self, GTlsDatabase *database);
+
+/* TLS session resumption: each successful handshake is remembered per
+ * host:port in a cache shared by every client in the process, and the next
+ * connection to that server offers it. On by default.
+ */
+void zc_client_set_tls_session_cache(ZcClient *self, gboolean enable);
+
+/* Sends are queued and written asynchronously. They fail up front with
+ * G_IO_ERROR_CLOSED when not connected, G_IO_ERROR_MESSAGE_TOO_LARGE when
+ * the line is over the IRC limits and G_IO_ERROR_INVALID_ARGUMENT when it
+ * is empty or holds CR, LF or NUL. Write errors are reported through
+ * "disconnected". Safe to call from any thread (see #ZcClient).
+ */
+gboolean zc_client_send_raw(ZcClient *self, const gchar *line, ZcSendPriority priority, GError **error);
+/* Like zc_client_send_raw() for a line built with #ZcIrcMessageBuilder; also
+ * fails with G_IO_ERROR_MESSAGE_TOO_LARGE or G_IO_ERROR_INVALID_ARGUMENT if
+ * the builder did. Copies the line, so @msg can be reused right away.
+ */
+gboolean zc_client_send_message(ZcClient *self, const ZcIrcMessageBuilder *msg, ZcSendPriority priority, GError **error);
+
+/* Token bucket: up to @burst lines at once, then one per @refill_ms.
+ * @refill_ms 0 disables pacing. Defaults to 5 lines / 2000 ms.
+ */
+void zc_client_set_flood_control(ZcClient *self, guint burst, guint refill_ms);
+void zc_client_get_send_stats(ZcClient *self, ZcSendStats *stats);
+/* Drop queued bulk lines whose first parameter is @target. Returns the count. */
+guint zc_client_cancel_queued(ZcClient *self, const gchar *target);
+
+/* Lines / bytes queued or being written but not yet accepted by the stream. */
+guint zc_client_get_write_queue_depth(ZcClient *self);
+gsize zc_client_get_write_queue_bytes(ZcClient *self);
+
+/* Registers: CAP LS (plus CAP REQ and AUTHENTICATE when the server's caps
+ * are cached from an earlier connection), NICK and USER go out in a single
+ * write. Once 001 arrives the auto-join channels are joined, batched into
+ * as few JOIN lines as possible.
+ */
 gboolean zc_client_login(ZcClient *self, GError **error);
+/* "#a,#b" or "#a #b"; NULL clears. Also re-joined after a reconnect. */
+void zc_client_set_auto_join(ZcClient *self, const gchar *channels);
+/* SASL PLAIN during registration; @account NULL disables it. CAP END waits
+ * for the outcome; a failure does not stop registration.
+ */
+void zc_client_set_sasl_plain(ZcClient *self, const gchar *account, const gchar *password);
+void zc_client_get_registration_timings(ZcClient *self, ZcRegistrationTimings *timings);
 gboolean zc_client_join(ZcClient *self, const gchar *channel, GError **error);
 gboolean zc_client_privmsg(ZcClient *self, const gchar *target, const gchar *text, GError **error);
+/* QUIT is not paced: it goes ahead of queued lines, like a PONG. */
 gboolean zc_client_quit(ZcClient *self, const gchar *message, GError **error);
 
+/* Membership of the channels we are in, kept from JOIN, PART, KICK, QUIT,
+ * NICK, MODE, CHGHOST and NAMES (multi-prefix and userhost-in-names aware)
+ * using the server's ISUPPORT PREFIX, CHANMODES and CASEMAPPING. Each
+ * message is applied just before its own "irc-message" emission, so
+ * those handlers see the state with that message applied.
+ * "irc-messages" is emitted once the whole read has been applied: its
+ * handlers, and "batch-end", see the state after the last message of the
+ * batch, so read the model at "batch-end" rather than per message there.
+ * %NULL if we are not on @channel / share no channel with @nick.
+ */
+ZcChannelState *zc_client_get_channel_state(ZcClient *self, const gchar *channel);
+ZcUser *zc_client_lookup_user(ZcClient *self, const gchar *nick);
+/* The prefix character ('@', '+', ...) of the highest-ranked mode in
+ * @modes, or 0 for none. */
+gchar zc_client_get_prefix_char(ZcClient *self, guint modes);
+
+/* Send @text to @target with @command ("PRIVMSG" or "NOTICE") as one job:
+ * split at newlines, and long lines cut at spaces or UTF-8 boundaries to
+ * fit zc_client_get_text_budget(). Goes out as a draft/multiline batch
+ * when that cap (and batch) is enabled and the server's limits allow,
+ * otherwise one line at a time at the flood-control pace, letting other
+ * sends in between. Returns the job id, 0 on error.
+ */
+guint zc_client_send_text(ZcClient *self, const gchar *command, const gchar *target, const gchar *text, GError **error);
+/* Drop the job's unsent lines; ones already handed over still go out. */
+void zc_client_cancel_send_job(ZcClient *self, guint job);
+/* Trailing bytes one @command line to @target can carry once the server
+ * has prefixed it with our nick!user@host (estimated until seen). */
+gsize zc_client_get_text_budget(ZcClient *self, const gchar *command, const gchar *target);
+
+/* Drops the link at once; lines still in the write queue are discarded. */
 void zc_client_disconnect(ZcClient *self);
+/* Sends QUIT and closes like zc_client_disconnect() once it and whatever
+ * was queued ahead of it have been written, or after @timeout_ms if the
+ * socket doesn't drain. Fails like zc_client_quit(). Owner thread only.
+ */
+gboolean zc_client_quit_and_close(ZcClient *self, const gchar *message, guint timeout_ms, GError **error);
 
 const gchar *zc_client_get_nick(ZcClient *self);
 
@@ -0,0 +1,84 @@
+#include "dns_cache.h"
+
+typedef struct {
+  GList *addresses; /* GInetAddress*, owned */
+  gint64 expires;   /* monotonic, µs */
+} ZcDnsEntry;
+
+static GMutex cache_lock;
+static GHashTable *cache; /* casefolded host -> ZcDnsEntry* */
+
+static void
+entry_free(ZcDnsEntry *e) {
+  g_resolver_free_addresses(e->addresses);
+  g_free(e);
+}
+
+static gchar *
+cache_key(const gchar *host) {
+  return g_ascii_strdown(host, -1);
+}
+
+GList *
+zc_dns_cache_lookup(const gchar *host) {
+  g_return_val_if_fail(host != NULL, NULL);
+
+  gchar *key = cache_key(host);
+  GList *out = NULL;
+
+  g_mutex_lock(&cache_lock);
+  ZcDnsEntry *e = cache ? g_hash_table_lookup(cache, key) : NULL;
+  if (e && e->expires <= g_get_monotonic_time()) {
+    g_hash_table_remove(cache, key);
+    e = NULL;
+  }
+  if (e) out = g_list_copy_deep(e->addresses, (GCopyFunc)g_object_ref, NULL);
+  g_mutex_unlock(&cache_lock);
+
+  g_free(key);
+  return out;
+}
+
+static gboolean
+list_has_address(GList *list, GInetAddress *addr) {
+  for (GList *l = list; l; l = l->next) {
+    if (g_inet_address_equal(l->data, addr)) return TRUE;
+  }
+  return FALSE;
+}
+
+void
+zc_dns_cache_insert(const gchar *host, GList *addresses) {
+  g_return_if_fail(host != NULL);
+  if (!addresses) return;
+
+  g_mutex_lock(&cache_lock);
+  if (!cache) cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)entry_free);
+
+  gchar *key = cache_key(host);
+  ZcDnsEntry *e = g_hash_table_lookup(cache, key);
+  if (!e || e->expires <= g_get_monotonic_time()) {
+    e = g_new0(ZcDnsEntry, 1);
+    g_hash_table_replace(cache, key, e);
+  } else {
+    g_free(key);
+  }
+
+  /* The A and AAAA answers arrive separately; merge rather than replace. */
+  for (GList *l = addresses; l; l = l->next) {
+    if (!list_has_address(e->addresses, l->data)) e->addresses = g_list_append(e->addresses, g_object_ref(l->data));
+  }
+  e->expires = g_get_monotonic_time() + (gint64)ZC_DNS_CACHE_TTL_S * G_USEC_PER_SEC;
+  g_mutex_unlock(&cache_lock);
+}
+
+void
+zc_dns_cache_invalidate(const gchar *host) {
+  g_return_if_fail(host != NULL);
+
+  gchar *key = cache_key(host);
+  g_mutex_lock(&cache_lock);
+  if (cache) g_hash_table_remove(cache, key);
+  g_mutex_unlock(&cache_lock);
+  g_free(key);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Process-wide host name -> addresses cache shared by every client.
+ * Thread-safe. GResolver does not report record TTLs, so entries live for
+ * a fixed time.
+ */
+#define ZC_DNS_CACHE_TTL_S 300
+
+/* Returns a new list of new refs (free with g_resolver_free_addresses()),
+ * or %NULL if @host is not cached or has expired.
+ */
+GList *zc_dns_cache_lookup(const gchar *host);
+/* Adds @addresses (GInetAddress*, borrowed) to whatever is cached for
+ * @host and restarts its lifetime.
+ */
+void zc_dns_cache_insert(const gchar *host, GList *addresses);
+/* Drop @host, e.g. when none of its cached addresses would connect. */
+void zc_dns_cache_invalidate(const gchar *host);
+
+G_END_DECLS
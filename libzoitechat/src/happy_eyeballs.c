@@ -0,0 +1,348 @@
+#include "happy_eyeballs.h"
+#include "dns_cache.h"
+
+/* RFC 8305 recommended values. */
+#define ZC_HE_ATTEMPT_DELAY_MS 250
+#define ZC_HE_RESOLUTION_DELAY_MS 50
+
+typedef struct {
+  GSocketClient *client;
+  gchar *host;
+  guint16 port;
+  GCancellable *cancellable; /* the caller's, may be NULL */
+  gulong cancelled_id;
+
+  GQueue v6;                 /* GInetAddress* not tried yet */
+  GQueue v4;
+  GSocketFamily last_family;
+  guint lookups_pending;
+  gboolean have_v6_answer;
+
+  GPtrArray *inflight;       /* GCancellable* per running attempt */
+  GMainContext *context;     /* the caller's thread-default; timers go here */
+  guint attempt_source;      /* next attempt may start when this fires */
+  guint resolution_source;   /* A answered first: give AAAA a moment */
+
+  GError *error;             /* first attempt failure, for the final report */
+  gboolean done;
+  ZcHappyEyeballsInfo info;
+  gint64 started_at;
+  gint64 first_attempt_at;
+} ZcRace;
+
+typedef struct {
+  GTask *task;
+  GCancellable *cancellable;
+} ZcAttempt;
+
+static void race_try_start(GTask *task);
+
+static void
+race_free(ZcRace *r) {
+  if (r->cancelled_id) g_cancellable_disconnect(r->cancellable, r->cancelled_id);
+  g_clear_object(&r->cancellable);
+  g_object_unref(r->client);
+  g_free(r->host);
+  g_queue_clear_full(&r->v6, g_object_unref);
+  g_queue_clear_full(&r->v4, g_object_unref);
+  g_ptr_array_unref(r->inflight);
+  g_main_context_unref(r->context);
+  g_clear_error(&r->error);
+  g_free(r);
+}
+
+static guint
+race_timeout(ZcRace *r, guint ms, GSourceFunc func, GTask *task) {
+  GSource *src = g_timeout_source_new(ms);
+  g_source_set_callback(src, func, g_object_ref(task), g_object_unref);
+  const guint id = g_source_attach(src, r->context);
+  g_source_unref(src);
+  return id;
+}
+
+static void
+race_source_remove(ZcRace *r, guint id) {
+  GSource *src = g_main_context_find_source_by_id(r->context, id);
+  if (src) g_source_destroy(src);
+}
+
+static void
+race_stop_timers(ZcRace *r) {
+  if (r->attempt_source) {
+    race_source_remove(r, r->attempt_source);
+    r->attempt_source = 0;
+  }
+  if (r->resolution_source) {
+    race_source_remove(r, r->resolution_source);
+    r->resolution_source = 0;
+  }
+}
+
+static void
+race_cancel_inflight(ZcRace *r) {
+  for (guint i = 0; i < r->inflight->len; i++) g_cancellable_cancel(g_ptr_array_index(r->inflight, i));
+}
+
+static void
+on_caller_cancelled(GCancellable *cancellable, gpointer user_data) {
+  (void)cancellable;
+  race_cancel_inflight(user_data);
+}
+
+static void
+race_succeed(GTask *task, GSocketConnection *conn) {
+  ZcRace *r = g_task_get_task_data(task);
+  r->done = TRUE;
+  r->info.connect_us = g_get_monotonic_time() - r->first_attempt_at;
+  race_stop_timers(r);
+  race_cancel_inflight(r);
+  g_task_return_pointer(task, conn, g_object_unref);
+}
+
+static void
+race_fail(GTask *task) {
+  ZcRace *r = g_task_get_task_data(task);
+  r->done = TRUE;
+  race_stop_timers(r);
+
+  /* Nothing the cache gave us worked; look the name up again next time. */
+  if (r->info.cached) zc_dns_cache_invalidate(r->host);
+
+  if (g_cancellable_is_cancelled(r->cancellable)) {
+    g_clear_error(&r->error);
+    g_cancellable_set_error_if_cancelled(r->cancellable, &r->error);
+  }
+  if (r->error) {
+    g_task_return_error(task, g_steal_pointer(&r->error));
+  } else {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_HOST_NOT_FOUND, "No usable address for %s", r->host);
+  }
+}
+
+/* Alternate families, preferring IPv6 first (RFC 8305 section 4). */
+static GInetAddress *
+race_pop_next(ZcRace *r) {
+  GQueue *first = r->last_family == G_SOCKET_FAMILY_IPV6 ? &r->v4 : &r->v6;
+  GQueue *second = first == &r->v6 ? &r->v4 : &r->v6;
+  GInetAddress *addr = g_queue_pop_head(first);
+  if (!addr) addr = g_queue_pop_head(second);
+  if (addr) r->last_family = g_inet_address_get_family(addr);
+  return addr;
+}
+
+static void
+attempt_free(ZcAttempt *a) {
+  ZcRace *r = g_task_get_task_data(a->task);
+  g_ptr_array_remove_fast(r->inflight, a->cancellable);
+  g_object_unref(a->cancellable);
+  g_object_unref(a->task);
+  g_free(a);
+}
+
+static void
+on_attempt_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+  ZcAttempt *a = user_data;
+  GTask *task = a->task;
+  ZcRace *r = g_task_get_task_data(task);
+  GError *error = NULL;
+
+  GSocketConnection *conn = g_socket_client_connect_finish(G_SOCKET_CLIENT(source), res, &error);
+
+  if (r->done) {
+    /* Lost the race. */
+    if (conn) {
+      g_io_stream_close(G_IO_STREAM(conn), NULL, NULL);
+      g_object_unref(conn);
+    }
+    g_clear_error(&error);
+    attempt_free(a);
+    return;
+  }
+
+  if (conn) {
+    race_succeed(task, conn);
+    attempt_free(a);
+    return;
+  }
+
+  if (!r->error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) r->error = g_steal_pointer(&error);
+  g_clear_error(&error);
+
+  /* A failure frees the slot at once instead of waiting out the delay. */
+  if (r->attempt_source) {
+    race_source_remove(r, r->attempt_source);
+    r->attempt_source = 0;
+  }
+  g_object_ref(task);
+  attempt_free(a);
+  race_try_start(task);
+  g_object_unref(task);
+}
+
+static gboolean
+on_attempt_delay(gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  ZcRace *r = g_task_get_task_data(task);
+  r->attempt_source = 0;
+  race_try_start(task);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+on_resolution_delay(gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  ZcRace *r = g_task_get_task_data(task);
+  r->resolution_source = 0;
+  race_try_start(task);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+race_try_start(GTask *task) {
+  ZcRace *r = g_task_get_task_data(task);
+  if (r->done || r->attempt_source || r->resolution_source) return;
+
+  if (g_cancellable_is_cancelled(r->cancellable)) {
+    if (r->inflight->len == 0) race_fail(task);
+    return;
+  }
+
+  GInetAddress *addr = race_pop_next(r);
+  if (!addr) {
+    if (r->inflight->len == 0 && r->lookups_pending == 0) race_fail(task);
+    return;
+  }
+
+  if (r->info.attempts++ == 0) r->first_attempt_at = g_get_monotonic_time();
+
+  ZcAttempt *a = g_new0(ZcAttempt, 1);
+  a->task = g_object_ref(task);
+  a->cancellable = g_cancellable_new();
+  g_ptr_array_add(r->inflight, a->cancellable);
+
+  GSocketAddress *sa = g_inet_socket_address_new(addr, r->port);
+  g_socket_client_connect_async(r->client, G_SOCKET_CONNECTABLE(sa), a->cancellable, on_attempt_done, a);
+  g_object_unref(sa);
+  g_object_unref(addr);
+
+  r->attempt_source = race_timeout(r, ZC_HE_ATTEMPT_DELAY_MS, on_attempt_delay, task);
+}
+
+static void
+race_add_addresses(ZcRace *r, GList *addresses) {
+  for (GList *l = addresses; l; l = l->next) {
+    GInetAddress *addr = l->data;
+    GQueue *q = g_inet_address_get_family(addr) == G_SOCKET_FAMILY_IPV6 ? &r->v6 : &r->v4;
+    g_queue_push_tail(q, g_object_ref(addr));
+  }
+}
+
+static void
+on_lookup_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  ZcRace *r = g_task_get_task_data(task);
+  GError *error = NULL;
+
+  GList *addresses = g_resolver_lookup_by_name_with_flags_finish(G_RESOLVER(source), res, &error);
+  r->lookups_pending--;
+
+  if (addresses) {
+    zc_dns_cache_insert(r->host, addresses);
+    if (!r->done) {
+      const gboolean v6 = g_inet_address_get_family(addresses->data) == G_SOCKET_FAMILY_IPV6;
+      if (!r->info.resolve_us) r->info.resolve_us = g_get_monotonic_time() - r->started_at;
+      race_add_addresses(r, addresses);
+
+      if (v6) {
+        r->have_v6_answer = TRUE;
+        if (r->resolution_source) {
+          race_source_remove(r, r->resolution_source);
+          r->resolution_source = 0;
+        }
+      } else if (!r->have_v6_answer && r->lookups_pending > 0 && r->info.attempts == 0) {
+        /* A came back first: hold it briefly in case AAAA is right behind. */
+        r->resolution_source = race_timeout(r, ZC_HE_RESOLUTION_DELAY_MS, on_resolution_delay, task);
+      }
+    }
+    g_resolver_free_addresses(addresses);
+  } else if (!r->error && !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    r->error = g_steal_pointer(&error);
+  }
+  g_clear_error(&error);
+
+  if (r->lookups_pending == 0 && r->resolution_source) {
+    race_source_remove(r, r->resolution_source);
+    r->resolution_source = 0;
+  }
+  race_try_start(task);
+  g_object_unref(task);
+}
+
+void
+zc_happy_eyeballs_connect_async(
+  GSocketClient *client,
+  const gchar *host,
+  guint16 port,
+  GCancellable *cancellable,
+  GAsyncReadyCallback callback,
+  gpointer user_data
+) {
+  g_return_if_fail(G_IS_SOCKET_CLIENT(client));
+  g_return_if_fail(host != NULL);
+
+  ZcRace *r = g_new0(ZcRace, 1);
+  r->client = g_object_ref(client);
+  r->host = g_strdup(host);
+  r->port = port;
+  r->cancellable = cancellable ? g_object_ref(cancellable) : NULL;
+  r->last_family = G_SOCKET_FAMILY_IPV4;
+  r->inflight = g_ptr_array_new();
+  r->context = g_main_context_ref_thread_default();
+  r->started_at = g_get_monotonic_time();
+  g_queue_init(&r->v6);
+  g_queue_init(&r->v4);
+
+  GTask *task = g_task_new(NULL, cancellable, callback, user_data);
+  g_task_set_source_tag(task, zc_happy_eyeballs_connect_async);
+  g_task_set_task_data(task, r, (GDestroyNotify)race_free);
+
+  if (r->cancellable) {
+    r->cancelled_id = g_cancellable_connect(r->cancellable, G_CALLBACK(on_caller_cancelled), r, NULL);
+  }
+
+  GInetAddress *literal = g_inet_address_new_from_string(host);
+  if (literal) {
+    g_queue_push_tail(g_inet_address_get_family(literal) == G_SOCKET_FAMILY_IPV6 ? &r->v6 : &r->v4, literal);
+    race_try_start(task);
+    g_object_unref(task);
+    return;
+  }
+
+  GList *cached = zc_dns_cache_lookup(host);
+  if (cached) {
+    r->info.cached = TRUE;
+    race_add_addresses(r, cached);
+    g_resolver_free_addresses(cached);
+    race_try_start(task);
+    g_object_unref(task);
+    return;
+  }
+
+  /* One query per family, so a slow or broken AAAA answer doesn't hold up A. */
+  GResolver *resolver = g_resolver_get_default();
+  r->lookups_pending = 2;
+  g_resolver_lookup_by_name_with_flags_async(resolver, host, G_RESOLVER_NAME_LOOKUP_FLAGS_IPV6_ONLY,
+                                             cancellable, on_lookup_done, g_object_ref(task));
+  g_resolver_lookup_by_name_with_flags_async(resolver, host, G_RESOLVER_NAME_LOOKUP_FLAGS_IPV4_ONLY,
+                                             cancellable, on_lookup_done, g_object_ref(task));
+  g_object_unref(resolver);
+  g_object_unref(task);
+}
+
+GSocketConnection *
+zc_happy_eyeballs_connect_finish(GAsyncResult *res, ZcHappyEyeballsInfo *info, GError **error) {
+  g_return_val_if_fail(g_task_is_valid(res, NULL), NULL);
+  GTask *task = G_TASK(res);
+  if (info) *info = ((ZcRace *)g_task_get_task_data(task))->info;
+  return g_task_propagate_pointer(task, error);
+}
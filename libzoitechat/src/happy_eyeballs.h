@@ -0,0 +1,31 @@
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* RFC 8305 style connect: AAAA and A are looked up in parallel and TCP
+ * attempts alternate between families, a new one starting every 250 ms
+ * (or as soon as the previous one fails) until one connects. Resolved
+ * addresses go through the shared DNS cache.
+ */
+typedef struct {
+  gint64 resolve_us;   /* until the first usable answer; 0 if cached */
+  gint64 connect_us;   /* first attempt started -> winner connected */
+  guint attempts;      /* TCP attempts started */
+  gboolean cached;     /* addresses came from the DNS cache */
+} ZcHappyEyeballsInfo;
+
+void zc_happy_eyeballs_connect_async(
+  GSocketClient *client,
+  const gchar *host,
+  guint16 port,
+  GCancellable *cancellable,
+  GAsyncReadyCallback callback,
+  gpointer user_data
+);
+
+/* @info may be %NULL; it is filled on failure too. */
+GSocketConnection *zc_happy_eyeballs_connect_finish(GAsyncResult *res, ZcHappyEyeballsInfo *info, GError **error);
+
+G_END_DECLS
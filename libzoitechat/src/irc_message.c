@@ -2,34 +2,53 @@
 
 #include <string.h>
 
-G_DEFINE_BOXED_TYPE(ZcIrcMessage, zc_irc_message, zc_irc_message_copy, zc_irc_message_free)
+/* Boxed copy is a ref: signal marshalling and GValue storage share the
+ * instance instead of duplicating every string. */
+G_DEFINE_BOXED_TYPE(ZcIrcMessage, zc_irc_message, zc_irc_message_ref, zc_irc_message_unref)
 
-static void
-zc_irc_message_init_arrays(ZcIrcMessage *msg) {
-  msg->params = g_ptr_array_new_with_free_func(g_free);
+static ZcIrcMessage *
+zc_irc_message_alloc(guint n_params) {
+  ZcIrcMessage *msg = g_new0(ZcIrcMessage, 1);
+  g_atomic_ref_count_init(&msg->ref_count);
+  msg->params = g_ptr_array_new_full(n_params, g_free);
+  return msg;
 }
 
 ZcIrcMessage *
 zc_irc_message_new(void) {
-  ZcIrcMessage *msg = g_new0(ZcIrcMessage, 1);
-  zc_irc_message_init_arrays(msg);
+  return zc_irc_message_alloc(0);
+}
+
+ZcIrcMessage *
+zc_irc_message_ref(ZcIrcMessage *msg) {
+  g_return_val_if_fail(msg != NULL, NULL);
+  g_atomic_ref_count_inc(&msg->ref_count);
   return msg;
 }
 
 void
-zc_irc_message_free(ZcIrcMessage *msg) {
+zc_irc_message_unref(ZcIrcMessage *msg) {
   if (!msg) return;
+  if (!g_atomic_ref_count_dec(&msg->ref_count)) return;
+
   g_free(msg->prefix);
   g_free(msg->command);
   if (msg->params) g_ptr_array_free(msg->params, TRUE);
   g_free(msg->trailing);
+  g_free(msg->tags);
+  if (msg->tag_cache) g_hash_table_destroy(msg->tag_cache);
   g_free(msg);
 }
 
+void
+zc_irc_message_free(ZcIrcMessage *msg) {
+  zc_irc_message_unref(msg);
+}
+
 ZcIrcMessage *
 zc_irc_message_copy(const ZcIrcMessage *src) {
   if (!src) return NULL;
-  ZcIrcMessage *dst = zc_irc_message_new();
+  ZcIrcMessage *dst = zc_irc_message_alloc(src->params ? src->params->len : 0);
   dst->prefix = g_strdup(src->prefix);
   dst->command = g_strdup(src->command);
     if (src->params) {
@@ -38,6 +57,8 @@ zc_irc_message_copy(const ZcIrcMessage *src) {
     }
   }
   dst->trailing = g_strdup(src->trailing);
+  dst->command_id = src->command_id;
+  dst->tags = g_strdup(src->tags);
   return dst;
 }
 
@@ -48,57 +69,574 @@ zc_irc_message_param(const ZcIrcMessage *msg, guint idx) {
   return (const gchar *)g_ptr_array_index(msg->params, idx);
 }
 
+/* ---- Command IDs ---------------------------------------------------------
+ * Verbs resolve through a perfect hash over (first, second, last char, len):
+ * every known verb lands in its own slot, so a lookup is one hash and one
+ * memcmp. Regenerate the multipliers if a verb is added and slots collide.
+ */
+
+#define ZC_VERB_SLOTS 64
+
+typedef struct {
+  const gchar *name;
+  ZcIrcCommand id;
+} ZcVerbSlot;
+
+static const ZcVerbSlot verb_slots[ZC_VERB_SLOTS] = {
+  [4]  = { "BATCH",        ZC_IRC_CMD_BATCH },
+  [6]  = { "TOPIC",        ZC_IRC_CMD_TOPIC },
+  [9]  = { "PONG",         ZC_IRC_CMD_PONG },
+  [16] = { "WARN",         ZC_IRC_CMD_WARN },
+  [17] = { "PART",         ZC_IRC_CMD_PART },
+  [18] = { "AWAY",         ZC_IRC_CMD_AWAY },
+  [19] = { "ACCOUNT",      ZC_IRC_CMD_ACCOUNT },
+  [21] = { "JOIN",         ZC_IRC_CMD_JOIN },
+  [23] = { "INVITE",       ZC_IRC_CMD_INVITE },
+  [24] = { "AUTHENTICATE", ZC_IRC_CMD_AUTHENTICATE },
+  [25] = { "TAGMSG",       ZC_IRC_CMD_TAGMSG },
+  [27] = { "PRIVMSG",      ZC_IRC_CMD_PRIVMSG },
+  [29] = { "SETNAME",      ZC_IRC_CMD_SETNAME },
+  [36] = { "ERROR",        ZC_IRC_CMD_ERROR },
+  [42] = { "KICK",         ZC_IRC_CMD_KICK },
+  [43] = { "PING",         ZC_IRC_CMD_PING },
+  [46] = { "MODE",         ZC_IRC_CMD_MODE },
+  [47] = { "FAIL",         ZC_IRC_CMD_FAIL },
+  [48] = { "KILL",         ZC_IRC_CMD_KILL },
+  [49] = { "WALLOPS",      ZC_IRC_CMD_WALLOPS },
+  [51] = { "NOTE",         ZC_IRC_CMD_NOTE },
+  [53] = { "NOTICE",       ZC_IRC_CMD_NOTICE },
+  [54] = { "CHGHOST",      ZC_IRC_CMD_CHGHOST },
+  [55] = { "CAP",          ZC_IRC_CMD_CAP },
+  [57] = { "NICK",         ZC_IRC_CMD_NICK },
+  [58] = { "QUIT",         ZC_IRC_CMD_QUIT },
+};
+
+static inline guint
+verb_hash(const guchar *s, gsize len) {
+  return ((guint)s[0] * 5u + (guint)s[1] * 5u + (guint)s[len - 1] * 6u + (guint)len) & (ZC_VERB_SLOTS - 1);
+}
+
+/* @command must already be uppercase (the parser uppercases in place). */
+static ZcIrcCommand
+command_id_for(const gchar *command, gsize len) {
+  const guchar *s = (const guchar *)command;
+
+  if (len == 3 && g_ascii_isdigit(s[0]) && g_ascii_isdigit(s[1]) && g_ascii_isdigit(s[2])) {
+    return (ZcIrcCommand)((s[0] - '0') * 100 + (s[1] - '0') * 10 + (s[2] - '0'));
+  }
+  if (len < 2) return ZC_IRC_CMD_UNKNOWN;
+
+  const ZcVerbSlot *slot = &verb_slots[verb_hash(s, len)];
+  if (slot->name && strlen(slot->name) == len && memcmp(slot->name, command, len) == 0) {
+    return slot->id;
+  }
+  return ZC_IRC_CMD_UNKNOWN;
+}
+
+ZcIrcCommand
+zc_irc_command_lookup(const gchar *command, gssize len) {
+  if (!command) return ZC_IRC_CMD_UNKNOWN;
+  const gsize n = len < 0 ? strlen(command) : (gsize)len;
+  if (n == 0 || n > 16) return ZC_IRC_CMD_UNKNOWN;
+
+  gchar upper[16];
+  for (gsize i = 0; i < n; i++) upper[i] = g_ascii_toupper(command[i]);
+  return command_id_for(upper, n);
+}
+
+/* ---- IRCv3 message-tags --------------------------------------------------
+ * Only the span of the tag block is recorded at parse time. View lookups
+ * scan that span for the key and unescape just the matching value. When a
+ * key repeats, the last occurrence wins.
+ */
+
+static gboolean
+tags_find(const gchar *raw, gsize raw_len, const gchar *key, const gchar **value, gsize *value_len) {
+  if (!raw || !key || !*key) return FALSE;
+
+  const gsize key_len = strlen(key);
+  const gchar *p = raw;
+  const gchar *end = raw + raw_len;
+
+  gboolean found = FALSE;
+  while (p < end) {
+    const gchar *tag_end = memchr(p, ';', (gsize)(end - p));
+    if (!tag_end) tag_end = end;
+
+    const gchar *eq = memchr(p, '=', (gsize)(tag_end - p));
+    const gchar *name_end = eq ? eq : tag_end;
+
+    if ((gsize)(name_end - p) == key_len && memcmp(p, key, key_len) == 0) {
+      *value = eq ? eq + 1 : tag_end;
+      *value_len = (gsize)(tag_end - *value);
+      found = TRUE;
+    }
+
+    p = tag_end + 1;
+  }
+
+  return found;
+}
+
+static gchar *
+tags_unescape(const gchar *value, gsize len) {
+  gchar *out = g_malloc(len + 1);
+  gchar *o = out;
+
+  for (gsize i = 0; i < len; i++) {
+    if (value[i] != '\\') {
+      *o++ = value[i];
+      continue;
+    }
+    if (++i >= len) break; /* lone trailing backslash is dropped */
+    switch (value[i]) {
+      case ':': *o++ = ';'; break;
+      case 's': *o++ = ' '; break;
+      case 'r': *o++ = '\r'; break;
+      case 'n': *o++ = '\n'; break;
+      default:  *o++ = value[i]; break; /* covers "\\" */
+    }
+  }
+
+  *o = '\0';
+  return out;
+}
+
+/* Every tag of @raw, unescaped; a repeated key keeps its last value. */
+static GHashTable *
+tags_decode_all(const gchar *raw) {
+  GHashTable *tags = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  const gchar *p = raw;
+  const gchar *end = raw + strlen(raw);
+
+  while (p < end) {
+    const gchar *tag_end = memchr(p, ';', (gsize)(end - p));
+    if (!tag_end) tag_end = end;
+
+    const gchar *eq = memchr(p, '=', (gsize)(tag_end - p));
+    const gchar *name_end = eq ? eq : tag_end;
+    if (name_end > p) {
+      const gchar *value = eq ? eq + 1 : tag_end;
+      g_hash_table_replace(tags, g_strndup(p, (gsize)(name_end - p)), tags_unescape(value, (gsize)(tag_end - value)));
+    }
+
+    p = tag_end + 1;
+  }
+  return tags;
+}
+
+/* The first lookup decodes the whole block into a table that is never
+ * changed afterwards. Messages are shared between threads (the client can
+ * parse on its I/O thread), so the table is built privately and published
+ * with a compare-and-swap; a thread that loses the race drops its copy. */
+const gchar *
+zc_irc_message_get_tag(const ZcIrcMessage *msg, const gchar *key) {
+  if (!msg || !msg->tags || !key) return NULL;
+
+  /* The cache is not part of the message's value, so const does not cover it. */
+  GHashTable **slot = (GHashTable **)&msg->tag_cache;
+  GHashTable *cache = g_atomic_pointer_get(slot);
+  if (!cache) {
+    GHashTable *built = tags_decode_all(msg->tags);
+    if (g_atomic_pointer_compare_and_exchange_full(slot, NULL, built, &cache)) {
+      cache = built;
+    } else {
+      g_hash_table_destroy(built);
+    }
+  }
+  return g_hash_table_lookup(cache, key);
+}
+
+gboolean
+zc_irc_message_has_tag(const ZcIrcMessage *msg, const gchar *key) {
+  if (!msg || !msg->tags || !key) return FALSE;
+  const gchar *value = NULL;
+  gsize value_len = 0;
+  return tags_find(msg->tags, strlen(msg->tags), key, &value, &value_len);
+}
+
 static gboolean
 is_space(gchar c) {
   return c == ' ' || c == '\t';
 }
 
-/* RFC1459-ish line parsing, good enough for a starter */
-ZcIrcMessage *
-zc_irc_message_parse_line(const gchar *line) {
+/* ---- ZcIrcMessageView ----------------------------------------------------
+ * One g_malloc holds the header, the span table and a private copy of the
+ * line. Tokens are NUL-terminated in place, so accessors never allocate.
+ * Spans are offsets (not pointers), which keeps the block relocatable:
+ * copying a view is a single memdup.
+ */
+
+/* RFC 2812: at most 14 middle params; anything after that is trailing. */
+#define ZC_IRC_VIEW_MAX_MIDDLE 14
+#define ZC_IRC_SPAN_NONE G_MAXUINT32
+
+typedef struct {
+  guint32 off;
+  guint32 len;
+} ZcIrcSpan;
+
+struct _ZcIrcMessageView {
+  gsize alloc_size;
+  ZcIrcSpan tags;
+  ZcIrcSpan prefix;
+  ZcIrcSpan command;
+  ZcIrcSpan trailing;
+  ZcIrcCommand command_id;
+  guint n_params;
+  ZcIrcSpan params[ZC_IRC_VIEW_MAX_MIDDLE];
+  gchar buf[];
+};
+
+G_DEFINE_BOXED_TYPE(ZcIrcMessageView, zc_irc_message_view, zc_irc_message_view_copy, zc_irc_message_view_free)
+
+static const gchar *
+view_span(const ZcIrcMessageView *view, const ZcIrcSpan *span) {
+  if (span->off == ZC_IRC_SPAN_NONE) return NULL;
+  return view->buf + span->off;
+}
+
+ZcIrcMessageView *
+zc_irc_message_view_parse(const gchar *line, gssize len) {
   if (!line) return NULL;
 
-  const gchar *p = line;
-  while (*p && is_space(*p)) p++;
+  const gsize n = len < 0 ? strlen(line) : (gsize)len;
+  if (n >= ZC_IRC_SPAN_NONE) return NULL;
 
-  ZcIrcMessage *msg = zc_irc_message_new();
+  const gsize alloc_size = G_STRUCT_OFFSET(ZcIrcMessageView, buf) + n + 1;
+  ZcIrcMessageView *view = g_malloc(alloc_size);
+  view->alloc_size = alloc_size;
+  view->tags.off = view->prefix.off = view->command.off = view->trailing.off = ZC_IRC_SPAN_NONE;
+  view->tags.len = view->prefix.len = view->command.len = view->trailing.len = 0;
+  view->command_id = ZC_IRC_CMD_UNKNOWN;
+  view->n_params = 0;
+
+  gchar *buf = view->buf;
+  memcpy(buf, line, n);
+  buf[n] = '\0';
+
+  gchar *p = buf;
+  gchar *end = buf + n;
+  while (p < end && is_space(*p)) p++;
+
+  /* IRCv3 tags: record the span only, decode on lookup */
+  if (p < end && *p == '@') {
+    p++;
+    gchar *start = p;
+    while (p < end && !is_space(*p)) p++;
+    view->tags.off = (guint32)(start - buf);
+    view->tags.len = (guint32)(p - start);
+    while (p < end && is_space(*p)) *p++ = '\0';
+  }
 
   /* Prefix */
-  if (*p == ':') {
+  if (p < end && *p == ':') {
     p++;
-    const gchar *start = p;
-    while (*p && !is_space(*p)) p++;
-    msg->prefix = g_strndup(start, (gsize)(p - start));
-    while (*p && is_space(*p)) p++;
+    gchar *start = p;
+    while (p < end && !is_space(*p)) p++;
+    view->prefix.off = (guint32)(start - buf);
+    view->prefix.len = (guint32)(p - start);
+    while (p < end && is_space(*p)) *p++ = '\0';
   }
 
-  /* Command */
-  if (!*p) {
-    zc_irc_message_free(msg);
+  /* Command (uppercased in place) */
+  if (p >= end) {
+    g_free(view);
     return NULL;
   }
   {
-    const gchar *start = p;
-    while (*p && !is_space(*p)) p++;
-    msg->command = g_ascii_strup(start, (gsize)(p - start));
-    while (*p && is_space(*p)) p++;
+    gchar *start = p;
+    while (p < end && !is_space(*p)) {
+      *p = g_ascii_toupper(*p);
+      p++;
+    }
+    view->command.off = (guint32)(start - buf);
+    view->command.len = (guint32)(p - start);
+    view->command_id = command_id_for(start, view->command.len);
+    while (p < end && is_space(*p)) *p++ = '\0';
   }
 
   /* Params + trailing */
-  while (*p) {
-    if (*p == ':') {
-      p++;
-      msg->trailing = g_strdup(p);
+  while (p < end) {
+    if (*p == ':' || view->n_params == ZC_IRC_VIEW_MAX_MIDDLE) {
+      if (*p == ':') p++;
+      view->trailing.off = (guint32)(p - buf);
+      view->trailing.len = (guint32)(end - p);
       break;
     }
-    const gchar *start = p;
-    while (*p && !is_space(*p)) p++;
-    if (p > start) {
-      g_ptr_array_add(msg->params, g_strndup(start, (gsize)(p - start)));
+    gchar *start = p;
+    while (p < end && !is_space(*p)) p++;
+    ZcIrcSpan *span = &view->params[view->n_params++];
+    span->off = (guint32)(start - buf);
+    span->len = (guint32)(p - start);
+    while (p < end && is_space(*p)) *p++ = '\0';
+  }
+
+  return view;
+}
+
+ZcIrcMessageView *
+zc_irc_message_view_copy(const ZcIrcMessageView *view) {
+  if (!view) return NULL;
+  return g_memdup2(view, view->alloc_size);
+}
+
+void
+zc_irc_message_view_free(ZcIrcMessageView *view) {
+  g_free(view);
+}
+
+const gchar *
+zc_irc_message_view_get_tags(const ZcIrcMessageView *view) {
+  return view ? view_span(view, &view->tags) : NULL;
+}
+
+gchar *
+zc_irc_message_view_dup_tag(const ZcIrcMessageView *view, const gchar *key) {
+  if (!view || view->tags.off == ZC_IRC_SPAN_NONE) return NULL;
+  const gchar *value = NULL;
+  gsize value_len = 0;
+  if (!tags_find(view->buf + view->tags.off, view->tags.len, key, &value, &value_len)) return NULL;
+  return tags_unescape(value, value_len);
+}
+
+const gchar *
+zc_irc_message_view_get_prefix(const ZcIrcMessageView *view) {
+  return view ? view_span(view, &view->prefix) : NULL;
+}
+
+const gchar *
+zc_irc_message_view_get_command(const ZcIrcMessageView *view) {
+  return view ? view_span(view, &view->command) : NULL;
+}
+
+const gchar *
+zc_irc_message_view_get_trailing(const ZcIrcMessageView *view) {
+  return view ? view_span(view, &view->trailing) : NULL;
+}
+
+ZcIrcCommand
+zc_irc_message_view_get_command_id(const ZcIrcMessageView *view) {
+  return view ? view->command_id : ZC_IRC_CMD_UNKNOWN;
+}
+
+guint
+zc_irc_message_view_get_n_params(const ZcIrcMessageView *view) {
+  return view ? view->n_params : 0;
+}
+
+const gchar *
+zc_irc_message_view_param(const ZcIrcMessageView *view, guint idx) {
+  if (!view || idx >= view->n_params) return NULL;
+  return view_span(view, &view->params[idx]);
+}
+
+gsize
+zc_irc_message_view_param_len(const ZcIrcMessageView *view, guint idx) {
+  if (!view || idx >= view->n_params) return 0;
+  return view->params[idx].len;
+}
+
+static gchar *
+view_dup_span(const ZcIrcMessageView *view, const ZcIrcSpan *span) {
+  if (span->off == ZC_IRC_SPAN_NONE) return NULL;
+  return g_strndup(view->buf + span->off, span->len);
+}
+
+ZcIrcMessage *
+zc_irc_message_view_to_message(const ZcIrcMessageView *view) {
+  if (!view) return NULL;
+
+  ZcIrcMessage *msg = zc_irc_message_alloc(view->n_params);
+  msg->tags = view_dup_span(view, &view->tags);
+  msg->prefix = view_dup_span(view, &view->prefix);
+  msg->command = view_dup_span(view, &view->command);
+  msg->command_id = view->command_id;
+  for (guint i = 0; i < view->n_params; i++) {
+    g_ptr_array_add(msg->params, view_dup_span(view, &view->params[i]));
+  }
+  msg->trailing = view_dup_span(view, &view->trailing);
+  return msg;
+}
+
+/* ---- ZcIrcMessageBuilder ------------------------------------------------- */
+
+enum {
+  BUILD_TAGS,
+  BUILD_PARAMS,
+  BUILD_TRAILING
+};
+
+static void
+builder_fail(ZcIrcMessageBuilder *b, ZcIrcBuildStatus status) {
+  if (b->status == ZC_IRC_BUILD_OK) b->status = (guint8)status;
+}
+
+/* Room for @n more bytes in the current section? The tag section keeps one
+ * byte back for the space before the command, the body two for CRLF. */
+static gboolean
+builder_room(ZcIrcMessageBuilder *b, gsize n) {
+  const gsize limit = b->state == BUILD_TAGS ? ZC_IRC_CLIENT_TAGS_MAX - 1 : b->body + ZC_IRC_LINE_MAX - 2;
+  if (b->len + n <= limit) return TRUE;
+  builder_fail(b, ZC_IRC_BUILD_TOO_LONG);
+  return FALSE;
+}
+
+static void
+builder_put(ZcIrcMessageBuilder *b, const gchar *s, gsize n) {
+  memcpy(b->buf + b->len, s, n);
+  b->len += (guint)n;
+  b->buf[b->len] = '\0';
+}
+
+/* No CR, LF or NUL, and for middle params no space either. */
+static gboolean
+builder_clean(const gchar *s, gsize n, gboolean middle) {
+  for (gsize i = 0; i < n; i++) {
+    const gchar c = s[i];
+    if (c == '\r' || c == '\n' || c == '\0' || (middle && c == ' ')) return FALSE;
+  }
+  return TRUE;
+}
+
+void
+zc_irc_message_builder_init(ZcIrcMessageBuilder *b) {
+  g_return_if_fail(b != NULL);
+  b->len = 0;
+  b->body = 0;
+  b->state = BUILD_TAGS;
+  b->status = ZC_IRC_BUILD_OK;
+  b->buf[0] = '\0';
+}
+
+void
+zc_irc_message_builder_add_tag(ZcIrcMessageBuilder *b, const gchar *key, const gchar *value) {
+  g_return_if_fail(b != NULL);
+  g_return_if_fail(key != NULL);
+  if (b->status != ZC_IRC_BUILD_OK) return;
+  g_return_if_fail(b->state == BUILD_TAGS);
+
+  const gsize klen = strlen(key);
+  if (klen == 0 || strpbrk(key, "=; \r\n")) {
+    builder_fail(b, ZC_IRC_BUILD_INVALID);
+    return;
+  }
+  if (!builder_room(b, 1 + klen)) return;
+  builder_put(b, b->len ? ";" : "@", 1);
+  builder_put(b, key, klen);
+  if (!value || !*value) return;
+
+  if (!builder_room(b, 1)) return;
+  builder_put(b, "=", 1);
+  for (const gchar *p = value; *p; p++) {
+    const gchar *esc = NULL;
+    switch (*p) {
+      case ';':  esc = "\\:"; break;
+      case ' ':  esc = "\\s"; break;
+      case '\\': esc = "\\\\"; break;
+      case '\r': esc = "\\r"; break;
+      case '\n': esc = "\\n"; break;
+      default: break;
+    }
+    if (esc) {
+      if (!builder_room(b, 2)) return;
+      builder_put(b, esc, 2);
+    } else {
+      if (!builder_room(b, 1)) return;
+      builder_put(b, p, 1);
     }
-    while (*p && is_space(*p)) p++;
   }
+}
+
+void
+zc_irc_message_builder_set_command(ZcIrcMessageBuilder *b, const gchar *command) {
+  g_return_if_fail(b != NULL);
+  g_return_if_fail(command != NULL);
+  if (b->status != ZC_IRC_BUILD_OK) return;
+  g_return_if_fail(b->state == BUILD_TAGS);
+
+  if (b->len) builder_put(b, " ", 1);
+  b->body = b->len;
+  b->state = BUILD_PARAMS;
+
+  const gsize n = strlen(command);
+  if (n == 0 || !builder_clean(command, n, TRUE) || command[0] == ':') {
+    builder_fail(b, ZC_IRC_BUILD_INVALID);
+    return;
+  }
+  if (builder_room(b, n)) builder_put(b, command, n);
+}
+
+void
+zc_irc_message_builder_add_param(ZcIrcMessageBuilder *b, const gchar *param, gssize len) {
+  g_return_if_fail(b != NULL);
+  g_return_if_fail(param != NULL);
+  if (b->status != ZC_IRC_BUILD_OK) return;
+  g_return_if_fail(b->state == BUILD_PARAMS);
+
+  const gsize n = len < 0 ? strlen(param) : (gsize)len;
+  if (n == 0 || param[0] == ':' || !builder_clean(param, n, TRUE)) {
+    builder_fail(b, ZC_IRC_BUILD_INVALID);
+    return;
+  }
+  if (!builder_room(b, 1 + n)) return;
+  builder_put(b, " ", 1);
+  builder_put(b, param, n);
+}
+
+void
+zc_irc_message_builder_add_trailing(ZcIrcMessageBuilder *b, const gchar *text, gssize len) {
+  g_return_if_fail(b != NULL);
+  g_return_if_fail(text != NULL);
+  if (b->status != ZC_IRC_BUILD_OK) return;
+  g_return_if_fail(b->state == BUILD_PARAMS);
+
+  b->state = BUILD_TRAILING;
+  if (!builder_room(b, 2)) return;
+  builder_put(b, " :", 2);
+  zc_irc_message_builder_append(b, text, len);
+}
+
+void
+zc_irc_message_builder_append(ZcIrcMessageBuilder *b, const gchar *text, gssize len) {
+  g_return_if_fail(b != NULL);
+  g_return_if_fail(text != NULL);
+  if (b->status != ZC_IRC_BUILD_OK) return;
+  g_return_if_fail(b->state == BUILD_TRAILING);
+
+  const gsize n = len < 0 ? strlen(text) : (gsize)len;
+  if (!builder_clean(text, n, FALSE)) {
+    builder_fail(b, ZC_IRC_BUILD_INVALID);
+    return;
+  }
+  if (builder_room(b, n)) builder_put(b, text, n);
+}
+
+ZcIrcBuildStatus
+zc_irc_message_builder_get_status(const ZcIrcMessageBuilder *b) {
+  g_return_val_if_fail(b != NULL, ZC_IRC_BUILD_INVALID);
+  if (b->status == ZC_IRC_BUILD_OK && b->state == BUILD_TAGS) return ZC_IRC_BUILD_INVALID;
+  return (ZcIrcBuildStatus)b->status;
+}
+
+const gchar *
+zc_irc_message_builder_get_line(const ZcIrcMessageBuilder *b, gsize *length) {
+  g_return_val_if_fail(b != NULL, NULL);
+  if (zc_irc_message_builder_get_status(b) != ZC_IRC_BUILD_OK) return NULL;
+  if (length) *length = b->len;
+  return b->buf;
+}
+
+/* RFC1459-ish line parsing, good enough for a starter.
+ * Produces an owned copy; hot paths should use zc_irc_message_view_parse().
+ */
+ZcIrcMessage *
+zc_irc_message_parse_line(const gchar *line) {
+  ZcIrcMessageView *view = zc_irc_message_view_parse(line, -1);
+  if (!view) return NULL;
 
+  ZcIrcMessage *msg = zc_irc_message_view_to_message(view);
+  zc_irc_message_view_free(view);
   return msg;
 }
 
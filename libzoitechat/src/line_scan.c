@@ -0,0 +1,96 @@
+#include "line_scan.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define ZC_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/* ---- Portable fallback ---------------------------------------------------
+ * Classic "has zero byte" trick: XOR with a broadcast of '\n' turns matches
+ * into zero bytes, then (v - 0x01..) & ~v & 0x80.. flags them.
+ */
+static const gchar *
+scan_newline_swar(const gchar *p, gsize len) {
+  const gchar *end = p + len;
+
+  while (p < end && ((guintptr)p & (sizeof(gsize) - 1))) {
+    if (*p == '\n') return p;
+    p++;
+  }
+
+  const gsize ones = (gsize)-1 / 0xFF;
+  const gsize highs = ones * 0x80;
+  const gsize nl = ones * (gsize)'\n';
+
+  while ((gsize)(end - p) >= sizeof(gsize)) {
+    gsize v;
+    memcpy(&v, p, sizeof(v));
+    v ^= nl;
+    if ((v - ones) & ~v & highs) break;
+    p += sizeof(gsize);
+  }
+
+  while (p < end) {
+    if (*p == '\n') return p;
+    p++;
+  }
+  return NULL;
+}
+
+#ifdef ZC_SCAN_X86
+
+static const gchar *
+scan_newline_sse2(const gchar *p, gsize len) {
+  const gchar *end = p + len;
+  const __m128i nl = _mm_set1_epi8('\n');
+
+  while ((gsize)(end - p) >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    guint mask = (guint)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+    if (mask) return p + __builtin_ctz(mask);
+    p += 16;
+  }
+  return scan_newline_swar(p, (gsize)(end - p));
+}
+
+__attribute__((target("avx2")))
+static const gchar *
+scan_newline_avx2(const gchar *p, gsize len) {
+  const gchar *end = p + len;
+  const __m256i nl = _mm256_set1_epi8('\n');
+
+  while ((gsize)(end - p) >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    guint mask = (guint)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+    if (mask) return p + __builtin_ctz(mask);
+    p += 32;
+  }
+  return scan_newline_sse2(p, (gsize)(end - p));
+}
+
+typedef const gchar *(*ZcScanFunc)(const gchar *p, gsize len);
+
+static ZcScanFunc
+scan_newline_select(void) {
+  static gsize impl = 0;
+  if (g_once_init_enter(&impl)) {
+    __builtin_cpu_init();
+    ZcScanFunc f = __builtin_cpu_supports("avx2") ? scan_newline_avx2 : scan_newline_sse2;
+    g_once_init_leave(&impl, (gsize)f);
+  }
+  return (ZcScanFunc)impl;
+}
+
+#endif
+
+const gchar *
+zc_scan_newline(const gchar *p, gsize len) {
+  if (!p || len == 0) return NULL;
+#ifdef ZC_SCAN_X86
+  return scan_newline_select()(p, len);
+#else
+  return scan_newline_swar(p, len);
+#endif
+}
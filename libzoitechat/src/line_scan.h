@@ -0,0 +1,12 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Returns the first '\n' in [p, p + len), or %NULL. Uses AVX2/SSE2 where
+ * available and a word-at-a-time scan otherwise.
+ */
+const gchar *zc_scan_newline(const gchar *p, gsize len);
+
+G_END_DECLS
@@ -0,0 +1,586 @@
+#include "members.h"
+
+#include <string.h>
+
+/* Prefix modes per server fit a guint mask; real servers have at most six. */
+#define ZC_MAX_PREFIXES 16
+
+/* Set on every membership when a fresh NAMES reply starts; whoever the
+ * reply doesn't list is dropped at 366. Never visible outside this file. */
+#define MEMBER_STALE (1u << 31)
+
+struct _ZcUser {
+  gint ref_count;
+  gchar *nick;
+  gchar *userhost;
+  guint n_channels;
+};
+
+struct _ZcChannelState {
+  gchar *name;
+  ZcMembers *owner;
+  /* ZcUser* -> GUINT_TO_POINTER(modes). The entry is the membership: no
+   * allocation per member, and a nick change doesn't touch it. */
+  GHashTable *members;
+  gboolean in_names;   /* between the first 353 of a reply and its 366 */
+};
+
+typedef enum {
+  CASEMAP_ASCII,
+  CASEMAP_STRICT_RFC1459,
+  CASEMAP_RFC1459,
+} ZcCasemap;
+
+struct _ZcMembers {
+  ZcCasemap casemap;
+  GHashTable *users;     /* user->nick -> ZcUser*, holds a ref */
+  GHashTable *channels;  /* chan->name -> ZcChannelState* */
+  gchar prefix_modes[ZC_MAX_PREFIXES + 1];  /* "ov", highest rank first */
+  gchar prefix_chars[ZC_MAX_PREFIXES + 1];  /* "@+" */
+  gchar *chanmodes[4];   /* CHANMODES types A-D */
+  /* Ours, followed line by line: a chunk can hold our NICK and then a JOIN
+   * from the new nick, and the client only catches up after the chunk. */
+  gchar *self_nick;
+};
+
+/* ---- Casemapping -------------------------------------------------------------
+ * ascii folds A-Z; strict-rfc1459 also []\ to {}|; rfc1459 (the default)
+ * also ^ to ~. Each is "add 32 up to some last byte", so nicks are hashed
+ * and compared in place instead of being folded into a second copy.
+ */
+
+#define FOLD(c, last) ((c) >= 'A' && (c) <= (last) ? (guchar)((c) + 32) : (guchar)(c))
+
+#define CASEMAP_FUNCS(name, last)                                          \
+  static guint                                                             \
+  name##_hash(gconstpointer key) {                                         \
+    guint h = 5381;                                                        \
+    for (const guchar *p = key; *p; p++) h = (h << 5) + h + FOLD(*p, last); \
+    return h;                                                              \
+  }                                                                        \
+  static gboolean                                                          \
+  name##_equal(gconstpointer a, gconstpointer b) {                         \
+    const guchar *x = a, *y = b;                                           \
+    while (*x && FOLD(*x, last) == FOLD(*y, last)) {                       \
+      x++;                                                                 \
+      y++;                                                                 \
+    }                                                                      \
+    return FOLD(*x, last) == FOLD(*y, last);                               \
+  }
+
+CASEMAP_FUNCS(ascii, 'Z')
+CASEMAP_FUNCS(strict, ']')
+CASEMAP_FUNCS(rfc1459, '^')
+
+static const struct {
+  const gchar *name;
+  GHashFunc hash;
+  GEqualFunc equal;
+} casemaps[] = {
+  [CASEMAP_ASCII] = {"ascii", ascii_hash, ascii_equal},
+  [CASEMAP_STRICT_RFC1459] = {"strict-rfc1459", strict_hash, strict_equal},
+  [CASEMAP_RFC1459] = {"rfc1459", rfc1459_hash, rfc1459_equal},
+};
+
+static void channel_state_free(ZcChannelState *chan);
+
+/* Only while we share no channel, so there is nothing to rehash. */
+static void
+casemap_set(ZcMembers *m, ZcCasemap casemap) {
+  if (m->users && g_hash_table_size(m->channels) > 0) return;
+  if (m->users) {
+    g_hash_table_unref(m->users);
+    g_hash_table_unref(m->channels);
+  }
+  m->casemap = casemap;
+  m->users = g_hash_table_new_full(casemaps[casemap].hash, casemaps[casemap].equal, NULL,
+                                   (GDestroyNotify)zc_user_unref);
+  m->channels = g_hash_table_new_full(casemaps[casemap].hash, casemaps[casemap].equal, NULL,
+                                      (GDestroyNotify)channel_state_free);
+}
+
+/* ---- Users ------------------------------------------------------------------ */
+
+ZcUser *
+zc_user_ref(ZcUser *user) {
+  g_return_val_if_fail(user != NULL, NULL);
+  g_atomic_int_inc(&user->ref_count);
+  return user;
+}
+
+void
+zc_user_unref(ZcUser *user) {
+  if (!user) return;
+  if (!g_atomic_int_dec_and_test(&user->ref_count)) return;
+  g_free(user->nick);
+  g_free(user->userhost);
+  g_free(user);
+}
+
+const gchar *
+zc_user_get_nick(const ZcUser *user) {
+  g_return_val_if_fail(user != NULL, NULL);
+  return user->nick;
+}
+
+const gchar *
+zc_user_get_userhost(const ZcUser *user) {
+  g_return_val_if_fail(user != NULL, NULL);
+  return user->userhost;
+}
+
+guint
+zc_user_get_n_channels(const ZcUser *user) {
+  g_return_val_if_fail(user != NULL, 0);
+  return user->n_channels;
+}
+
+/* The one ZcUser for @nick, created on first sight. */
+static ZcUser *
+user_intern(ZcMembers *m, const gchar *nick) {
+  ZcUser *user = g_hash_table_lookup(m->users, nick);
+  if (!user) {
+    user = g_new0(ZcUser, 1);
+    user->ref_count = 1;
+    user->nick = g_strdup(nick);
+    g_hash_table_insert(m->users, user->nick, user);
+  }
+  return user;
+}
+
+static void
+user_set_userhost(ZcUser *user, const gchar *userhost) {
+  if (!userhost || !*userhost) return;
+  if (user->userhost && strcmp(user->userhost, userhost) == 0) return;
+  g_free(user->userhost);
+  user->userhost = g_strdup(userhost);
+}
+
+/* Drops the user once we share no channel with it; @user may be gone after. */
+static void
+user_release(ZcMembers *m, ZcUser *user) {
+  if (--user->n_channels == 0) g_hash_table_remove(m->users, user->nick);
+}
+
+/* "nick!user@host" -> nick, and user@host if the prefix has one. */
+static gchar *
+prefix_split(const gchar *prefix, const gchar **userhost) {
+  const gchar *bang = strchr(prefix, '!');
+  const gchar *at = strchr(prefix, '@');
+  const gchar *end = bang ? bang : at;
+  *userhost = bang && at ? bang + 1 : NULL;
+  return end ? g_strndup(prefix, (gsize)(end - prefix)) : g_strdup(prefix);
+}
+
+/* ---- Channels --------------------------------------------------------------- */
+
+static ZcChannelState *
+channel_state_new(ZcMembers *m, const gchar *name) {
+  ZcChannelState *chan = g_new0(ZcChannelState, 1);
+  chan->name = g_strdup(name);
+  chan->owner = m;
+  chan->members = g_hash_table_new(g_direct_hash, g_direct_equal);
+  return chan;
+}
+
+static void
+channel_clear(ZcChannelState *chan) {
+  GHashTableIter it;
+  gpointer user;
+  g_hash_table_iter_init(&it, chan->members);
+  while (g_hash_table_iter_next(&it, &user, NULL)) {
+    g_hash_table_iter_remove(&it);
+    user_release(chan->owner, user);
+  }
+}
+
+static void
+channel_state_free(ZcChannelState *chan) {
+  channel_clear(chan);
+  g_hash_table_unref(chan->members);
+  g_free(chan->name);
+  g_free(chan);
+}
+
+static void
+member_set(ZcChannelState *chan, ZcUser *user, guint modes) {
+  if (!g_hash_table_contains(chan->members, user)) user->n_channels++;
+  g_hash_table_insert(chan->members, user, GUINT_TO_POINTER(modes));
+}
+
+static void
+member_remove(ZcChannelState *chan, ZcUser *user) {
+  if (g_hash_table_remove(chan->members, user)) user_release(chan->owner, user);
+}
+
+const gchar *
+zc_channel_state_get_name(const ZcChannelState *chan) {
+  g_return_val_if_fail(chan != NULL, NULL);
+  return chan->name;
+}
+
+guint
+zc_channel_state_get_n_members(const ZcChannelState *chan) {
+  g_return_val_if_fail(chan != NULL, 0);
+  return g_hash_table_size(chan->members);
+}
+
+gboolean
+zc_channel_state_lookup(const ZcChannelState *chan, const gchar *nick, ZcUser **user, guint *modes) {
+  g_return_val_if_fail(chan != NULL, FALSE);
+  g_return_val_if_fail(nick != NULL, FALSE);
+
+  ZcUser *u = g_hash_table_lookup(chan->owner->users, nick);
+  gpointer v = NULL;
+  if (!u || !g_hash_table_lookup_extended(chan->members, u, NULL, &v)) return FALSE;
+  if (user) *user = u;
+  if (modes) *modes = GPOINTER_TO_UINT(v) & ~MEMBER_STALE;
+  return TRUE;
+}
+
+void
+zc_channel_state_foreach(const ZcChannelState *chan, ZcMemberFunc func, gpointer user_data) {
+  g_return_if_fail(chan != NULL);
+  g_return_if_fail(func != NULL);
+
+  GHashTableIter it;
+  gpointer user, v;
+  g_hash_table_iter_init(&it, chan->members);
+  while (g_hash_table_iter_next(&it, &user, &v)) func(user, GPOINTER_TO_UINT(v) & ~MEMBER_STALE, user_data);
+}
+
+/* ---- Model ------------------------------------------------------------------ */
+
+static void
+isupport_defaults(ZcMembers *m) {
+  g_strlcpy(m->prefix_modes, "ov", sizeof(m->prefix_modes));
+  g_strlcpy(m->prefix_chars, "@+", sizeof(m->prefix_chars));
+  static const gchar *const chanmodes[4] = {"beI", "k", "l", "imnpst"};
+  for (guint i = 0; i < 4; i++) {
+    g_free(m->chanmodes[i]);
+    m->chanmodes[i] = g_strdup(chanmodes[i]);
+  }
+}
+
+ZcMembers *
+zc_members_new(void) {
+  ZcMembers *m = g_new0(ZcMembers, 1);
+  casemap_set(m, CASEMAP_RFC1459);
+  isupport_defaults(m);
+  return m;
+}
+
+void
+zc_members_free(ZcMembers *m) {
+  if (!m) return;
+  /* Channels first: they release their users. */
+  g_hash_table_unref(m->channels);
+  g_hash_table_unref(m->users);
+  for (guint i = 0; i < 4; i++) g_free(m->chanmodes[i]);
+  g_free(m->self_nick);
+  g_free(m);
+}
+
+void
+zc_members_reset(ZcMembers *m, const gchar *self_nick) {
+  g_return_if_fail(m != NULL);
+  g_free(m->self_nick);
+  m->self_nick = g_strdup(self_nick);
+  g_hash_table_remove_all(m->channels);
+  casemap_set(m, CASEMAP_RFC1459);
+  isupport_defaults(m);
+}
+
+ZcChannelState *
+zc_members_get_channel(ZcMembers *m, const gchar *name) {
+  return name ? g_hash_table_lookup(m->channels, name) : NULL;
+}
+
+ZcUser *
+zc_members_lookup_user(ZcMembers *m, const gchar *nick) {
+  return nick ? g_hash_table_lookup(m->users, nick) : NULL;
+}
+
+gchar
+zc_members_prefix_char(ZcMembers *m, guint modes) {
+  const gint bit = g_bit_nth_lsf(modes & ~MEMBER_STALE, -1);
+  if (bit < 0 || (gsize)bit >= strlen(m->prefix_chars)) return 0;
+  return m->prefix_chars[bit];
+}
+
+static const gchar *
+view_arg(const ZcIrcMessageView *view, guint idx) {
+  const guint n = zc_irc_message_view_get_n_params(view);
+  if (idx < n) return zc_irc_message_view_param(view, idx);
+  return idx == n ? zc_irc_message_view_get_trailing(view) : NULL;
+}
+
+/* 005 RPL_ISUPPORT: "<nick> TOKEN[=value]... :are supported" */
+static void
+apply_isupport(ZcMembers *m, const ZcIrcMessageView *view) {
+  const guint n = zc_irc_message_view_get_n_params(view);
+  for (guint i = 1; i < n; i++) {
+    const gchar *tok = zc_irc_message_view_param(view, i);
+
+    if (g_str_has_prefix(tok, "PREFIX=")) {
+      const gchar *v = tok + 7;
+      const gchar *close = *v == '(' ? strchr(v, ')') : NULL;
+      const gsize len = close ? (gsize)(close - v - 1) : 0;
+      if (*v && (!close || len > ZC_MAX_PREFIXES || strlen(close + 1) != len)) continue;
+      memcpy(m->prefix_modes, v + 1, len);
+      m->prefix_modes[len] = '\0';
+      memcpy(m->prefix_chars, close ? close + 1 : "", len);
+      m->prefix_chars[len] = '\0';
+    } else if (g_str_has_prefix(tok, "CHANMODES=")) {
+      gchar **types = g_strsplit(tok + 10, ",", 5);
+      const guint n_types = g_strv_length(types);
+      for (guint t = 0; t < 4; t++) {
+        g_free(m->chanmodes[t]);
+        m->chanmodes[t] = g_strdup(t < n_types ? types[t] : "");
+      }
+      g_strfreev(types);
+    } else if (g_str_has_prefix(tok, "CASEMAPPING=")) {
+      ZcCasemap cm = CASEMAP_ASCII; /* also for rfc7613 and anything newer */
+      for (guint c = 0; c < G_N_ELEMENTS(casemaps); c++) {
+        if (g_ascii_strcasecmp(tok + 12, casemaps[c].name) == 0) cm = (ZcCasemap)c;
+      }
+      if (cm != m->casemap) casemap_set(m, cm);
+    }
+  }
+}
+
+/* 353 RPL_NAMREPLY: "<nick> [=*@] <channel> :[prefixes]nick[!user@host] ..." */
+static void
+apply_names(ZcMembers *m, const ZcIrcMessageView *view) {
+  const guint n = zc_irc_message_view_get_n_params(view);
+  const gchar *names = zc_irc_message_view_get_trailing(view);
+  ZcChannelState *chan = n >= 2 ? zc_members_get_channel(m, zc_irc_message_view_param(view, n - 1)) : NULL;
+  if (!chan || !names) return;
+
+  if (!chan->in_names) {
+    GHashTableIter it;
+    gpointer user, v;
+    g_hash_table_iter_init(&it, chan->members);
+    while (g_hash_table_iter_next(&it, &user, &v)) {
+      g_hash_table_iter_replace(&it, GUINT_TO_POINTER(GPOINTER_TO_UINT(v) | MEMBER_STALE));
+    }
+    chan->in_names = TRUE;
+  }
+
+  const gchar *p = names;
+  while (*p) {
+    while (*p == ' ') p++;
+    if (!*p) break;
+
+    /* multi-prefix sends every prefix the member holds, e.g. "@+nick". */
+    guint modes = 0;
+    const gchar *pc;
+    while (*p && (pc = strchr(m->prefix_chars, *p))) {
+      modes |= 1u << (pc - m->prefix_chars);
+      p++;
+    }
+    const gchar *end = p;
+    while (*end && *end != ' ') end++;
+
+    gchar *tok = g_strndup(p, (gsize)(end - p));
+    const gchar *userhost = NULL;
+    gchar *nick = prefix_split(tok, &userhost);
+    if (*nick) {
+      ZcUser *user = user_intern(m, nick);
+      user_set_userhost(user, userhost);
+      member_set(chan, user, modes);
+    }
+    g_free(nick);
+    g_free(tok);
+    p = end;
+  }
+}
+
+/* 366 RPL_ENDOFNAMES: "<nick> <channel> :End of /NAMES list." */
+static void
+apply_names_end(ZcMembers *m, const ZcIrcMessageView *view) {
+  ZcChannelState *chan = zc_members_get_channel(m, view_arg(view, 1));
+  if (!chan || !chan->in_names) return;
+
+  GHashTableIter it;
+  gpointer user, v;
+  g_hash_table_iter_init(&it, chan->members);
+  while (g_hash_table_iter_next(&it, &user, &v)) {
+    if (!(GPOINTER_TO_UINT(v) & MEMBER_STALE)) continue;
+    g_hash_table_iter_remove(&it);
+    user_release(m, user);
+  }
+  chan->in_names = FALSE;
+}
+
+/* "MODE <channel> <+-modes> <args...>": only prefix modes touch members,
+ * but every mode that takes an argument has to be stepped over. */
+static void
+apply_mode(ZcMembers *m, const ZcIrcMessageView *view) {
+  ZcChannelState *chan = zc_members_get_channel(m, view_arg(view, 0));
+  const gchar *modes = view_arg(view, 1);
+  if (!chan || !modes) return;
+
+  guint arg = 2;
+  gboolean adding = TRUE;
+  for (const gchar *c = modes; *c; c++) {
+    if (*c == '+' || *c == '-') {
+      adding = *c == '+';
+      continue;
+    }
+
+    const gchar *pm = strchr(m->prefix_modes, *c);
+    if (pm) {
+      const gchar *nick = view_arg(view, arg++);
+      ZcUser *user = zc_members_lookup_user(m, nick);
+      gpointer v;
+      if (user && g_hash_table_lookup_extended(chan->members, user, NULL, &v)) {
+        const guint bit = 1u << (pm - m->prefix_modes);
+        const guint bits = adding ? GPOINTER_TO_UINT(v) | bit : GPOINTER_TO_UINT(v) & ~bit;
+        g_hash_table_insert(chan->members, user, GUINT_TO_POINTER(bits));
+      }
+    } else if (strchr(m->chanmodes[0], *c) || strchr(m->chanmodes[1], *c) ||
+               (adding && strchr(m->chanmodes[2], *c))) {
+      arg++;
+    }
+  }
+}
+
+static void
+apply_quit(ZcMembers *m, ZcUser *user) {
+  /* Releasing the last channel frees the user; hold it until we're done. */
+  zc_user_ref(user);
+  GHashTableIter it;
+  gpointer chan;
+  g_hash_table_iter_init(&it, m->channels);
+  while (user->n_channels > 0 && g_hash_table_iter_next(&it, NULL, &chan)) member_remove(chan, user);
+  zc_user_unref(user);
+}
+
+static void
+apply_nick(ZcMembers *m, ZcUser *user, const gchar *newnick) {
+  if (!newnick || !*newnick) return;
+  /* Someone we still hold under the new nick must have left unseen. */
+  ZcUser *other = zc_members_lookup_user(m, newnick);
+  if (other && other != user) apply_quit(m, other);
+
+  /* Same ZcUser, new key; the memberships point at the user, not the nick. */
+  g_hash_table_steal(m->users, user->nick);
+  g_free(user->nick);
+  user->nick = g_strdup(newnick);
+  g_hash_table_replace(m->users, user->nick, user);
+}
+
+void
+zc_members_apply(ZcMembers *m, const ZcIrcMessageView *view) {
+  g_return_if_fail(m != NULL);
+  g_return_if_fail(view != NULL);
+
+  const ZcIrcCommand cmd = zc_irc_message_view_get_command_id(view);
+  const gchar *self_nick = m->self_nick;
+  switch ((guint)cmd) {
+    case 1: { /* RPL_WELCOME: the nick we registered with */
+      const gchar *nick = view_arg(view, 0);
+      if (nick && *nick) {
+        g_free(m->self_nick);
+        m->self_nick = g_strdup(nick);
+      }
+      return;
+    }
+    case 5:
+      apply_isupport(m, view);
+      return;
+    case 353:
+      apply_names(m, view);
+      return;
+    case 366:
+      apply_names_end(m, view);
+      return;
+    case ZC_IRC_CMD_MODE:
+      apply_mode(m, view);
+      return;
+    case ZC_IRC_CMD_JOIN:
+    case ZC_IRC_CMD_PART:
+    case ZC_IRC_CMD_KICK:
+    case ZC_IRC_CMD_QUIT:
+    case ZC_IRC_CMD_NICK:
+    case ZC_IRC_CMD_CHGHOST:
+      break;
+    default:
+      return;
+  }
+
+  const gchar *prefix = zc_irc_message_view_get_prefix(view);
+  if (!prefix) return;
+  const gchar *userhost = NULL;
+  gchar *nick = prefix_split(prefix, &userhost);
+  const gboolean is_self = self_nick && casemaps[m->casemap].equal(nick, self_nick);
+  const gchar *arg0 = view_arg(view, 0);
+  ZcUser *user = zc_members_lookup_user(m, nick);
+
+  switch ((guint)cmd) {
+    case ZC_IRC_CMD_JOIN: {
+      if (!arg0 || !*arg0) break;
+      ZcChannelState *chan = zc_members_get_channel(m, arg0);
+      if (!chan && is_self) {
+        chan = channel_state_new(m, arg0);
+        g_hash_table_insert(m->channels, chan->name, chan);
+      }
+      if (!chan) break;
+      user = user_intern(m, nick);
+      user_set_userhost(user, userhost);
+      if (!g_hash_table_contains(chan->members, user)) member_set(chan, user, 0);
+      break;
+    }
+    case ZC_IRC_CMD_PART: {
+      if (!arg0) break;
+      gchar **chans = g_strsplit(arg0, ",", -1);
+      for (gchar **c = chans; *c; c++) {
+        if (is_self) g_hash_table_remove(m->channels, *c);
+        else if (user) {
+          ZcChannelState *chan = zc_members_get_channel(m, *c);
+          if (chan) member_remove(chan, user);
+          /* user_release() may have dropped it. */
+          user = zc_members_lookup_user(m, nick);
+        }
+      }
+      g_strfreev(chans);
+      break;
+    }
+    case ZC_IRC_CMD_KICK: {
+      const gchar *victim = view_arg(view, 1);
+      if (!arg0 || !victim) break;
+      if (self_nick && casemaps[m->casemap].equal(victim, self_nick)) {
+        g_hash_table_remove(m->channels, arg0);
+      } else {
+        ZcChannelState *chan = zc_members_get_channel(m, arg0);
+        ZcUser *kicked = zc_members_lookup_user(m, victim);
+        if (chan && kicked) member_remove(chan, kicked);
+      }
+      break;
+    }
+    case ZC_IRC_CMD_QUIT:
+      if (user) apply_quit(m, user);
+      break;
+    case ZC_IRC_CMD_NICK:
+      if (user) apply_nick(m, user, arg0);
+      if (is_self && arg0 && *arg0) {
+        g_free(m->self_nick);
+        m->self_nick = g_strdup(arg0);
+      }
+      break;
+    case ZC_IRC_CMD_CHGHOST: {
+      /* "CHGHOST <new user> <new host>" */
+      const gchar *host = view_arg(view, 1);
+      if (user && arg0 && host) {
+        gchar *uh = g_strconcat(arg0, "@", host, NULL);
+        user_set_userhost(user, uh);
+        g_free(uh);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  g_free(nick);
+}
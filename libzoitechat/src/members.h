@@ -0,0 +1,27 @@
+#pragma once
+
+#include "zoitechat/channel_state.h"
+#include "zoitechat/irc_message.h"
+
+G_BEGIN_DECLS
+
+/* Channel membership for one connection: the channels we are in, one
+ * interned ZcUser per nick, and the ISUPPORT tokens (PREFIX, CHANMODES,
+ * CASEMAPPING) needed to read NAMES and MODE. Owner context only.
+ */
+typedef struct _ZcMembers ZcMembers;
+
+ZcMembers *zc_members_new(void);
+void zc_members_free(ZcMembers *members);
+/* Forget every channel and user and go back to RFC 1459 defaults. Our nick
+ * starts as @self_nick and then follows 001 and our own NICKs. */
+void zc_members_reset(ZcMembers *members, const gchar *self_nick);
+
+/* Apply one incoming message. */
+void zc_members_apply(ZcMembers *members, const ZcIrcMessageView *view);
+
+ZcChannelState *zc_members_get_channel(ZcMembers *members, const gchar *name);
+ZcUser *zc_members_lookup_user(ZcMembers *members, const gchar *nick);
+gchar zc_members_prefix_char(ZcMembers *members, guint modes);
+
+G_END_DECLS
@@ -0,0 +1,33 @@
+#include "mpsc_queue.h"
+
+/* Producers push onto a Treiber stack with compare-and-swap. The consumer
+ * never pops single nodes: it swaps the whole stack out for NULL and
+ * reverses it, so there is no ABA window and producers see "empty" exactly
+ * once per batch. Order is FIFO per producer; pushes that race each other
+ * land in whichever order their CAS succeeded.
+ */
+
+gboolean
+zc_mpsc_queue_push(ZcMpscQueue *queue, ZcMpscNode *node) {
+  g_return_val_if_fail(node != NULL, FALSE);
+
+  ZcMpscNode *head = g_atomic_pointer_get(&queue->head);
+  do {
+    node->next = head;
+    /* GLib atomics are full barriers, so node->next is visible first. */
+  } while (!g_atomic_pointer_compare_and_exchange_full(&queue->head, head, node, &head));
+  return head == NULL;
+}
+
+ZcMpscNode *
+zc_mpsc_queue_take(ZcMpscQueue *queue) {
+  ZcMpscNode *node = g_atomic_pointer_exchange(&queue->head, NULL);
+  ZcMpscNode *fifo = NULL;
+  while (node) {
+    ZcMpscNode *next = node->next;
+    node->next = fifo;
+    fifo = node;
+    node = next;
+  }
+  return fifo;
+}
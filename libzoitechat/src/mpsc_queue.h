@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Unbounded intrusive multi-producer/single-consumer queue. Any thread may
+ * push; one thread at a time takes everything queued so far. No locks are
+ * taken and pushing never allocates: embed a #ZcMpscNode in the item.
+ */
+typedef struct _ZcMpscNode ZcMpscNode;
+struct _ZcMpscNode {
+  ZcMpscNode *next;
+};
+
+typedef struct {
+  ZcMpscNode *head; /* newest first */
+} ZcMpscQueue;
+
+#define ZC_MPSC_QUEUE_INIT { NULL }
+
+/* Returns %TRUE if the queue was empty, i.e. the consumer needs waking. */
+gboolean zc_mpsc_queue_push(ZcMpscQueue *queue, ZcMpscNode *node);
+/* Detaches every queued node and returns them oldest first, linked through
+ * ->next; %NULL if the queue is empty. Consumer only. */
+ZcMpscNode *zc_mpsc_queue_take(ZcMpscQueue *queue);
+
+G_END_DECLS
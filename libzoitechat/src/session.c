@@ -0,0 +1,306 @@
+#include "zoitechat/session.h"
+
+#include <string.h>
+
+typedef struct {
+  ZcNetworkConfig *config;
+  ZcClient *client;
+} ZcNetwork;
+
+struct _ZcSession {
+  GObject parent_instance;
+
+  GSocketClient *sock_client;
+  GTlsDatabase *tls_database;
+
+  GPtrArray *networks; /* ZcNetwork*, in insertion order */
+};
+
+G_DEFINE_TYPE(ZcSession, zc_session, G_TYPE_OBJECT)
+
+enum {
+  SIG_CONNECT_FAILED,
+  N_SIGNALS
+};
+
+static guint signals[N_SIGNALS] = {0};
+
+ZcNetworkConfig *
+zc_network_config_new(const gchar *name) {
+  ZcNetworkConfig *c = g_new0(ZcNetworkConfig, 1);
+  c->name = g_strdup(name ? name : "");
+  c->port = 6697;
+  c->tls = TRUE;
+  return c;
+}
+
+ZcNetworkConfig *
+zc_network_config_copy(const ZcNetworkConfig *config) {
+  if (!config) return NULL;
+  ZcNetworkConfig *c = g_new0(ZcNetworkConfig, 1);
+  c->name = g_strdup(config->name);
+  c->host = g_strdup(config->host);
+  c->port = config->port;
+  c->tls = config->tls;
+  c->nick = g_strdup(config->nick);
+  c->user = g_strdup(config->user);
+  c->realname = g_strdup(config->realname);
+  c->auto_join = g_strdup(config->auto_join);
+  c->sasl_account = g_strdup(config->sasl_account);
+  c->sasl_password = g_strdup(config->sasl_password);
+  c->autoconnect = config->autoconnect;
+  c->charset = g_strdup(config->charset);
+  return c;
+}
+
+void
+zc_network_config_free(ZcNetworkConfig *config) {
+  if (!config) return;
+  g_free(config->name);
+  g_free(config->host);
+  g_free(config->nick);
+  g_free(config->user);
+  g_free(config->realname);
+  g_free(config->auto_join);
+  g_free(config->sasl_account);
+  g_free(config->sasl_password);
+  g_free(config->charset);
+  g_free(config);
+}
+
+static void
+network_free(ZcNetwork *net) {
+  g_signal_handlers_disconnect_by_data(net->client, net);
+  zc_client_disconnect(net->client);
+  g_object_unref(net->client);
+  zc_network_config_free(net->config);
+  g_free(net);
+}
+
+static void
+zc_session_dispose(GObject *object) {
+  ZcSession *self = ZC_SESSION(object);
+
+  if (self->networks) g_ptr_array_set_size(self->networks, 0);
+  g_clear_object(&self->sock_client);
+  g_clear_object(&self->tls_database);
+
+  G_OBJECT_CLASS(zc_session_parent_class)->dispose(object);
+}
+
+static void
+zc_session_finalize(GObject *object) {
+  ZcSession *self = ZC_SESSION(object);
+
+  g_ptr_array_unref(self->networks);
+
+  G_OBJECT_CLASS(zc_session_parent_class)->finalize(object);
+}
+
+static void
+zc_session_class_init(ZcSessionClass *klass) {
+  GObjectClass *object_class = G_OBJECT_CLASS(klass);
+  object_class->dispose = zc_session_dispose;
+  object_class->finalize = zc_session_finalize;
+
+  signals[SIG_CONNECT_FAILED] = g_signal_new(
+    "connect-failed",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    2,
+    ZC_TYPE_CLIENT,
+    G_TYPE_STRING
+  );
+}
+
+static void
+zc_session_init(ZcSession *self) {
+  self->sock_client = g_socket_client_new();
+  g_socket_client_set_timeout(self->sock_client, 30);
+  self->tls_database = g_tls_backend_get_default_database(g_tls_backend_get_default());
+  self->networks = g_ptr_array_new_with_free_func((GDestroyNotify)network_free);
+}
+
+ZcSession *
+zc_session_new(void) {
+  return g_object_new(ZC_TYPE_SESSION, NULL);
+}
+
+static ZcNetwork *
+find_network(ZcSession *self, const gchar *name, guint *index) {
+  if (!name) return NULL;
+  for (guint i = 0; i < self->networks->len; i++) {
+    ZcNetwork *net = g_ptr_array_index(self->networks, i);
+    if (g_strcmp0(net->config->name, name) == 0) {
+      if (index) *index = i;
+      return net;
+    }
+  }
+  return NULL;
+}
+
+static void
+apply_identity(ZcNetwork *net) {
+  zc_client_set_identity(net->client, net->config->nick, net->config->user, net->config->realname);
+  zc_client_set_auto_join(net->client, net->config->auto_join);
+  zc_client_set_sasl_plain(net->client, net->config->sasl_account, net->config->sasl_password);
+  if (!zc_client_set_fallback_charset(net->client, net->config->charset)) {
+    g_warning("%s: unsupported charset \"%s\", repairing instead", net->config->name, net->config->charset);
+    zc_client_set_fallback_charset(net->client, NULL);
+  }
+}
+
+ZcClient *
+zc_session_add_network(ZcSession *self, const ZcNetworkConfig *config) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), NULL);
+  g_return_val_if_fail(config != NULL && config->name != NULL && *config->name, NULL);
+
+  if (find_network(self, config->name, NULL)) return NULL;
+
+  ZcNetwork *net = g_new0(ZcNetwork, 1);
+  net->config = zc_network_config_copy(config);
+  net->client = zc_client_new();
+  zc_client_set_socket_client(net->client, self->sock_client);
+  if (self->tls_database) zc_client_set_tls_database(net->client, self->tls_database);
+  apply_identity(net);
+
+  g_ptr_array_add(self->networks, net);
+  return net->client;
+}
+
+gboolean
+zc_session_remove_network(ZcSession *self, const gchar *name) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), FALSE);
+  guint index = 0;
+  if (!find_network(self, name, &index)) return FALSE;
+  g_ptr_array_remove_index(self->networks, index);
+  return TRUE;
+}
+
+gboolean
+zc_session_update_network(ZcSession *self, const ZcNetworkConfig *config) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), FALSE);
+  g_return_val_if_fail(config != NULL, FALSE);
+
+  ZcNetwork *net = find_network(self, config->name, NULL);
+  if (!net) return FALSE;
+
+  zc_network_config_free(net->config);
+  net->config = zc_network_config_copy(config);
+  apply_identity(net);
+  return TRUE;
+}
+
+guint
+zc_session_get_n_networks(ZcSession *self) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), 0);
+  return self->networks->len;
+}
+
+const ZcNetworkConfig *
+zc_session_get_nth_config(ZcSession *self, guint index) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), NULL);
+  if (index >= self->networks->len) return NULL;
+  return ((ZcNetwork *)g_ptr_array_index(self->networks, index))->config;
+}
+
+const ZcNetworkConfig *
+zc_session_get_config(ZcSession *self, const gchar *name) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), NULL);
+  ZcNetwork *net = find_network(self, name, NULL);
+  return net ? net->config : NULL;
+}
+
+ZcClient *
+zc_session_get_client(ZcSession *self, const gchar *name) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), NULL);
+  ZcNetwork *net = find_network(self, name, NULL);
+  return net ? net->client : NULL;
+}
+
+static void
+on_network_connected(GObject *source, GAsyncResult *res, gpointer user_data) {
+  ZcSession *self = ZC_SESSION(user_data);
+  ZcClient *client = ZC_CLIENT(source);
+  GError *error = NULL;
+
+  if (!zc_client_connect_finish(client, res, &error)) {
+    /* Superseded by a newer connect or a disconnect: not worth reporting. */
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+      g_signal_emit(self, signals[SIG_CONNECT_FAILED], 0, client, error->message);
+    }
+    g_clear_error(&error);
+  }
+  g_object_unref(self);
+}
+
+static void
+connect_network(ZcSession *self, ZcNetwork *net) {
+  const ZcNetworkConfig *c = net->config;
+  if (!c->host || !*c->host) return;
+  apply_identity(net);
+  zc_client_connect_async(net->client, c->host, c->port, c->tls, NULL, on_network_connected, g_object_ref(self));
+}
+
+gboolean
+zc_session_connect(ZcSession *self, const gchar *name) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), FALSE);
+  ZcNetwork *net = find_network(self, name, NULL);
+  if (!net) return FALSE;
+  connect_network(self, net);
+  return TRUE;
+}
+
+void
+zc_session_connect_all(ZcSession *self) {
+  g_return_if_fail(ZC_IS_SESSION(self));
+  for (guint i = 0; i < self->networks->len; i++) {
+    ZcNetwork *net = g_ptr_array_index(self->networks, i);
+    if (net->config->autoconnect && !zc_client_is_connected(net->client)) connect_network(self, net);
+  }
+}
+
+void
+zc_session_disconnect_all(ZcSession *self) {
+  g_return_if_fail(ZC_IS_SESSION(self));
+  for (guint i = 0; i < self->networks->len; i++) {
+    ZcNetwork *net = g_ptr_array_index(self->networks, i);
+    zc_client_disconnect(net->client);
+  }
+}
+
+void
+zc_session_get_stats(ZcSession *self, ZcSessionStats *stats) {
+  g_return_if_fail(ZC_IS_SESSION(self));
+  g_return_if_fail(stats != NULL);
+
+  memset(stats, 0, sizeof(*stats));
+  stats->n_networks = self->networks->len;
+  for (guint i = 0; i < self->networks->len; i++) {
+    ZcNetwork *net = g_ptr_array_index(self->networks, i);
+    ZcSendStats ss;
+    zc_client_get_send_stats(net->client, &ss);
+    if (zc_client_is_connected(net->client)) stats->n_connected++;
+    stats->queued += ss.queued;
+    stats->sent += ss.sent;
+    stats->delayed += ss.delayed;
+    stats->cancelled += ss.cancelled;
+    stats->write_queue_bytes += zc_client_get_write_queue_bytes(net->client);
+  }
+}
+
+GSocketClient *
+zc_session_get_socket_client(ZcSession *self) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), NULL);
+  return self->sock_client;
+}
+
+GTlsDatabase *
+zc_session_get_tls_database(ZcSession *self) {
+  g_return_val_if_fail(ZC_IS_SESSION(self), NULL);
+  return self->tls_database;
+}
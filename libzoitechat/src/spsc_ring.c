@@ -0,0 +1,81 @@
+#include "spsc_ring.h"
+
+/* head is written only by the consumer, tail only by the producer. Each
+ * side keeps a cached copy of the other's index so the common case touches
+ * just its own cache line. Indices run freely and are masked on access.
+ */
+#define ZC_CACHE_LINE 64
+
+struct _ZcSpscRing {
+  /* read-only after creation, shared by both sides */
+  gpointer *slots;
+  guint mask;
+  gchar pad0[ZC_CACHE_LINE - sizeof(gpointer) - sizeof(guint)];
+
+  gint head;
+  guint tail_cache; /* consumer's view of tail */
+  gchar pad1[ZC_CACHE_LINE - 2 * sizeof(gint)];
+
+  gint tail;
+  guint head_cache; /* producer's view of head */
+  gchar pad2[ZC_CACHE_LINE - 2 * sizeof(gint)];
+};
+
+/* The pads assume no hidden alignment padding; keep each index on its own line. */
+G_STATIC_ASSERT(G_STRUCT_OFFSET(struct _ZcSpscRing, head) % ZC_CACHE_LINE == 0);
+G_STATIC_ASSERT(G_STRUCT_OFFSET(struct _ZcSpscRing, tail) % ZC_CACHE_LINE == 0);
+G_STATIC_ASSERT(sizeof(struct _ZcSpscRing) % ZC_CACHE_LINE == 0);
+
+ZcSpscRing *
+zc_spsc_ring_new(guint capacity) {
+  g_return_val_if_fail(capacity > 0 && capacity <= (1u << 30), NULL);
+
+  guint size = 1;
+  while (size < capacity) size <<= 1;
+
+  ZcSpscRing *ring = g_aligned_alloc0(1, sizeof(ZcSpscRing), ZC_CACHE_LINE);
+  ring->mask = size - 1;
+  ring->slots = g_new0(gpointer, size);
+  return ring;
+}
+
+void
+zc_spsc_ring_free(ZcSpscRing *ring, GDestroyNotify item_free) {
+  if (!ring) return;
+  gpointer item;
+  while ((item = zc_spsc_ring_pop(ring))) {
+    if (item_free) item_free(item);
+  }
+  g_free(ring->slots);
+  g_aligned_free(ring);
+}
+
+gboolean
+zc_spsc_ring_push(ZcSpscRing *ring, gpointer item) {
+  g_return_val_if_fail(item != NULL, FALSE);
+
+  const guint tail = (guint)g_atomic_int_get(&ring->tail);
+  if (tail - ring->head_cache > ring->mask) {
+    ring->head_cache = (guint)g_atomic_int_get(&ring->head);
+    if (tail - ring->head_cache > ring->mask) return FALSE;
+  }
+
+  ring->slots[tail & ring->mask] = item;
+  /* Publishes the slot: GLib atomics are full barriers. */
+  g_atomic_int_set(&ring->tail, (gint)(tail + 1));
+  return TRUE;
+}
+
+gpointer
+zc_spsc_ring_pop(ZcSpscRing *ring) {
+  const guint head = (guint)g_atomic_int_get(&ring->head);
+  if (head == ring->tail_cache) {
+    ring->tail_cache = (guint)g_atomic_int_get(&ring->tail);
+    if (head == ring->tail_cache) return NULL;
+  }
+
+  gpointer item = ring->slots[head & ring->mask];
+  ring->slots[head & ring->mask] = NULL;
+  g_atomic_int_set(&ring->head, (gint)(head + 1));
+  return item;
+}
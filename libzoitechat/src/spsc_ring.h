@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Bounded single-producer/single-consumer pointer ring. Exactly one thread
+ * may push and exactly one (other) thread may pop; no locks are taken.
+ */
+typedef struct _ZcSpscRing ZcSpscRing;
+
+/* @capacity is rounded up to a power of two. */
+ZcSpscRing *zc_spsc_ring_new(guint capacity);
+/* Frees the ring; any items still queued are passed to @item_free. */
+void zc_spsc_ring_free(ZcSpscRing *ring, GDestroyNotify item_free);
+
+/* Returns %FALSE if the ring is full. */
+gboolean zc_spsc_ring_push(ZcSpscRing *ring, gpointer item);
+/* Returns %NULL if the ring is empty. */
+gpointer zc_spsc_ring_pop(ZcSpscRing *ring);
+
+G_END_DECLS
@@ -0,0 +1,73 @@
+#include "tls_session_cache.h"
+
+typedef struct {
+  GTlsClientConnection *conn;
+  gint64 expires; /* monotonic, µs */
+} ZcTlsSession;
+
+static GMutex cache_lock;
+static GHashTable *cache; /* "host:port" (casefolded) -> ZcTlsSession* */
+
+static void
+session_free(ZcTlsSession *s) {
+  g_object_unref(s->conn);
+  g_free(s);
+}
+
+static gchar *
+cache_key(const gchar *host, guint16 port) {
+  gchar *lower = g_ascii_strdown(host, -1);
+  gchar *key = g_strdup_printf("%s:%u", lower, (guint)port);
+  g_free(lower);
+  return key;
+}
+
+gboolean
+zc_tls_session_cache_apply(const gchar *host, guint16 port, GTlsClientConnection *conn) {
+  g_return_val_if_fail(host != NULL, FALSE);
+  g_return_val_if_fail(G_IS_TLS_CLIENT_CONNECTION(conn), FALSE);
+
+  gchar *key = cache_key(host, port);
+  GTlsClientConnection *source = NULL;
+
+  g_mutex_lock(&cache_lock);
+  ZcTlsSession *s = cache ? g_hash_table_lookup(cache, key) : NULL;
+  if (s && s->expires <= g_get_monotonic_time()) {
+    g_hash_table_remove(cache, key);
+    s = NULL;
+  }
+  if (s) source = g_object_ref(s->conn);
+  g_mutex_unlock(&cache_lock);
+  g_free(key);
+
+  if (!source) return FALSE;
+  g_tls_client_connection_copy_session_state(conn, source);
+  g_object_unref(source);
+  return TRUE;
+}
+
+void
+zc_tls_session_cache_store(const gchar *host, guint16 port, GTlsClientConnection *conn) {
+  g_return_if_fail(host != NULL);
+  g_return_if_fail(G_IS_TLS_CLIENT_CONNECTION(conn));
+
+  ZcTlsSession *s = g_new0(ZcTlsSession, 1);
+  s->conn = g_object_ref(conn);
+  s->expires = g_get_monotonic_time() + (gint64)ZC_TLS_SESSION_TTL_S * G_USEC_PER_SEC;
+
+  g_mutex_lock(&cache_lock);
+  if (!cache) cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)session_free);
+  g_hash_table_replace(cache, cache_key(host, port), s);
+  g_mutex_unlock(&cache_lock);
+}
+
+void
+zc_tls_session_cache_forget(const gchar *host, guint16 port) {
+  g_return_if_fail(host != NULL);
+
+  gchar *key = cache_key(host, port);
+  g_mutex_lock(&cache_lock);
+  if (cache) g_hash_table_remove(cache, key);
+  g_mutex_unlock(&cache_lock);
+  g_free(key);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* Process-wide TLS resumption cache: the last handshaken connection per
+ * host:port, whose session state new connections to the same server copy
+ * before their handshake. Thread-safe.
+ *
+ * GIO keeps session state opaque, so the cache lives in memory only.
+ */
+#define ZC_TLS_SESSION_TTL_S (2 * 60 * 60)
+
+/* Copies cached session state into @conn. Returns %TRUE if there was any. */
+gboolean zc_tls_session_cache_apply(const gchar *host, guint16 port, GTlsClientConnection *conn);
+/* Remember @conn (after a successful handshake) as the source for @host. */
+void zc_tls_session_cache_store(const gchar *host, guint16 port, GTlsClientConnection *conn);
+/* Drop @host, e.g. after a handshake that offered its session failed. */
+void zc_tls_session_cache_forget(const gchar *host, guint16 port);
+
+G_END_DECLS
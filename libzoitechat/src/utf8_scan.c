@@ -0,0 +1,149 @@
+#include "utf8_scan.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define ZC_UTF8_X86 1
+#include <immintrin.h>
+#endif
+
+/* ---- ASCII runs ------------------------------------------------------------
+ * Nearly all IRC traffic is ASCII, so validation is a search for the first
+ * byte with the high bit set; only what follows it is decoded.
+ */
+
+static gsize
+ascii_prefix_swar(const guchar *p, gsize len) {
+  const guchar *start = p;
+  const guchar *end = p + len;
+
+  while (p < end && ((guintptr)p & (sizeof(gsize) - 1))) {
+    if (*p & 0x80) return (gsize)(p - start);
+    p++;
+  }
+
+  const gsize highs = ((gsize)-1 / 0xFF) * 0x80;
+  while ((gsize)(end - p) >= sizeof(gsize)) {
+    gsize v;
+    memcpy(&v, p, sizeof(v));
+    if (v & highs) break;
+    p += sizeof(gsize);
+  }
+
+  while (p < end && !(*p & 0x80)) p++;
+  return (gsize)(p - start);
+}
+
+#ifdef ZC_UTF8_X86
+
+static gsize
+ascii_prefix_sse2(const guchar *p, gsize len) {
+  gsize i = 0;
+  while (len - i >= 16) {
+    guint mask = (guint)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(p + i)));
+    if (mask) return i + (gsize)__builtin_ctz(mask);
+    i += 16;
+  }
+  return i + ascii_prefix_swar(p + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static gsize
+ascii_prefix_avx2(const guchar *p, gsize len) {
+  gsize i = 0;
+  while (len - i >= 32) {
+    guint mask = (guint)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(p + i)));
+    if (mask) return i + (gsize)__builtin_ctz(mask);
+    i += 32;
+  }
+  return i + ascii_prefix_sse2(p + i, len - i);
+}
+
+typedef gsize (*ZcAsciiFunc)(const guchar *p, gsize len);
+
+static ZcAsciiFunc
+ascii_prefix_select(void) {
+  static gsize impl = 0;
+  if (g_once_init_enter(&impl)) {
+    __builtin_cpu_init();
+    ZcAsciiFunc f = __builtin_cpu_supports("avx2") ? ascii_prefix_avx2 : ascii_prefix_sse2;
+    g_once_init_leave(&impl, (gsize)f);
+  }
+  return (ZcAsciiFunc)impl;
+}
+
+#endif
+
+static inline gsize
+ascii_prefix(const guchar *p, gsize len) {
+#ifdef ZC_UTF8_X86
+  return ascii_prefix_select()(p, len);
+#else
+  return ascii_prefix_swar(p, len);
+#endif
+}
+
+static inline gboolean
+is_cont(guchar c) {
+  return (c & 0xC0) == 0x80;
+}
+
+gboolean
+zc_utf8_validate(const gchar *text, gsize len) {
+  const guchar *p = (const guchar *)text;
+  const guchar *end = p + len;
+
+  while (p < end) {
+    p += ascii_prefix(p, (gsize)(end - p));
+    if (p >= end) break;
+
+    /* One multi-byte sequence; the second byte's range rules out overlong
+     * forms, surrogates and anything past U+10FFFF. */
+    const guchar c = p[0];
+    const gsize left = (gsize)(end - p);
+    if (c < 0xC2) return FALSE;
+    if (c < 0xE0) {
+      if (left < 2 || !is_cont(p[1])) return FALSE;
+      p += 2;
+    } else if (c < 0xF0) {
+      const guchar lo = c == 0xE0 ? 0xA0 : 0x80;
+      const guchar hi = c == 0xED ? 0x9F : 0xBF;
+      if (left < 3 || p[1] < lo || p[1] > hi || !is_cont(p[2])) return FALSE;
+      p += 3;
+    } else if (c < 0xF5) {
+      const guchar lo = c == 0xF0 ? 0x90 : 0x80;
+      const guchar hi = c == 0xF4 ? 0x8F : 0xBF;
+      if (left < 4 || p[1] < lo || p[1] > hi || !is_cont(p[2]) || !is_cont(p[3])) return FALSE;
+      p += 4;
+    } else {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+/* Windows-1252 0x80..0x9F. The five unassigned bytes keep their C1 code
+ * point, as browsers do. */
+static const guint16 cp1252_c1[32] = {
+  0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+  0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+  0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+  0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+};
+
+void
+zc_utf8_append_from_cp1252(GString *out, const gchar *text, gsize len, gboolean cp1252) {
+  const guchar *p = (const guchar *)text;
+  const guchar *end = p + len;
+
+  while (p < end) {
+    const gsize run = ascii_prefix(p, (gsize)(end - p));
+    g_string_append_len(out, (const gchar *)p, (gssize)run);
+    p += run;
+    if (p >= end) break;
+
+    const gunichar ch = cp1252 && *p < 0xA0 ? cp1252_c1[*p - 0x80] : *p;
+    g_string_append_unichar(out, ch);
+    p++;
+  }
+}
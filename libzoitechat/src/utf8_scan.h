@@ -0,0 +1,18 @@
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* TRUE if [p, p + len) is well-formed UTF-8 (RFC 3629: no overlong forms,
+ * surrogates or code points past U+10FFFF). ASCII runs are skipped with
+ * AVX2/SSE2 where available and a word at a time otherwise.
+ */
+gboolean zc_utf8_validate(const gchar *p, gsize len);
+
+/* Append @len bytes of ISO-8859-1 (@cp1252 FALSE) or Windows-1252 text to
+ * @out as UTF-8. Every byte maps to something, so this cannot fail.
+ */
+void zc_utf8_append_from_cp1252(GString *out, const gchar *p, gsize len, gboolean cp1252);
+
+G_END_DECLS
@@ -1,6 +1,112 @@
 #include "zoitechat/zoitechat.h"
+#include "line_scan.h"
+#include "members.h"
+#include "utf8_scan.h"
+#include "spsc_ring.h"
+#include "mpsc_queue.h"
+#include "happy_eyeballs.h"
+#include "tls_session_cache.h"
 
 #include <string.h>
+#ifdef G_OS_UNIX
+#include <time.h>
+#endif
+
+/* Socket reads pull up to this much at once; every complete line in the
+ * chunk is handled in the same main-loop dispatch.
+ */
+#define ZC_READ_CHUNK (64 * 1024)
+/* IRCv3: 8191 bytes of tags + 512 bytes of message. */
+#define ZC_DEFAULT_MAX_LINE (8191 + 512)
+/* Flood control defaults: what most ircds tolerate before Excess Flood. */
+#define ZC_DEFAULT_FLOOD_BURST 5
+#define ZC_DEFAULT_FLOOD_REFILL_MS 2000
+/* Re-join and CAP REQ lines are cut here, well inside the 512-byte limit. */
+#define ZC_REJOIN_LINE_MAX 400
+#define ZC_CAP_LINE_MAX 400
+/* Lag probes: one PING per interval; LAGGING past the first threshold, the
+ * link is declared dead (and dropped) past the second. */
+#define ZC_DEFAULT_LAG_INTERVAL_MS 30000
+#define ZC_DEFAULT_LAG_WARN_MS 10000
+#define ZC_DEFAULT_LAG_DEAD_MS 90000
+/* AUTHENTICATE payloads are sent in chunks of this many base64 bytes. */
+#define ZC_SASL_CHUNK 400
+
+/* Our "user@host" as relayed by the server, until we have seen it: a
+ * 10-byte username and a 63-byte hostname. */
+#define ZC_USERHOST_GUESS (10 + 1 + 63)
+
+/* Batches in flight from the I/O thread to the owner context. */
+#define ZC_IO_RING_SIZE 1024
+/* The I/O thread stops reading while this many bytes of parsed input wait
+ * for the owner: a slow owner pushes back on the socket. */
+#define ZC_IO_MAX_BACKLOG (4 * ZC_READ_CHUNK)
+
+/* A zc_client_send_text() job: lines fed to the user lane one at a time,
+ * or all at once for a multiline batch. */
+typedef struct {
+  guint id;
+  gchar *target;
+  GPtrArray *lines;
+  guint next;
+  guint sent;    /* message lines handed over, BATCH framing excluded */
+  guint total;
+  gboolean atomic;
+} ZcSendJob;
+
+/* A line waiting in one of the priority lanes. */
+typedef struct {
+  gchar *line;
+  gchar *target; /* lowercased first parameter, bulk lane only */
+  gboolean delayed;
+} ZcQueuedLine;
+
+/* A line handed over by another thread; node must stay first. */
+typedef struct {
+  ZcMpscNode node;
+  ZcSendPriority priority;
+  gsize len;
+  gchar line[];
+} ZcSubmission;
+
+typedef enum {
+  ZC_FALLBACK_REPLACE,   /* no charset: invalid bytes become U+FFFD */
+  ZC_FALLBACK_LATIN1,
+  ZC_FALLBACK_CP1252,
+  ZC_FALLBACK_ICONV,
+} ZcFallbackCharset;
+
+/* Inbound counters. Owned by whichever context runs the read loop: the I/O
+ * thread counts into its current batch and the owner adds them up.
+ */
+typedef struct {
+  guint64 lines;
+  guint64 bytes;
+  guint64 malformed;
+  guint64 transcoded;
+  guint64 parse_ns;
+  guint64 parse_hist[ZC_STATS_PARSE_BUCKETS];
+} ZcInCounters;
+
+/* Upper bounds of the parse-time histogram buckets; the last is open. */
+static const guint64 parse_bucket_le_ns[ZC_STATS_PARSE_BUCKETS] = {
+  250, 500, 1000, 2500, 5000, 10000, 50000, G_MAXUINT64
+};
+
+/* One socket read's worth of parsed input, handed from the I/O thread to
+ * the owner context. A read error or EOF ends the stream.
+ */
+typedef struct {
+  guint generation;
+  ZcInCounters in;
+  GPtrArray *views;      /* ZcIrcMessageView* */
+  GPtrArray *raw_lines;  /* gchar*, parallel to views; NULL if unused */
+  guint next;            /* owner: views delivered so far */
+  gsize bytes;           /* input consumed, counted in io_backlog */
+  gboolean closed;
+  gint error_code;
+  gchar *error_message;
+} ZcIoBatch;
 
 struct _ZcClient {
   GObject parent_instance;
@@ -9,29 +115,291 @@ struct _ZcClient {
   gchar *user;
   gchar *realname;
 
-  GSocketClient *sock_client;
-  GSocketConnection *connection;
-  GDataInputStream *din;
+  GSocketClient *sock_client;   /* may be shared between clients */
+  GTlsDatabase *tls_database;   /* NULL: system default */
+  gboolean tls_session_cache;
+  GIOStream *connection;        /* socket connection, or TLS on top of it */
+  GInputStream *in;
   GOutputStream *out;
   GCancellable *cancellable;
 
+  /* Signals are emitted on the context the client was created on. With
+   * zc_client_set_io_thread() the read loop runs on io_ctx instead, and
+   * parsed batches come back through the ring. Everything from rd_in down
+   * to rbuf_discarding belongs to the context running the read loop.
+   */
+  GMainContext *owner_ctx;
+  GThread *owner_thread; /* created us; sends from any other thread are queued */
+  GMainContext *io_ctx;
+  GMainLoop *io_loop;
+  GThread *io_thread;
+  ZcSpscRing *io_ring;
+  ZcIoBatch *io_batch;   /* being filled by the I/O thread */
+  gint io_dispatch_pending;
+  /* Ring full: batches wait in io_parked and no read is issued until the
+   * owner has made room and io_resume_cb runs. Both owned by the I/O thread,
+   * except io_reader_paused, which the owner clears (atomic). */
+  GQueue io_parked;
+  gboolean io_read_stopped;
+  gint io_reader_paused;
+  gint io_backlog;         /* bytes published and not yet delivered (atomic) */
+  ZcIoBatch *io_current;   /* owner: batch cut short by the ingest budget */
+
+  GInputStream *rd_in;
+  GCancellable *rd_cancellable;
+
+  /* Read buffer: reused across reads. Complete lines are consumed in place
+   * and only the partial tail is moved back to the front.
+   */
+  gchar *rbuf;
+  gsize rbuf_cap;
+  gsize rbuf_len;
+  gsize rbuf_scanned;  /* bytes of the tail already known to hold no '\n' */
+  gsize max_line;
+  gboolean rbuf_discarding; /* dropping an over-long line until its '\n' */
+  guint read_generation;
+
+  /* Lines that aren't UTF-8 are decoded from the fallback charset into
+   * in_transcoded. The decoder is picked from charset at connect and only
+   * read by the read loop after that.
+   */
+  gchar *charset;
+  ZcFallbackCharset in_fallback;
+  GIConv in_iconv;
+  GString *in_transcoded;
+
+  /* Views parsed from the current read chunk, for "irc-messages". */
+  GPtrArray *batch;
+
+  /* Ingest slicing: with a budget, a read's lines are handled in slices
+   * of at most ingest_budget_us, each run from an idle source below the
+   * redraw priority. No new read is issued until the buffer is drained,
+   * so a consumer that falls behind pushes back on the socket.
+   */
+  guint ingest_budget_us;
+  guint ingest_source;
+  gint64 ingest_paused_at;
+  ZcIngestStats ingest_stats;
+  gint io_stalls;        /* reads paused on a full ring (atomic) */
+
+  /* Outbound queue: lines are appended (with CRLF) to wq_pending and the
+   * whole buffer is handed to one async writev whenever no write is in
+   * flight, so a burst of sends drains in as few syscalls as possible.
+   */
+  GByteArray *wq_pending;
+  GByteArray *wq_urgent; /* keepalive replies, written ahead of wq_pending */
+  guint64 wq_lines_out;  /* totals, for zc_client_get_stats() */
+  guint64 wq_bytes_out;
+  guint64 wq_pongs_out;
+  guint wq_pending_lines;
+  guint wq_urgent_lines;
+  guint wq_inflight_lines;
+  gsize wq_inflight_bytes;
+  gboolean wq_writing;
+  gboolean wq_corked;    /* collecting a burst; write_queue_uncork() sends it */
+  gint wq_kick_pending;  /* owner -> I/O thread kick scheduled (atomic) */
+
+  /* Lines sent from threads other than the owner's, drained on owner_ctx.
+   * Only the thread that finds the queue empty schedules a drain. */
+  ZcMpscQueue submit_queue;
+  gint linked; /* atomic: out is set; lets any thread reject sends early */
+  gint quitting; /* atomic: a QUIT went out, so the next drop is ours */
+  gint close_when_drained; /* atomic: zc_client_quit_and_close() is waiting */
+  guint close_source;      /* its deadline */
+
+  /* Flood control: lanes are drained into wq_pending in priority order as
+   * the token bucket allows. KEEPALIVE bypasses the bucket.
+   */
+  GQueue lanes[ZC_SEND_PRIORITY_BULK + 1];
+  gdouble tokens;
+  gint64 tokens_at;
+  guint flood_burst;
+  guint flood_refill_ms;
+  guint flood_source;
+  ZcSendStats send_stats;
+
+  /* Reconnect: the last target, the channels we are in (casefolded name ->
+   * name as joined) and the backoff state while the link is down.
+   */
+  gchar *host;
+  guint16 port;
+  gboolean use_tls;
+  GHashTable *channels;
+  ZcMembers *members;  /* who is on the channels we are in */
+  gboolean reconnect_enabled;
+  ZcReconnectPolicy reconnect;
+  guint reconnect_attempt;
+  guint reconnect_source;
+  gboolean reconnect_pending;
+  gboolean resuming;
+  gint64 dropped_at;
+  ZcReconnectStats reconnect_stats;
+  gulong netmon_handler;
+
+  /* IRCv3 capability negotiation (CAP LS 302). */
+  gchar **caps_wanted;
+  GHashTable *caps_available;  /* name -> value ("" if none), from LS/NEW */
+  GHashTable *caps_enabled;    /* name set */
+  GHashTable *caps_pending;    /* name set: in a REQ not yet answered */
+  GHashTable *caps_refused;    /* name set: NAK'd on this connection */
+  GQueue caps_req;             /* ZcCapReq*, oldest first */
+  GString *caps_ls;            /* LS reply so far, for the cache */
+  gboolean caps_ls_done;
+  gboolean caps_negotiating;   /* CAP END still owed */
+
+  /* SASL PLAIN; CAP END waits while an exchange is running. */
+  gchar *sasl_account;
+  gchar *sasl_password;
+  gboolean sasl_started;       /* AUTHENTICATE PLAIN sent */
+  gboolean sasl_active;        /* ... and no 90x result yet */
+
+  /* Registration: channels joined right after 001, and when each phase of
+   * this connection's registration was reached. */
+  gchar **auto_join;
+  GHashTable *auto_join_pending; /* casefolded names not yet JOINed */
+  gint64 reg_started;
+  ZcRegistrationTimings reg_timings;
+
+  /* Text jobs from zc_client_send_text(). The head job feeds the user lane
+   * whenever every lane is empty, so typed lines slip in between. */
+  GQueue send_jobs;
+  guint send_job_next;
+  gboolean send_jobs_pumping;
+  gchar *self_userhost;        /* "user@host" the server shows for us */
+
+  /* Lag meter: our own "PING :zc-<us>" probes, matched on the PONG. RTT
+   * and its variation are smoothed as in TCP (RFC 6298). */
+  guint lag_interval_ms;       /* 0: no probes */
+  guint lag_warn_ms;
+  guint lag_dead_ms;
+  guint lag_source;            /* 1 s tick while registered */
+  gint64 lag_probe_sent;       /* outstanding probe, 0 if none */
+  gint64 lag_last_probe;
+  guint lag_ms;                /* "lag" property */
+  ZcLinkHealth health;
+  ZcLagStats lag_stats;
+
+  /* Performance counters (see zc_client_get_stats()). */
+  ZcInCounters in_counters;
+  guint64 dispatches;
+  guint64 dispatch_us_total;
+  guint64 dispatch_us_max;
+  guint64 ping_timeouts;
+
+  gchar *remote_address;
+  ZcConnectTimings timings;
+  gint64 connect_started;
+
   gboolean connected;
   GMutex write_lock;
 };
 
 G_DEFINE_TYPE(ZcClient, zc_client, G_TYPE_OBJECT)
 
+G_DEFINE_ENUM_TYPE(ZcLinkHealth, zc_link_health,
+  G_DEFINE_ENUM_VALUE(ZC_LINK_HEALTH_UNKNOWN, "unknown"),
+  G_DEFINE_ENUM_VALUE(ZC_LINK_HEALTH_OK, "ok"),
+  G_DEFINE_ENUM_VALUE(ZC_LINK_HEALTH_LAGGING, "lagging"),
+  G_DEFINE_ENUM_VALUE(ZC_LINK_HEALTH_DEAD, "dead"))
+
 enum {
   SIG_CONNECTED,
   SIG_DISCONNECTED,
   SIG_RAW_LINE,
   SIG_IRC_MESSAGE,
+  SIG_IRC_MESSAGES,
+  SIG_BATCH_END,
+  SIG_RECONNECTING,
+  SIG_RECONNECT_FAILED,
+  SIG_CAP_CHANGED,
+  SIG_REGISTRATION_PHASE,
+  SIG_HEALTH_CHANGED,
+  SIG_SEND_JOB_PROGRESS,
+  SIG_SEND_JOB_FINISHED,
   N_SIGNALS
 };
 
 static guint signals[N_SIGNALS] = {0};
 
+enum {
+  PROP_0,
+  PROP_LAG,
+  PROP_HEALTH,
+  N_PROPS
+};
+
+static GParamSpec *props[N_PROPS] = {NULL};
+
 static void zc_client_start_read_loop(ZcClient *self);
+static void flood_reset(ZcClient *self);
+static void submit_discard(ZcClient *self);
+static gboolean write_line_len(ZcClient *self, const gchar *line, gsize len, ZcSendPriority priority, GError **error);
+static void io_thread_stop(ZcClient *self);
+static void io_batch_free(ZcIoBatch *b);
+static void reconnect_cancel(ZcClient *self);
+static void track_view(ZcClient *self, const ZcIrcMessageView *view);
+static void caps_reset(ZcClient *self);
+static void caps_begin(ZcClient *self);
+static void caps_handle(ZcClient *self, const ZcIrcMessageView *view);
+static void caps_maybe_end(ZcClient *self);
+static void sasl_handle(ZcClient *self, const ZcIrcMessageView *view);
+static void registration_phase(ZcClient *self, ZcRegistrationPhase phase);
+static void lag_start(ZcClient *self);
+static void lag_stop(ZcClient *self);
+static void lag_handle_pong(ZcClient *self, const ZcIrcMessageView *view);
+static void ingest_cancel(ZcClient *self);
+static void close_cancel(ZcClient *self);
+static void send_jobs_pump(ZcClient *self);
+static void send_jobs_reset(ZcClient *self, gboolean emit);
+static void ingest_record(ZcClient *self, gint64 us, gboolean cut, gsize backlog);
+static gboolean process_buffered_lines(ZcClient *self);
+
+/* Timers and idles live on owner_ctx, not on whatever context is the
+ * global default. Ids are only unique per context, so they are removed
+ * through it too. */
+static guint
+owner_source_add(ZcClient *self, GSource *src, gint priority, GSourceFunc func) {
+  g_source_set_priority(src, priority);
+  g_source_set_callback(src, func, self, NULL);
+  const guint id = g_source_attach(src, self->owner_ctx);
+  g_source_unref(src);
+  return id;
+}
+
+static void
+owner_source_remove(ZcClient *self, guint id) {
+  GSource *src = g_main_context_find_source_by_id(self->owner_ctx, id);
+  if (src) g_source_destroy(src);
+}
+
+/* Requested when the server offers them unless zc_client_set_wanted_caps()
+ * says otherwise. */
+static const gchar *const default_caps[] = {
+  "account-notify",
+  "account-tag",
+  "away-notify",
+  "cap-notify",
+  "chghost",
+  "echo-message",
+  "extended-join",
+  "multi-prefix",
+  "server-time",
+  "userhost-in-names",
+  NULL
+};
+
+/* A CAP REQ awaiting its ACK/NAK; the server answers them in order. */
+typedef struct {
+  gchar **names;
+  gboolean from_cache;
+} ZcCapReq;
+
+static void
+queued_line_free(ZcQueuedLine *q) {
+  g_free(q->line);
+  g_free(q->target);
+  g_free(q);
+}
 
 static void
 zc_client_dispose(GObject *object) {
@@ -42,19 +410,59 @@ zc_client_dispose(GObject *object) {
     g_clear_object(&self->cancellable);
   }
 
-  if (self->connection) {
-    GIOStream *s = G_IO_STREAM(self->connection);
-    g_io_stream_close(s, NULL, NULL);
-  }
+  /* Reads and writes hold a reference, so none is in flight here and the
+   * stream can be closed from this thread. */
+  if (self->connection) g_io_stream_close(self->connection, NULL, NULL);
 
-  g_clear_object(&self->din);
+  g_clear_object(&self->in);
+  g_atomic_int_set(&self->linked, 0);
+  g_mutex_lock(&self->write_lock);
   g_clear_object(&self->out);
+  g_mutex_unlock(&self->write_lock);
   g_clear_object(&self->connection);
   g_clear_object(&self->sock_client);
+  g_clear_object(&self->tls_database);
+  flood_reset(self);
+  send_jobs_reset(self, FALSE);
+  submit_discard(self);
+
+  /* No read can be pending here (each holds a ref), so the reader state is
+   * ours to drop whichever thread we are on. */
+  g_clear_object(&self->rd_in);
+  g_clear_object(&self->rd_cancellable);
+  io_thread_stop(self);
+
+  reconnect_cancel(self);
+  ingest_cancel(self);
+  close_cancel(self);
+  if (self->lag_source) {
+    owner_source_remove(self, self->lag_source);
+    self->lag_source = 0;
+  }
+  if (self->netmon_handler) {
+    g_signal_handler_disconnect(g_network_monitor_get_default(), self->netmon_handler);
+    self->netmon_handler = 0;
+  }
 
   G_OBJECT_CLASS(zc_client_parent_class)->dispose(object);
 }
 
+static void
+zc_client_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec) {
+  ZcClient *self = ZC_CLIENT(object);
+  switch (prop_id) {
+    case PROP_LAG:
+      g_value_set_uint(value, self->lag_ms);
+      break;
+    case PROP_HEALTH:
+      g_value_set_enum(value, self->health);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
 static void
 zc_client_finalize(GObject *object) {
   ZcClient *self = ZC_CLIENT(object);
@@ -62,6 +470,38 @@ zc_client_finalize(GObject *object) {
   g_free(self->nick);
   g_free(self->user);
   g_free(self->realname);
+  g_free(self->host);
+  g_free(self->remote_address);
+  caps_reset(self);
+  g_strfreev(self->caps_wanted);
+  g_free(self->sasl_account);
+  if (self->sasl_password) memset(self->sasl_password, 0, strlen(self->sasl_password));
+  g_free(self->sasl_password);
+  g_strfreev(self->auto_join);
+  g_free(self->self_userhost);
+  g_hash_table_unref(self->auto_join_pending);
+  g_hash_table_unref(self->caps_available);
+  g_hash_table_unref(self->caps_enabled);
+  g_hash_table_unref(self->caps_pending);
+  g_hash_table_unref(self->caps_refused);
+  g_string_free(self->caps_ls, TRUE);
+  g_hash_table_unref(self->channels);
+  zc_members_free(self->members);
+  g_free(self->rbuf);
+  g_free(self->charset);
+  if (self->in_iconv != (GIConv)-1) g_iconv_close(self->in_iconv);
+  g_string_free(self->in_transcoded, TRUE);
+  g_ptr_array_unref(self->batch);
+  if (self->io_batch) io_batch_free(self->io_batch);
+  g_queue_clear_full(&self->io_parked, (GDestroyNotify)io_batch_free);
+  if (self->io_current) io_batch_free(self->io_current);
+  zc_spsc_ring_free(self->io_ring, (GDestroyNotify)io_batch_free);
+  g_main_context_unref(self->owner_ctx);
+  g_byte_array_unref(self->wq_pending);
+  g_byte_array_unref(self->wq_urgent);
+  for (guint i = 0; i < G_N_ELEMENTS(self->lanes); i++) {
+    g_queue_clear_full(&self->lanes[i], (GDestroyNotify)queued_line_free);
+  }
   g_mutex_clear(&self->write_lock);
 
   G_OBJECT_CLASS(zc_client_parent_class)->finalize(object);
@@ -72,6 +512,21 @@ zc_client_class_init(ZcClientClass *klass) {
   GObjectClass *object_class = G_OBJECT_CLASS(klass);
   object_class->dispose = zc_client_dispose;
   object_class->finalize = zc_client_finalize;
+  object_class->get_property = zc_client_get_property;
+
+  /* Round-trip time in ms: the smoothed RTT, or the age of an unanswered
+   * probe once that is larger. 0 until the first PONG. */
+  props[PROP_LAG] = g_param_spec_uint(
+    "lag", "Lag", "Smoothed round-trip time to the server in ms",
+    0, G_MAXUINT, 0,
+    G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+  );
+  props[PROP_HEALTH] = g_param_spec_enum(
+    "health", "Health", "Health of the connection",
+    ZC_TYPE_LINK_HEALTH, ZC_LINK_HEALTH_UNKNOWN,
+    G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS
+  );
+  g_object_class_install_properties(object_class, N_PROPS, props);
 
   signals[SIG_CONNECTED] = g_signal_new(
     "connected",
@@ -106,7 +561,7 @@ zc_client_class_init(ZcClientClass *klass) {
     NULL,
     G_TYPE_NONE,
     1,
-    G_TYPE_STRING
+    G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE
   );
 
   signals[SIG_IRC_MESSAGE] = g_signal_new(
@@ -118,14 +573,150 @@ zc_client_class_init(ZcClientClass *klass) {
     NULL,
     G_TYPE_NONE,
     1,
-    ZC_TYPE_IRC_MESSAGE
+    ZC_TYPE_IRC_MESSAGE | G_SIGNAL_TYPE_STATIC_SCOPE
+  );
+
+  signals[SIG_IRC_MESSAGES] = g_signal_new(
+    "irc-messages",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    1,
+    G_TYPE_PTR_ARRAY | G_SIGNAL_TYPE_STATIC_SCOPE
+  );
+
+  signals[SIG_BATCH_END] = g_signal_new(
+    "batch-end",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    0
+  );
+
+  signals[SIG_RECONNECTING] = g_signal_new(
+    "reconnecting",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    2,
+    G_TYPE_UINT,
+    G_TYPE_UINT
+  );
+
+  signals[SIG_RECONNECT_FAILED] = g_signal_new(
+    "reconnect-failed",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    1,
+    G_TYPE_UINT
+  );
+
+  signals[SIG_CAP_CHANGED] = g_signal_new(
+    "cap-changed",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    2,
+    G_TYPE_STRING,
+    G_TYPE_BOOLEAN
+  );
+
+  signals[SIG_REGISTRATION_PHASE] = g_signal_new(
+    "registration-phase",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    2,
+    G_TYPE_UINT,
+    G_TYPE_INT64
+  );
+
+  signals[SIG_HEALTH_CHANGED] = g_signal_new(
+    "health-changed",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    1,
+    ZC_TYPE_LINK_HEALTH
+  );
+
+  signals[SIG_SEND_JOB_PROGRESS] = g_signal_new(
+    "send-job-progress",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    4,
+    G_TYPE_UINT, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_UINT
+  );
+
+  signals[SIG_SEND_JOB_FINISHED] = g_signal_new(
+    "send-job-finished",
+    G_TYPE_FROM_CLASS(klass),
+    G_SIGNAL_RUN_LAST,
+    0,
+    NULL, NULL,
+    NULL,
+    G_TYPE_NONE,
+    3,
+    G_TYPE_UINT, G_TYPE_STRING, G_TYPE_BOOLEAN
   );
 }
 
 static void
 zc_client_init(ZcClient *self) {
   self->sock_client = g_socket_client_new();
+  self->tls_session_cache = TRUE;
   self->connected = FALSE;
+  self->max_line = ZC_DEFAULT_MAX_LINE;
+  self->in_iconv = (GIConv)-1;
+  self->in_transcoded = g_string_new(NULL);
+  self->batch = g_ptr_array_new_with_free_func((GDestroyNotify)zc_irc_message_view_free);
+  self->wq_pending = g_byte_array_new();
+  self->wq_urgent = g_byte_array_new();
+  self->owner_ctx = g_main_context_ref_thread_default();
+  self->owner_thread = g_thread_self();
+  for (guint i = 0; i < G_N_ELEMENTS(self->lanes); i++) g_queue_init(&self->lanes[i]);
+  self->flood_burst = ZC_DEFAULT_FLOOD_BURST;
+  self->flood_refill_ms = ZC_DEFAULT_FLOOD_REFILL_MS;
+  self->tokens = ZC_DEFAULT_FLOOD_BURST;
+  self->channels = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  self->members = zc_members_new();
+  self->caps_wanted = g_strdupv((gchar **)default_caps);
+  self->caps_available = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  self->caps_enabled = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  self->caps_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  self->caps_refused = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  g_queue_init(&self->caps_req);
+  self->caps_ls = g_string_new(NULL);
+  self->auto_join_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  self->lag_interval_ms = ZC_DEFAULT_LAG_INTERVAL_MS;
+  self->lag_warn_ms = ZC_DEFAULT_LAG_WARN_MS;
+  self->lag_dead_ms = ZC_DEFAULT_LAG_DEAD_MS;
   g_mutex_init(&self->write_lock);
 }
 
@@ -152,229 +743,2977 @@ zc_client_get_nick(ZcClient *self) {
   return self->nick;
 }
 
-gboolean
-zc_client_is_connected(ZcClient *self) {
-  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
-  return self->connected;
+void
+zc_client_set_max_line_length(ZcClient *self, gsize max_len) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(max_len >= 512);
+  /* Takes effect on the next connection; the buffer is sized at connect. */
+  self->max_line = max_len;
 }
 
-static void
-emit_disconnected(ZcClient *self, gint code, const gchar *message) {
-  self->connected = FALSE;
-  g_signal_emit(self, signals[SIG_DISCONNECTED], 0, code, message ? message : "");
+gsize
+zc_client_get_max_line_length(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), 0);
+  return self->max_line;
 }
 
-static gboolean
-write_line(ZcClient *self, const gchar *line, GError **error) {
-  g_return_val_if_fail(line != NULL, FALSE);
-  if (!self->out) {
-    g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED, "Not connected");
-    return FALSE;
+static ZcFallbackCharset
+fallback_charset_kind(const gchar *charset) {
+  if (!charset || !*charset) return ZC_FALLBACK_REPLACE;
+  if (!g_ascii_strcasecmp(charset, "ISO-8859-1") || !g_ascii_strcasecmp(charset, "LATIN1")) {
+    return ZC_FALLBACK_LATIN1;
   }
-
-  gchar *payload = g_strdup_printf("%s\r\n", line);
-
-  g_mutex_lock(&self->write_lock);
-  gboolean ok = g_output_stream_write_all(self->out, payload, strlen(payload), NULL, self->cancellable, error);
-  if (ok) ok = g_output_stream_flush(self->out, self->cancellable, error);
-  g_mutex_unlock(&self->write_lock);
-
-  g_free(payload);
-  return ok;
+  if (!g_ascii_strcasecmp(charset, "CP1252") || !g_ascii_strcasecmp(charset, "WINDOWS-1252")) {
+    return ZC_FALLBACK_CP1252;
+  }
+  return ZC_FALLBACK_ICONV;
 }
 
 gboolean
-zc_client_send_raw(ZcClient *self, const gchar *line, GError **error) {
+zc_client_set_fallback_charset(ZcClient *self, const gchar *charset) {
   g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
-  g_return_val_if_fail(line != NULL, FALSE);
-  return write_line(self, line, error);
+
+  if (fallback_charset_kind(charset) == ZC_FALLBACK_ICONV) {
+    GIConv cd = g_iconv_open("UTF-8", charset);
+    if (cd == (GIConv)-1) return FALSE;
+    g_iconv_close(cd);
+  }
+  g_free(self->charset);
+  self->charset = charset && *charset ? g_strdup(charset) : NULL;
+  return TRUE;
 }
 
-gboolean
-zc_client_login(ZcClient *self, GError **error) {
-  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
-  if (!self->nick || !self->user || !self->realname) {
-    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Identity not set");
-    return FALSE;
+const gchar *
+zc_client_get_fallback_charset(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), NULL);
+  return self->charset;
+}
+
+/* Owner context, before the read loop starts. */
+static void
+ingest_decoder_setup(ZcClient *self) {
+  if (self->in_iconv != (GIConv)-1) {
+    g_iconv_close(self->in_iconv);
+    self->in_iconv = (GIConv)-1;
   }
+  self->in_fallback = fallback_charset_kind(self->charset);
+  if (self->in_fallback == ZC_FALLBACK_ICONV) {
+    self->in_iconv = g_iconv_open("UTF-8", self->charset);
+    if (self->in_iconv == (GIConv)-1) self->in_fallback = ZC_FALLBACK_REPLACE;
+  }
+}
 
-  gchar *nick_line = g_strdup_printf("NICK %s", self->nick);
-  gboolean ok = write_line(self, nick_line, error);
-  g_free(nick_line);
-  if (!ok) return FALSE;
+void
+zc_client_set_socket_client(ZcClient *self, GSocketClient *sock_client) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(G_IS_SOCKET_CLIENT(sock_client));
+  g_set_object(&self->sock_client, sock_client);
+}
 
-  gchar *user_line = g_strdup_printf("USER %s 0 * :%s", self->user, self->realname);
-  ok = write_line(self, user_line, error);
-  g_free(user_line);
-  return ok;
+void
+zc_client_set_tls_database(ZcClient *self, GTlsDatabase *database) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(database == NULL || G_IS_TLS_DATABASE(database));
+  g_set_object(&self->tls_database, database);
 }
 
-gboolean
-zc_client_join(ZcClient *self, const gchar *channel, GError **error) {
-  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
-  g_return_val_if_fail(channel != NULL, FALSE);
-  gchar *line = g_strdup_printf("JOIN %s", channel);
-  gboolean ok = write_line(self, line, error);
-  g_free(line);
-  return ok;
+void
+zc_client_set_tls_session_cache(ZcClient *self, gboolean enable) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  self->tls_session_cache = enable;
 }
 
 gboolean
-zc_client_privmsg(ZcClient *self, const gchar *target, const gchar *text, GError **error) {
+zc_client_is_connected(ZcClient *self) {
   g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
-  g_return_val_if_fail(target != NULL, FALSE);
-  g_return_val_if_fail(text != NULL, FALSE);
-  gchar *line = g_strdup_printf("PRIVMSG %s :%s", target, text);
-  gboolean ok = write_line(self, line, error);
-  g_free(line);
-  return ok;
+  return self->connected;
 }
 
-gboolean
-zc_client_quit(ZcClient *self, const gchar *message, GError **error) {
-  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
-  const gchar *msg = message ? message : "Client exiting";
-  gchar *line = g_strdup_printf("QUIT :%s", msg);
-  gboolean ok = write_line(self, line, error);
-  g_free(line);
-  return ok;
+/* Stop waiting for a zc_client_quit_and_close() drain. */
+static void
+close_cancel(ZcClient *self) {
+  g_atomic_int_set(&self->close_when_drained, 0);
+  if (self->close_source) {
+    owner_source_remove(self, self->close_source);
+    self->close_source = 0;
+  }
 }
 
-void
-zc_client_disconnect(ZcClient *self) {
-  g_return_if_fail(ZC_IS_CLIENT(self));
+static void
+emit_disconnected(ZcClient *self, gint code, const gchar *message) {
+  close_cancel(self);
+  self->connected = FALSE;
+  caps_reset(self);
+  lag_stop(self);
+  send_jobs_reset(self, TRUE);
+  zc_members_reset(self->members, self->nick);
+  g_signal_emit(self, signals[SIG_DISCONNECTED], 0, code, message ? message : "");
+}
 
-  if (self->cancellable) g_cancellable_cancel(self->cancellable);
+static void reconnect_schedule(ZcClient *self);
 
-  if (self->connection) {
-    GIOStream *s = G_IO_STREAM(self->connection);
-    g_io_stream_close(s, NULL, NULL);
+/* The link went away without zc_client_disconnect(): report it, then retry
+ * if the policy allows. A server closing the link after our QUIT (usually
+ * with "ERROR :Closing Link") is the answer to it, not a drop. Owner
+ * context only.
+ */
+static void
+connection_lost(ZcClient *self, gint code, const gchar *message) {
+  if (!self->connected) return;
+
+  self->resuming = FALSE;
+  if (self->reconnect_enabled && self->host && !g_atomic_int_get(&self->quitting)) {
+    /* Recovery time runs from the first drop, across failed attempts. */
+    if (!self->dropped_at) self->dropped_at = g_get_monotonic_time();
+    self->reconnect_pending = TRUE;
   }
+  emit_disconnected(self, code, message);
 
-  g_clear_object(&self->din);
-  g_clear_object(&self->out);
-  g_clear_object(&self->connection);
-
-  if (self->connected) emit_disconnected(self, 0, "Disconnected");
+  /* A "disconnected" handler may have disconnected or reconnected itself. */
+  if (self->reconnect_pending && !self->reconnect_source) reconnect_schedule(self);
 }
 
-static void
-on_read_line(GObject *source, GAsyncResult *res, gpointer user_data) {
-  ZcClient *self = ZC_CLIENT(user_data);
-  GDataInputStream *din = G_DATA_INPUT_STREAM(source);
-  GError *error = NULL;
+static void io_batch_publish(ZcClient *self);
 
-  gsize length = 0;
-  gchar *line = g_data_input_stream_read_line_finish(din, res, &length, &error);
+static gboolean
+on_io_thread(ZcClient *self) {
+  return self->io_thread && g_thread_self() == self->io_thread;
+}
 
-  if (error) {
-    /* Normal during disconnect/shutdown. Don’t spam signals or explode. */
-    if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED) ||
-        g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CLOSED)) {
-      g_clear_error(&error);
-      g_object_unref(self);
-      return;
-    }
+static gboolean
+client_release_cb(gpointer data) {
+  g_object_unref(data);
+  return G_SOURCE_REMOVE;
+}
 
-    emit_disconnected(self, error->code, error->message);
-    g_clear_error(&error);
+/* Drop a reference held by work on the I/O thread. It may be the last one,
+ * and dispose must not run there: it joins that thread and touches
+ * owner_ctx sources, so the unref is sent back to the owner. */
+static void
+client_release(gpointer data) {
+  ZcClient *self = data;
+  if (!on_io_thread(self)) {
     g_object_unref(self);
     return;
   }
+  GSource *src = g_idle_source_new();
+  g_source_set_callback(src, client_release_cb, self, NULL);
+  g_source_attach(src, self->owner_ctx);
+  g_source_unref(src);
+}
 
-  if (!line) {
-    emit_disconnected(self, 0, "EOF");
-    g_object_unref(self);
-    return;
-  }
+static gboolean
+io_close_cb(gpointer data) {
+  /* Fails while a cancelled read or write is still completing; the stream
+   * then closes itself when that operation drops the last reference. */
+  g_io_stream_close(G_IO_STREAM(data), NULL, NULL);
+  return G_SOURCE_REMOVE;
+}
 
-  /* Strip CR if present */
-  if (length > 0 && line[length - 1] == '\r') {
-    line[length - 1] = '\0';
+/* Read/write failures. The I/O thread can't emit signals itself, so it
+ * closes its batch with the error and lets the owner context report it.
+ */
+static void
+report_stream_error(ZcClient *self, gint code, const gchar *message) {
+  if (on_io_thread(self)) {
+    self->io_batch->closed = TRUE;
+    self->io_batch->error_code = code;
+    self->io_batch->error_message = g_strdup(message);
+    io_batch_publish(self);
+    return;
   }
+  connection_lost(self, code, message);
+}
 
-  g_signal_emit(self, signals[SIG_RAW_LINE], 0, line);
-
-  ZcIrcMessage *msg = zc_irc_message_parse_line(line);
-  if (msg) {
-    g_signal_emit(self, signals[SIG_IRC_MESSAGE], 0, msg);
-
-    /* Auto PING/PONG */
-    if (g_strcmp0(msg->command, "PING") == 0) {
-      const gchar *pong = msg->trailing ? msg->trailing : zc_irc_message_param(msg, 0);
-      if (pong) {
-        gchar *pong_line = g_strdup_printf("PONG :%s", pong);
-        (void)write_line(self, pong_line, NULL);
-        g_free(pong_line);
-      }
-    }
+/* One async writev in flight. Owns the bytes it writes so a disconnect can
+ * reset the queue while the cancelled operation is still completing.
+ */
+typedef struct {
+  ZcClient *self;
+  GOutputStream *out;
+  GBytes *bytes[2];
+  GOutputVector vec[2];
+  guint n_vec;
+  guint n_lines;
+} ZcWriteOp;
 
-    zc_irc_message_free(msg);
-  }
+static void write_queue_kick(ZcClient *self);
 
-  g_free(line);
+static void
+write_op_free(ZcWriteOp *op) {
+  g_object_unref(op->out);
+  for (guint i = 0; i < op->n_vec; i++) g_bytes_unref(op->bytes[i]);
+  client_release(op->self);
+  g_free(op);
+}
 
-  /* Only continue if we’re still connected and this read belongs to the current stream. */
-  if (self->connected && self->din == din &&
-      self->cancellable && !g_cancellable_is_cancelled(self->cancellable)) {
-    zc_client_start_read_loop(self);
-  }
+static void
+write_queue_reset(ZcClient *self) {
+  g_mutex_lock(&self->write_lock);
+  g_byte_array_set_size(self->wq_pending, 0);
+  g_byte_array_set_size(self->wq_urgent, 0);
+  self->wq_pending_lines = 0;
+  self->wq_urgent_lines = 0;
+  self->wq_inflight_lines = 0;
+  self->wq_inflight_bytes = 0;
+  self->wq_writing = FALSE;
+  self->wq_corked = FALSE;
+  g_mutex_unlock(&self->write_lock);
+}
 
-  g_object_unref(self);
+static gboolean
+close_drained_cb(gpointer user_data) {
+  zc_client_disconnect(ZC_CLIENT(user_data));
+  return G_SOURCE_REMOVE;
 }
 
+/* After a write completes, on whichever thread runs the writes: once the
+ * QUIT and everything queued ahead of it are out, close on the owner. */
 static void
-zc_client_start_read_loop(ZcClient *self) {
-  if (!self->din) return;
-  /* Hold a ref to self for the lifetime of the async read. */
-  g_data_input_stream_read_line_async(
-    self->din,
-    G_PRIORITY_DEFAULT,
-    self->cancellable,
-    on_read_line,
-    g_object_ref(self)
-  );
+close_if_drained(ZcClient *self) {
+  g_mutex_lock(&self->write_lock);
+  const gboolean drained = !self->wq_writing && self->wq_urgent->len == 0 && self->wq_pending->len == 0;
+  g_mutex_unlock(&self->write_lock);
+  if (!drained || !g_atomic_int_compare_and_exchange(&self->close_when_drained, 1, 0)) return;
+
+  GSource *src = g_idle_source_new();
+  g_source_set_callback(src, close_drained_cb, g_object_ref(self), g_object_unref);
+  g_source_attach(src, self->owner_ctx);
+  g_source_unref(src);
 }
+
 static void
-on_connected(GObject *source, GAsyncResult *res, gpointer user_data) {
-  (void)source;
-  GTask *task = G_TASK(user_data);
-  ZcClient *self = ZC_CLIENT(g_task_get_source_object(task));
+on_write_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+  ZcWriteOp *op = user_data;
+  ZcClient *self = op->self;
   GError *error = NULL;
 
-  GSocketConnection *conn = g_socket_client_connect_to_host_finish(self->sock_client, res, &error);
-  if (!conn) {
-    g_task_return_error(task, error);
-    g_object_unref(task);
+  gboolean ok = g_output_stream_writev_all_finish(G_OUTPUT_STREAM(source), res, NULL, &error);
+
+  /* Stale write from a previous connection; the queue was already reset. */
+  g_mutex_lock(&self->write_lock);
+  const gboolean stale = self->out != op->out;
+  g_mutex_unlock(&self->write_lock);
+  if (stale) {
+    g_clear_error(&error);
+    write_op_free(op);
     return;
   }
 
-  self->connection = conn;
-  /* Disable 30s socket I/O timeout (it disconnects idle IRC sessions).
-   * Keep the connect timeout on the GSocketClient, but once connected,
-   * make the socket non-timeout and enable keepalive.
-   */
-  GSocket *sock = g_socket_connection_get_socket(conn);
-  if (sock) {
-    g_socket_set_timeout(sock, 0);
-    g_socket_set_keepalive(sock, TRUE);
+  if (!ok) {
+    const gboolean quiet =
+      g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED) ||
+      g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+    write_queue_reset(self);
+    if (!quiet) {
+      report_stream_error(self, error->code, error->message);
+      /* The read loop may be idle; hand the closed batch over now. */
+      if (on_io_thread(self)) io_batch_publish(self);
+    }
+    g_clear_error(&error);
+    write_op_free(op);
+    return;
+  }
+
+  g_mutex_lock(&self->write_lock);
+  self->wq_inflight_lines = 0;
+  self->wq_inflight_bytes = 0;
+  self->wq_writing = FALSE;
+  g_mutex_unlock(&self->write_lock);
+
+  /* Kick before letting go of op's reference: it may be the last. */
+  write_queue_kick(self);
+  if (g_atomic_int_get(&self->close_when_drained)) close_if_drained(self);
+  write_op_free(op);
+}
+
+static gboolean
+write_kick_cb(gpointer user_data) {
+  ZcClient *self = ZC_CLIENT(user_data);
+  g_atomic_int_set(&self->wq_kick_pending, 0);
+  write_queue_kick(self);
+  return G_SOURCE_REMOVE;
+}
+
+/* Hand @buf's contents to @op as its next vector and start a new buffer. */
+static void
+write_op_take(ZcWriteOp *op, GByteArray **buf) {
+  const guint i = op->n_vec++;
+  op->bytes[i] = g_byte_array_free_to_bytes(*buf);
+  op->vec[i].buffer = g_bytes_get_data(op->bytes[i], &op->vec[i].size);
+  *buf = g_byte_array_new();
+}
+
+/* Start draining the queue unless a write is already in flight; the
+ * completion handler calls back in to pick up whatever piled up meanwhile.
+ * Keepalive replies go first and are not held back by a cork.
+ *
+ * With an I/O thread every write is issued (and completes) there, so a
+ * stalled owner context cannot sit on a finished write and block the
+ * replies queued behind it.
+ */
+static void
+write_queue_kick(ZcClient *self) {
+  if (self->io_thread && !on_io_thread(self)) {
+    if (g_atomic_int_compare_and_exchange(&self->wq_kick_pending, 0, 1)) {
+      g_main_context_invoke_full(self->io_ctx, G_PRIORITY_HIGH, write_kick_cb,
+                                 g_object_ref(self), client_release);
+    }
+    return;
+  }
+
+  g_mutex_lock(&self->write_lock);
+  const gboolean urgent = self->wq_urgent->len > 0;
+  const gboolean pending = !self->wq_corked && self->wq_pending->len > 0;
+  if (self->wq_writing || !self->out || (!urgent && !pending)) {
+    g_mutex_unlock(&self->write_lock);
+    return;
+  }
+
+  ZcWriteOp *op = g_new0(ZcWriteOp, 1);
+  op->self = g_object_ref(self);
+  op->out = g_object_ref(self->out);
+  if (urgent) {
+    op->n_lines += self->wq_urgent_lines;
+    self->wq_urgent_lines = 0;
+    write_op_take(op, &self->wq_urgent);
+  }
+  if (pending) {
+    op->n_lines += self->wq_pending_lines;
+    self->wq_pending_lines = 0;
+    write_op_take(op, &self->wq_pending);
+  }
+
+  self->wq_inflight_lines = op->n_lines;
+  self->wq_inflight_bytes = 0;
+  for (guint i = 0; i < op->n_vec; i++) self->wq_inflight_bytes += op->vec[i].size;
+  self->wq_writing = TRUE;
+  g_mutex_unlock(&self->write_lock);
+
+  g_output_stream_writev_all_async(
+    op->out,
+    op->vec,
+    op->n_vec,
+    G_PRIORITY_DEFAULT,
+    on_io_thread(self) ? self->rd_cancellable : self->cancellable,
+    on_write_done,
+    op
+  );
+}
+
+/* Append one line (plus CRLF) to the write queue; the caller kicks it. */
+static void
+write_queue_append(ZcClient *self, const gchar *line, gsize len) {
+  g_mutex_lock(&self->write_lock);
+  g_byte_array_append(self->wq_pending, (const guint8 *)line, (guint)len);
+  g_byte_array_append(self->wq_pending, (const guint8 *)"\r\n", 2);
+  self->wq_pending_lines++;
+  self->wq_lines_out++;
+  self->wq_bytes_out += len + 2;
+  g_mutex_unlock(&self->write_lock);
+}
+
+/* A keepalive reply or a QUIT: skips the flood lanes and whatever user
+ * traffic is already queued, and goes out with the next writev. Safe from
+ * any thread that runs the writes (the reader or the owner).
+ */
+static void
+write_queue_urgent(ZcClient *self, const gchar *line, gsize len, gboolean pong) {
+  g_mutex_lock(&self->write_lock);
+  g_byte_array_append(self->wq_urgent, (const guint8 *)line, (guint)len);
+  g_byte_array_append(self->wq_urgent, (const guint8 *)"\r\n", 2);
+  self->wq_urgent_lines++;
+  self->wq_lines_out++;
+  self->wq_bytes_out += len + 2;
+  if (pong) self->wq_pongs_out++;
+  g_mutex_unlock(&self->write_lock);
+  write_queue_kick(self);
+}
+
+/* While corked, released lines pile up in wq_pending; uncorking hands the
+ * whole burst to a single writev.
+ */
+static void
+write_queue_cork(ZcClient *self) {
+  g_mutex_lock(&self->write_lock);
+  self->wq_corked = TRUE;
+  g_mutex_unlock(&self->write_lock);
+}
+
+static void
+write_queue_uncork(ZcClient *self) {
+  g_mutex_lock(&self->write_lock);
+  self->wq_corked = FALSE;
+  g_mutex_unlock(&self->write_lock);
+  write_queue_kick(self);
+}
+
+/* ---- Flood control -------------------------------------------------------
+ * A token bucket of flood_burst lines refilled at one line per
+ * flood_refill_ms. Lanes drain strictly in priority order; a timer wakes
+ * the pump when the next token is due.
+ */
+
+static void
+flood_reset(ZcClient *self) {
+  if (self->flood_source) {
+    owner_source_remove(self, self->flood_source);
+    self->flood_source = 0;
+  }
+  for (guint i = 0; i < G_N_ELEMENTS(self->lanes); i++) {
+    g_queue_clear_full(&self->lanes[i], (GDestroyNotify)queued_line_free);
+  }
+  self->send_stats.queued = 0;
+  self->tokens = self->flood_burst;
+  self->tokens_at = 0;
+}
+
+static void
+flood_refill(ZcClient *self) {
+  const gint64 now = g_get_monotonic_time();
+  if (self->flood_refill_ms == 0) {
+    self->tokens = self->flood_burst;
+  } else if (self->tokens_at != 0) {
+    const gdouble gained = (gdouble)(now - self->tokens_at) / (1000.0 * self->flood_refill_ms);
+    self->tokens = MIN((gdouble)self->flood_burst, self->tokens + gained);
+  }
+  self->tokens_at = now;
+}
+
+static gboolean flood_timeout_cb(gpointer user_data);
+
+static void
+flood_pump(ZcClient *self) {
+  gboolean released = FALSE;
+
+  flood_refill(self);
+
+  for (guint lane = 0; lane < G_N_ELEMENTS(self->lanes); lane++) {
+    GQueue *q = &self->lanes[lane];
+    while (!g_queue_is_empty(q)) {
+      const gboolean exempt = lane == ZC_SEND_PRIORITY_KEEPALIVE;
+      if (!exempt && self->tokens < 1.0) goto out;
+
+      ZcQueuedLine *ql = g_queue_pop_head(q);
+      write_queue_append(self, ql->line, strlen(ql->line));
+      if (!exempt) self->tokens -= 1.0;
+      self->send_stats.queued--;
+      self->send_stats.sent++;
+      if (ql->delayed) self->send_stats.delayed++;
+      queued_line_free(ql);
+      released = TRUE;
+    }
+  }
+
+out:
+  if (released) write_queue_kick(self);
+  if (self->send_stats.queued == 0) send_jobs_pump(self);
+
+  if (self->flood_source || self->send_stats.queued == 0) return;
+
+  /* Mark what is left as delayed and wake up when the next token is due. */
+  for (guint lane = 0; lane < G_N_ELEMENTS(self->lanes); lane++) {
+    for (GList *l = self->lanes[lane].head; l; l = l->next) ((ZcQueuedLine *)l->data)->delayed = TRUE;
+  }
+  const guint wait_ms = (guint)((1.0 - self->tokens) * self->flood_refill_ms) + 1;
+  self->flood_source = owner_source_add(self, g_timeout_source_new(wait_ms), G_PRIORITY_DEFAULT, flood_timeout_cb);
+}
+
+static gboolean
+flood_timeout_cb(gpointer user_data) {
+  ZcClient *self = ZC_CLIENT(user_data);
+  self->flood_source = 0;
+  flood_pump(self);
+  return G_SOURCE_REMOVE;
+}
+
+/* ---- Submissions from other threads -----------------------------------------
+ * Off the owner context a send only copies the line onto a lock-free queue.
+ * The owner drains it in one go, under cork, so a worker's burst still
+ * leaves in a single write once flood control lets it.
+ */
+
+static void
+submit_drain(ZcClient *self) {
+  ZcMpscNode *n = zc_mpsc_queue_take(&self->submit_queue);
+  if (!n) return;
+
+  write_queue_cork(self);
+  while (n) {
+    ZcSubmission *sub = (ZcSubmission *)n;
+    n = n->next;
+    if (self->out) {
+      (void)write_line_len(self, sub->line, sub->len, sub->priority, NULL);
+      self->send_stats.submitted++;
+    } else {
+      self->send_stats.dropped++;
+    }
+    g_free(sub);
+  }
+  write_queue_uncork(self);
+}
+
+static void
+submit_discard(ZcClient *self) {
+  ZcMpscNode *n = zc_mpsc_queue_take(&self->submit_queue);
+  while (n) {
+    ZcMpscNode *next = n->next;
+    g_free(n);
+    n = next;
+  }
+}
+
+static gboolean
+submit_drain_cb(gpointer data) {
+  submit_drain(ZC_CLIENT(data));
+  return G_SOURCE_REMOVE;
+}
+
+/* Any thread; the caller holds a reference and has checked the line. An
+ * idle source rather than g_main_context_invoke(), which could run the
+ * drain right here if the owner context happens to be free. */
+static void
+submit_line(ZcClient *self, const gchar *line, gsize len, ZcSendPriority priority) {
+  ZcSubmission *sub = g_malloc(sizeof(ZcSubmission) + len + 1);
+  sub->priority = priority;
+  sub->len = len;
+  memcpy(sub->line, line, len);
+  sub->line[len] = '\0';
+
+  if (zc_mpsc_queue_push(&self->submit_queue, &sub->node)) {
+    GSource *src = g_idle_source_new();
+    g_source_set_priority(src, G_PRIORITY_DEFAULT);
+    g_source_set_callback(src, submit_drain_cb, g_object_ref(self), g_object_unref);
+    g_source_attach(src, self->owner_ctx);
+    g_source_unref(src);
+  }
+}
+
+/* Checks any thread can make before a line is queued. A line that passes
+ * can still be dropped if the link goes down before the owner drains it. */
+static gboolean
+line_check(ZcClient *self, const gchar *line, gsize len, GError **error) {
+  if (!g_atomic_int_get(&self->linked)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED, "Not connected");
+    return FALSE;
+  }
+
+  gsize tags = 0;
+  if (len > 0 && line[0] == '@') {
+    const gchar *sp = memchr(line, ' ', len);
+    tags = sp ? (gsize)(sp - line) + 1 : len;
+  }
+  if (tags > ZC_IRC_CLIENT_TAGS_MAX || len - tags > ZC_IRC_LINE_MAX - 2) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE, "Line too long");
+    return FALSE;
+  }
+
+  if (len == 0 || memchr(line, '\r', len) || memchr(line, '\n', len) || memchr(line, '\0', len)) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Empty line or embedded CR, LF or NUL");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* "[@tags ]QUIT[ ...]", in any case. */
+static gboolean
+line_is_quit(const gchar *line, gsize len) {
+  const gchar *end = line + len;
+  if (*line == '@') {
+    line = memchr(line, ' ', len);
+    if (!line) return FALSE;
+    line++;
+  }
+  if (end - line < 4 || g_ascii_strncasecmp(line, "QUIT", 4) != 0) return FALSE;
+  return end - line == 4 || line[4] == ' ';
+}
+
+/* Queue one line for sending. Never blocks: write failures surface later
+ * through "disconnected". Lines that are empty, too long or hold CR/LF/NUL,
+ * and any line while not connected, are refused here on every thread;
+ * threads other than the owner then go through submit_line().
+ *
+ * When nothing is waiting for a token the line would be released at once,
+ * so it is copied straight into the write buffer; only lines that have to
+ * wait get a queue entry of their own.
+ */
+static gboolean
+write_line_len(ZcClient *self, const gchar *line, gsize len, ZcSendPriority priority, GError **error) {
+  if (!line_check(self, line, len, error)) return FALSE;
+  if (line_is_quit(line, len)) g_atomic_int_set(&self->quitting, 1);
+  if (G_UNLIKELY(g_thread_self() != self->owner_thread)) {
+    submit_line(self, line, len, priority);
+    return TRUE;
+  }
+
+  if (self->send_stats.queued == 0) {
+    const gboolean exempt = priority == ZC_SEND_PRIORITY_KEEPALIVE;
+    if (!exempt) flood_refill(self);
+    if (exempt || self->tokens >= 1.0) {
+      write_queue_append(self, line, len);
+      if (!exempt) self->tokens -= 1.0;
+      self->send_stats.sent++;
+      write_queue_kick(self);
+      return TRUE;
+    }
+  }
+
+  ZcQueuedLine *ql = g_new0(ZcQueuedLine, 1);
+  ql->line = g_strndup(line, len);
+  if (priority == ZC_SEND_PRIORITY_BULK) {
+    /* "[@tags ]<COMMAND> <target> ..." */
+    const gchar *cmd = ql->line;
+    if (*cmd == '@' && (cmd = strchr(cmd, ' '))) cmd++;
+    const gchar *sp = cmd ? strchr(cmd, ' ') : NULL;
+    if (sp) {
+      const gchar *t = sp + 1;
+      const gchar *e = strchr(t, ' ');
+      if (*t != ':') ql->target = g_ascii_strdown(t, e ? (gssize)(e - t) : -1);
+    }
+  }
+  g_queue_push_tail(&self->lanes[priority], ql);
+  self->send_stats.queued++;
+
+  flood_pump(self);
+  return TRUE;
+}
+
+static gboolean
+write_line(ZcClient *self, const gchar *line, ZcSendPriority priority, GError **error) {
+  g_return_val_if_fail(line != NULL, FALSE);
+  return write_line_len(self, line, strlen(line), priority, error);
+}
+
+static gboolean
+write_message(ZcClient *self, const ZcIrcMessageBuilder *msg, ZcSendPriority priority, GError **error) {
+  gsize len = 0;
+  const gchar *line = zc_irc_message_builder_get_line(msg, &len);
+  if (line) return write_line_len(self, line, len, priority, error);
+
+  if (zc_irc_message_builder_get_status(msg) == ZC_IRC_BUILD_TOO_LONG) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE, "Line too long");
+  } else {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Invalid line");
+  }
+  return FALSE;
+}
+
+/* QUIT ends the session, so like a PONG it is not paced: it jumps the flood
+ * lanes and the lines already waiting for the socket. Another thread can't
+ * reach the write queue directly; its QUIT is submitted unpaced instead.
+ */
+static gboolean
+write_quit(ZcClient *self, const ZcIrcMessageBuilder *msg, GError **error) {
+  gsize len = 0;
+  const gchar *line = zc_irc_message_builder_get_line(msg, &len);
+  if (!line) return write_message(self, msg, ZC_SEND_PRIORITY_KEEPALIVE, error);
+  if (!line_check(self, line, len, error)) return FALSE;
+
+  g_atomic_int_set(&self->quitting, 1);
+  if (G_UNLIKELY(g_thread_self() != self->owner_thread)) {
+    submit_line(self, line, len, ZC_SEND_PRIORITY_KEEPALIVE);
+    return TRUE;
+  }
+  write_queue_urgent(self, line, len, FALSE);
+  self->send_stats.sent++;
+  return TRUE;
+}
+
+void
+zc_client_set_flood_control(ZcClient *self, guint burst, guint refill_ms) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(burst >= 1);
+  self->flood_burst = burst;
+  self->flood_refill_ms = refill_ms;
+  self->tokens = MIN(self->tokens, (gdouble)burst);
+  if (self->flood_source) {
+    owner_source_remove(self, self->flood_source);
+    self->flood_source = 0;
+  }
+  flood_pump(self);
+}
+
+void
+zc_client_get_send_stats(ZcClient *self, ZcSendStats *stats) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(stats != NULL);
+  *stats = self->send_stats;
+}
+
+guint
+zc_client_cancel_queued(ZcClient *self, const gchar *target) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), 0);
+  g_return_val_if_fail(target != NULL, 0);
+
+  GQueue *q = &self->lanes[ZC_SEND_PRIORITY_BULK];
+  guint n = 0;
+  for (GList *l = q->head; l;) {
+    GList *next = l->next;
+    ZcQueuedLine *ql = l->data;
+    if (ql->target && g_ascii_strcasecmp(ql->target, target) == 0) {
+      queued_line_free(ql);
+      g_queue_delete_link(q, l);
+      n++;
+    }
+    l = next;
+  }
+  self->send_stats.queued -= n;
+  self->send_stats.cancelled += n;
+  if (n > 0 && self->send_stats.queued == 0) send_jobs_pump(self);
+  return n;
+}
+
+guint
+zc_client_get_write_queue_depth(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), 0);
+  g_mutex_lock(&self->write_lock);
+  const guint depth = self->wq_pending_lines + self->wq_urgent_lines + self->wq_inflight_lines;
+  g_mutex_unlock(&self->write_lock);
+  return depth;
+}
+
+gsize
+zc_client_get_write_queue_bytes(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), 0);
+  g_mutex_lock(&self->write_lock);
+  const gsize bytes = self->wq_pending->len + self->wq_urgent->len + self->wq_inflight_bytes;
+  g_mutex_unlock(&self->write_lock);
+  return bytes;
+}
+
+gboolean
+zc_client_send_raw(ZcClient *self, const gchar *line, ZcSendPriority priority, GError **error) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+  g_return_val_if_fail(line != NULL, FALSE);
+  g_return_val_if_fail(priority <= ZC_SEND_PRIORITY_BULK, FALSE);
+  return write_line(self, line, priority, error);
+}
+
+gboolean
+zc_client_send_message(ZcClient *self, const ZcIrcMessageBuilder *msg, ZcSendPriority priority, GError **error) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+  g_return_val_if_fail(msg != NULL, FALSE);
+  g_return_val_if_fail(priority <= ZC_SEND_PRIORITY_BULK, FALSE);
+  return write_message(self, msg, priority, error);
+}
+
+gboolean
+zc_client_login(ZcClient *self, GError **error) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+  if (!self->nick || !self->user || !self->realname) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Identity not set");
+    return FALSE;
+  }
+  if (!self->connected) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_CONNECTED, "Not connected");
+    return FALSE;
+  }
+
+  /* The whole burst (CAP LS, CAP REQ and AUTHENTICATE when the server is
+   * known, NICK, USER) leaves in one write. CAP LS goes first: a server
+   * that supports it holds registration until CAP END.
+   */
+  write_queue_cork(self);
+  caps_begin(self);
+
+  ZcIrcMessageBuilder b;
+  zc_irc_message_builder_init(&b);
+  zc_irc_message_builder_set_command(&b, "NICK");
+  zc_irc_message_builder_add_param(&b, self->nick, -1);
+  gboolean ok = write_message(self, &b, ZC_SEND_PRIORITY_KEEPALIVE, error);
+
+  if (ok) {
+    zc_irc_message_builder_init(&b);
+    zc_irc_message_builder_set_command(&b, "USER");
+    zc_irc_message_builder_add_param(&b, self->user, -1);
+    zc_irc_message_builder_add_param(&b, "0", 1);
+    zc_irc_message_builder_add_param(&b, "*", 1);
+    zc_irc_message_builder_add_trailing(&b, self->realname, -1);
+    ok = write_message(self, &b, ZC_SEND_PRIORITY_KEEPALIVE, error);
+  }
+  write_queue_uncork(self);
+
+  if (ok) registration_phase(self, ZC_REGISTRATION_PHASE_SENT);
+  return ok;
+}
+
+gboolean
+zc_client_join(ZcClient *self, const gchar *channel, GError **error) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+  g_return_val_if_fail(channel != NULL, FALSE);
+  /* "#chan" or "#a,#b key1,key2" */
+  const gchar *sp = strchr(channel, ' ');
+  ZcIrcMessageBuilder b;
+  zc_irc_message_builder_init(&b);
+  zc_irc_message_builder_set_command(&b, "JOIN");
+  zc_irc_message_builder_add_param(&b, channel, sp ? sp - channel : -1);
+  if (sp) {
+    while (*sp == ' ') sp++;
+    if (*sp) zc_irc_message_builder_add_param(&b, sp, -1);
+  }
+  return write_message(self, &b, ZC_SEND_PRIORITY_BULK, error);
+}
+
+gboolean
+zc_client_privmsg(ZcClient *self, const gchar *target, const gchar *text, GError **error) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+  g_return_val_if_fail(target != NULL, FALSE);
+  g_return_val_if_fail(text != NULL, FALSE);
+  ZcIrcMessageBuilder b;
+  zc_irc_message_builder_init(&b);
+  zc_irc_message_builder_set_command(&b, "PRIVMSG");
+  zc_irc_message_builder_add_param(&b, target, -1);
+  zc_irc_message_builder_add_trailing(&b, text, -1);
+  return write_message(self, &b, ZC_SEND_PRIORITY_USER, error);
+}
+
+gboolean
+zc_client_quit(ZcClient *self, const gchar *message, GError **error) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+  ZcIrcMessageBuilder b;
+  zc_irc_message_builder_init(&b);
+  zc_irc_message_builder_set_command(&b, "QUIT");
+  zc_irc_message_builder_add_trailing(&b, message ? message : "Client exiting", -1);
+  return write_quit(self, &b, error);
+}
+
+/* ---- Text jobs -------------------------------------------------------------
+ * zc_client_send_text() splits text into lines that still fit once the
+ * server has put our prefix in front, and sends them as one job: as a
+ * draft/multiline batch when the server takes one that size, otherwise
+ * paced by flood control one line at a time.
+ */
+
+typedef struct {
+  const gchar *text;
+  gsize len;
+  gboolean concat;   /* continues the previous piece's line */
+} ZcTextPiece;
+
+static void
+send_job_free(ZcSendJob *job) {
+  g_free(job->target);
+  g_ptr_array_unref(job->lines);
+  g_free(job);
+}
+
+/* Bytes of trailing text a @command to @target can carry. */
+static gsize
+text_budget(ZcClient *self, const gchar *command, const gchar *target) {
+  /* ":nick!user@host COMMAND target :" + CRLF */
+  const gsize overhead = 1 + strlen(self->nick ? self->nick : "") + 1 +
+    (self->self_userhost ? strlen(self->self_userhost) : ZC_USERHOST_GUESS) + 1 +
+    strlen(command) + 1 + strlen(target) + 2 + 2;
+  return overhead < ZC_IRC_LINE_MAX ? ZC_IRC_LINE_MAX - overhead : 0;
+}
+
+/* Cut @text into lines, and lines longer than @max into pieces. Cuts go
+ * after the last space in the final quarter of a piece if there is one,
+ * else at a UTF-8 character boundary, and keep every byte so concatenated
+ * pieces give back the line. Empty lines are dropped.
+ */
+static void
+split_text(GArray *out, const gchar *text, gsize max) {
+  const gchar *p = text;
+  while (*p) {
+    const gchar *nl = strchr(p, '\n');
+    gsize len = nl ? (gsize)(nl - p) : strlen(p);
+    const gchar *next = nl ? nl + 1 : p + len;
+    if (len > 0 && p[len - 1] == '\r') len--;
+
+    gboolean concat = FALSE;
+    while (len > max) {
+      gsize cut = max;
+      while (cut > 0 && ((guchar)p[cut] & 0xC0) == 0x80) cut--;
+      for (gsize i = cut; i > 0 && i > max - max / 4; i--) {
+        if (p[i - 1] == ' ') {
+          cut = i;
+          break;
+        }
+      }
+      if (cut == 0) cut = max;
+      const ZcTextPiece piece = { p, cut, concat };
+      g_array_append_val(out, piece);
+      p += cut;
+      len -= cut;
+      concat = TRUE;
+    }
+    if (len > 0) {
+      const ZcTextPiece piece = { p, len, concat };
+      g_array_append_val(out, piece);
+    }
+    p = next;
+  }
+}
+
+static gchar *
+build_text_line(const gchar *batch, gboolean concat, const gchar *command, const gchar *target,
+                const ZcTextPiece *piece) {
+  ZcIrcMessageBuilder b;
+  zc_irc_message_builder_init(&b);
+  if (batch) zc_irc_message_builder_add_tag(&b, "batch", batch);
+  if (concat) zc_irc_message_builder_add_tag(&b, "draft/multiline-concat", NULL);
+  zc_irc_message_builder_set_command(&b, command);
+  zc_irc_message_builder_add_param(&b, target, -1);
+  zc_irc_message_builder_add_trailing(&b, piece->text, (gssize)piece->len);
+  gsize len = 0;
+  const gchar *line = zc_irc_message_builder_get_line(&b, &len);
+  return line ? g_strndup(line, len) : NULL;
+}
+
+/* Limits from "draft/multiline=max-bytes=4096,max-lines=24"; FALSE if the
+ * server does not take multiline batches. */
+static gboolean
+multiline_limits(ZcClient *self, gsize *max_bytes, guint *max_lines) {
+  if (!zc_client_has_cap(self, "batch") || !zc_client_has_cap(self, "draft/multiline")) return FALSE;
+  const gchar *value = zc_client_get_cap_value(self, "draft/multiline");
+  *max_bytes = 0;
+  *max_lines = G_MAXUINT;
+  gchar **kv = g_strsplit(value ? value : "", ",", -1);
+  for (gchar **k = kv; *k; k++) {
+    if (g_str_has_prefix(*k, "max-bytes=")) *max_bytes = (gsize)g_ascii_strtoull(*k + 10, NULL, 10);
+    else if (g_str_has_prefix(*k, "max-lines=")) *max_lines = (guint)g_ascii_strtoull(*k + 10, NULL, 10);
+  }
+  g_strfreev(kv);
+  return *max_bytes > 0;
+}
+
+static void
+send_jobs_pump(ZcClient *self) {
+  if (self->send_jobs_pumping) return;
+  self->send_jobs_pumping = TRUE;
+
+  ZcSendJob *job;
+  while (self->send_stats.queued == 0 && (job = g_queue_peek_head(&self->send_jobs))) {
+    const guint sent_before = job->sent;
+    gboolean ok = TRUE;
+    do {
+      const gchar *line = g_ptr_array_index(job->lines, job->next++);
+      ok = write_line(self, line, ZC_SEND_PRIORITY_USER, NULL);
+      if (ok && !g_str_has_prefix(line, "BATCH ")) job->sent++;
+    } while (ok && job->atomic && job->next < job->lines->len);
+
+    /* Handlers may cancel or add jobs: nothing below touches @job after
+     * an emission unless it was unlinked first. */
+    const guint id = job->id;
+    const guint sent = job->sent;
+    const guint total = job->total;
+    const gboolean done = !ok || job->next == job->lines->len;
+    gchar *target = g_strdup(job->target);
+    if (done) g_queue_pop_head(&self->send_jobs);
+    if (sent != sent_before) g_signal_emit(self, signals[SIG_SEND_JOB_PROGRESS], 0, id, target, sent, total);
+    if (done) {
+      g_signal_emit(self, signals[SIG_SEND_JOB_FINISHED], 0, id, target, ok);
+      send_job_free(job);
+    }
+    g_free(target);
+  }
+
+  self->send_jobs_pumping = FALSE;
+}
+
+static void
+send_jobs_reset(ZcClient *self, gboolean emit) {
+  ZcSendJob *job;
+  while ((job = g_queue_pop_head(&self->send_jobs))) {
+    if (emit) g_signal_emit(self, signals[SIG_SEND_JOB_FINISHED], 0, job->id, job->target, FALSE);
+    send_job_free(job);
+  }
+}
+
+gsize
+zc_client_get_text_budget(ZcClient *self, const gchar *command, const gchar *target) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), 0);
+  g_return_val_if_fail(command != NULL, 0);
+  g_return_val_if_fail(target != NULL, 0);
+  return text_budget(self, command, target);
+}
+
+guint
+zc_client_send_text(ZcClient *self, const gchar *command, const gchar *target, const gchar *text, GError **error) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), 0);
+  g_return_val_if_fail(command != NULL, 0);
+  g_return_val_if_fail(target != NULL, 0);
+  g_return_val_if_fail(text != NULL, 0);
+  if (!self->out) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED, "Not connected");
+    return 0;
+  }
+
+  const gsize budget = text_budget(self, command, target);
+  if (budget < 16) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE, "Target name too long");
+    return 0;
+  }
+
+  GArray *pieces = g_array_new(FALSE, FALSE, sizeof(ZcTextPiece));
+  split_text(pieces, text, budget);
+  if (pieces->len == 0) {
+    g_array_unref(pieces);
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Nothing to send");
+    return 0;
+  }
+
+  ZcSendJob *job = g_new0(ZcSendJob, 1);
+  job->id = ++self->send_job_next;
+  if (job->id == 0) job->id = ++self->send_job_next;
+  job->target = g_strdup(target);
+  job->lines = g_ptr_array_new_with_free_func(g_free);
+  job->total = pieces->len;
+
+  /* Several lines and a server that takes them as one message: batch. */
+  gsize max_bytes = 0;
+  guint max_lines = 0;
+  gchar ref[16] = "";
+  if (pieces->len > 1 && multiline_limits(self, &max_bytes, &max_lines) && pieces->len <= max_lines) {
+    gsize bytes = 0;
+    for (guint i = 0; i < pieces->len; i++) {
+      const ZcTextPiece *pc = &g_array_index(pieces, ZcTextPiece, i);
+      bytes += pc->len + (i > 0 && !pc->concat ? 1 : 0);
+    }
+    if (bytes <= max_bytes) g_snprintf(ref, sizeof(ref), "zc%u", job->id);
+  }
+
+  if (*ref) {
+    job->atomic = TRUE;
+    g_ptr_array_add(job->lines, g_strdup_printf("BATCH +%s draft/multiline %s", ref, target));
+  }
+  for (guint i = 0; i < pieces->len; i++) {
+    const ZcTextPiece *pc = &g_array_index(pieces, ZcTextPiece, i);
+    gchar *line = build_text_line(*ref ? ref : NULL, *ref && pc->concat, command, target, pc);
+    if (!line) {
+      g_array_unref(pieces);
+      send_job_free(job);
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "Invalid command or target");
+      return 0;
+    }
+    g_ptr_array_add(job->lines, line);
+  }
+  if (*ref) g_ptr_array_add(job->lines, g_strdup_printf("BATCH -%s", ref));
+  g_array_unref(pieces);
+
+  const guint id = job->id;
+  g_queue_push_tail(&self->send_jobs, job);
+  send_jobs_pump(self);
+  return id;
+}
+
+void
+zc_client_cancel_send_job(ZcClient *self, guint job_id) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  for (GList *l = self->send_jobs.head; l; l = l->next) {
+    ZcSendJob *job = l->data;
+    if (job->id != job_id) continue;
+    g_queue_delete_link(&self->send_jobs, l);
+    g_signal_emit(self, signals[SIG_SEND_JOB_FINISHED], 0, job->id, job->target, FALSE);
+    send_job_free(job);
+    return;
+  }
+}
+
+/* Tear the transport down without touching reconnect state or emitting. */
+static void
+connection_close(ZcClient *self) {
+  if (self->cancellable) g_cancellable_cancel(self->cancellable);
+  close_cancel(self);
+
+  /* With an I/O thread a read or write may be in flight there: the stream
+   * is closed on that thread, after the cancelled operations. */
+  if (self->connection && self->io_thread) {
+    g_main_context_invoke_full(self->io_ctx, G_PRIORITY_LOW, io_close_cb,
+                               g_steal_pointer(&self->connection), g_object_unref);
+  } else if (self->connection) {
+    g_io_stream_close(self->connection, NULL, NULL);
+  }
+
+  g_clear_object(&self->in);
+  g_atomic_int_set(&self->linked, 0);
+  g_mutex_lock(&self->write_lock);
+  g_clear_object(&self->out);
+  g_mutex_unlock(&self->write_lock);
+  g_clear_object(&self->connection);
+  write_queue_reset(self);
+  flood_reset(self);
+  ingest_cancel(self);
+  /* Batches already queued by the I/O thread are dropped by generation. */
+  self->read_generation++;
+  if (!self->io_thread) {
+    g_clear_object(&self->rd_in);
+    g_clear_object(&self->rd_cancellable);
+  }
+}
+
+static gboolean
+close_timeout_cb(gpointer user_data) {
+  ZcClient *self = ZC_CLIENT(user_data);
+  self->close_source = 0;
+  zc_client_disconnect(self);
+  return G_SOURCE_REMOVE;
+}
+
+gboolean
+zc_client_quit_and_close(ZcClient *self, const gchar *message, guint timeout_ms, GError **error) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+
+  /* Armed first: with an I/O thread the QUIT can be written before
+   * zc_client_quit() returns. */
+  g_atomic_int_set(&self->close_when_drained, 1);
+  if (!zc_client_quit(self, message, error)) {
+    g_atomic_int_set(&self->close_when_drained, 0);
+    return FALSE;
+  }
+
+  reconnect_cancel(self);
+  if (!self->close_source) {
+    self->close_source = owner_source_add(self, g_timeout_source_new(timeout_ms), G_PRIORITY_DEFAULT, close_timeout_cb);
+  }
+  return TRUE;
+}
+
+void
+zc_client_disconnect(ZcClient *self) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+
+  reconnect_cancel(self);
+  connection_close(self);
+
+  if (self->connected) emit_disconnected(self, 0, "Disconnected");
+}
+
+/* ---- Reconnect and resume ------------------------------------------------
+ * After an unexpected drop the client retries on a jittered exponential
+ * backoff. A successful reconnect registers on its own ("resuming") and,
+ * at the welcome numeric, re-joins the channels tracked below.
+ */
+
+static void connect_start(ZcClient *self, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+static void
+reconnect_cancel(ZcClient *self) {
+  if (self->reconnect_source) {
+    owner_source_remove(self, self->reconnect_source);
+    self->reconnect_source = 0;
+  }
+  self->reconnect_pending = FALSE;
+  self->resuming = FALSE;
+  self->reconnect_attempt = 0;
+  self->dropped_at = 0;
+}
+
+static guint
+reconnect_delay_ms(ZcClient *self) {
+  const ZcReconnectPolicy *p = &self->reconnect;
+  gdouble delay = p->initial_delay_ms;
+  for (guint i = 0; i < self->reconnect_attempt && delay < p->max_delay_ms; i++) delay *= p->multiplier;
+  delay = MIN(delay, (gdouble)p->max_delay_ms);
+  delay -= delay * p->jitter * g_random_double();
+  return (guint)delay;
+}
+
+static void
+on_reconnect_done(GObject *source, GAsyncResult *res, gpointer user_data) {
+  (void)user_data;
+  ZcClient *self = ZC_CLIENT(source);
+  GError *error = NULL;
+
+  if (g_task_propagate_boolean(G_TASK(res), &error)) return;
+
+  /* Cancelled: zc_client_disconnect(), a new connect, or dispose. */
+  const gboolean cancelled = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_clear_error(&error);
+  if (!cancelled && self->reconnect_pending) reconnect_schedule(self);
+}
+
+static gboolean
+reconnect_cb(gpointer user_data) {
+  ZcClient *self = ZC_CLIENT(user_data);
+  self->reconnect_source = 0;
+  self->reconnect_attempt++;
+  self->reconnect_stats.attempts++;
+  self->resuming = TRUE;
+
+  connection_close(self);
+  connect_start(self, NULL, on_reconnect_done, NULL);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+reconnect_schedule(ZcClient *self) {
+  if (!self->reconnect_enabled || !self->host) {
+    reconnect_cancel(self);
+    return;
+  }
+
+  const guint max = self->reconnect.max_attempts;
+  if (max && self->reconnect_attempt >= max) {
+    const guint attempts = self->reconnect_attempt;
+    reconnect_cancel(self);
+    g_signal_emit(self, signals[SIG_RECONNECT_FAILED], 0, attempts);
+    return;
+  }
+
+  const guint delay = reconnect_delay_ms(self);
+  self->reconnect_pending = TRUE;
+  self->reconnect_source = owner_source_add(self, g_timeout_source_new(delay), G_PRIORITY_DEFAULT, reconnect_cb);
+  g_signal_emit(self, signals[SIG_RECONNECTING], 0, self->reconnect_attempt + 1, delay);
+}
+
+/* A new route is worth trying now rather than at the end of a long backoff. */
+static void
+on_network_changed(GNetworkMonitor *monitor, gboolean available, gpointer user_data) {
+  (void)monitor;
+  ZcClient *self = ZC_CLIENT(user_data);
+  if (!available || !self->reconnect_source) return;
+
+  owner_source_remove(self, self->reconnect_source);
+  self->reconnect_source = 0;
+  g_signal_emit(self, signals[SIG_RECONNECTING], 0, self->reconnect_attempt + 1, 0u);
+  if (self->reconnect_pending) reconnect_cb(self);
+}
+
+void
+zc_client_set_reconnect_policy(ZcClient *self, const ZcReconnectPolicy *policy) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+
+  if (!policy) {
+    self->reconnect_enabled = FALSE;
+    if (self->netmon_handler) {
+      g_signal_handler_disconnect(g_network_monitor_get_default(), self->netmon_handler);
+      self->netmon_handler = 0;
+    }
+    if (!self->connected) reconnect_cancel(self);
+    return;
+  }
+
+  self->reconnect = *policy;
+  if (self->reconnect.multiplier < 1.0) self->reconnect.multiplier = 1.0;
+  self->reconnect.jitter = CLAMP(self->reconnect.jitter, 0.0, 1.0);
+  if (self->reconnect.max_delay_ms < self->reconnect.initial_delay_ms) {
+    self->reconnect.max_delay_ms = self->reconnect.initial_delay_ms;
+  }
+  self->reconnect_enabled = TRUE;
+
+  if (!self->netmon_handler) {
+    self->netmon_handler = g_signal_connect(g_network_monitor_get_default(), "network-changed",
+                                            G_CALLBACK(on_network_changed), self);
+  }
+}
+
+gboolean
+zc_client_is_resuming(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+  return self->resuming;
+}
+
+void
+zc_client_get_reconnect_stats(ZcClient *self, ZcReconnectStats *stats) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(stats != NULL);
+  *stats = self->reconnect_stats;
+}
+
+/* @names in as few JOIN lines as the line limit allows. */
+static void
+join_batched(ZcClient *self, GPtrArray *names) {
+  GString *line = g_string_new(NULL);
+  for (guint i = 0; i < names->len; i++) {
+    const gchar *name = g_ptr_array_index(names, i);
+    const gsize len = strlen(name);
+    if (line->len > 0 && line->len + 1 + len > ZC_REJOIN_LINE_MAX) {
+      (void)write_line(self, line->str, ZC_SEND_PRIORITY_BULK, NULL);
+      g_string_truncate(line, 0);
+    }
+    g_string_append(line, line->len ? "," : "JOIN ");
+    g_string_append_len(line, name, (gssize)len);
+  }
+  if (line->len > 0) (void)write_line(self, line->str, ZC_SEND_PRIORITY_BULK, NULL);
+  g_string_free(line, TRUE);
+}
+
+/* Every tracked channel, plus auto-join channels we were not in. They are
+ * all pending like a first auto-join, so JOINED is reported after a resume
+ * too.
+ */
+static void
+rejoin_channels(ZcClient *self) {
+  g_hash_table_remove_all(self->auto_join_pending);
+
+  GPtrArray *names = g_ptr_array_new();
+  GHashTableIter it;
+  gpointer key, name;
+  g_hash_table_iter_init(&it, self->channels);
+  while (g_hash_table_iter_next(&it, &key, &name)) {
+    g_hash_table_add(self->auto_join_pending, g_strdup(key));
+    g_ptr_array_add(names, name);
+  }
+
+  for (gchar **c = self->auto_join; c && *c; c++) {
+    if (g_hash_table_add(self->auto_join_pending, g_ascii_strdown(*c, -1))) g_ptr_array_add(names, *c);
+  }
+
+  if (names->len > 0) join_batched(self, names);
+  g_ptr_array_free(names, TRUE);
+}
+
+/* Right after 001: the configured channels, batched, ahead of anything the
+ * user queued. JOINED is reported once the server confirmed all of them.
+ */
+static void
+auto_join_send(ZcClient *self) {
+  g_hash_table_remove_all(self->auto_join_pending);
+  if (!self->auto_join || !*self->auto_join) return;
+
+  GPtrArray *names = g_ptr_array_new();
+  for (gchar **c = self->auto_join; *c; c++) {
+    if (g_hash_table_add(self->auto_join_pending, g_ascii_strdown(*c, -1))) g_ptr_array_add(names, *c);
+  }
+  join_batched(self, names);
+  g_ptr_array_free(names, TRUE);
+}
+
+static void
+resume_finish(ZcClient *self) {
+  self->resuming = FALSE;
+  if (self->dropped_at) {
+    const guint64 ms = (guint64)(g_get_monotonic_time() - self->dropped_at) / 1000;
+    ZcReconnectStats *rs = &self->reconnect_stats;
+    rs->recoveries++;
+    rs->last_ms = ms;
+    rs->max_ms = MAX(rs->max_ms, ms);
+    rs->total_ms += ms;
+  }
+  self->dropped_at = 0;
+  self->reconnect_attempt = 0;
+  self->reconnect_pending = FALSE;
+
+  rejoin_channels(self);
+}
+
+static const gchar *
+view_arg(const ZcIrcMessageView *view, guint idx) {
+  const guint n = zc_irc_message_view_get_n_params(view);
+  if (idx < n) return zc_irc_message_view_param(view, idx);
+  return idx == n ? zc_irc_message_view_get_trailing(view) : NULL;
+}
+
+static gboolean
+prefix_is_self(ZcClient *self, const gchar *prefix) {
+  if (!prefix || !self->nick) return FALSE;
+  const gsize n = strlen(self->nick);
+  if (g_ascii_strncasecmp(prefix, self->nick, n) != 0) return FALSE;
+  return prefix[n] == '\0' || prefix[n] == '!' || prefix[n] == '@';
+}
+
+/* Remember the "user@host" part of our own "nick!user@host" prefix. */
+static void
+self_userhost_set(ZcClient *self, const gchar *prefix) {
+  const gchar *bang = prefix ? strchr(prefix, '!') : NULL;
+  if (!bang || !strchr(bang, '@')) return;
+  g_free(self->self_userhost);
+  self->self_userhost = g_strdup(bang + 1);
+}
+
+static void
+channel_forget(ZcClient *self, const gchar *channel) {
+  gchar *key = g_ascii_strdown(channel, -1);
+  g_hash_table_remove(self->channels, key);
+  g_free(key);
+}
+
+ZcChannelState *
+zc_client_get_channel_state(ZcClient *self, const gchar *channel) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), NULL);
+  return zc_members_get_channel(self->members, channel);
+}
+
+ZcUser *
+zc_client_lookup_user(ZcClient *self, const gchar *nick) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), NULL);
+  return zc_members_lookup_user(self->members, nick);
+}
+
+gchar
+zc_client_get_prefix_char(ZcClient *self, guint modes) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), 0);
+  return zc_members_prefix_char(self->members, modes);
+}
+
+/* Keep our own nick and the rejoin list current. Runs on the owner
+ * context after listeners have seen the message; the membership model
+ * (zc_members_apply()) is updated before they see it instead.
+ */
+static void
+track_view(ZcClient *self, const ZcIrcMessageView *view) {
+  const gchar *prefix = zc_irc_message_view_get_prefix(view);
+  const gchar *arg0 = view_arg(view, 0);
+
+  switch ((guint)zc_irc_message_view_get_command_id(view)) {
+    case 1: /* RPL_WELCOME */
+      /* Registered: whatever CAP and SASL were going to do is done. */
+      self->caps_negotiating = FALSE;
+      self->sasl_active = FALSE;
+      registration_phase(self, ZC_REGISTRATION_PHASE_WELCOME);
+      /* Most servers end the welcome with our full "nick!user@host". */
+      {
+        const gchar *text = zc_irc_message_view_get_trailing(view);
+        const gchar *word = text ? strrchr(text, ' ') : NULL;
+        word = word ? word + 1 : text;
+        if (prefix_is_self(self, word)) self_userhost_set(self, word);
+      }
+      lag_start(self);
+      if (self->resuming && self->connected) resume_finish(self);
+      else auto_join_send(self);
+      break;
+    case ZC_IRC_CMD_CAP:
+      caps_handle(self, view);
+      break;
+    case ZC_IRC_CMD_PONG:
+      lag_handle_pong(self, view);
+      break;
+    case ZC_IRC_CMD_AUTHENTICATE:
+    case 900: /* RPL_LOGGEDIN */
+    case 902: /* ERR_NICKLOCKED */
+    case 903: /* RPL_SASLSUCCESS */
+    case 904: /* ERR_SASLFAIL */
+    case 905: /* ERR_SASLTOOLONG */
+    case 906: /* ERR_SASLABORTED */
+    case 907: /* ERR_SASLALREADY */
+      sasl_handle(self, view);
+      break;
+    case ZC_IRC_CMD_JOIN:
+      if (arg0 && *arg0 && prefix_is_self(self, prefix)) {
+        gchar *key = g_ascii_strdown(arg0, -1);
+        if (g_hash_table_remove(self->auto_join_pending, key) &&
+            g_hash_table_size(self->auto_join_pending) == 0) {
+          registration_phase(self, ZC_REGISTRATION_PHASE_JOINED);
+        }
+        g_hash_table_replace(self->channels, key, g_strdup(arg0));
+        self_userhost_set(self, prefix);
+      }
+      break;
+    case ZC_IRC_CMD_PART:
+      if (arg0 && prefix_is_self(self, prefix)) {
+        gchar **chans = g_strsplit(arg0, ",", -1);
+        for (gchar **c = chans; *c; c++) channel_forget(self, *c);
+        g_strfreev(chans);
+      }
+      break;
+    case ZC_IRC_CMD_KICK: {
+      const gchar *victim = view_arg(view, 1);
+      if (arg0 && victim && self->nick && g_ascii_strcasecmp(victim, self->nick) == 0) channel_forget(self, arg0);
+      break;
+    }
+    case ZC_IRC_CMD_NICK:
+      if (arg0 && *arg0 && prefix_is_self(self, prefix)) {
+        g_free(self->nick);
+        self->nick = g_strdup(arg0);
+      }
+      break;
+    case ZC_IRC_CMD_CHGHOST: {
+      const gchar *host = view_arg(view, 1);
+      if (arg0 && host && prefix_is_self(self, prefix)) {
+        g_free(self->self_userhost);
+        self->self_userhost = g_strconcat(arg0, "@", host, NULL);
+      }
+      break;
+    }
+    case 396: { /* RPL_VISIBLEHOST: "<nick> <host> :is now your displayed host" */
+      const gchar *host = view_arg(view, 1);
+      const gchar *at = self->self_userhost ? strchr(self->self_userhost, '@') : NULL;
+      if (host && at) {
+        gchar *uh = g_strdup_printf("%.*s@%s", (gint)(at - self->self_userhost), self->self_userhost, host);
+        g_free(self->self_userhost);
+        self->self_userhost = uh;
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+/* ---- IRCv3 capabilities ----------------------------------------------------
+ * zc_client_login() opens with CAP LS 302. If an earlier connection to the
+ * same server left its LS reply in the cache, the wanted caps it listed are
+ * requested right away instead of after LS. CAP END goes out once LS is
+ * complete and every REQ has been answered.
+ */
+
+static GMutex caps_cache_lock;
+static GHashTable *caps_cache; /* "host:port" -> LS list */
+
+static gchar *
+caps_cache_key(ZcClient *self) {
+  gchar *lower = g_ascii_strdown(self->host, -1);
+  gchar *key = g_strdup_printf("%s:%u", lower, (guint)self->port);
+  g_free(lower);
+  return key;
+}
+
+static gchar *
+caps_cache_lookup(ZcClient *self) {
+  if (!self->host) return NULL;
+  gchar *key = caps_cache_key(self);
+  g_mutex_lock(&caps_cache_lock);
+  gchar *ls = caps_cache ? g_strdup(g_hash_table_lookup(caps_cache, key)) : NULL;
+  g_mutex_unlock(&caps_cache_lock);
+  g_free(key);
+  return ls;
+}
+
+static void
+caps_cache_store(ZcClient *self, const gchar *ls) {
+  if (!self->host) return;
+  g_mutex_lock(&caps_cache_lock);
+  if (!caps_cache) caps_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_hash_table_replace(caps_cache, caps_cache_key(self), g_strdup(ls));
+  g_mutex_unlock(&caps_cache_lock);
+}
+
+static void
+cap_req_free(ZcCapReq *req) {
+  g_strfreev(req->names);
+  g_free(req);
+}
+
+static gint
+cap_name_cmp(gconstpointer a, gconstpointer b, gpointer user_data) {
+  (void)user_data;
+  return strcmp(*(const gchar *const *)a, *(const gchar *const *)b);
+}
+
+static void
+caps_reset(ZcClient *self) {
+  g_hash_table_remove_all(self->caps_available);
+  g_hash_table_remove_all(self->caps_enabled);
+  g_hash_table_remove_all(self->caps_pending);
+  g_hash_table_remove_all(self->caps_refused);
+  g_queue_clear_full(&self->caps_req, (GDestroyNotify)cap_req_free);
+  g_string_truncate(self->caps_ls, 0);
+  self->caps_ls_done = FALSE;
+  self->caps_negotiating = FALSE;
+  self->sasl_started = FALSE;
+  self->sasl_active = FALSE;
+}
+
+/* Adds "name[=value]" tokens from an LS/NEW list to @into. */
+static void
+caps_parse_list(GHashTable *into, const gchar *list) {
+  if (!list) return;
+  gchar **tokens = g_strsplit(list, " ", -1);
+  for (gchar **t = tokens; *t; t++) {
+    if (!**t) continue;
+    gchar *eq = strchr(*t, '=');
+    gchar *name = eq ? g_strndup(*t, (gsize)(eq - *t)) : g_strdup(*t);
+    g_hash_table_replace(into, name, g_strdup(eq ? eq + 1 : ""));
+  }
+  g_strfreev(tokens);
+}
+
+static void
+caps_send_req(ZcClient *self, GPtrArray *names, gboolean from_cache) {
+  guint i = 0;
+  while (i < names->len) {
+    GString *line = g_string_new("CAP REQ :");
+    const gsize head = line->len;
+    GPtrArray *batch = g_ptr_array_new();
+
+    for (; i < names->len; i++) {
+      const gchar *name = g_ptr_array_index(names, i);
+      if (line->len > head && line->len + 1 + strlen(name) > ZC_CAP_LINE_MAX) break;
+      if (line->len > head) g_string_append_c(line, ' ');
+      g_string_append(line, name);
+      g_ptr_array_add(batch, g_strdup(name));
+      g_hash_table_add(self->caps_pending, g_strdup(name));
+    }
+    g_ptr_array_add(batch, NULL);
+
+    ZcCapReq *req = g_new0(ZcCapReq, 1);
+    req->names = (gchar **)g_ptr_array_free(batch, FALSE);
+    req->from_cache = from_cache;
+    g_queue_push_tail(&self->caps_req, req);
+
+    (void)write_line(self, line->str, ZC_SEND_PRIORITY_KEEPALIVE, NULL);
+    g_string_free(line, TRUE);
+  }
+}
+
+/* SASL PLAIN: "sasl" is requested whenever credentials are set and the
+ * server offers PLAIN (a bare "sasl" in a 301-style LS offers it too).
+ */
+static gboolean
+sasl_wanted(ZcClient *self, GHashTable *offered) {
+  if (!self->sasl_account || self->sasl_started) return FALSE;
+  if (g_hash_table_contains(self->caps_enabled, "sasl")) return FALSE;
+  if (g_hash_table_contains(self->caps_pending, "sasl")) return FALSE;
+  if (g_hash_table_contains(self->caps_refused, "sasl")) return FALSE;
+
+  const gchar *mechs = g_hash_table_lookup(offered, "sasl");
+  if (!mechs) return FALSE;
+  if (!*mechs) return TRUE;
+
+  gboolean plain = FALSE;
+  gchar **list = g_strsplit(mechs, ",", -1);
+  for (gchar **m = list; *m && !plain; m++) plain = g_ascii_strcasecmp(*m, "PLAIN") == 0;
+  g_strfreev(list);
+  return plain;
+}
+
+static void
+sasl_start(ZcClient *self) {
+  if (self->sasl_started || !self->sasl_account) return;
+  self->sasl_started = TRUE;
+  self->sasl_active = TRUE;
+  (void)write_line(self, "AUTHENTICATE PLAIN", ZC_SEND_PRIORITY_KEEPALIVE, NULL);
+}
+
+/* "AUTHENTICATE +" asks for the credentials: authzid \0 authcid \0 passwd,
+ * base64 in 400-byte chunks, with a lone "+" if the last chunk was full.
+ */
+static void
+sasl_send_plain(ZcClient *self) {
+  const gsize alen = strlen(self->sasl_account);
+  const gsize plen = strlen(self->sasl_password ? self->sasl_password : "");
+  const gsize len = alen * 2 + plen + 2;
+  guchar *raw = g_malloc(len);
+  memcpy(raw, self->sasl_account, alen);
+  raw[alen] = '\0';
+  memcpy(raw + alen + 1, self->sasl_account, alen);
+  raw[alen * 2 + 1] = '\0';
+  if (plen) memcpy(raw + alen * 2 + 2, self->sasl_password, plen);
+
+  gchar *b64 = g_base64_encode(raw, len);
+  memset(raw, 0, len);
+  g_free(raw);
+
+  const gsize b64len = strlen(b64);
+  gchar line[sizeof("AUTHENTICATE ") + ZC_SASL_CHUNK];
+  for (gsize off = 0; off < b64len; off += ZC_SASL_CHUNK) {
+    const gsize n = MIN((gsize)ZC_SASL_CHUNK, b64len - off);
+    g_snprintf(line, sizeof(line), "AUTHENTICATE %.*s", (gint)n, b64 + off);
+    (void)write_line(self, line, ZC_SEND_PRIORITY_KEEPALIVE, NULL);
+  }
+  if (b64len % ZC_SASL_CHUNK == 0) (void)write_line(self, "AUTHENTICATE +", ZC_SEND_PRIORITY_KEEPALIVE, NULL);
+
+  memset(line, 0, sizeof(line));
+  memset(b64, 0, b64len);
+  g_free(b64);
+}
+
+static void
+sasl_handle(ZcClient *self, const ZcIrcMessageView *view) {
+  if (!self->sasl_active) return;
+
+  const guint id = (guint)zc_irc_message_view_get_command_id(view);
+  if (id == ZC_IRC_CMD_AUTHENTICATE) {
+    if (g_strcmp0(view_arg(view, 0), "+") == 0) sasl_send_plain(self);
+    return;
+  }
+  if (id == 900) return; /* RPL_LOGGEDIN: 903 follows */
+
+  self->reg_timings.sasl_succeeded = id == 903;
+  self->sasl_active = FALSE;
+  registration_phase(self, ZC_REGISTRATION_PHASE_SASL);
+  caps_maybe_end(self);
+}
+
+/* REQ everything wanted that @offered lists and nobody has asked for yet. */
+static void
+caps_request_from(ZcClient *self, GHashTable *offered, gboolean from_cache) {
+  GPtrArray *names = g_ptr_array_new();
+  for (gchar **w = self->caps_wanted; w && *w; w++) {
+    if (!g_hash_table_contains(offered, *w)) continue;
+    if (g_hash_table_contains(self->caps_enabled, *w)) continue;
+    if (g_hash_table_contains(self->caps_pending, *w)) continue;
+    if (g_hash_table_contains(self->caps_refused, *w)) continue;
+    g_ptr_array_add(names, *w);
+  }
+  if (names->len > 0) caps_send_req(self, names, from_cache);
+  g_ptr_array_free(names, TRUE);
+
+  if (sasl_wanted(self, offered)) {
+    /* On a line of its own, so a NAK can't take other caps down with it. */
+    GPtrArray *sasl = g_ptr_array_new();
+    g_ptr_array_add(sasl, (gpointer)"sasl");
+    caps_send_req(self, sasl, from_cache);
+    g_ptr_array_free(sasl, TRUE);
+  }
+}
+
+static void
+caps_maybe_end(ZcClient *self) {
+  if (!self->caps_negotiating || !self->caps_ls_done) return;
+  if (!g_queue_is_empty(&self->caps_req) || self->sasl_active) return;
+  self->caps_negotiating = FALSE;
+  (void)write_line(self, "CAP END", ZC_SEND_PRIORITY_KEEPALIVE, NULL);
+  registration_phase(self, ZC_REGISTRATION_PHASE_CAPS);
+}
+
+static void
+caps_begin(ZcClient *self) {
+  caps_reset(self);
+  if ((!self->caps_wanted || !*self->caps_wanted) && !self->sasl_account) return;
+
+  self->caps_negotiating = TRUE;
+  (void)write_line(self, "CAP LS 302", ZC_SEND_PRIORITY_KEEPALIVE, NULL);
+
+  gchar *cached = caps_cache_lookup(self);
+  if (cached) {
+    GHashTable *offered = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    caps_parse_list(offered, cached);
+    caps_request_from(self, offered, TRUE);
+    /* The server handles lines in order, so by the time it reads this the
+     * sasl REQ above has been ACK'd. */
+    if (g_hash_table_contains(self->caps_pending, "sasl")) sasl_start(self);
+    g_hash_table_unref(offered);
+    g_free(cached);
+  }
+}
+
+static void
+caps_set_enabled(ZcClient *self, const gchar *name, gboolean enabled) {
+  gboolean changed;
+  if (enabled) changed = g_hash_table_add(self->caps_enabled, g_strdup(name));
+  else changed = g_hash_table_remove(self->caps_enabled, name);
+  if (changed) g_signal_emit(self, signals[SIG_CAP_CHANGED], 0, name, enabled);
+}
+
+static void
+caps_handle(ZcClient *self, const ZcIrcMessageView *view) {
+  const gchar *sub = view_arg(view, 1);
+  if (!sub) return;
+
+  /* "CAP * LS * :list" marks all but the last line of a multi-line reply. */
+  const gchar *a2 = view_arg(view, 2);
+  const gchar *a3 = view_arg(view, 3);
+  const gboolean more = a3 && g_strcmp0(a2, "*") == 0;
+  const gchar *list = more ? a3 : a2;
+
+  if (g_ascii_strcasecmp(sub, "LS") == 0) {
+    if (self->caps_ls_done) return; /* LS outside negotiation: not ours */
+    caps_parse_list(self->caps_available, list);
+    if (list && *list) {
+      if (self->caps_ls->len) g_string_append_c(self->caps_ls, ' ');
+      g_string_append(self->caps_ls, list);
+    }
+    if (more) return;
+
+    self->caps_ls_done = TRUE;
+    caps_cache_store(self, self->caps_ls->str);
+    caps_request_from(self, self->caps_available, FALSE);
+    caps_maybe_end(self);
+    return;
+  }
+
+  if (g_ascii_strcasecmp(sub, "ACK") == 0 || g_ascii_strcasecmp(sub, "NAK") == 0) {
+    const gboolean ack = g_ascii_toupper(sub[0]) == 'A';
+    ZcCapReq *req = g_queue_pop_head(&self->caps_req);
+    gchar **names = g_strsplit(list ? list : "", " ", -1);
+
+    for (gchar **n = names; *n; n++) {
+      if (!**n) continue;
+      const gboolean disable = **n == '-';
+      const gchar *name = disable ? *n + 1 : *n;
+      g_hash_table_remove(self->caps_pending, name);
+      if (strcmp(name, "sasl") == 0) {
+        if (ack && !disable) {
+          sasl_start(self);
+        } else {
+          /* a pipelined AUTHENTICATE is answered with an error; ignore it */
+          self->sasl_active = FALSE;
+          self->sasl_started = FALSE;
+        }
+      }
+      if (ack) caps_set_enabled(self, name, !disable);
+      /* A NAK of a cached guess just means the server changed; LS decides. */
+      else if (!req || !req->from_cache) g_hash_table_add(self->caps_refused, g_strdup(name));
+    }
+    g_strfreev(names);
+
+    if (!ack && req && req->from_cache && self->caps_ls_done) caps_request_from(self, self->caps_available, FALSE);
+    if (req) cap_req_free(req);
+    caps_maybe_end(self);
+    return;
+  }
+
+  if (g_ascii_strcasecmp(sub, "NEW") == 0) {
+    caps_parse_list(self->caps_available, list);
+    GHashTable *offered = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    caps_parse_list(offered, list);
+    caps_request_from(self, offered, FALSE);
+    g_hash_table_unref(offered);
+    return;
+  }
+
+  if (g_ascii_strcasecmp(sub, "DEL") == 0) {
+    gchar **names = g_strsplit(list ? list : "", " ", -1);
+    for (gchar **n = names; *n; n++) {
+      if (!**n) continue;
+      g_hash_table_remove(self->caps_available, *n);
+      caps_set_enabled(self, *n, FALSE);
+    }
+    g_strfreev(names);
+  }
+}
+
+void
+zc_client_set_wanted_caps(ZcClient *self, const gchar *const *caps) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_strfreev(self->caps_wanted);
+  self->caps_wanted = g_strdupv((gchar **)(caps ? caps : default_caps));
+}
+
+gboolean
+zc_client_has_cap(ZcClient *self, const gchar *cap) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+  g_return_val_if_fail(cap != NULL, FALSE);
+  return g_hash_table_contains(self->caps_enabled, cap);
+}
+
+gchar **
+zc_client_dup_enabled_caps(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), NULL);
+  guint n = 0;
+  gchar **out = (gchar **)g_hash_table_get_keys_as_array(self->caps_enabled, &n);
+  for (guint i = 0; i < n; i++) out[i] = g_strdup(out[i]);
+  g_qsort_with_data(out, (gint)n, sizeof(gchar *), cap_name_cmp, NULL);
+  return out;
+}
+
+const gchar *
+zc_client_get_cap_value(ZcClient *self, const gchar *cap) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), NULL);
+  g_return_val_if_fail(cap != NULL, NULL);
+  return g_hash_table_lookup(self->caps_available, cap);
+}
+
+void
+zc_client_set_sasl_plain(ZcClient *self, const gchar *account, const gchar *password) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_free(self->sasl_account);
+  if (self->sasl_password) memset(self->sasl_password, 0, strlen(self->sasl_password));
+  g_free(self->sasl_password);
+  self->sasl_account = account && *account ? g_strdup(account) : NULL;
+  self->sasl_password = self->sasl_account ? g_strdup(password ? password : "") : NULL;
+}
+
+/* ---- Registration --------------------------------------------------------- */
+
+static void
+registration_phase(ZcClient *self, ZcRegistrationPhase phase) {
+  const gint64 us = g_get_monotonic_time() - self->reg_started;
+  ZcRegistrationTimings *t = &self->reg_timings;
+  gint64 *slot = NULL;
+  switch (phase) {
+    case ZC_REGISTRATION_PHASE_SENT: slot = &t->sent_us; break;
+    case ZC_REGISTRATION_PHASE_CAPS: slot = &t->caps_us; break;
+    case ZC_REGISTRATION_PHASE_SASL: slot = &t->sasl_us; break;
+    case ZC_REGISTRATION_PHASE_WELCOME: slot = &t->welcome_us; break;
+    case ZC_REGISTRATION_PHASE_JOINED: slot = &t->joined_us; break;
+  }
+  if (!slot || *slot) return; /* once per connection */
+  *slot = MAX(us, 1);
+  g_signal_emit(self, signals[SIG_REGISTRATION_PHASE], 0, (guint)phase, *slot);
+}
+
+void
+zc_client_set_auto_join(ZcClient *self, const gchar *channels) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_strfreev(self->auto_join);
+  self->auto_join = NULL;
+  if (!channels) return;
+
+  /* "#a,#b" or "#a #b" */
+  GPtrArray *list = g_ptr_array_new();
+  gchar **parts = g_strsplit_set(channels, ", ", -1);
+  for (gchar **p = parts; *p; p++) {
+    if (**p) g_ptr_array_add(list, g_strdup(*p));
+  }
+  g_strfreev(parts);
+  g_ptr_array_add(list, NULL);
+  self->auto_join = (gchar **)g_ptr_array_free(list, FALSE);
+}
+
+void
+zc_client_get_registration_timings(ZcClient *self, ZcRegistrationTimings *timings) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(timings != NULL);
+  *timings = self->reg_timings;
+}
+
+/* ---- Lag meter -------------------------------------------------------------
+ * Once registered, a 1 s tick sends "PING :zc-<monotonic us>" every
+ * lag_interval_ms (one probe outstanding at most) and watches how long the
+ * current one has been waiting. That catches a half-dead TCP connection
+ * within lag_dead_ms instead of whenever keepalive gives up.
+ */
+
+static void
+lag_set_health(ZcClient *self, ZcLinkHealth health) {
+  if (self->health == health) return;
+  self->health = health;
+  g_object_notify_by_pspec(G_OBJECT(self), props[PROP_HEALTH]);
+  g_signal_emit(self, signals[SIG_HEALTH_CHANGED], 0, health);
+}
+
+static void
+lag_set_ms(ZcClient *self, guint ms) {
+  if (self->lag_ms == ms) return;
+  self->lag_ms = ms;
+  g_object_notify_by_pspec(G_OBJECT(self), props[PROP_LAG]);
+}
+
+static void
+lag_send_probe(ZcClient *self, gint64 now) {
+  gchar line[48];
+  g_snprintf(line, sizeof(line), "PING :zc-%" G_GINT64_FORMAT, now);
+  if (!write_line(self, line, ZC_SEND_PRIORITY_KEEPALIVE, NULL)) return;
+  self->lag_probe_sent = now;
+  self->lag_last_probe = now;
+  self->lag_stats.probes++;
+}
+
+static gboolean
+lag_tick(gpointer user_data) {
+  ZcClient *self = ZC_CLIENT(user_data);
+  const gint64 now = g_get_monotonic_time();
+
+  if (self->lag_probe_sent) {
+    const guint waiting_ms = (guint)((now - self->lag_probe_sent) / 1000);
+    if (self->lag_dead_ms && waiting_ms >= self->lag_dead_ms) {
+      gchar *msg = g_strdup_printf("Ping timeout: %u seconds", waiting_ms / 1000);
+      self->lag_stats.timeouts++;
+      self->ping_timeouts++;
+      self->lag_source = 0;
+      lag_set_health(self, ZC_LINK_HEALTH_DEAD);
+      /* Closing first makes the drop final; connection_lost() then
+       * reports it and lets the reconnect policy take over. */
+      connection_close(self);
+      connection_lost(self, G_IO_ERROR_TIMED_OUT, msg);
+      g_free(msg);
+      return G_SOURCE_REMOVE;
+    }
+    if (waiting_ms > self->lag_ms) lag_set_ms(self, waiting_ms);
+    if (self->lag_warn_ms && waiting_ms >= self->lag_warn_ms) lag_set_health(self, ZC_LINK_HEALTH_LAGGING);
+  } else if ((now - self->lag_last_probe) / 1000 >= self->lag_interval_ms) {
+    lag_send_probe(self, now);
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+static void
+lag_stop(ZcClient *self) {
+  if (self->lag_source) {
+    owner_source_remove(self, self->lag_source);
+    self->lag_source = 0;
+  }
+  self->lag_probe_sent = 0;
+  lag_set_ms(self, 0);
+  lag_set_health(self, ZC_LINK_HEALTH_UNKNOWN);
+}
+
+static void
+lag_start(ZcClient *self) {
+  lag_stop(self);
+  memset(&self->lag_stats, 0, sizeof(self->lag_stats));
+  if (!self->lag_interval_ms) return;
+  self->lag_source = owner_source_add(self, g_timeout_source_new_seconds(1), G_PRIORITY_DEFAULT, lag_tick);
+  lag_send_probe(self, g_get_monotonic_time());
+}
+
+static void
+lag_handle_pong(ZcClient *self, const ZcIrcMessageView *view) {
+  if (!self->lag_probe_sent) return;
+
+  /* "PONG <server> :zc-<us>"; anything else is not ours. */
+  const gchar *token = view_arg(view, 1);
+  if (!token) token = view_arg(view, 0);
+  if (!token || !g_str_has_prefix(token, "zc-")) return;
+  if (g_ascii_strtoll(token + 3, NULL, 10) != self->lag_probe_sent) return;
+
+  const gint64 rtt = g_get_monotonic_time() - self->lag_probe_sent;
+  self->lag_probe_sent = 0;
+
+  ZcLagStats *ls = &self->lag_stats;
+  if (ls->pongs == 0) {
+    ls->srtt_us = rtt;
+    ls->jitter_us = rtt / 2;
+  } else {
+    const gint64 err = rtt > ls->srtt_us ? rtt - ls->srtt_us : ls->srtt_us - rtt;
+    ls->jitter_us += (err - ls->jitter_us) / 4;
+    ls->srtt_us += (rtt - ls->srtt_us) / 8;
+  }
+  ls->last_us = rtt;
+  ls->pongs++;
+
+  lag_set_ms(self, (guint)(ls->srtt_us / 1000));
+  const gboolean lagging = self->lag_warn_ms && self->lag_ms >= self->lag_warn_ms;
+  lag_set_health(self, lagging ? ZC_LINK_HEALTH_LAGGING : ZC_LINK_HEALTH_OK);
+}
+
+void
+zc_client_set_lag_check(ZcClient *self, guint interval_ms, guint warn_ms, guint dead_ms) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(interval_ms == 0 || interval_ms >= 1000);
+  self->lag_interval_ms = interval_ms;
+  self->lag_warn_ms = warn_ms;
+  self->lag_dead_ms = dead_ms;
+
+  /* Registered already: apply now rather than at the next welcome. */
+  if (self->lag_source && !interval_ms) lag_stop(self);
+  else if (!self->lag_source && interval_ms && self->reg_timings.welcome_us && self->connected) lag_start(self);
+}
+
+guint
+zc_client_get_lag(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), 0);
+  return self->lag_ms;
+}
+
+ZcLinkHealth
+zc_client_get_health(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), ZC_LINK_HEALTH_UNKNOWN);
+  return self->health;
+}
+
+void
+zc_client_get_lag_stats(ZcClient *self, ZcLagStats *stats) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(stats != NULL);
+  *stats = self->lag_stats;
+}
+
+void
+zc_client_get_stats(ZcClient *self, ZcClientStats *stats) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(stats != NULL);
+  memset(stats, 0, sizeof(*stats));
+
+  const ZcInCounters *in = &self->in_counters;
+  stats->lines_in = in->lines;
+  stats->bytes_in = in->bytes;
+  stats->malformed = in->malformed;
+  stats->lines_transcoded = in->transcoded;
+  stats->parse_ns_total = in->parse_ns;
+  memcpy(stats->parse_hist, in->parse_hist, sizeof(stats->parse_hist));
+
+  g_mutex_lock(&self->write_lock);
+  stats->lines_out = self->wq_lines_out;
+  stats->bytes_out = self->wq_bytes_out;
+  stats->write_queue_depth = self->wq_pending_lines + self->wq_urgent_lines + self->wq_inflight_lines;
+  stats->write_queue_bytes = self->wq_pending->len + self->wq_urgent->len + self->wq_inflight_bytes;
+  stats->pongs_sent = self->wq_pongs_out;
+  g_mutex_unlock(&self->write_lock);
+  stats->flood_queued = self->send_stats.queued;
+
+  stats->dispatches = self->dispatches;
+  stats->dispatch_us_total = self->dispatch_us_total;
+  stats->dispatch_us_max = self->dispatch_us_max;
+
+  stats->rtt_us = self->lag_stats.srtt_us;
+  stats->rtt_jitter_us = self->lag_stats.jitter_us;
+  stats->ping_timeouts = self->ping_timeouts;
+  stats->reconnects = self->reconnect_stats.attempts;
+}
+
+guint64
+zc_client_stats_parse_bucket_le_ns(guint bucket) {
+  g_return_val_if_fail(bucket < ZC_STATS_PARSE_BUCKETS, G_MAXUINT64);
+  return parse_bucket_le_ns[bucket];
+}
+
+/* ---- Keepalive fast path -------------------------------------------------
+ * Server PINGs are answered straight from the read, before the chunk is
+ * parsed or any listener runs, so neither slow handlers nor an ingest
+ * backlog can delay the PONG. On the I/O thread this needs nothing from
+ * the owner context at all.
+ */
+
+static const gchar *
+skip_token(const gchar *p, const gchar *end) {
+  while (p < end && *p != ' ') p++;
+  while (p < end && *p == ' ') p++;
+  return p;
+}
+
+/* Answer @line if it is a PING, the way the parser would read it: the
+ * trailing parameter if there is one, else the first. */
+static void
+keepalive_line(ZcClient *self, const gchar *line, gsize len) {
+  const gchar *p = line;
+  const gchar *end = line + len;
+
+  if (p < end && *p == '@') p = skip_token(p, end);
+  if (p < end && *p == ':') p = skip_token(p, end);
+  if (end - p < 5 || memcmp(p, "PING ", 5) != 0) return;
+  p += 5;
+
+  const gchar *arg = NULL;
+  const gchar *arg_end = NULL;
+  while (p < end && *p == ' ') p++;
+  while (p < end) {
+    if (*p == ':') {
+      arg = p + 1;
+      arg_end = end;
+      break;
+    }
+    const gchar *e = p;
+    while (e < end && *e != ' ') e++;
+    if (!arg) {
+      arg = p;
+      arg_end = e;
+    }
+    p = e;
+    while (p < end && *p == ' ') p++;
+  }
+  if (!arg) return;
+
+  ZcIrcMessageBuilder b;
+  zc_irc_message_builder_init(&b);
+  zc_irc_message_builder_set_command(&b, "PONG");
+  zc_irc_message_builder_add_trailing(&b, arg, arg_end - arg);
+  gsize n = 0;
+  const gchar *pong = zc_irc_message_builder_get_line(&b, &n);
+  if (pong) write_queue_urgent(self, pong, n, TRUE);
+}
+
+/* Check the lines completed by the @n bytes just read. Reads only resume
+ * once the previous buffer was handled, so rbuf holds at most a partial
+ * line (without '\n') in front of them. */
+static void
+keepalive_scan(ZcClient *self, gsize n) {
+  const gchar *buf = self->rbuf;
+  gsize start = 0;
+  gsize from = self->rbuf_len - n;
+  gboolean skip = self->rbuf_discarding;
+
+  const gchar *nl;
+  while ((nl = zc_scan_newline(buf + from, self->rbuf_len - from))) {
+    gsize len = (gsize)(nl - buf) - start;
+    if (len > 0 && buf[start + len - 1] == '\r') len--;
+    if (!skip && len > 0 && len <= self->max_line) keepalive_line(self, buf + start, len);
+    skip = FALSE;
+    start = from = (gsize)(nl - buf) + 1;
+  }
+}
+
+/* The I/O thread counts into its batch; the owner merges them on delivery. */
+static ZcInCounters *
+in_counters(ZcClient *self) {
+  return on_io_thread(self) ? &self->io_batch->in : &self->in_counters;
+}
+
+/* Parsing is well under a microsecond per line, below what
+ * g_get_monotonic_time() resolves. */
+static inline guint64
+now_ns(void) {
+#ifdef G_OS_UNIX
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * G_GUINT64_CONSTANT(1000000000) + (guint64)ts.tv_nsec;
+#else
+  return (guint64)g_get_monotonic_time() * 1000;
+#endif
+}
+
+static ZcIrcMessageView *
+parse_counted(ZcClient *self, const gchar *line, gsize length) {
+  ZcInCounters *c = in_counters(self);
+  const guint64 t0 = now_ns();
+  ZcIrcMessageView *view = zc_irc_message_view_parse(line, (gssize)length);
+  const guint64 ns = now_ns() - t0;
+
+  c->lines++;
+  c->parse_ns += ns;
+  guint b = 0;
+  while (ns > parse_bucket_le_ns[b]) b++;
+  c->parse_hist[b]++;
+  if (!view) c->malformed++;
+  return view;
+}
+
+static void
+in_counters_add(ZcInCounters *to, const ZcInCounters *from) {
+  to->lines += from->lines;
+  to->bytes += from->bytes;
+  to->malformed += from->malformed;
+  to->transcoded += from->transcoded;
+  to->parse_ns += from->parse_ns;
+  for (guint i = 0; i < ZC_STATS_PARSE_BUCKETS; i++) to->parse_hist[i] += from->parse_hist[i];
+}
+
+/* Time the owner context spent handing one read's lines to listeners. */
+static void
+dispatch_record(ZcClient *self, gint64 us) {
+  if (us < 0) us = 0;
+  self->dispatches++;
+  self->dispatch_us_total += (guint64)us;
+  self->dispatch_us_max = MAX(self->dispatch_us_max, (guint64)us);
+}
+
+/* Nearly every line is valid UTF-8 and passes through untouched. Anything
+ * else is decoded from the fallback charset into in_transcoded, which is
+ * reused for the next such line. */
+static gchar *
+ingest_utf8(ZcClient *self, gchar *line, gsize *length) {
+  if (G_LIKELY(zc_utf8_validate(line, *length))) return line;
+
+  GString *out = self->in_transcoded;
+  g_string_truncate(out, 0);
+  in_counters(self)->transcoded++;
+
+  switch (self->in_fallback) {
+  case ZC_FALLBACK_LATIN1:
+  case ZC_FALLBACK_CP1252:
+    zc_utf8_append_from_cp1252(out, line, *length, self->in_fallback == ZC_FALLBACK_CP1252);
+    break;
+  case ZC_FALLBACK_ICONV: {
+    gsize written = 0;
+    gchar *utf8 = g_convert_with_iconv(line, (gssize)*length, self->in_iconv, NULL, &written, NULL);
+    if (utf8) {
+      g_string_append_len(out, utf8, (gssize)written);
+      g_free(utf8);
+      break;
+    }
+    /* Not valid in the fallback either: reset the shift state and repair. */
+    g_iconv(self->in_iconv, NULL, NULL, NULL, NULL);
+  }
+    G_GNUC_FALLTHROUGH;
+  case ZC_FALLBACK_REPLACE:
+  default: {
+    gchar *valid = g_utf8_make_valid(line, (gssize)*length);
+    g_string_append(out, valid);
+    g_free(valid);
+    break;
+  }
+  }
+
+  *length = out->len;
+  return out->str;
+}
+
+/* When @batch is set the view is kept for the "irc-messages" emission at the
+ * end of the chunk instead of being freed here. On the I/O thread nothing is
+ * emitted: the view (and raw line, if wanted) go into the outgoing batch. */
+static void
+handle_line(ZcClient *self, gchar *line, gsize length, gboolean batch) {
+  line = ingest_utf8(self, line, &length);
+
+  const gboolean want_raw = g_signal_has_handler_pending(self, signals[SIG_RAW_LINE], 0, FALSE);
+
+  if (on_io_thread(self)) {
+    ZcIrcMessageView *view = parse_counted(self, line, length);
+    if (!view) return;
+
+    ZcIoBatch *b = self->io_batch;
+    g_ptr_array_add(b->views, view);
+    if (want_raw && !b->raw_lines) {
+      /* Late subscriber: keep the arrays parallel. */
+      b->raw_lines = g_ptr_array_new_with_free_func(g_free);
+      g_ptr_array_set_size(b->raw_lines, b->views->len - 1);
+    }
+    if (b->raw_lines) g_ptr_array_add(b->raw_lines, want_raw ? g_strndup(line, length) : NULL);
+    return;
+  }
+
+  /* Both signals are static-scope: handlers borrow the line/message for the
+   * duration of the emission and must ref/copy to keep them. */
+  if (want_raw) {
+    g_signal_emit(self, signals[SIG_RAW_LINE], 0, line);
+  }
+
+  ZcIrcMessageView *view = parse_counted(self, line, length);
+  if (!view) return;
+  zc_members_apply(self->members, view);
+
+  if (g_signal_has_handler_pending(self, signals[SIG_IRC_MESSAGE], 0, FALSE)) {
+    ZcIrcMessage *msg = zc_irc_message_view_to_message(view);
+    g_signal_emit(self, signals[SIG_IRC_MESSAGE], 0, msg);
+    zc_irc_message_unref(msg);
+  }
+
+  if (batch) {
+    g_ptr_array_add(self->batch, view);
+  } else {
+    track_view(self, view);
+    zc_irc_message_view_free(view);
+  }
+}
+
+/* Deliver the chunk's views in one emission, then tell every listener the
+ * chunk is over so per-line UI work (scrolling, list refreshes) can be
+ * coalesced. */
+static void
+flush_batch(ZcClient *self, guint n_lines) {
+  if (self->batch->len > 0) {
+    g_signal_emit(self, signals[SIG_IRC_MESSAGES], 0, self->batch);
+    for (guint i = 0; i < self->batch->len; i++) track_view(self, g_ptr_array_index(self->batch, i));
+    g_ptr_array_set_size(self->batch, 0);
+  }
+  if (n_lines > 0) g_signal_emit(self, signals[SIG_BATCH_END], 0);
+}
+
+/* ---- I/O thread handoff --------------------------------------------------
+ * The I/O thread fills io_batch while splitting a chunk and publishes it
+ * through the SPSC ring. The owner context is woken at most once until it
+ * drains the ring, however many batches pile up in between.
+ */
+
+static ZcIoBatch *
+io_batch_new(guint generation) {
+  ZcIoBatch *b = g_new0(ZcIoBatch, 1);
+  b->generation = generation;
+  b->views = g_ptr_array_new_with_free_func((GDestroyNotify)zc_irc_message_view_free);
+  return b;
+}
+
+static void
+io_batch_free(ZcIoBatch *b) {
+  g_ptr_array_unref(b->views);
+  if (b->raw_lines) g_ptr_array_unref(b->raw_lines);
+  g_free(b->error_message);
+  g_free(b);
+}
+
+/* Delivers b from its cursor on. With a budget the batch may be cut
+ * between lines; every slice gets its own "irc-messages" and "batch-end".
+ * Returns FALSE when views are left for the next dispatch.
+ */
+static gboolean
+io_batch_deliver(ZcClient *self, ZcIoBatch *b, gint64 t0, gint64 budget) {
+  if (b->next == 0) in_counters_add(&self->in_counters, &b->in);
+  if (b->generation != self->read_generation) return TRUE;
+
+  const gint64 s0 = g_get_monotonic_time();
+  const guint from = b->next;
+
+  const gboolean want_msg = g_signal_has_handler_pending(self, signals[SIG_IRC_MESSAGE], 0, FALSE);
+  while (b->next < b->views->len) {
+    const guint i = b->next++;
+    zc_members_apply(self->members, g_ptr_array_index(b->views, i));
+    const gchar *raw = b->raw_lines ? g_ptr_array_index(b->raw_lines, i) : NULL;
+    if (raw) g_signal_emit(self, signals[SIG_RAW_LINE], 0, raw);
+    if (want_msg) {
+      ZcIrcMessage *msg = zc_irc_message_view_to_message(g_ptr_array_index(b->views, i));
+      g_signal_emit(self, signals[SIG_IRC_MESSAGE], 0, msg);
+      zc_irc_message_unref(msg);
+    }
+    if (b->generation != self->read_generation) return TRUE;
+    if (budget && g_get_monotonic_time() - t0 >= budget) break;
+  }
+
+  if (b->next > from) {
+    /* The whole batch goes out as is; a slice needs its own array. */
+    GPtrArray *slice = b->views;
+    if (from > 0 || b->next < b->views->len) {
+      slice = g_ptr_array_sized_new(b->next - from);
+      for (guint i = from; i < b->next; i++) g_ptr_array_add(slice, g_ptr_array_index(b->views, i));
+    } else {
+      g_ptr_array_ref(slice);
+    }
+    g_signal_emit(self, signals[SIG_IRC_MESSAGES], 0, slice);
+    g_signal_emit(self, signals[SIG_BATCH_END], 0);
+    g_ptr_array_unref(slice);
+    for (guint i = from; i < b->next; i++) track_view(self, g_ptr_array_index(b->views, i));
+    dispatch_record(self, g_get_monotonic_time() - s0);
+  }
+  if (b->next < b->views->len) return FALSE;
+
+  if (b->closed && b->generation == self->read_generation) {
+    connection_lost(self, b->error_code, b->error_message ? b->error_message : "EOF");
+  }
+  return TRUE;
+}
+
+static gboolean io_dispatch_cb(gpointer user_data);
+static gboolean io_resume_cb(gpointer user_data);
+static gboolean io_reader_blocked(ZcClient *self);
+
+/* An idle rather than g_main_context_invoke(), which would run the dispatch
+ * right away on whichever thread can acquire owner_ctx: the I/O thread
+ * before the owner's loop runs, or the owner from inside a dispatch. The
+ * reference is dropped on the owner context. */
+static void
+io_dispatch_schedule(ZcClient *self, gint priority) {
+  GSource *src = g_idle_source_new();
+  g_source_set_priority(src, priority);
+  g_source_set_callback(src, io_dispatch_cb, g_object_ref(self), g_object_unref);
+  g_source_attach(src, self->owner_ctx);
+  g_source_unref(src);
+}
+
+static gboolean
+io_dispatch_cb(gpointer user_data) {
+  ZcClient *self = ZC_CLIENT(user_data);
+  /* Clear first: anything published after this point schedules a new wakeup. */
+  g_atomic_int_set(&self->io_dispatch_pending, 0);
+
+  const gint64 t0 = g_get_monotonic_time();
+  const gint64 budget = self->ingest_budget_us;
+  gboolean cut = FALSE;
+  ZcIoBatch *b;
+  while ((b = self->io_current ? self->io_current : zc_spsc_ring_pop(self->io_ring))) {
+    self->io_current = NULL;
+    if (!io_batch_deliver(self, b, t0, budget)) {
+      self->io_current = b;
+      cut = TRUE;
+      break;
+    }
+    const gint backlog = g_atomic_int_add(&self->io_backlog, -(gint)b->bytes) - (gint)b->bytes;
+    io_batch_free(b);
+    /* There is room again: let a paused reader go on. */
+    if (backlog < ZC_IO_MAX_BACKLOG && g_atomic_int_compare_and_exchange(&self->io_reader_paused, 1, 0)) {
+      g_main_context_invoke_full(self->io_ctx, G_PRIORITY_DEFAULT, io_resume_cb, g_object_ref(self), client_release);
+    }
+    if (budget && g_get_monotonic_time() - t0 >= budget) {
+      cut = TRUE;
+      break;
+    }
+  }
+
+  if (budget) ingest_record(self, g_get_monotonic_time() - t0, cut, 0);
+  /* Over budget: come back below the redraw priority. If the I/O thread
+   * published meanwhile, its wakeup is already on the way. */
+  if (cut && g_atomic_int_compare_and_exchange(&self->io_dispatch_pending, 0, 1)) {
+    io_dispatch_schedule(self, ZC_INGEST_PRIORITY);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+/* Moves parked batches into the ring, oldest first. Returns FALSE when
+ * some are still parked. */
+static gboolean
+io_parked_flush(ZcClient *self) {
+  gboolean pushed = FALSE;
+  ZcIoBatch *b;
+  while ((b = g_queue_peek_head(&self->io_parked)) && zc_spsc_ring_push(self->io_ring, b)) {
+    g_queue_pop_head(&self->io_parked);
+    pushed = TRUE;
+  }
+  if (pushed && g_atomic_int_compare_and_exchange(&self->io_dispatch_pending, 0, 1)) {
+    io_dispatch_schedule(self, G_PRIORITY_DEFAULT);
+  }
+  return g_queue_is_empty(&self->io_parked);
+}
+
+static void
+io_batch_publish(ZcClient *self) {
+  ZcIoBatch *b = self->io_batch;
+  if (b->views->len == 0 && !b->closed) return;
+
+  self->io_batch = io_batch_new(b->generation);
+  g_atomic_int_add(&self->io_backlog, (gint)b->bytes);
+  g_queue_push_tail(&self->io_parked, b);
+  if (io_parked_flush(self)) return;
+
+  /* Owner is behind by a whole ring. Arms the wakeup for what is parked. */
+  g_atomic_int_inc(&self->io_stalls);
+  (void)io_reader_blocked(self);
+}
+
+/* Whether the next read has to wait for the owner: the ring is full or too
+ * much parsed input is still undelivered. Rather than block the thread,
+ * which still has writes and PONGs to send, the reader stops and the owner
+ * resumes it once it has made room. The flag goes up before the re-check,
+ * so room made in between is not missed; whichever side clears the flag
+ * restarts the reader.
+ */
+static gboolean
+io_reader_blocked(ZcClient *self) {
+  if (io_parked_flush(self) && g_atomic_int_get(&self->io_backlog) < ZC_IO_MAX_BACKLOG) return FALSE;
+
+  g_atomic_int_set(&self->io_reader_paused, 1);
+  return !(io_parked_flush(self) && g_atomic_int_get(&self->io_backlog) < ZC_IO_MAX_BACKLOG &&
+           g_atomic_int_compare_and_exchange(&self->io_reader_paused, 1, 0));
+}
+
+/* Runs on the I/O thread once the owner has made room. */
+static gboolean
+io_resume_cb(gpointer user_data) {
+  ZcClient *self = ZC_CLIENT(user_data);
+  if (io_reader_blocked(self) || !self->io_read_stopped) return G_SOURCE_REMOVE;
+
+  self->io_read_stopped = FALSE;
+  if (self->rd_in && !g_cancellable_is_cancelled(self->rd_cancellable)) zc_client_start_read_loop(self);
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer
+io_thread_main(gpointer data) {
+  GMainLoop *loop = data;
+  GMainContext *ctx = g_main_loop_get_context(loop);
+
+  g_main_context_push_thread_default(ctx);
+  g_main_loop_run(loop);
+  g_main_context_pop_thread_default(ctx);
+
+  g_main_loop_unref(loop);
+  return NULL;
+}
+
+static void
+io_thread_stop(ZcClient *self) {
+  if (!self->io_thread) return;
+
+  g_main_loop_quit(self->io_loop);
+  if (g_thread_self() == self->io_thread) g_thread_unref(self->io_thread);
+  else g_thread_join(self->io_thread);
+
+  self->io_thread = NULL;
+  g_clear_pointer(&self->io_loop, g_main_loop_unref);
+  g_clear_pointer(&self->io_ctx, g_main_context_unref);
+}
+
+void
+zc_client_set_io_thread(ZcClient *self, gboolean enable) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(!self->connection);
+
+  if (!enable) {
+    io_thread_stop(self);
+    return;
+  }
+  if (self->io_thread) return;
+
+  if (!self->io_ring) self->io_ring = zc_spsc_ring_new(ZC_IO_RING_SIZE);
+  self->io_ctx = g_main_context_new();
+  self->io_loop = g_main_loop_new(self->io_ctx, FALSE);
+  self->io_thread = g_thread_new("zc-io", io_thread_main, g_main_loop_ref(self->io_loop));
+}
+
+gboolean
+zc_client_get_io_thread(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
+  return self->io_thread != NULL;
+}
+
+/* ---- Ingest slicing -------------------------------------------------------- */
+
+static gboolean ingest_slice_cb(gpointer user_data);
+
+static void
+ingest_record(ZcClient *self, gint64 us, gboolean cut, gsize backlog) {
+  ZcIngestStats *is = &self->ingest_stats;
+  is->slices++;
+  is->max_slice_us = MAX(is->max_slice_us, (guint64)MAX(us, 0));
+  is->backlog_bytes = cut ? backlog : 0;
+  is->max_backlog_bytes = MAX(is->max_backlog_bytes, is->backlog_bytes);
+  if (cut) {
+    is->yields++;
+    if (!self->ingest_paused_at) self->ingest_paused_at = g_get_monotonic_time();
+  } else if (self->ingest_paused_at) {
+    is->paused_us += (guint64)(g_get_monotonic_time() - self->ingest_paused_at);
+    self->ingest_paused_at = 0;
+  }
+}
+
+static void
+ingest_schedule(ZcClient *self) {
+  if (self->ingest_source) return;
+  self->ingest_source = owner_source_add(self, g_idle_source_new(), ZC_INGEST_PRIORITY, ingest_slice_cb);
+}
+
+static void
+ingest_cancel(ZcClient *self) {
+  if (self->ingest_source) {
+    owner_source_remove(self, self->ingest_source);
+    self->ingest_source = 0;
+  }
+  if (self->ingest_paused_at) {
+    self->ingest_stats.paused_us += (guint64)(g_get_monotonic_time() - self->ingest_paused_at);
+    self->ingest_paused_at = 0;
+  }
+  self->ingest_stats.backlog_bytes = 0;
+}
+
+static gboolean
+ingest_slice_cb(gpointer user_data) {
+  ZcClient *self = ZC_CLIENT(user_data);
+  self->ingest_source = 0;
+  if (!self->rd_in || g_cancellable_is_cancelled(self->rd_cancellable)) return G_SOURCE_REMOVE;
+
+  GInputStream *in = self->rd_in;
+  const gboolean more = process_buffered_lines(self);
+  /* Resume reading only once the backlog is gone. */
+  if (self->rd_in == in && !g_cancellable_is_cancelled(self->rd_cancellable)) {
+    if (more) ingest_schedule(self);
+    else zc_client_start_read_loop(self);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+void
+zc_client_set_ingest_budget(ZcClient *self, guint budget_us) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  self->ingest_budget_us = budget_us;
+}
+
+void
+zc_client_get_ingest_stats(ZcClient *self, ZcIngestStats *stats) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(stats != NULL);
+  *stats = self->ingest_stats;
+  stats->io_stalls = (guint64)g_atomic_int_get(&self->io_stalls);
+}
+
+/* Split everything buffered so far into lines and hand each complete one
+ * to the parser. Lines are NUL-terminated in place (over the CR or LF), so
+ * raw-line handlers get a pointer into the buffer without a copy.
+ *
+ * Returns TRUE when the ingest budget ran out with complete lines still
+ * buffered; they stay at the front of rbuf for the next slice.
+ */
+static gboolean
+process_buffered_lines(ZcClient *self) {
+  const gboolean threaded = on_io_thread(self);
+  /* read_generation belongs to the owner; the I/O thread never needs it. */
+  const guint generation = threaded ? 0 : self->read_generation;
+  const gboolean batch = !threaded && g_signal_has_handler_pending(self, signals[SIG_IRC_MESSAGES], 0, FALSE);
+  gchar *buf = self->rbuf;
+  gsize pos = 0;
+  guint n_lines = 0;
+  ZcInCounters *counters = in_counters(self);
+  const gint64 t0 = threaded ? 0 : g_get_monotonic_time();
+  const guint64 parse_ns0 = counters->parse_ns;
+  const gint64 budget = threaded ? 0 : self->ingest_budget_us;
+  gboolean cut = FALSE;
+
+  for (;;) {
+    const gsize from = pos + self->rbuf_scanned;
+    const gchar *nl = zc_scan_newline(buf + from, self->rbuf_len - from);
+    if (!nl) break;
+
+    gchar *line = buf + pos;
+    gsize length = (gsize)(nl - line);
+    const gsize next = length + 1 + pos;
+    self->rbuf_scanned = 0;
+
+    if (self->rbuf_discarding) {
+      self->rbuf_discarding = FALSE;
+      pos = next;
+      continue;
+    }
+
+    if (length > 0 && line[length - 1] == '\r') length--;
+    line[length] = '\0';
+    pos = next;
+
+    if (length > self->max_line) counters->malformed++;
+    if (length == 0 || length > self->max_line) continue;
+
+    handle_line(self, line, length, batch);
+    n_lines++;
+
+    /* A handler may have disconnected (or reconnected) under us. */
+    if (!threaded && (generation != self->read_generation || !self->connected)) {
+      flush_batch(self, n_lines);
+      dispatch_record(self, g_get_monotonic_time() - t0 - (gint64)((counters->parse_ns - parse_ns0) / 1000));
+      return FALSE;
+    }
+
+    if (budget && g_get_monotonic_time() - t0 >= budget) {
+      cut = TRUE;
+      break;
+    }
+  }
+
+  if (threaded) {
+    self->io_batch->bytes += pos;
+    io_batch_publish(self);
+  } else {
+    flush_batch(self, n_lines);
+    if (n_lines > 0) dispatch_record(self, g_get_monotonic_time() - t0 - (gint64)((counters->parse_ns - parse_ns0) / 1000));
+    if (budget) ingest_record(self, g_get_monotonic_time() - t0, cut, self->rbuf_len - pos);
   }
-  GIOStream *s = G_IO_STREAM(conn);
-  self->out = g_io_stream_get_output_stream(s);
-  g_object_ref(self->out);
 
-  GInputStream *in = g_io_stream_get_input_stream(s);
-  self->din = g_data_input_stream_new(in);
-  g_data_input_stream_set_newline_type(self->din, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+  gsize tail = self->rbuf_len - pos;
+  if (cut) {
+    /* Unhandled lines (and maybe a partial one) wait for the next slice. */
+    if (pos > 0 && tail > 0) memmove(buf, buf + pos, tail);
+    self->rbuf_len = tail;
+    self->rbuf_scanned = 0;
+    return TRUE;
+  }
+
+  if (!self->rbuf_discarding && tail > self->max_line) in_counters(self)->malformed++;
+  if (self->rbuf_discarding || tail > self->max_line) {
+    /* No newline within the limit: drop what we have and skip to the next one. */
+    self->rbuf_discarding = TRUE;
+    tail = 0;
+    pos = self->rbuf_len;
+  }
+  if (pos > 0 && tail > 0) memmove(buf, buf + pos, tail);
+  self->rbuf_len = tail;
+  self->rbuf_scanned = tail;
+  return FALSE;
+}
+
+static void
+on_read_chunk(GObject *source, GAsyncResult *res, gpointer user_data) {
+  ZcClient *self = ZC_CLIENT(user_data);
+  GInputStream *in = G_INPUT_STREAM(source);
+  GError *error = NULL;
+
+  gssize n = g_input_stream_read_finish(in, res, &error);
+
+  /* Stale read from a previous connection. */
+  if (self->rd_in != in) {
+    g_clear_error(&error);
+    client_release(self);
+    return;
+  }
+
+  if (n < 0) {
+    /* Normal during disconnect/shutdown. Don’t spam signals or explode. */
+    if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED) &&
+        !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CLOSED)) {
+      report_stream_error(self, error->code, error->message);
+    }
+    g_clear_error(&error);
+    client_release(self);
+    return;
+  }
+
+  if (n == 0) {
+    report_stream_error(self, 0, "EOF");
+    client_release(self);
+    return;
+  }
+
+  self->rbuf_len += (gsize)n;
+  in_counters(self)->bytes += (guint64)n;
+  keepalive_scan(self, (gsize)n);
+  const gboolean more = process_buffered_lines(self);
+
+  /* Only continue if this read still belongs to the current stream. */
+  if (self->rd_in == in && !g_cancellable_is_cancelled(self->rd_cancellable)) {
+    if (on_io_thread(self) && io_reader_blocked(self)) {
+      /* io_resume_cb issues the next read. */
+      self->io_read_stopped = TRUE;
+    } else if (!more) {
+      /* The next read holds its own reference, so ours is not the last. */
+      zc_client_start_read_loop(self);
+      g_object_unref(self);
+      return;
+    } else {
+      ingest_schedule(self);
+    }
+  }
+
+  client_release(self);
+}
+
+static void
+zc_client_start_read_loop(ZcClient *self) {
+  if (!self->rd_in) return;
 
+  /* Hold a ref to self for the lifetime of the async read. */
+  g_input_stream_read_async(
+    self->rd_in,
+    self->rbuf + self->rbuf_len,
+    self->rbuf_cap - self->rbuf_len,
+    G_PRIORITY_DEFAULT,
+    self->rd_cancellable,
+    on_read_chunk,
+    g_object_ref(self)
+  );
+}
+
+typedef struct {
+  ZcClient *self;
+  GInputStream *in;
+  GCancellable *cancellable;
+  guint generation;
+} ZcReaderStart;
+
+static void
+reader_start_free(gpointer data) {
+  ZcReaderStart *rs = data;
+  client_release(rs->self);
+  g_object_unref(rs->in);
+  g_object_unref(rs->cancellable);
+  g_free(rs);
+}
+
+/* Runs on the context that owns the read loop. */
+static gboolean
+reader_start_cb(gpointer data) {
+  ZcReaderStart *rs = data;
+  ZcClient *self = rs->self;
+
+  g_set_object(&self->rd_in, rs->in);
+  g_set_object(&self->rd_cancellable, rs->cancellable);
+
+  /* Room for one full chunk on top of the longest partial line we keep. */
+  const gsize cap = ZC_READ_CHUNK + self->max_line + 1;
+  if (self->rbuf_cap != cap) {
+    g_free(self->rbuf);
+    self->rbuf = g_malloc(cap);
+    self->rbuf_cap = cap;
+  }
+  self->rbuf_len = self->rbuf_scanned = 0;
+  self->rbuf_discarding = FALSE;
+
+  if (self->io_thread) {
+    if (self->io_batch) io_batch_free(self->io_batch);
+    self->io_batch = io_batch_new(rs->generation);
+    /* Leftovers of the previous connection; the owner would drop them. */
+    ZcIoBatch *b;
+    while ((b = g_queue_pop_head(&self->io_parked))) {
+      g_atomic_int_add(&self->io_backlog, -(gint)b->bytes);
+      io_batch_free(b);
+    }
+    self->io_read_stopped = FALSE;
+  }
+
+  zc_client_start_read_loop(self);
+  return G_SOURCE_REMOVE;
+}
+
+typedef struct {
+  gchar *host;
+  guint16 port;
+  gboolean use_tls;
+  gint64 tls_started;
+} ZcConnectData;
+
+static void
+connect_data_free(ZcConnectData *cd) {
+  g_free(cd->host);
+  g_free(cd);
+}
+
+/* Transport is up (and TLS negotiated, if requested): start the session. */
+static void
+connection_ready(ZcClient *self, GTask *task, GIOStream *stream) {
+  write_queue_reset(self);
+  flood_reset(self);
+  caps_reset(self);
+  zc_members_reset(self->members, self->nick);
+  self->connection = stream;
+  g_mutex_lock(&self->write_lock);
+  self->out = g_object_ref(g_io_stream_get_output_stream(stream));
+  g_mutex_unlock(&self->write_lock);
+  g_atomic_int_set(&self->quitting, 0);
+  g_atomic_int_set(&self->linked, 1);
+
+  self->in = g_object_ref(g_io_stream_get_input_stream(stream));
+
+  self->timings.total_us = g_get_monotonic_time() - self->connect_started;
+  self->reg_started = g_get_monotonic_time();
+  memset(&self->reg_timings, 0, sizeof(self->reg_timings));
+  g_clear_pointer(&self->self_userhost, g_free);
+  ingest_decoder_setup(self);
   self->connected = TRUE;
+  /* Resuming: register before listeners run so they can't race it. */
+  if (self->resuming) (void)zc_client_login(self, NULL);
   g_signal_emit(self, signals[SIG_CONNECTED], 0);
-  zc_client_start_read_loop(self);
+
+  /* A "connected" handler may already have disconnected again. */
+  if (self->in) {
+    ZcReaderStart *rs = g_new0(ZcReaderStart, 1);
+    rs->self = g_object_ref(self);
+    rs->in = g_object_ref(self->in);
+    rs->cancellable = g_object_ref(self->cancellable);
+    rs->generation = self->read_generation;
+    if (self->io_thread) {
+      g_main_context_invoke_full(self->io_ctx, G_PRIORITY_DEFAULT, reader_start_cb, rs, reader_start_free);
+    } else {
+      reader_start_cb(rs);
+      reader_start_free(rs);
+    }
+  }
 
   g_task_return_boolean(task, TRUE);
   g_object_unref(task);
 }
 
+static void
+on_tls_handshake(GObject *source, GAsyncResult *res, gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  ZcClient *self = ZC_CLIENT(g_task_get_source_object(task));
+  const ZcConnectData *cd = g_task_get_task_data(task);
+  GTlsConnection *tls = G_TLS_CONNECTION(source);
+  GError *error = NULL;
+
+  if (!g_tls_connection_handshake_finish(tls, res, &error)) {
+    /* A stale or rejected ticket must not break every later attempt. */
+    if (self->timings.tls_session_offered) zc_tls_session_cache_forget(cd->host, cd->port);
+    g_io_stream_close(G_IO_STREAM(tls), NULL, NULL);
+    g_object_unref(tls);
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  self->timings.tls_us = g_get_monotonic_time() - cd->tls_started;
+  if (self->tls_session_cache) zc_tls_session_cache_store(cd->host, cd->port, G_TLS_CLIENT_CONNECTION(tls));
+  connection_ready(self, task, G_IO_STREAM(tls));
+}
+
+static void
+on_connected(GObject *source, GAsyncResult *res, gpointer user_data) {
+  GTask *task = G_TASK(user_data);
+  ZcClient *self = ZC_CLIENT(g_task_get_source_object(task));
+  ZcConnectData *cd = g_task_get_task_data(task);
+  ZcHappyEyeballsInfo info;
+  GError *error = NULL;
+  (void)source;
+
+  GSocketConnection *conn = zc_happy_eyeballs_connect_finish(res, &info, &error);
+  if (!conn) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+
+  self->timings.resolve_us = info.resolve_us;
+  self->timings.tcp_us = info.connect_us;
+  self->timings.attempts = info.attempts;
+  self->timings.dns_cached = info.cached;
+
+  GSocketAddress *remote = g_socket_connection_get_remote_address(conn, NULL);
+  if (remote) {
+    g_free(self->remote_address);
+    self->remote_address = g_socket_connectable_to_string(G_SOCKET_CONNECTABLE(remote));
+    g_object_unref(remote);
+  }
+
+  /* Disable 30s socket I/O timeout (it disconnects idle IRC sessions).
+   * Keep the connect timeout on the GSocketClient, but once connected,
+   * make the socket non-timeout and enable keepalive.
+   */
+  GSocket *sock = g_socket_connection_get_socket(conn);
+  if (sock) {
+    g_socket_set_timeout(sock, 0);
+    g_socket_set_keepalive(sock, TRUE);
+  }
+
+  if (!cd->use_tls) {
+    connection_ready(self, task, G_IO_STREAM(conn));
+    return;
+  }
+
+  /* TLS is layered here rather than via g_socket_client_set_tls() so one
+   * GSocketClient can serve plain and TLS clients alike. */
+  GSocketConnectable *identity = g_network_address_new(cd->host, cd->port);
+  GIOStream *tls = g_tls_client_connection_new(G_IO_STREAM(conn), identity, &error);
+  g_object_unref(identity);
+  g_object_unref(conn);
+  if (!tls) {
+    g_task_return_error(task, error);
+    g_object_unref(task);
+    return;
+  }
+  if (self->tls_database) g_tls_connection_set_database(G_TLS_CONNECTION(tls), self->tls_database);
+  if (self->tls_session_cache) {
+    self->timings.tls_session_offered = zc_tls_session_cache_apply(cd->host, cd->port, G_TLS_CLIENT_CONNECTION(tls));
+  }
+
+  cd->tls_started = g_get_monotonic_time();
+  g_tls_connection_handshake_async(G_TLS_CONNECTION(tls), G_PRIORITY_DEFAULT, self->cancellable, on_tls_handshake, task);
+}
+
 void
 zc_client_connect_async(
   ZcClient *self,
@@ -390,17 +3729,39 @@ zc_client_connect_async(
 
   zc_client_disconnect(self);
 
+  /* A new connect is a new session: nothing to resume. */
+  if (g_strcmp0(self->host, host) != 0) {
+    g_free(self->host);
+    self->host = g_strdup(host);
+  }
+  self->port = port;
+  self->use_tls = use_tls;
+  g_hash_table_remove_all(self->channels);
+
+  connect_start(self, cancellable, callback, user_data);
+}
+
+static void
+connect_start(ZcClient *self, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer user_data) {
   if (self->cancellable) {
     g_cancellable_cancel(self->cancellable);
     g_clear_object(&self->cancellable);
   }
   self->cancellable = cancellable ? g_object_ref(cancellable) : g_cancellable_new();
 
-  g_socket_client_set_tls(self->sock_client, use_tls);
   g_socket_client_set_timeout(self->sock_client, 30);
 
+  ZcConnectData *cd = g_new0(ZcConnectData, 1);
+  cd->host = g_strdup(self->host);
+  cd->port = self->port;
+  cd->use_tls = self->use_tls;
+
+  memset(&self->timings, 0, sizeof(self->timings));
+  self->connect_started = g_get_monotonic_time();
+
   GTask *task = g_task_new(self, self->cancellable, callback, user_data);
-  g_socket_client_connect_to_host_async(self->sock_client, host, port, self->cancellable, on_connected, task);
+  g_task_set_task_data(task, cd, (GDestroyNotify)connect_data_free);
+  zc_happy_eyeballs_connect_async(self->sock_client, cd->host, cd->port, self->cancellable, on_connected, task);
 }
 
 gboolean
@@ -408,3 +3769,16 @@ zc_client_connect_finish(ZcClient *self, GAsyncResult *res, GError **error) {
   g_return_val_if_fail(ZC_IS_CLIENT(self), FALSE);
   return g_task_propagate_boolean(G_TASK(res), error);
 }
+
+const gchar *
+zc_client_get_remote_address(ZcClient *self) {
+  g_return_val_if_fail(ZC_IS_CLIENT(self), NULL);
+  return self->remote_address;
+}
+
+void
+zc_client_get_connect_timings(ZcClient *self, ZcConnectTimings *timings) {
+  g_return_if_fail(ZC_IS_CLIENT(self));
+  g_return_if_fail(timings != NULL);
+  *timings = self->timings;
+}
@@ -0,0 +1,161 @@
+#include "zoitechat/zoitechat.h"
+
+#include <stdio.h>
+
+/* N threads send numbered lines through one client connected to a
+ * loopback server. Sends from threads other than the owner go through the
+ * submission queue and then flood control; the server must see every line
+ * exactly once, and each thread's lines in the order it sent them. */
+
+#define N_SENDERS 8
+#define N_LINES 250
+
+typedef struct {
+  ZcClient *client;
+  guint sender;
+  gint *go;
+} Sender;
+
+typedef struct {
+  GDataInputStream *in;
+  GSocketConnection *conn;
+  guint next[N_SENDERS];
+  guint received;
+  gboolean connected;
+  gboolean failed;
+} Fixture;
+
+static gpointer
+sender_run(gpointer data) {
+  Sender *s = data;
+  /* Alternate lanes: order only has to hold within one sender's lines. */
+  const ZcSendPriority priority = s->sender % 2 ? ZC_SEND_PRIORITY_USER : ZC_SEND_PRIORITY_BULK;
+
+  while (!g_atomic_int_get(s->go)) g_thread_yield();
+  for (guint i = 0; i < N_LINES; i++) {
+    GError *error = NULL;
+    gchar line[64];
+    g_snprintf(line, sizeof(line), "PRIVMSG #t%u :%u", s->sender, i);
+    g_assert_true(zc_client_send_raw(s->client, line, priority, &error));
+    g_assert_no_error(error);
+  }
+  return NULL;
+}
+
+static void
+on_line(GObject *source, GAsyncResult *res, gpointer user_data) {
+  Fixture *f = user_data;
+  GError *error = NULL;
+  gchar *line = g_data_input_stream_read_line_finish(G_DATA_INPUT_STREAM(source), res, NULL, &error);
+
+  if (!line) {
+    if (error) f->failed = TRUE;
+    g_clear_error(&error);
+    return;
+  }
+
+  guint sender = 0, seq = 0;
+  g_assert_cmpint(sscanf(line, "PRIVMSG #t%u :%u", &sender, &seq), ==, 2);
+  g_assert_cmpuint(sender, <, N_SENDERS);
+  g_assert_cmpuint(seq, ==, f->next[sender]);
+  f->next[sender]++;
+  f->received++;
+  g_free(line);
+
+  g_data_input_stream_read_line_async(f->in, G_PRIORITY_DEFAULT, NULL, on_line, f);
+}
+
+static gboolean
+on_incoming(GSocketService *service, GSocketConnection *conn, GObject *source, gpointer user_data) {
+  Fixture *f = user_data;
+  g_assert_null(f->conn);
+  f->conn = g_object_ref(conn);
+  f->in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(conn)));
+  g_data_input_stream_set_newline_type(f->in, G_DATA_STREAM_NEWLINE_TYPE_CR_LF);
+  g_data_input_stream_read_line_async(f->in, G_PRIORITY_DEFAULT, NULL, on_line, f);
+  return TRUE;
+}
+
+static void
+on_connected(GObject *source, GAsyncResult *res, gpointer user_data) {
+  Fixture *f = user_data;
+  GError *error = NULL;
+  g_assert_true(zc_client_connect_finish(ZC_CLIENT(source), res, &error));
+  g_assert_no_error(error);
+  f->connected = TRUE;
+}
+
+static gboolean
+on_timeout(gpointer user_data) {
+  Fixture *f = user_data;
+  f->failed = TRUE;
+  return G_SOURCE_REMOVE;
+}
+
+static void
+test_client_send_threads(gconstpointer data) {
+  const gboolean io_thread = GPOINTER_TO_INT(data);
+  Fixture f = {0};
+  GError *error = NULL;
+
+  GSocketService *service = g_socket_service_new();
+  const guint16 port = g_socket_listener_add_any_inet_port(G_SOCKET_LISTENER(service), NULL, &error);
+  g_assert_no_error(error);
+  g_signal_connect(service, "incoming", G_CALLBACK(on_incoming), &f);
+  g_socket_service_start(service);
+
+  ZcClient *client = zc_client_new();
+  zc_client_set_io_thread(client, io_thread);
+  /* Paced, but quick enough to keep the test short. */
+  zc_client_set_flood_control(client, 5, 1);
+
+  /* Not linked yet: refused up front, on any thread. */
+  g_assert_false(zc_client_send_raw(client, "PRIVMSG #t0 :early", ZC_SEND_PRIORITY_USER, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+  g_clear_error(&error);
+
+  const guint timeout = g_timeout_add_seconds(60, on_timeout, &f);
+  zc_client_connect_async(client, "127.0.0.1", port, FALSE, NULL, on_connected, &f);
+  while (!(f.connected && f.conn) && !f.failed) g_main_context_iteration(NULL, TRUE);
+  g_assert_false(f.failed);
+
+  Sender senders[N_SENDERS];
+  GThread *threads[N_SENDERS];
+  gint go = 0;
+  for (guint i = 0; i < N_SENDERS; i++) {
+    senders[i] = (Sender){client, i, &go};
+    threads[i] = g_thread_new("sender", sender_run, &senders[i]);
+  }
+  g_atomic_int_set(&go, 1);
+
+  while (f.received < N_SENDERS * N_LINES && !f.failed) g_main_context_iteration(NULL, TRUE);
+  g_assert_false(f.failed);
+  for (guint i = 0; i < N_SENDERS; i++) {
+    g_thread_join(threads[i]);
+    g_assert_cmpuint(f.next[i], ==, N_LINES);
+  }
+
+  ZcSendStats stats;
+  zc_client_get_send_stats(client, &stats);
+  g_assert_cmpuint(stats.submitted, ==, N_SENDERS * N_LINES);
+  g_assert_cmpuint(stats.dropped, ==, 0);
+
+  g_source_remove(timeout);
+  zc_client_disconnect(client);
+  g_object_unref(client);
+  g_io_stream_close(G_IO_STREAM(f.conn), NULL, NULL);
+  g_object_unref(f.in);
+  g_object_unref(f.conn);
+  g_socket_service_stop(service);
+  g_socket_listener_close(G_SOCKET_LISTENER(service));
+  g_object_unref(service);
+  while (g_main_context_iteration(NULL, FALSE));
+}
+
+int
+main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+  g_test_add_data_func("/client/send-threads", GINT_TO_POINTER(FALSE), test_client_send_threads);
+  g_test_add_data_func("/client/send-threads-io-thread", GINT_TO_POINTER(TRUE), test_client_send_threads);
+  return g_test_run();
+}
@@ -0,0 +1,415 @@
+#include "zoitechat/irc_message.h"
+
+#include <string.h>
+
+/* ---- View parser ---------------------------------------------------------
+ * @params is the middle params joined with single spaces, NULL for none.
+ * A NULL @command means the line must be rejected.
+ */
+
+typedef struct {
+  const gchar *line;
+  const gchar *tags;
+  const gchar *prefix;
+  const gchar *command;
+  ZcIrcCommand id;
+  const gchar *params;
+  const gchar *trailing;
+} ViewCase;
+
+static const ViewCase view_cases[] = {
+  { "PING :irc.example.net", NULL, NULL, "PING", ZC_IRC_CMD_PING, NULL, "irc.example.net" },
+  { ":nick!u@h PRIVMSG #chan :hello world", NULL, "nick!u@h", "PRIVMSG", ZC_IRC_CMD_PRIVMSG, "#chan", "hello world" },
+  { "@time=2024-01-01T00:00:00Z;msgid=abc :n!u@h privmsg #c :hi",
+    "time=2024-01-01T00:00:00Z;msgid=abc", "n!u@h", "PRIVMSG", ZC_IRC_CMD_PRIVMSG, "#c", "hi" },
+  { ":srv 001 me :Welcome", NULL, "srv", "001", 1, "me", "Welcome" },
+  { ":srv 433 * nick :Nickname is already in use", NULL, "srv", "433", 433, "* nick", "Nickname is already in use" },
+  { "MODE #c +o nick", NULL, NULL, "MODE", ZC_IRC_CMD_MODE, "#c +o nick", NULL },
+  { "PRIVMSG #c :", NULL, NULL, "PRIVMSG", ZC_IRC_CMD_PRIVMSG, "#c", "" },
+  { "PRIVMSG #c ::-)", NULL, NULL, "PRIVMSG", ZC_IRC_CMD_PRIVMSG, "#c", ":-)" },
+  { "PRIVMSG #c :a  b ", NULL, NULL, "PRIVMSG", ZC_IRC_CMD_PRIVMSG, "#c", "a  b " },
+  { "   PING x", NULL, NULL, "PING", ZC_IRC_CMD_PING, "x", NULL },
+  { "PING  a   b  ", NULL, NULL, "PING", ZC_IRC_CMD_PING, "a b", NULL },
+  { "PING\tx", NULL, NULL, "PING", ZC_IRC_CMD_PING, "x", NULL },
+  { "@ PING", "", NULL, "PING", ZC_IRC_CMD_PING, NULL, NULL },
+  { "FOO bar", NULL, NULL, "FOO", ZC_IRC_CMD_UNKNOWN, "bar", NULL },
+  /* RFC 2812: past 14 middle params the rest is trailing. */
+  { "CMD 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16", NULL, NULL, "CMD", ZC_IRC_CMD_UNKNOWN,
+    "1 2 3 4 5 6 7 8 9 10 11 12 13 14", "15 16" },
+  /* Malformed: no command. */
+  { "", NULL, NULL, NULL, 0, NULL, NULL },
+  { "   ", NULL, NULL, NULL, 0, NULL, NULL },
+  { "@a=b", NULL, NULL, NULL, 0, NULL, NULL },
+  { ":prefix", NULL, NULL, NULL, 0, NULL, NULL },
+  { "@a=b :prefix  ", NULL, NULL, NULL, 0, NULL, NULL },
+};
+
+static gchar *
+view_join_params(const ZcIrcMessageView *view) {
+  const guint n = zc_irc_message_view_get_n_params(view);
+  if (n == 0) return NULL;
+
+  GString *s = g_string_new(NULL);
+  for (guint i = 0; i < n; i++) {
+    const gchar *param = zc_irc_message_view_param(view, i);
+    g_assert_cmpuint(zc_irc_message_view_param_len(view, i), ==, strlen(param));
+    if (i) g_string_append_c(s, ' ');
+    g_string_append(s, param);
+  }
+  return g_string_free(s, FALSE);
+}
+
+static void
+test_view_parse(void) {
+  for (guint i = 0; i < G_N_ELEMENTS(view_cases); i++) {
+    const ViewCase *c = &view_cases[i];
+    ZcIrcMessageView *view = zc_irc_message_view_parse(c->line, -1);
+    g_test_message("%s", c->line);
+
+    if (!c->command) {
+      g_assert_null(view);
+      continue;
+    }
+    g_assert_nonnull(view);
+    g_assert_cmpstr(zc_irc_message_view_get_tags(view), ==, c->tags);
+    g_assert_cmpstr(zc_irc_message_view_get_prefix(view), ==, c->prefix);
+    g_assert_cmpstr(zc_irc_message_view_get_command(view), ==, c->command);
+    g_assert_cmpint(zc_irc_message_view_get_command_id(view), ==, c->id);
+    g_assert_cmpstr(zc_irc_message_view_get_trailing(view), ==, c->trailing);
+    gchar *params = view_join_params(view);
+    g_assert_cmpstr(params, ==, c->params);
+    g_free(params);
+
+    /* A copy and the owned message carry the same fields. */
+    ZcIrcMessageView *copy = zc_irc_message_view_copy(view);
+    zc_irc_message_view_free(view);
+    ZcIrcMessage *msg = zc_irc_message_view_to_message(copy);
+    g_assert_cmpstr(msg->prefix, ==, c->prefix);
+    g_assert_cmpstr(msg->command, ==, c->command);
+    g_assert_cmpint(msg->command_id, ==, c->id);
+    g_assert_cmpstr(msg->trailing, ==, c->trailing);
+    g_assert_cmpuint(msg->params->len, ==, zc_irc_message_view_get_n_params(copy));
+    zc_irc_message_unref(msg);
+    zc_irc_message_view_free(copy);
+  }
+}
+
+static void
+test_view_parse_length(void) {
+  /* Only @len bytes count; the line need not be NUL-terminated there. */
+  ZcIrcMessageView *view = zc_irc_message_view_parse("PING :abcXYZ", 9);
+  g_assert_nonnull(view);
+  g_assert_cmpstr(zc_irc_message_view_get_trailing(view), ==, "abc");
+  zc_irc_message_view_free(view);
+
+  g_assert_null(zc_irc_message_view_parse(NULL, -1));
+  g_assert_null(zc_irc_message_view_parse("PING", 0));
+}
+
+/* ---- Tags ----------------------------------------------------------------
+ * Each lookup goes through both the view (scan and unescape one value) and
+ * the owned message (decode all once, then cache). @value NULL: absent.
+ */
+
+typedef struct {
+  const gchar *line;
+  const gchar *key;
+  const gchar *value;
+} TagCase;
+
+static const TagCase tag_cases[] = {
+  { "@a=1;b=2 CMD", "a", "1" },
+  { "@a=1;b=2 CMD", "b", "2" },
+  { "@a=1;b=2 CMD", "c", NULL },
+  { "@a=1;b=2 CMD", "", NULL },
+  /* A repeated key yields its last value, also a bare one. */
+  { "@a=1;a=2 CMD", "a", "2" },
+  { "@a=1;b;a=3 CMD", "a", "3" },
+  { "@a=x;a CMD", "a", "" },
+  { "@a;a=y CMD", "a", "y" },
+  /* Keys match whole, not by prefix. */
+  { "@ab=1;a=2 CMD", "a", "2" },
+  { "@ab=1;a=2 CMD", "ab", "1" },
+  { "@a=1 CMD", "ab", NULL },
+  { "@k CMD", "k", "" },
+  { "@k= CMD", "k", "" },
+  { "@+draft/reply=abc CMD", "+draft/reply", "abc" },
+  /* Escapes: \: \s \\ \r \n; others drop the backslash, as does a trailing one. */
+  { "@k=\\:\\s\\\\\\r\\n CMD", "k", "; \\\r\n" },
+  { "@k=a\\b CMD", "k", "ab" },
+  { "@k=a\\ CMD", "k", "a" },
+  { "@k=\\\\s CMD", "k", "\\s" },
+  { "CMD", "k", NULL },
+};
+
+static void
+test_tags(void) {
+  for (guint i = 0; i < G_N_ELEMENTS(tag_cases); i++) {
+    const TagCase *c = &tag_cases[i];
+    g_test_message("%s [%s]", c->line, c->key);
+
+    ZcIrcMessageView *view = zc_irc_message_view_parse(c->line, -1);
+    g_assert_nonnull(view);
+    gchar *value = zc_irc_message_view_dup_tag(view, c->key);
+    g_assert_cmpstr(value, ==, c->value);
+    g_free(value);
+
+    ZcIrcMessage *msg = zc_irc_message_view_to_message(view);
+    g_assert_cmpstr(zc_irc_message_get_tag(msg, c->key), ==, c->value);
+    /* Second lookup: served from the cache. */
+    g_assert_cmpstr(zc_irc_message_get_tag(msg, c->key), ==, c->value);
+    g_assert_true(zc_irc_message_has_tag(msg, c->key) == (c->value != NULL));
+    zc_irc_message_unref(msg);
+    zc_irc_message_view_free(view);
+  }
+}
+
+/* ---- Command IDs ---------------------------------------------------------
+ * Every verb must land in its own slot of the perfect hash.
+ */
+
+typedef struct {
+  const gchar *name;
+  ZcIrcCommand id;
+} VerbCase;
+
+static const VerbCase verb_cases[] = {
+  { "PRIVMSG", ZC_IRC_CMD_PRIVMSG },
+  { "NOTICE", ZC_IRC_CMD_NOTICE },
+  { "JOIN", ZC_IRC_CMD_JOIN },
+  { "PART", ZC_IRC_CMD_PART },
+  { "QUIT", ZC_IRC_CMD_QUIT },
+  { "NICK", ZC_IRC_CMD_NICK },
+  { "KICK", ZC_IRC_CMD_KICK },
+  { "MODE", ZC_IRC_CMD_MODE },
+  { "TOPIC", ZC_IRC_CMD_TOPIC },
+  { "INVITE", ZC_IRC_CMD_INVITE },
+  { "PING", ZC_IRC_CMD_PING },
+  { "PONG", ZC_IRC_CMD_PONG },
+  { "ERROR", ZC_IRC_CMD_ERROR },
+  { "KILL", ZC_IRC_CMD_KILL },
+  { "WALLOPS", ZC_IRC_CMD_WALLOPS },
+  { "CAP", ZC_IRC_CMD_CAP },
+  { "AUTHENTICATE", ZC_IRC_CMD_AUTHENTICATE },
+  { "ACCOUNT", ZC_IRC_CMD_ACCOUNT },
+  { "AWAY", ZC_IRC_CMD_AWAY },
+  { "CHGHOST", ZC_IRC_CMD_CHGHOST },
+  { "SETNAME", ZC_IRC_CMD_SETNAME },
+  { "BATCH", ZC_IRC_CMD_BATCH },
+  { "TAGMSG", ZC_IRC_CMD_TAGMSG },
+  { "FAIL", ZC_IRC_CMD_FAIL },
+  { "WARN", ZC_IRC_CMD_WARN },
+  { "NOTE", ZC_IRC_CMD_NOTE },
+  { "001", 1 },
+  { "433", 433 },
+  { "999", 999 },
+  /* Misses, including neighbours that share a hash input with a verb. */
+  { "000", ZC_IRC_CMD_UNKNOWN },
+  { "01", ZC_IRC_CMD_UNKNOWN },
+  { "1234", ZC_IRC_CMD_UNKNOWN },
+  { "P", ZC_IRC_CMD_UNKNOWN },
+  { "PRIVMSGS", ZC_IRC_CMD_UNKNOWN },
+  { "PRIVMAG", ZC_IRC_CMD_UNKNOWN },
+  { "JOINT", ZC_IRC_CMD_UNKNOWN },
+  { "PASS", ZC_IRC_CMD_UNKNOWN },
+  { "USER", ZC_IRC_CMD_UNKNOWN },
+  { "CAPS", ZC_IRC_CMD_UNKNOWN },
+  { "AUTHENTICATED", ZC_IRC_CMD_UNKNOWN },
+  { "AUTHENTICATEAUTHENTICATE", ZC_IRC_CMD_UNKNOWN },
+};
+
+static void
+test_command_lookup(void) {
+  guint verbs = 0;
+  for (guint i = 0; i < G_N_ELEMENTS(verb_cases); i++) {
+    const VerbCase *c = &verb_cases[i];
+    g_test_message("%s", c->name);
+
+    g_assert_cmpint(zc_irc_command_lookup(c->name, -1), ==, c->id);
+    gchar *lower = g_ascii_strdown(c->name, -1);
+    g_assert_cmpint(zc_irc_command_lookup(lower, -1), ==, c->id);
+    g_free(lower);
+
+    gchar *line = g_strconcat(c->name, " x", NULL);
+    ZcIrcMessageView *view = zc_irc_message_view_parse(line, -1);
+    g_assert_cmpint(zc_irc_message_view_get_command_id(view), ==, c->id);
+    zc_irc_message_view_free(view);
+    g_free(line);
+
+    if (c->id > ZC_IRC_CMD_NUMERIC_MAX) verbs++;
+  }
+  /* The table above names every verb once. */
+  g_assert_cmpuint(verbs, ==, ZC_IRC_CMD_LAST - ZC_IRC_CMD_PRIVMSG);
+
+  g_assert_cmpint(zc_irc_command_lookup("PRIVMSG", 4), ==, ZC_IRC_CMD_UNKNOWN);
+  g_assert_cmpint(zc_irc_command_lookup("JOINED", 4), ==, ZC_IRC_CMD_JOIN);
+  g_assert_cmpint(zc_irc_command_lookup("", -1), ==, ZC_IRC_CMD_UNKNOWN);
+  g_assert_cmpint(zc_irc_command_lookup(NULL, -1), ==, ZC_IRC_CMD_UNKNOWN);
+}
+
+/* ---- Builder ---------------------------------------------------------------
+ * A NULL @command leaves it unset; @line is NULL unless @status is OK.
+ */
+
+typedef struct {
+  const gchar *tag_key;
+  const gchar *tag_value;
+  const gchar *command;
+  const gchar *param;
+  const gchar *trailing;
+  ZcIrcBuildStatus status;
+  const gchar *line;
+} BuildCase;
+
+static const BuildCase build_cases[] = {
+  { NULL, NULL, "PRIVMSG", "#c", "hi", ZC_IRC_BUILD_OK, "PRIVMSG #c :hi" },
+  { NULL, NULL, "PRIVMSG", "#c", "", ZC_IRC_BUILD_OK, "PRIVMSG #c :" },
+  { NULL, NULL, "PRIVMSG", "#c", ":-) a  b", ZC_IRC_BUILD_OK, "PRIVMSG #c ::-) a  b" },
+  { NULL, NULL, "QUIT", NULL, NULL, ZC_IRC_BUILD_OK, "QUIT" },
+  { "+typing", NULL, "TAGMSG", "#c", NULL, ZC_IRC_BUILD_OK, "@+typing TAGMSG #c" },
+  { "+typing", "", "TAGMSG", "#c", NULL, ZC_IRC_BUILD_OK, "@+typing TAGMSG #c" },
+  { "msgid", "a; b\\c\r\n", "TAGMSG", "#c", NULL, ZC_IRC_BUILD_OK, "@msgid=a\\:\\sb\\\\c\\r\\n TAGMSG #c" },
+  { "k", "v", "PRIVMSG", "#c", "x", ZC_IRC_BUILD_OK, "@k=v PRIVMSG #c :x" },
+  /* Invalid fields. */
+  { "", "v", "PRIVMSG", "#c", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { "a=b", "v", "PRIVMSG", "#c", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { "a;b", NULL, "PRIVMSG", "#c", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { "a b", NULL, "PRIVMSG", "#c", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { NULL, NULL, "", "#c", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { NULL, NULL, ":PRIVMSG", "#c", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { NULL, NULL, "PRIV MSG", "#c", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { NULL, NULL, "PRIVMSG", "", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { NULL, NULL, "PRIVMSG", "#a b", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { NULL, NULL, "PRIVMSG", ":c", "x", ZC_IRC_BUILD_INVALID, NULL },
+  { NULL, NULL, "PRIVMSG", "#c", "a\rb", ZC_IRC_BUILD_INVALID, NULL },
+  { NULL, NULL, "PRIVMSG", "#c", "a\nb", ZC_IRC_BUILD_INVALID, NULL },
+  /* No command at all. */
+  { NULL, NULL, NULL, NULL, NULL, ZC_IRC_BUILD_INVALID, NULL },
+  { "k", "v", NULL, NULL, NULL, ZC_IRC_BUILD_INVALID, NULL },
+};
+
+static void
+check_build(const ZcIrcMessageBuilder *b, ZcIrcBuildStatus status, const gchar *expected) {
+  gsize len = 0;
+  const gchar *line = zc_irc_message_builder_get_line(b, &len);
+  g_assert_cmpint(zc_irc_message_builder_get_status(b), ==, status);
+  g_assert_cmpstr(line, ==, expected);
+  if (line) g_assert_cmpuint(len, ==, strlen(expected));
+}
+
+static void
+test_builder(void) {
+  for (guint i = 0; i < G_N_ELEMENTS(build_cases); i++) {
+    const BuildCase *c = &build_cases[i];
+    ZcIrcMessageBuilder b;
+    g_test_message("case %u", i);
+
+    zc_irc_message_builder_init(&b);
+    if (c->tag_key) zc_irc_message_builder_add_tag(&b, c->tag_key, c->tag_value);
+    if (c->command) zc_irc_message_builder_set_command(&b, c->command);
+    if (c->param) zc_irc_message_builder_add_param(&b, c->param, -1);
+    if (c->trailing) zc_irc_message_builder_add_trailing(&b, c->trailing, -1);
+    check_build(&b, c->status, c->line);
+  }
+}
+
+static void
+test_builder_limits(void) {
+  ZcIrcMessageBuilder b;
+  /* "PRIVMSG #c :" is 12 bytes; the body may use 510 (512 less CRLF). */
+  gchar *fill = g_strnfill(ZC_IRC_LINE_MAX, 'x');
+
+  for (gsize n = 496; n <= 500; n++) {
+    zc_irc_message_builder_init(&b);
+    zc_irc_message_builder_set_command(&b, "PRIVMSG");
+    zc_irc_message_builder_add_param(&b, "#c", -1);
+    zc_irc_message_builder_add_trailing(&b, fill, (gssize)n);
+    gchar *line = g_strdup_printf("PRIVMSG #c :%.*s", (int)n, fill);
+    if (n <= 498) check_build(&b, ZC_IRC_BUILD_OK, line);
+    else check_build(&b, ZC_IRC_BUILD_TOO_LONG, NULL);
+    g_free(line);
+  }
+
+  /* Appending counts against the same limit. */
+  zc_irc_message_builder_init(&b);
+  zc_irc_message_builder_set_command(&b, "PRIVMSG");
+  zc_irc_message_builder_add_param(&b, "#c", -1);
+  zc_irc_message_builder_add_trailing(&b, fill, 400);
+  zc_irc_message_builder_append(&b, fill, 98);
+  g_assert_cmpint(zc_irc_message_builder_get_status(&b), ==, ZC_IRC_BUILD_OK);
+  zc_irc_message_builder_append(&b, "y", 1);
+  check_build(&b, ZC_IRC_BUILD_TOO_LONG, NULL);
+
+  /* The first problem sticks. */
+  zc_irc_message_builder_init(&b);
+  zc_irc_message_builder_set_command(&b, "PRIVMSG");
+  zc_irc_message_builder_add_param(&b, "a b", -1);
+  zc_irc_message_builder_add_param(&b, "#c", -1);
+  zc_irc_message_builder_add_trailing(&b, fill, -1);
+  check_build(&b, ZC_IRC_BUILD_INVALID, NULL);
+
+  /* Only @len bytes of a param are used. */
+  zc_irc_message_builder_init(&b);
+  zc_irc_message_builder_set_command(&b, "JOIN");
+  zc_irc_message_builder_add_param(&b, "#chanXXX", 5);
+  check_build(&b, ZC_IRC_BUILD_OK, "JOIN #chan");
+
+  g_free(fill);
+}
+
+static void
+test_builder_tag_limits(void) {
+  ZcIrcMessageBuilder b;
+  /* "@k=" plus the value may fill ZC_IRC_CLIENT_TAGS_MAX less the space. */
+  const gsize room = ZC_IRC_CLIENT_TAGS_MAX - 1 - 3;
+  gchar *value = g_strnfill(room + 1, 'v');
+  gchar *semis = g_strnfill(room / 2 + 1, ';');
+  gchar *body = g_strnfill(ZC_IRC_LINE_MAX, 'x');
+
+  zc_irc_message_builder_init(&b);
+  value[room] = '\0';
+  zc_irc_message_builder_add_tag(&b, "k", value);
+  zc_irc_message_builder_set_command(&b, "PRIVMSG");
+  zc_irc_message_builder_add_param(&b, "#c", -1);
+  /* The body limit is separate from the tags'. */
+  zc_irc_message_builder_add_trailing(&b, body, ZC_IRC_LINE_MAX - 2 - 12);
+  gsize len = 0;
+  g_assert_nonnull(zc_irc_message_builder_get_line(&b, &len));
+  g_assert_cmpuint(len, ==, ZC_IRC_CLIENT_TAGS_MAX + ZC_IRC_LINE_MAX - 2);
+
+  zc_irc_message_builder_init(&b);
+  value[room] = 'v';
+  zc_irc_message_builder_add_tag(&b, "k", value);
+  zc_irc_message_builder_set_command(&b, "TAGMSG");
+  check_build(&b, ZC_IRC_BUILD_TOO_LONG, NULL);
+
+  /* Escaped bytes count twice. */
+  zc_irc_message_builder_init(&b);
+  semis[room / 2] = '\0';
+  zc_irc_message_builder_add_tag(&b, "k", semis);
+  zc_irc_message_builder_set_command(&b, "TAGMSG");
+  g_assert_cmpint(zc_irc_message_builder_get_status(&b), ==, ZC_IRC_BUILD_OK);
+
+  zc_irc_message_builder_init(&b);
+  semis[room / 2] = ';';
+  zc_irc_message_builder_add_tag(&b, "k", semis);
+  zc_irc_message_builder_set_command(&b, "TAGMSG");
+  check_build(&b, ZC_IRC_BUILD_TOO_LONG, NULL);
+
+  g_free(body);
+  g_free(semis);
+  g_free(value);
+}
+
+int
+main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+  g_test_add_func("/irc-message/view-parse", test_view_parse);
+  g_test_add_func("/irc-message/view-parse-length", test_view_parse_length);
+  g_test_add_func("/irc-message/tags", test_tags);
+  g_test_add_func("/irc-message/command-lookup", test_command_lookup);
+  g_test_add_func("/irc-message/builder", test_builder);
+  g_test_add_func("/irc-message/builder-limits", test_builder_limits);
+  g_test_add_func("/irc-message/builder-tag-limits", test_builder_tag_limits);
+  return g_test_run();
+}
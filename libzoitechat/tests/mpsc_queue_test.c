@@ -0,0 +1,103 @@
+#include "mpsc_queue.h"
+
+/* N producers push numbered items as fast as they can while the main
+ * thread takes batches. Every item must arrive exactly once, and each
+ * producer's items in the order it pushed them. */
+
+#define N_PRODUCERS 8
+#define N_ITEMS 200000
+
+typedef struct {
+  ZcMpscNode node; /* first: the queue hands back ZcMpscNode* */
+  guint producer;
+  guint seq;
+} Item;
+
+typedef struct {
+  ZcMpscQueue *queue;
+  Item *items;
+  guint producer;
+  gint *go;
+  guint wakeups;
+} Producer;
+
+static gpointer
+producer_run(gpointer data) {
+  Producer *p = data;
+  while (!g_atomic_int_get(p->go)) g_thread_yield();
+  for (guint i = 0; i < N_ITEMS; i++) {
+    p->items[i].producer = p->producer;
+    p->items[i].seq = i;
+    if (zc_mpsc_queue_push(p->queue, &p->items[i].node)) p->wakeups++;
+  }
+  return NULL;
+}
+
+static void
+test_mpsc_queue_stress(void) {
+  ZcMpscQueue queue = ZC_MPSC_QUEUE_INIT;
+  Producer producers[N_PRODUCERS];
+  GThread *threads[N_PRODUCERS];
+  guint next[N_PRODUCERS] = {0};
+  gint go = 0;
+
+  for (guint i = 0; i < N_PRODUCERS; i++) {
+    producers[i] = (Producer){&queue, g_new0(Item, N_ITEMS), i, &go, 0};
+    threads[i] = g_thread_new("producer", producer_run, &producers[i]);
+  }
+  g_atomic_int_set(&go, 1);
+
+  guint64 total = 0;
+  guint batches = 0;
+  while (total < (guint64)N_PRODUCERS * N_ITEMS) {
+    ZcMpscNode *n = zc_mpsc_queue_take(&queue);
+    if (!n) {
+      g_thread_yield();
+      continue;
+    }
+    batches++;
+    for (; n; n = n->next) {
+      const Item *it = (const Item *)n;
+      g_assert_cmpuint(it->producer, <, N_PRODUCERS);
+      g_assert_cmpuint(it->seq, ==, next[it->producer]);
+      next[it->producer]++;
+      total++;
+    }
+  }
+
+  guint wakeups = 0;
+  for (guint i = 0; i < N_PRODUCERS; i++) {
+    g_thread_join(threads[i]);
+    wakeups += producers[i].wakeups;
+    g_assert_cmpuint(next[i], ==, N_ITEMS);
+    g_free(producers[i].items);
+  }
+  g_assert_null(zc_mpsc_queue_take(&queue));
+  g_assert_cmpuint(total, ==, (guint64)N_PRODUCERS * N_ITEMS);
+  /* Each non-empty take was preceded by exactly one push onto empty. */
+  g_assert_cmpuint(wakeups, ==, batches);
+}
+
+static void
+test_mpsc_queue_empty(void) {
+  ZcMpscQueue queue = ZC_MPSC_QUEUE_INIT;
+  Item a = {0}, b = {0};
+
+  g_assert_null(zc_mpsc_queue_take(&queue));
+  g_assert_true(zc_mpsc_queue_push(&queue, &a.node));
+  g_assert_false(zc_mpsc_queue_push(&queue, &b.node));
+
+  ZcMpscNode *n = zc_mpsc_queue_take(&queue);
+  g_assert_true(n == &a.node);
+  g_assert_true(n->next == &b.node);
+  g_assert_null(n->next->next);
+  g_assert_null(zc_mpsc_queue_take(&queue));
+}
+
+int
+main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+  g_test_add_func("/mpsc-queue/empty", test_mpsc_queue_empty);
+  g_test_add_func("/mpsc-queue/stress", test_mpsc_queue_stress);
+  return g_test_run();
+}
@@ -0,0 +1,152 @@
+/* Built together with line_scan.c so each newline scanner can be checked
+ * on its own, not only the one the CPU selects. */
+#include "line_scan.c"
+#include "utf8_scan.h"
+
+/* ---- Newline scanners ------------------------------------------------------
+ * Every implementation must agree with memchr() for any alignment, length
+ * and newline position, whatever the other bytes are.
+ */
+
+typedef struct {
+  const gchar *name;
+  const gchar *(*scan)(const gchar *p, gsize len);
+} Scanner;
+
+/* Bytes next to '\n' in value, or with its low bits, to trip up the SWAR
+ * zero-byte test and signed compares. */
+static const guchar fillers[] = { 'a', 0x00, 0x09, 0x0B, 0x0D, 0x8A, 0x4A, 0xFF };
+
+static void
+check_scanner(const Scanner *s) {
+  gchar buf[160];
+
+  for (guint f = 0; f < G_N_ELEMENTS(fillers); f++) {
+    memset(buf, fillers[f], sizeof(buf));
+    for (gsize off = 0; off < 32; off++) {
+      for (gsize len = 0; len <= 100; len++) {
+        gchar *p = buf + off;
+        g_assert_true(s->scan(p, len) == memchr(p, '\n', len));
+
+        for (gsize at = 0; at < len; at++) {
+          p[at] = '\n';
+          if (at + 1 < len) p[len - 1] = '\n'; /* the first one wins */
+          const gchar *found = s->scan(p, len);
+          if (found != p + at) g_error("%s: filler %02x off %" G_GSIZE_FORMAT " len %" G_GSIZE_FORMAT " nl %" G_GSIZE_FORMAT, s->name, fillers[f], off, len, at);
+          p[at] = (gchar)fillers[f];
+          p[len - 1] = (gchar)fillers[f];
+        }
+      }
+    }
+  }
+}
+
+static void
+test_scan_newline(void) {
+  Scanner scanners[] = {
+    { "swar", scan_newline_swar },
+#ifdef ZC_SCAN_X86
+    { "sse2", scan_newline_sse2 },
+    { "avx2", NULL },
+#endif
+    { "dispatch", zc_scan_newline },
+  };
+
+#ifdef ZC_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) scanners[2].scan = scan_newline_avx2;
+#endif
+
+  for (guint i = 0; i < G_N_ELEMENTS(scanners); i++) {
+    if (!scanners[i].scan) {
+      g_test_message("%s: not supported here", scanners[i].name);
+      continue;
+    }
+    check_scanner(&scanners[i]);
+  }
+  g_assert_null(zc_scan_newline(NULL, 0));
+}
+
+/* ---- UTF-8 validation ------------------------------------------------------
+ * Each sequence is also checked behind ASCII runs of every length around the
+ * SIMD block sizes, and followed by ASCII, so all prefix scanners see it.
+ */
+
+typedef struct {
+  const gchar *bytes;
+  gsize len;
+  gboolean valid;
+} Utf8Case;
+
+#define U(s, valid) { s, sizeof(s) - 1, valid }
+
+static const Utf8Case utf8_cases[] = {
+  U("", TRUE),
+  U("abc", TRUE),
+  U("\0", TRUE),
+  U("\x7F", TRUE),
+  /* Two bytes: U+0080..U+07FF; C0 and C1 only start overlongs. */
+  U("\xC2\x80", TRUE),
+  U("\xDF\xBF", TRUE),
+  U("\xC0\x80", FALSE),
+  U("\xC1\xBF", FALSE),
+  U("\xC2\x41", FALSE),
+  U("\xC2", FALSE),
+  /* Three bytes: U+0800..U+FFFF without the surrogates. */
+  U("\xE0\xA0\x80", TRUE),
+  U("\xE0\x80\x80", FALSE),
+  U("\xE0\x9F\xBF", FALSE),
+  U("\xE2\x82\xAC", TRUE),
+  U("\xE2\x82", FALSE),
+  U("\xE2\x28\xA1", FALSE),
+  U("\xED\x9F\xBF", TRUE),
+  U("\xED\xA0\x80", FALSE),
+  U("\xED\xBF\xBF", FALSE),
+  U("\xEE\x80\x80", TRUE),
+  U("\xEF\xBF\xBF", TRUE),
+  /* Four bytes: U+10000..U+10FFFF. */
+  U("\xF0\x90\x80\x80", TRUE),
+  U("\xF0\x9F\x98\x80", TRUE),
+  U("\xF0\x80\x80\x80", FALSE),
+  U("\xF0\x8F\xBF\xBF", FALSE),
+  U("\xF4\x8F\xBF\xBF", TRUE),
+  U("\xF4\x90\x80\x80", FALSE),
+  U("\xF5\x80\x80\x80", FALSE),
+  U("\xF0\x9F\x98", FALSE),
+  /* Bytes that never occur. */
+  U("\x80", FALSE),
+  U("\xBF", FALSE),
+  U("\xF8\x88\x80\x80\x80", FALSE),
+  U("\xFE", FALSE),
+  U("\xFF", FALSE),
+};
+
+#undef U
+
+static void
+test_utf8_validate(void) {
+  static const gsize runs[] = { 0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65 };
+  gchar buf[128];
+
+  for (guint i = 0; i < G_N_ELEMENTS(utf8_cases); i++) {
+    const Utf8Case *c = &utf8_cases[i];
+    for (guint r = 0; r < G_N_ELEMENTS(runs); r++) {
+      for (gsize tail = 0; tail <= 1; tail++) {
+        const gsize n = runs[r] + c->len + tail;
+        memset(buf, 'a', sizeof(buf));
+        memcpy(buf + runs[r], c->bytes, c->len);
+        if (zc_utf8_validate(buf, n) != c->valid) {
+          g_error("case %u: ASCII run %" G_GSIZE_FORMAT ", tail %" G_GSIZE_FORMAT ": expected %s", i, runs[r], tail, c->valid ? "valid" : "invalid");
+        }
+      }
+    }
+  }
+}
+
+int
+main(int argc, char **argv) {
+  g_test_init(&argc, &argv, NULL);
+  g_test_add_func("/scan/newline", test_scan_newline);
+  g_test_add_func("/scan/utf8-validate", test_utf8_validate);
+  return g_test_run();
+}
@@ -19,6 +19,16 @@ struct _ChatPage {
   GtkWidget *user_scroller;
   GtkWidget *user_view;
   GtkListStore *user_store;
+  GHashTable *user_rows;   /* folded nick -> GtkTreeIter* into user_store */
+
+  /* Scroll batching: while held, appends only mark the view dirty. */
+  gboolean scroll_held;
+  gboolean scroll_pending;
+
+  /* Outgoing send job (a paste or split message), hidden when idle. */
+  GtkWidget *send_progress;
+  GtkWidget *send_cancel;
+  guint send_job;
 };
 
 static gboolean
@@ -40,24 +50,39 @@ prefix_rank(gchar prefix) {
   }
 }
 
-static gboolean
-user_store_find(ChatPage *p, const gchar *nick, GtkTreeIter *out_iter) {
-  if (!p || !p->user_store || !nick || !*nick) return FALSE;
-
-  GtkTreeIter iter;
-  gboolean valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(p->user_store), &iter);
-  while (valid) {
-    gchar *cur = NULL;
-    gtk_tree_model_get(GTK_TREE_MODEL(p->user_store), &iter, ZC_USERLIST_COL_NICK, &cur, -1);
-    gboolean match = (cur && g_ascii_strcasecmp(cur, nick) == 0);
-    g_free(cur);
-    if (match) {
-      if (out_iter) *out_iter = iter;
-      return TRUE;
-    }
-    valid = gtk_tree_model_iter_next(GTK_TREE_MODEL(p->user_store), &iter);
+/* List store iters stay valid as long as their row exists. */
+static GtkTreeIter *
+user_row_lookup(ChatPage *p, const gchar *nick) {
+  if (!p || !p->user_rows || !nick || !*nick) return NULL;
+  gchar *fold = g_ascii_strdown(nick, -1);
+  GtkTreeIter *iter = g_hash_table_lookup(p->user_rows, fold);
+  g_free(fold);
+  return iter;
+}
+
+static void
+user_row_remove(ChatPage *p, const gchar *nick) {
+  gchar *fold = g_ascii_strdown(nick, -1);
+  GtkTreeIter *iter = g_hash_table_lookup(p->user_rows, fold);
+  if (iter) {
+    gtk_list_store_remove(p->user_store, iter);
+    g_hash_table_remove(p->user_rows, fold);
   }
-  return FALSE;
+  g_free(fold);
+}
+
+/* The store's default string sort collates through g_utf8_collate(); the
+ * keys are "<rank> <ascii-folded nick>", so a byte compare is enough. */
+static gint
+user_sort_cmp(GtkTreeModel *model, GtkTreeIter *a, GtkTreeIter *b, gpointer data) {
+  (void)data;
+  gchar *ka = NULL, *kb = NULL;
+  gtk_tree_model_get(model, a, ZC_USERLIST_COL_SORTKEY, &ka, -1);
+  gtk_tree_model_get(model, b, ZC_USERLIST_COL_SORTKEY, &kb, -1);
+  const gint r = g_strcmp0(ka, kb);
+  g_free(ka);
+  g_free(kb);
+  return r;
 }
 
 static gchar *
@@ -74,6 +99,16 @@ timestamp_now(void) {
   return g_strdup(buf);
 }
 
+/* Server-supplied times (IRCv3 server-time) are shown in local time. */
+static gchar *
+timestamp_at(GDateTime *when) {
+  if (!when) return timestamp_now();
+  GDateTime *local = g_date_time_to_local(when);
+  gchar *ts = local ? g_date_time_format(local, "%H:%M") : NULL;
+  if (local) g_date_time_unref(local);
+  return ts ? ts : timestamp_now();
+}
+
 /* -------------------------------------------------------------------------
  * ANSI SGR (\x1b[...m) support for chat windows.
  *
@@ -612,7 +647,9 @@ chat_page_new(const gchar *target) {
   if (is_chan) {
     p->user_store = gtk_list_store_new(ZC_USERLIST_N_COLS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
     GtkTreeSortable *sortable = GTK_TREE_SORTABLE(p->user_store);
+    gtk_tree_sortable_set_sort_func(sortable, ZC_USERLIST_COL_SORTKEY, user_sort_cmp, NULL, NULL);
     gtk_tree_sortable_set_sort_column_id(sortable, ZC_USERLIST_COL_SORTKEY, GTK_SORT_ASCENDING);
+    p->user_rows = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
     p->user_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(p->user_store));
     gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(p->user_view), FALSE);
@@ -646,6 +683,17 @@ chat_page_new(const gchar *target) {
 
   gtk_box_pack_start(GTK_BOX(entry_box), p->entry, TRUE, TRUE, 0);
 
+  p->send_progress = gtk_progress_bar_new();
+  gtk_progress_bar_set_show_text(GTK_PROGRESS_BAR(p->send_progress), TRUE);
+  gtk_widget_set_valign(p->send_progress, GTK_ALIGN_CENTER);
+  gtk_widget_set_no_show_all(p->send_progress, TRUE);
+  p->send_cancel = gtk_button_new_with_label("Cancel");
+  gtk_widget_set_no_show_all(p->send_cancel, TRUE);
+  g_object_add_weak_pointer(G_OBJECT(p->send_progress), (gpointer *)&p->send_progress);
+  g_object_add_weak_pointer(G_OBJECT(p->send_cancel), (gpointer *)&p->send_cancel);
+  gtk_box_pack_start(GTK_BOX(entry_box), p->send_progress, FALSE, FALSE, 0);
+  gtk_box_pack_start(GTK_BOX(entry_box), p->send_cancel, FALSE, FALSE, 0);
+
   gtk_box_pack_start(GTK_BOX(p->root), p->top_row, TRUE, TRUE, 0);
   gtk_box_pack_start(GTK_BOX(p->root), entry_box, FALSE, FALSE, 0);
 
@@ -664,6 +712,9 @@ chat_page_free(ChatPage *p) {
   if (p->textview) g_object_remove_weak_pointer(G_OBJECT(p->textview), (gpointer *)&p->textview);
   if (p->scroller) g_object_remove_weak_pointer(G_OBJECT(p->scroller), (gpointer *)&p->scroller);
   if (p->root)     g_object_remove_weak_pointer(G_OBJECT(p->root),     (gpointer *)&p->root);
+  if (p->send_progress) g_object_remove_weak_pointer(G_OBJECT(p->send_progress), (gpointer *)&p->send_progress);
+  if (p->send_cancel)   g_object_remove_weak_pointer(G_OBJECT(p->send_cancel),   (gpointer *)&p->send_cancel);
+  if (p->user_rows) g_hash_table_unref(p->user_rows);
   g_free(p->target);
   g_free(p);
 }
@@ -683,6 +734,35 @@ chat_page_get_entry(ChatPage *p) {
   return p ? GTK_ENTRY(p->entry) : NULL;
 }
 
+void
+chat_page_set_send_progress(ChatPage *p, guint job, guint sent, guint total) {
+  if (!p || !p->send_progress || !p->send_cancel) return;
+  if (total == 0 || sent >= total) {
+    p->send_job = 0;
+    gtk_widget_hide(p->send_progress);
+    gtk_widget_hide(p->send_cancel);
+    return;
+  }
+
+  p->send_job = job;
+  gchar *text = g_strdup_printf("Sending %u/%u", sent, total);
+  gtk_progress_bar_set_text(GTK_PROGRESS_BAR(p->send_progress), text);
+  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(p->send_progress), (gdouble)sent / (gdouble)total);
+  g_free(text);
+  gtk_widget_show(p->send_progress);
+  gtk_widget_show(p->send_cancel);
+}
+
+guint
+chat_page_get_send_job(ChatPage *p) {
+  return p ? p->send_job : 0;
+}
+
+GtkWidget *
+chat_page_get_send_cancel_button(ChatPage *p) {
+  return p ? p->send_cancel : NULL;
+}
+
 GtkTextBuffer *
 chat_page_get_buffer(ChatPage *p) {
   return p ? p->buffer : NULL;
@@ -697,8 +777,25 @@ void
 chat_page_userlist_clear(ChatPage *p) {
   if (!p || !p->user_store) return;
   gtk_list_store_clear(p->user_store);
+  g_hash_table_remove_all(p->user_rows);
+}
+
+void
+chat_page_userlist_freeze(ChatPage *p) {
+  if (!p || !p->user_view) return;
+  gtk_tree_view_set_model(GTK_TREE_VIEW(p->user_view), NULL);
 }
 
+void
+chat_page_userlist_thaw(ChatPage *p) {
+  if (!p || !p->user_view || !p->user_store) return;
+  gtk_tree_view_set_model(GTK_TREE_VIEW(p->user_view), GTK_TREE_MODEL(p->user_store));
+}
+
+/* Rows go in with gtk_list_store_insert_with_values(), which a sorted store
+ * places by binary search. Setting the sort column on an existing row would
+ * instead emit "rows-reordered" with a new order for the whole list, so a
+ * row whose key changes is removed and inserted again. */
 void
 chat_page_userlist_upsert(ChatPage *p, const gchar *nick, gchar prefix) {
   if (!p || !p->user_store || !nick || !*nick) return;
@@ -707,24 +804,34 @@ chat_page_userlist_upsert(ChatPage *p, const gchar *nick, gchar prefix) {
   gchar *disp = px ? g_strdup_printf("%c%s", px, nick) : g_strdup(nick);
   gchar *fold = g_ascii_strdown(nick, -1);
   gchar *sort = g_strdup_printf("%d %s", prefix_rank(px), fold);
-  g_free(fold);
 
-  GtkTreeIter iter;
-  if (user_store_find(p, nick, &iter)) {
-    gtk_list_store_set(p->user_store, &iter,
-      ZC_USERLIST_COL_NICK, nick,
-      ZC_USERLIST_COL_DISPLAY, disp,
-      ZC_USERLIST_COL_SORTKEY, sort,
-      -1);
-  } else {
-    gtk_list_store_append(p->user_store, &iter);
-    gtk_list_store_set(p->user_store, &iter,
+  GtkTreeIter *row = g_hash_table_lookup(p->user_rows, fold);
+  gboolean same_place = FALSE;
+  if (row) {
+    gchar *old = NULL;
+    gtk_tree_model_get(GTK_TREE_MODEL(p->user_store), row, ZC_USERLIST_COL_SORTKEY, &old, -1);
+    same_place = g_strcmp0(old, sort) == 0;
+    g_free(old);
+    if (same_place) {
+      gtk_list_store_set(p->user_store, row, ZC_USERLIST_COL_NICK, nick, ZC_USERLIST_COL_DISPLAY, disp, -1);
+    } else {
+      gtk_list_store_remove(p->user_store, row);
+    }
+  }
+
+  if (!same_place) {
+    GtkTreeIter iter;
+    gtk_list_store_insert_with_values(p->user_store, &iter, -1,
       ZC_USERLIST_COL_NICK, nick,
       ZC_USERLIST_COL_DISPLAY, disp,
       ZC_USERLIST_COL_SORTKEY, sort,
       -1);
+    /* Replacing frees the old iter copy along with its key. */
+    g_hash_table_replace(p->user_rows, fold, g_memdup2(&iter, sizeof(iter)));
+    fold = NULL;
   }
 
+  g_free(fold);
   g_free(disp);
   g_free(sort);
 }
@@ -732,39 +839,38 @@ chat_page_userlist_upsert(ChatPage *p, const gchar *nick, gchar prefix) {
 void
 chat_page_userlist_remove(ChatPage *p, const gchar *nick) {
   if (!p || !p->user_store || !nick || !*nick) return;
-  GtkTreeIter iter;
-  if (user_store_find(p, nick, &iter)) {
-    gtk_list_store_remove(p->user_store, &iter);
-  }
+  user_row_remove(p, nick);
 }
 
 void
 chat_page_userlist_rename(ChatPage *p, const gchar *oldnick, const gchar *newnick) {
   if (!p || !p->user_store || !oldnick || !*oldnick || !newnick || !*newnick) return;
 
-  GtkTreeIter iter;
-  if (!user_store_find(p, oldnick, &iter)) return;
+  GtkTreeIter *row = user_row_lookup(p, oldnick);
+  if (!row) return;
 
   gchar *disp = NULL;
-  gtk_tree_model_get(GTK_TREE_MODEL(p->user_store), &iter, ZC_USERLIST_COL_DISPLAY, &disp, -1);
+  gtk_tree_model_get(GTK_TREE_MODEL(p->user_store), row, ZC_USERLIST_COL_DISPLAY, &disp, -1);
   gchar px = '\0';
-  if (disp && (disp[0] == '~' || disp[0] == '&' || disp[0] == '@' || disp[0] == '%' || disp[0] == '+')) {
-    px = disp[0];
-  }
+  if (disp && prefix_rank(disp[0]) < prefix_rank('\0')) px = disp[0];
   g_free(disp);
 
-  GtkTreeIter dup;
-  if (user_store_find(p, newnick, &dup)) {
-    gtk_list_store_remove(p->user_store, &dup);
-  }
+  user_row_remove(p, oldnick);
   chat_page_userlist_upsert(p, newnick, px);
-  if (user_store_find(p, oldnick, &iter)) {
-    gtk_list_store_remove(p->user_store, &iter);
-  }
+}
+
+gboolean
+chat_page_userlist_contains(ChatPage *p, const gchar *nick) {
+  return user_row_lookup(p, nick) != NULL;
 }
 
 void
 chat_page_append(ChatPage *p, const gchar *line) {
+  chat_page_append_at(p, NULL, line);
+}
+
+void
+chat_page_append_at(ChatPage *p, GDateTime *when, const gchar *line) {
   if (!p || !line) return;
 
   if (!p->buffer || !p->scroller) return;
@@ -772,7 +878,7 @@ chat_page_append(ChatPage *p, const gchar *line) {
   GtkTextIter end;
   gtk_text_buffer_get_end_iter(p->buffer, &end);
 
-  gchar *ts = timestamp_now();
+  gchar *ts = timestamp_at(when);
   gchar *prefix = g_strdup_printf("[%s] ", ts);
 
   /* Timestamp prefix is always plain; message supports ANSI colors. */
@@ -783,6 +889,17 @@ chat_page_append(ChatPage *p, const gchar *line) {
   g_free(prefix);
   g_free(ts);
 
+  if (p->scroll_held) {
+    p->scroll_pending = TRUE;
+    return;
+  }
+  chat_page_scroll_to_end(p);
+}
+
+void
+chat_page_scroll_to_end(ChatPage *p) {
+  if (!p || !p->scroller) return;
+
   /* Auto-scroll to bottom without fighting GTK layout too hard. */
   GtkAdjustment *vadj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(p->scroller));
   const gdouble upper = gtk_adjustment_get_upper(vadj);
@@ -792,6 +909,22 @@ chat_page_append(ChatPage *p, const gchar *line) {
   gtk_adjustment_set_value(vadj, value);
 }
 
+void
+chat_page_hold_scroll(ChatPage *p) {
+  if (!p) return;
+  p->scroll_held = TRUE;
+}
+
+void
+chat_page_release_scroll(ChatPage *p) {
+  if (!p || !p->scroll_held) return;
+  p->scroll_held = FALSE;
+  if (p->scroll_pending) {
+    p->scroll_pending = FALSE;
+    chat_page_scroll_to_end(p);
+  }
+}
+
 void
 chat_page_append_fmt(ChatPage *p, const gchar *fmt, ...) {
   if (!p || !fmt) return;
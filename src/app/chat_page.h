@@ -22,8 +22,26 @@ const gchar *chat_page_get_target(ChatPage *page);
 
 void chat_page_append(ChatPage *page, const gchar *line);
 void chat_page_append_fmt(ChatPage *page, const gchar *fmt, ...) G_GNUC_PRINTF(2, 3);
+/* Like chat_page_append() but stamped with @when (e.g. IRCv3 server-time);
+ * @when NULL means now.
+ */
+void chat_page_append_at(ChatPage *page, GDateTime *when, const gchar *line);
+void chat_page_scroll_to_end(ChatPage *page);
+
+/* While held, appends skip the per-line auto-scroll; releasing scrolls once
+ * if anything was appended in between.
+ */
+void chat_page_hold_scroll(ChatPage *page);
+void chat_page_release_scroll(ChatPage *page);
 
 GtkEntry *chat_page_get_entry(ChatPage *page);
+
+/* Progress of the page's outgoing send job next to the entry, with a
+ * Cancel button; @total 0 (or @sent reaching it) hides both.
+ */
+void chat_page_set_send_progress(ChatPage *page, guint job, guint sent, guint total);
+guint chat_page_get_send_job(ChatPage *page);
+GtkWidget *chat_page_get_send_cancel_button(ChatPage *page);
 GtkTextBuffer *chat_page_get_buffer(ChatPage *page);
 
 /* Channel-only: returns the user list view (GtkTreeView). Returns NULL for
@@ -31,10 +49,16 @@ GtkTextBuffer *chat_page_get_buffer(ChatPage *page);
  */
 GtkWidget *chat_page_get_userlist_view(ChatPage *page);
 
-/* Channel-only helpers. No-ops for status/query pages. */
+/* Channel-only helpers. No-ops for status/query pages. Rows are indexed by
+ * nick, so each call costs a hash lookup plus a sorted insert or removal.
+ */
 void chat_page_userlist_clear(ChatPage *page);
 void chat_page_userlist_upsert(ChatPage *page, const gchar *nick, gchar prefix);
 void chat_page_userlist_remove(ChatPage *page, const gchar *nick);
 void chat_page_userlist_rename(ChatPage *page, const gchar *oldnick, const gchar *newnick);
+gboolean chat_page_userlist_contains(ChatPage *page, const gchar *nick);
+/* Detach the store from the view around a full refill. */
+void chat_page_userlist_freeze(ChatPage *page);
+void chat_page_userlist_thaw(ChatPage *page);
 
 G_END_DECLS
@@ -0,0 +1,202 @@
+#include "metrics.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+#ifdef G_OS_WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+struct _ZcMetricsWriter {
+  ZcSession *session;
+  gchar *path;
+  guint source;
+};
+
+/* Label values escape backslash, double quote and newline. @extra is an
+ * already formatted second label, or NULL. */
+static void
+append_labels(GString *out, const gchar *value, const gchar *extra) {
+  g_string_append(out, "{network=\"");
+  for (const gchar *p = value ? value : ""; *p; p++) {
+    if (*p == '\\') g_string_append(out, "\\\\");
+    else if (*p == '"') g_string_append(out, "\\\"");
+    else if (*p == '\n') g_string_append(out, "\\n");
+    else g_string_append_c(out, *p);
+  }
+  g_string_append_c(out, '"');
+  if (extra) g_string_append_printf(out, ",%s", extra);
+  g_string_append_c(out, '}');
+}
+
+typedef enum {
+  METRIC_COUNTER,
+  METRIC_GAUGE
+} MetricKind;
+
+typedef struct {
+  const gchar *name;
+  MetricKind kind;
+  const gchar *help;
+  gdouble (*value)(const ZcClientStats *st);
+} MetricSpec;
+
+#define FIELD(f) static gdouble get_##f(const ZcClientStats *st) { return (gdouble)st->f; }
+FIELD(lines_in)
+FIELD(bytes_in)
+FIELD(lines_out)
+FIELD(bytes_out)
+FIELD(malformed)
+FIELD(dispatches)
+FIELD(write_queue_depth)
+FIELD(write_queue_bytes)
+FIELD(flood_queued)
+FIELD(reconnects)
+FIELD(ping_timeouts)
+FIELD(pongs_sent)
+FIELD(lines_transcoded)
+#undef FIELD
+
+static gdouble get_dispatch_s(const ZcClientStats *st) { return st->dispatch_us_total / 1e6; }
+static gdouble get_dispatch_max_s(const ZcClientStats *st) { return st->dispatch_us_max / 1e6; }
+static gdouble get_rtt_s(const ZcClientStats *st) { return st->rtt_us / 1e6; }
+static gdouble get_rtt_jitter_s(const ZcClientStats *st) { return st->rtt_jitter_us / 1e6; }
+
+static const MetricSpec metrics[] = {
+  {"zoitechat_lines_received", METRIC_COUNTER, "Lines read from the server.", get_lines_in},
+  {"zoitechat_received_bytes", METRIC_COUNTER, "Bytes read from the server.", get_bytes_in},
+  {"zoitechat_lines_sent", METRIC_COUNTER, "Lines written to the server.", get_lines_out},
+  {"zoitechat_sent_bytes", METRIC_COUNTER, "Bytes written to the server.", get_bytes_out},
+  {"zoitechat_malformed_lines", METRIC_COUNTER, "Lines dropped as unparsable or over-long.", get_malformed},
+  {"zoitechat_dispatches", METRIC_COUNTER, "Socket reads handed to listeners.", get_dispatches},
+  {"zoitechat_dispatch_seconds", METRIC_COUNTER, "Time spent delivering reads to listeners.", get_dispatch_s},
+  {"zoitechat_dispatch_max_seconds", METRIC_GAUGE, "Longest single delivery.", get_dispatch_max_s},
+  {"zoitechat_write_queue_lines", METRIC_GAUGE, "Lines not yet accepted by the socket.", get_write_queue_depth},
+  {"zoitechat_write_queue_bytes", METRIC_GAUGE, "Bytes not yet accepted by the socket.", get_write_queue_bytes},
+  {"zoitechat_flood_queued_lines", METRIC_GAUGE, "Lines waiting for a flood-control token.", get_flood_queued},
+  {"zoitechat_rtt_seconds", METRIC_GAUGE, "Smoothed PING round trip.", get_rtt_s},
+  {"zoitechat_rtt_jitter_seconds", METRIC_GAUGE, "Smoothed PING round-trip deviation.", get_rtt_jitter_s},
+  {"zoitechat_reconnects", METRIC_COUNTER, "Reconnect attempts.", get_reconnects},
+  {"zoitechat_ping_timeouts", METRIC_COUNTER, "Connections dropped by the lag check.", get_ping_timeouts},
+  {"zoitechat_pongs_sent", METRIC_COUNTER, "Server PINGs answered.", get_pongs_sent},
+  {"zoitechat_transcoded_lines", METRIC_COUNTER, "Lines decoded from the fallback charset.", get_lines_transcoded},
+};
+
+gchar *
+zc_metrics_render(ZcSession *session) {
+  g_return_val_if_fail(ZC_IS_SESSION(session), NULL);
+
+  const guint n = zc_session_get_n_networks(session);
+  ZcClientStats *stats = g_new0(ZcClientStats, MAX(n, 1));
+  const gchar **names = g_new0(const gchar *, MAX(n, 1));
+  gboolean *connected = g_new0(gboolean, MAX(n, 1));
+  for (guint i = 0; i < n; i++) {
+    const ZcNetworkConfig *c = zc_session_get_nth_config(session, i);
+    ZcClient *client = zc_session_get_client(session, c->name);
+    names[i] = c->name;
+    connected[i] = zc_client_is_connected(client);
+    zc_client_get_stats(client, &stats[i]);
+  }
+
+  GString *out = g_string_new(NULL);
+
+  g_string_append(out, "# TYPE zoitechat_connected gauge\n# HELP zoitechat_connected Whether the network is connected.\n");
+  for (guint i = 0; i < n; i++) {
+    g_string_append(out, "zoitechat_connected");
+    append_labels(out, names[i], NULL);
+    g_string_append_printf(out, " %d\n", connected[i] ? 1 : 0);
+  }
+
+  gchar num[G_ASCII_DTOSTR_BUF_SIZE];
+  for (guint m = 0; m < G_N_ELEMENTS(metrics); m++) {
+    const MetricSpec *spec = &metrics[m];
+    const gboolean counter = spec->kind == METRIC_COUNTER;
+    g_string_append_printf(out, "# TYPE %s %s\n# HELP %s %s\n",
+      spec->name, counter ? "counter" : "gauge", spec->name, spec->help);
+    for (guint i = 0; i < n; i++) {
+      g_string_append_printf(out, "%s%s", spec->name, counter ? "_total" : "");
+      append_labels(out, names[i], NULL);
+      g_string_append_printf(out, " %s\n", g_ascii_dtostr(num, sizeof(num), spec->value(&stats[i])));
+    }
+  }
+
+  /* Buckets are cumulative in OpenMetrics; the library's are not. */
+  g_string_append(out, "# TYPE zoitechat_parse_seconds histogram\n# HELP zoitechat_parse_seconds Time to parse one line.\n");
+  for (guint i = 0; i < n; i++) {
+    guint64 cumulative = 0;
+    for (guint b = 0; b < ZC_STATS_PARSE_BUCKETS; b++) {
+      const guint64 le = zc_client_stats_parse_bucket_le_ns(b);
+      cumulative += stats[i].parse_hist[b];
+      gchar *bound = le == G_MAXUINT64 ? g_strdup("le=\"+Inf\"")
+                                       : g_strdup_printf("le=\"%s\"", g_ascii_dtostr(num, sizeof(num), le / 1e9));
+      g_string_append(out, "zoitechat_parse_seconds_bucket");
+      append_labels(out, names[i], bound);
+      g_free(bound);
+      g_string_append_printf(out, " %" G_GUINT64_FORMAT "\n", cumulative);
+    }
+    g_string_append(out, "zoitechat_parse_seconds_sum");
+    append_labels(out, names[i], NULL);
+    g_string_append_printf(out, " %s\n", g_ascii_dtostr(num, sizeof(num), stats[i].parse_ns_total / 1e9));
+    g_string_append(out, "zoitechat_parse_seconds_count");
+    append_labels(out, names[i], NULL);
+    g_string_append_printf(out, " %" G_GUINT64_FORMAT "\n", cumulative);
+  }
+
+  g_string_append(out, "# EOF\n");
+
+  g_free(connected);
+  g_free(names);
+  g_free(stats);
+  return g_string_free(out, FALSE);
+}
+
+static gboolean
+writer_tick(gpointer user_data) {
+  ZcMetricsWriter *w = user_data;
+  gchar *text = zc_metrics_render(w->session);
+  GError *error = NULL;
+  /* Written to a temporary and renamed, so a scrape never sees half a file. */
+  if (!g_file_set_contents(w->path, text, -1, &error)) {
+    g_warning("metrics: %s", error->message);
+    g_clear_error(&error);
+  }
+  g_free(text);
+  return G_SOURCE_CONTINUE;
+}
+
+ZcMetricsWriter *
+zc_metrics_writer_new(ZcSession *session, guint interval_s) {
+  g_return_val_if_fail(ZC_IS_SESSION(session), NULL);
+  g_return_val_if_fail(interval_s > 0, NULL);
+
+  gchar *dir = g_build_filename(g_get_user_runtime_dir(), "zoitechat-lite", NULL);
+  if (g_mkdir_with_parents(dir, 0700) != 0) {
+    g_warning("metrics: cannot create %s", dir);
+    g_free(dir);
+    return NULL;
+  }
+
+  ZcMetricsWriter *w = g_new0(ZcMetricsWriter, 1);
+  w->session = g_object_ref(session);
+  gchar *file = g_strdup_printf("zoitechat-lite-%d.prom", (gint)getpid());
+  w->path = g_build_filename(dir, file, NULL);
+  g_free(file);
+  g_free(dir);
+
+  writer_tick(w);
+  w->source = g_timeout_add_seconds(interval_s, writer_tick, w);
+  return w;
+}
+
+void
+zc_metrics_writer_free(ZcMetricsWriter *w) {
+  if (!w) return;
+  if (w->source) g_source_remove(w->source);
+  /* A stale file would keep reporting a client that is gone. */
+  g_unlink(w->path);
+  g_free(w->path);
+  g_object_unref(w->session);
+  g_free(w);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glib.h>
+#include "zoitechat/session.h"
+
+G_BEGIN_DECLS
+
+/* OpenMetrics text for every network in @session, one label per network. */
+gchar *zc_metrics_render(ZcSession *session);
+
+/* Rewrites $XDG_RUNTIME_DIR/zoitechat-lite/zoitechat-lite-<pid>.prom every
+ * @interval_s seconds (atomically, for a node exporter textfile collector)
+ * and removes it again when freed.
+ */
+typedef struct _ZcMetricsWriter ZcMetricsWriter;
+
+ZcMetricsWriter *zc_metrics_writer_new(ZcSession *session, guint interval_s);
+void zc_metrics_writer_free(ZcMetricsWriter *writer);
+
+G_END_DECLS
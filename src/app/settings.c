@@ -1,5 +1,8 @@
 #include "settings.h"
 #include <glib/gstdio.h>
+#include <string.h>
+
+#define NETWORK_GROUP_PREFIX "network:"
 
 static gchar *settings_path(void) {
   const gchar *base = g_get_user_config_dir();
@@ -10,18 +13,99 @@ static gchar *settings_path(void) {
   return path;
 }
 
+static void network_free(ZcNetworkSettings *n) {
+  if (!n) return;
+  g_free(n->name);
+  g_free(n->host);
+  g_free(n->nick);
+  g_free(n->user);
+  g_free(n->realname);
+  g_free(n->auto_join);
+  g_free(n->sasl_account);
+  g_free(n->sasl_password);
+  g_free(n->charset);
+  g_free(n);
+}
+
+static ZcNetworkSettings *network_new(const gchar *name) {
+  ZcNetworkSettings *n = g_new0(ZcNetworkSettings, 1);
+  n->name = g_strdup(name);
+  n->port = 6697;
+  n->tls = TRUE;
+  n->nick = g_strdup("zoiteguest");
+  n->user = g_strdup("zoite");
+  n->realname = g_strdup("ZoiteChat Lite");
+  n->auto_join = g_strdup("");
+  n->sasl_account = g_strdup("");
+  n->sasl_password = g_strdup("");
+  n->charset = g_strdup("CP1252");
+  n->autoconnect = FALSE;
+  return n;
+}
+
 static void set_defaults(ZcSettings *s) {
-  s->host = g_strdup("irc.zoite.net");
-  s->port = 6697;
-  s->tls = TRUE;
-  s->nick = g_strdup("zoiteguest");
-  s->user = g_strdup("zoite");
-  s->realname = g_strdup("ZoiteChat Lite");
-  s->auto_join = g_strdup("#zoite");
+  s->networks = g_ptr_array_new_with_free_func((GDestroyNotify)network_free);
   s->win_w = 980;
   s->win_h = 640;
 }
 
+static void add_default_network(ZcSettings *s) {
+  ZcNetworkSettings *n = zc_settings_add_network(s, "ZoiteNet");
+  n->host = g_strdup("irc.zoite.net");
+  g_free(n->auto_join);
+  n->auto_join = g_strdup("#zoite");
+}
+
+ZcNetworkSettings *zc_settings_find_network(const ZcSettings *s, const gchar *name) {
+  if (!s || !name) return NULL;
+  for (guint i = 0; i < s->networks->len; i++) {
+    ZcNetworkSettings *n = g_ptr_array_index(s->networks, i);
+    if (g_strcmp0(n->name, name) == 0) return n;
+  }
+  return NULL;
+}
+
+ZcNetworkSettings *zc_settings_add_network(ZcSettings *s, const gchar *name) {
+  g_return_val_if_fail(s != NULL && name != NULL && *name, NULL);
+  if (zc_settings_find_network(s, name)) return NULL;
+  ZcNetworkSettings *n = network_new(name);
+  g_ptr_array_add(s->networks, n);
+  return n;
+}
+
+void zc_settings_remove_network(ZcSettings *s, ZcNetworkSettings *net) {
+  if (!s || !net) return;
+  g_ptr_array_remove(s->networks, net);
+}
+
+/* Reads one network from @group; used for "network:NAME" and the legacy
+ * single-server [connection] group.
+ */
+static void load_network(GKeyFile *kf, const gchar *group, ZcNetworkSettings *n) {
+  #define GETSTR(key,field) \
+    if (g_key_file_has_key(kf, group, key, NULL)) { g_free(n->field); n->field = g_key_file_get_string(kf, group, key, NULL); }
+
+  GETSTR("host",host)
+  GETSTR("nick",nick)
+  GETSTR("user",user)
+  GETSTR("realname",realname)
+  GETSTR("auto_join",auto_join)
+  GETSTR("sasl_account",sasl_account)
+  GETSTR("sasl_password",sasl_password)
+  GETSTR("charset",charset)
+
+  #undef GETSTR
+
+  if (g_key_file_has_key(kf, group, "port", NULL)) {
+    const gint port_i = g_key_file_get_integer(kf, group, "port", NULL);
+    if (port_i > 0 && port_i <= 65535) n->port = (guint16)port_i;
+  }
+  if (g_key_file_has_key(kf, group, "tls", NULL))
+    n->tls = g_key_file_get_boolean(kf, group, "tls", NULL);
+  if (g_key_file_has_key(kf, group, "autoconnect", NULL))
+    n->autoconnect = g_key_file_get_boolean(kf, group, "autoconnect", NULL);
+}
+
 ZcSettings *zc_settings_load(void) {
   ZcSettings *s = g_new0(ZcSettings, 1);
   set_defaults(s);
@@ -34,24 +118,27 @@ ZcSettings *zc_settings_load(void) {
     g_clear_error(&error);
     g_key_file_free(kf);
     g_free(path);
+    add_default_network(s);
     return s;
   }
 
-  #define GETSTR(sec,key,field) \
-    if (g_key_file_has_key(kf, sec, key, NULL)) { g_free(s->field); s->field = g_key_file_get_string(kf, sec, key, NULL); }
-
-  GETSTR("connection","host",host)
-  GETSTR("connection","nick",nick)
-  GETSTR("connection","user",user)
-  GETSTR("connection","realname",realname)
-  GETSTR("connection","auto_join",auto_join)
-
-  if (g_key_file_has_key(kf, "connection", "port", NULL)) {
-    const gint port_i = g_key_file_get_integer(kf, "connection", "port", NULL);
-    if (port_i > 0 && port_i <= 65535) s->port = (guint16)port_i;
+  gchar **groups = g_key_file_get_groups(kf, NULL);
+  for (gchar **g = groups; g && *g; g++) {
+    if (!g_str_has_prefix(*g, NETWORK_GROUP_PREFIX)) continue;
+    const gchar *name = *g + strlen(NETWORK_GROUP_PREFIX);
+    ZcNetworkSettings *n = zc_settings_add_network(s, name);
+    if (n) load_network(kf, *g, n);
+  }
+  g_strfreev(groups);
+
+  /* Settings written before multi-network support: one server in [connection]. */
+  if (s->networks->len == 0 && g_key_file_has_group(kf, "connection")) {
+    gchar *host = g_key_file_get_string(kf, "connection", "host", NULL);
+    ZcNetworkSettings *n = zc_settings_add_network(s, host && *host ? host : "Network");
+    load_network(kf, "connection", n);
+    g_free(host);
   }
-  if (g_key_file_has_key(kf, "connection", "tls", NULL))
-    s->tls = g_key_file_get_boolean(kf, "connection", "tls", NULL);
+  if (s->networks->len == 0) add_default_network(s);
 
   if (g_key_file_has_key(kf, "window", "width", NULL)) {
     const gint w = g_key_file_get_integer(kf, "window", "width", NULL);
@@ -61,6 +148,10 @@ ZcSettings *zc_settings_load(void) {
     const gint h = g_key_file_get_integer(kf, "window", "height", NULL);
     if (h > 0) s->win_h = h;
   }
+  if (g_key_file_has_key(kf, "metrics", "interval", NULL)) {
+    const gint i = g_key_file_get_integer(kf, "metrics", "interval", NULL);
+    if (i > 0) s->metrics_interval = (guint)i;
+  }
 
   g_key_file_free(kf);
   g_free(path);
@@ -73,21 +164,36 @@ gboolean zc_settings_save(const ZcSettings *s, GError **error) {
   gchar *path = settings_path();
   GKeyFile *kf = g_key_file_new();
 
-  g_key_file_set_string(kf, "connection", "host", s->host ? s->host : "");
-  g_key_file_set_integer(kf, "connection", "port", (gint)s->port);
-  g_key_file_set_boolean(kf, "connection", "tls", s->tls);
-
-  g_key_file_set_string(kf, "connection", "nick", s->nick ? s->nick : "");
-  g_key_file_set_string(kf, "connection", "user", s->user ? s->user : "");
-  g_key_file_set_string(kf, "connection", "realname", s->realname ? s->realname : "");
-  g_key_file_set_string(kf, "connection", "auto_join", s->auto_join ? s->auto_join : "");
+  for (guint i = 0; i < s->networks->len; i++) {
+    const ZcNetworkSettings *n = g_ptr_array_index(s->networks, i);
+    gchar *group = g_strconcat(NETWORK_GROUP_PREFIX, n->name, NULL);
+
+    g_key_file_set_string(kf, group, "host", n->host ? n->host : "");
+    g_key_file_set_integer(kf, group, "port", (gint)n->port);
+    g_key_file_set_boolean(kf, group, "tls", n->tls);
+
+    g_key_file_set_string(kf, group, "nick", n->nick ? n->nick : "");
+    g_key_file_set_string(kf, group, "user", n->user ? n->user : "");
+    g_key_file_set_string(kf, group, "realname", n->realname ? n->realname : "");
+    g_key_file_set_string(kf, group, "auto_join", n->auto_join ? n->auto_join : "");
+    if (n->sasl_account && *n->sasl_account) {
+      g_key_file_set_string(kf, group, "sasl_account", n->sasl_account);
+      g_key_file_set_string(kf, group, "sasl_password", n->sasl_password ? n->sasl_password : "");
+    }
+    g_key_file_set_string(kf, group, "charset", n->charset ? n->charset : "");
+    g_key_file_set_boolean(kf, group, "autoconnect", n->autoconnect);
+
+    g_free(group);
+  }
 
   if (s->win_w > 0) g_key_file_set_integer(kf, "window", "width", s->win_w);
   if (s->win_h > 0) g_key_file_set_integer(kf, "window", "height", s->win_h);
+  if (s->metrics_interval > 0) g_key_file_set_integer(kf, "metrics", "interval", (gint)s->metrics_interval);
 
   gsize len = 0;
   gchar *data = g_key_file_to_data(kf, &len, NULL);
-  gboolean ok = g_file_set_contents(path, data, (gssize)len, error);
+  /* may hold a SASL password: keep it private to the user */
+  gboolean ok = g_file_set_contents_full(path, data, (gssize)len, G_FILE_SET_CONTENTS_CONSISTENT, 0600, error);
 
   g_free(data);
   g_key_file_free(kf);
@@ -97,10 +203,6 @@ gboolean zc_settings_save(const ZcSettings *s, GError **error) {
 
 void zc_settings_free(ZcSettings *s) {
   if (!s) return;
-  g_free(s->host);
-  g_free(s->nick);
-  g_free(s->user);
-  g_free(s->realname);
-  g_free(s->auto_join);
+  g_ptr_array_unref(s->networks);
   g_free(s);
 }
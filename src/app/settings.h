@@ -4,6 +4,8 @@
 G_BEGIN_DECLS
 
 typedef struct {
+  gchar *name;
+
   gchar *host;
   guint16 port;
   gboolean tls;
@@ -13,12 +15,33 @@ typedef struct {
   gchar *realname;
   gchar *auto_join;
 
+  /* SASL PLAIN; empty account disables it */
+  gchar *sasl_account;
+  gchar *sasl_password;
+
+  /* incoming lines that aren't UTF-8 are decoded from this; empty: repair */
+  gchar *charset;
+
+  gboolean autoconnect;
+} ZcNetworkSettings;
+
+typedef struct {
+  GPtrArray *networks; /* ZcNetworkSettings*, in display order */
+
   gint win_w;
   gint win_h;
+
+  /* seconds between OpenMetrics snapshots; 0: none */
+  guint metrics_interval;
 } ZcSettings;
 
 ZcSettings *zc_settings_load(void);
 gboolean zc_settings_save(const ZcSettings *s, GError **error);
 void zc_settings_free(ZcSettings *s);
 
+/* Returns the new entry (owned by @s), seeded with the default identity. */
+ZcNetworkSettings *zc_settings_add_network(ZcSettings *s, const gchar *name);
+ZcNetworkSettings *zc_settings_find_network(const ZcSettings *s, const gchar *name);
+void zc_settings_remove_network(ZcSettings *s, ZcNetworkSettings *net);
+
 G_END_DECLS
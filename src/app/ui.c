@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include "chat_page.h"
 #include "settings.h"
+#include "metrics.h"
 
 static void on_connect_clicked(GtkButton *btn, gpointer user_data);
 static void on_disconnect_clicked(GtkButton *btn, gpointer user_data);
@@ -11,15 +12,41 @@ static void on_disconnect_clicked(GtkButton *btn, gpointer user_data);
 
 #include "zoitechat/zoitechat.h"
 #include "zoitechat/irc_message.h"
+#include "zoitechat/session.h"
 
+/* One per top-level window: the header bar, the per-network notebook and the
+ * session that owns every network's client. */
 typedef struct {
   GtkApplication *app;
   GtkWidget *win;
 
+  /* one page per network, each holding that network's own notebook */
+  GtkWidget *networks;
+  GtkWidget *menu_btn;
+  GtkWidget *conn_toggle_btn;
+
+  ZcSession *session;
+  GPtrArray *nets; /* UiState*, one per network */
+
+  /* persisted settings */
+  ZcSettings *settings;
+  ZcMetricsWriter *metrics; /* NULL unless [metrics] interval is set */
+
+  /* last known normal window size (avoid saving 1x1 during teardown) */
+  gint last_win_w;
+  gint last_win_h;
+} UiWindow;
+
+/* Per-network state. */
+typedef struct {
+  GtkApplication *app;
+  GtkWidget *win;
+  UiWindow *uw;
+  ZcNetworkSettings *net;
+
   GtkWidget *notebook;
-  GtkWidget *status_label;
+  gchar *status_text;
 
-  GtkWidget *menu_btn;
   ZcClient *client;
 
   /* current connection settings */
@@ -30,21 +57,23 @@ typedef struct {
   gchar *user;
   gchar *realname;
   gchar *auto_join;
+  gchar *sasl_account;
+  gchar *sasl_password;
 
-  gboolean autojoin_pending;
   /* map target -> ChatPage* */
   GHashTable *pages;
 
-  GtkWidget *conn_toggle_btn;
-  /* channel -> (nick -> prefix string) */
-  GHashTable *chan_users;
-
-  /* persisted settings */
-  ZcSettings *settings;
-
-  /* last known normal window size (avoid saving 1x1 during teardown) */
-  gint last_win_w;
-  gint last_win_h;
+  /* Set between "irc-messages" and "batch-end": scrolling and userlist
+   * updates are deferred and done once per socket read, when the client's
+   * membership model has the whole read applied. */
+  gboolean in_batch;
+  GHashTable *dirty_userlists; /* channel name set */
+  gboolean dirty_userlists_all;
+  GHashTable *dirty_members; /* channel name -> nick set */
+  GHashTable *dirty_nicks;   /* nick set, synced on every channel */
+
+  /* "time" tag of the message being dispatched (IRCv3 server-time), or NULL */
+  GDateTime *msg_time;
 } UiState;
 
 
@@ -66,24 +95,27 @@ static gchar *zcl_userlist_normalize_nick(const gchar *s);
 
 static gboolean on_window_configure(GtkWidget *w, GdkEventConfigure *ev, gpointer user_data);
 static gboolean on_window_delete(GtkWidget *w, GdkEvent *ev, gpointer user_data);
-static void zcl_window_store_size_if_reasonable(UiState *st, GtkWindow *win, gint w, gint h);
-static void zcl_settings_sync_and_save(UiState *st);
+static void zcl_window_store_size_if_reasonable(UiWindow *uw, GtkWindow *win, gint w, gint h);
+static void zcl_settings_sync_and_save(UiWindow *uw);
+static UiState *ui_window_current(UiWindow *uw);
 
 static void on_userlist_menu_send_dm(GtkMenuItem *mi, gpointer user_data);
 static void on_userlist_menu_whois(GtkMenuItem *mi, gpointer user_data);
 static void on_userlist_menu_copy(GtkMenuItem *mi, gpointer user_data);
 
+/* The header bar button follows whichever network tab is in front. */
 static void
 ui_update_connect_toggle_button(UiState *st) {
-  if (!st || !st->conn_toggle_btn) return;
+  if (!st || !st->uw || !st->uw->conn_toggle_btn) return;
+  if (ui_window_current(st->uw) != st) return;
   const gboolean connected = zc_client_is_connected(st->client);
-  gtk_button_set_label(GTK_BUTTON(st->conn_toggle_btn), connected ? "Disconnect" : "Connect");
+  gtk_button_set_label(GTK_BUTTON(st->uw->conn_toggle_btn), connected ? "Disconnect" : "Connect");
 }
 
 static void
 on_connect_toggle_clicked(GtkButton *btn, gpointer user_data) {
   (void)btn;
-  UiState *st = (UiState *)user_data;
+  UiState *st = ui_window_current((UiWindow *)user_data);
   if (!st) return;
 
   if (zc_client_is_connected(st->client)) {
@@ -106,6 +138,14 @@ static void
 zcl_userlist_row_activated(GtkTreeView *tv, GtkTreePath *path, GtkTreeViewColumn *col, gpointer user_data);
 
 
+static void
+on_send_cancel_clicked(GtkButton *btn, gpointer user_data) {
+  ChatPage *page = user_data;
+  UiState *st = g_object_get_data(G_OBJECT(btn), "zc-state");
+  const guint job = chat_page_get_send_job(page);
+  if (st && st->client && job) zc_client_cancel_send_job(st->client, job);
+}
+
 static ChatPage *
 get_or_create_page(UiState *st, const gchar *target) {
   if (!target || !*target) target = "status";
@@ -127,6 +167,7 @@ get_or_create_page(UiState *st, const gchar *target) {
   /* Ensure tab-building callbacks can always resolve the page/target. */
   g_hash_table_insert(st->pages, g_strdup(target), page);
   g_object_set_data_full(G_OBJECT(root), "zcl-target", g_strdup(target), g_free);
+  if (st->in_batch) chat_page_hold_scroll(page);
 
   GtkWidget *tab = gtk_label_new(target);
   gtk_widget_set_halign(tab, GTK_ALIGN_START);
@@ -141,6 +182,9 @@ get_or_create_page(UiState *st, const gchar *target) {
   g_object_set_data(G_OBJECT(entry), "zc-target", (gpointer)chat_page_get_target(page));
   g_object_set_data(G_OBJECT(entry), "zc-state", st);
 
+  GtkWidget *cancel = chat_page_get_send_cancel_button(page);
+  g_object_set_data(G_OBJECT(cancel), "zc-state", st);
+  g_signal_connect(cancel, "clicked", G_CALLBACK(on_send_cancel_clicked), page);
 
   /* userlist: right-click context menu + double-click to open a query (channel tabs only) */
   GtkWidget *uv = chat_page_get_userlist_view(page);
@@ -233,14 +277,15 @@ zcl_userlist_row_activated(GtkTreeView *tv, GtkTreePath *path, GtkTreeViewColumn
 
 static void
 set_status(UiState *st, const gchar *text) {
+  if (!st) return;
   const gchar *t = text ? text : "";
-  /* No status text in the hamburger menu. Keep it as a tooltip only. */
-  if (st && st->menu_btn) {
-    gtk_widget_set_tooltip_text(st->menu_btn, *t ? t : "Menu");
+  if (text != st->status_text) {
+    g_free(st->status_text);
+    st->status_text = g_strdup(t);
   }
-  /* If some older UI element still exists, keep it in sync harmlessly. */
-  if (st && st->status_label) {
-    gtk_label_set_text(GTK_LABEL(st->status_label), t);
+  /* No status text in the hamburger menu. Keep it as a tooltip only. */
+  if (st->uw && st->uw->menu_btn && ui_window_current(st->uw) == st) {
+    gtk_widget_set_tooltip_text(st->uw->menu_btn, *t ? t : "Menu");
   }
 }
 
@@ -275,8 +320,8 @@ ui_apply_window_icon(GtkWindow *win) {
 static void
 on_about_zoitechat(GtkButton *btn, gpointer user_data) {
   (void)btn;
-  UiState *st = (UiState *)user_data;
-  if (!st || !st->win) return;
+  UiWindow *uw = (UiWindow *)user_data;
+  if (!uw || !uw->win) return;
 
   /* If launched from the popover, hide it so it doesn't sit there like a confused raccoon. */
   GtkWidget *pop = gtk_widget_get_ancestor(GTK_WIDGET(btn), GTK_TYPE_POPOVER);
@@ -284,7 +329,7 @@ on_about_zoitechat(GtkButton *btn, gpointer user_data) {
 
   GtkWidget *dlg = gtk_dialog_new_with_buttons(
     "About ZoiteChat",
-    GTK_WINDOW(st->win),
+    GTK_WINDOW(uw->win),
     GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
     "_Close", GTK_RESPONSE_CLOSE,
     NULL
@@ -342,148 +387,142 @@ gtk_box_pack_start(GTK_BOX(box), img, FALSE, FALSE, 0);GtkWidget *title = gtk_la
   gtk_widget_destroy(dlg);
 }
 
-static gint
-prefix_rank(gchar c) {
-  switch (c) {
-    case '~': return 5;
-    case '&': return 4;
-    case '@': return 3;
-    case '%': return 2;
-    case '+': return 1;
-    default: return 0;
-  }
+typedef struct {
+  UiState *st;
+  ChatPage *page;
+} UiUserlistFill;
+
+static void
+userlist_add_member(ZcUser *user, guint modes, gpointer data) {
+  UiUserlistFill *fill = data;
+  chat_page_userlist_upsert(fill->page, zc_user_get_nick(user), zc_client_get_prefix_char(fill->st->client, modes));
 }
 
-static GHashTable *
-users_for_channel(UiState *st, const gchar *chan) {
-  if (!st->chan_users) {
-    st->chan_users = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_destroy);
-  }
+/* The user list mirrors the client's membership model for @chan. */
+static void
+userlist_rebuild_channel(UiState *st, const gchar *chan) {
+  if (!st || !chan || !*chan) return;
+
+  ChatPage *page = g_hash_table_lookup(st->pages, chan);
+  if (!page) return;
+  if (!chat_page_get_userlist_view(page)) return;
 
-  GHashTable *map = g_hash_table_lookup(st->chan_users, chan);
-  if (!map) {
-    map = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free); /* nick -> prefix string */
-    g_hash_table_insert(st->chan_users, g_strdup(chan), map);
+  chat_page_userlist_freeze(page);
+  chat_page_userlist_clear(page);
+  ZcChannelState *cs = zc_client_get_channel_state(st->client, chan);
+  if (cs) {
+    UiUserlistFill fill = {st, page};
+    zc_channel_state_foreach(cs, userlist_add_member, &fill);
   }
-  return map;
+  chat_page_userlist_thaw(page);
 }
 
+/* Bring one member's row in line with the client's model. */
 static void
-user_add_token(UiState *st, const gchar *chan, const gchar *token) {
-  if (!is_channel_name(chan) || !token || !*token) return;
-
-  gchar pfx = 0;
-  const gchar *nick = token;
-  if (strchr("~&@%+", token[0])) {
-    pfx = token[0];
-    nick = token + 1;
+userlist_apply_member(UiState *st, const gchar *chan, const gchar *nick) {
+  ChatPage *page = chan ? g_hash_table_lookup(st->pages, chan) : NULL;
+  if (!page || !nick || !*nick) return;
+
+  ZcChannelState *cs = zc_client_get_channel_state(st->client, chan);
+  ZcUser *user = NULL;
+  guint modes = 0;
+  if (cs && zc_channel_state_lookup(cs, nick, &user, &modes)) {
+    chat_page_userlist_upsert(page, zc_user_get_nick(user), zc_client_get_prefix_char(st->client, modes));
+  } else {
+    chat_page_userlist_remove(page, nick);
   }
-  if (!nick || !*nick) return;
+}
 
-  GHashTable *map = users_for_channel(st, chan);
-  gchar *existing = g_hash_table_lookup(map, nick);
+static GHashTable *
+nick_set_new(void) {
+  return g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+}
 
-  if (!existing) {
-    gchar prefbuf[2] = {0, 0};
-    if (pfx) prefbuf[0] = pfx;
-    g_hash_table_insert(map, g_strdup(nick), g_strdup(prefbuf));
+/* One member changed. Inside a batch the model is already past this
+ * message, so the row is synced at "batch-end" instead. */
+static void
+userlist_sync_member(UiState *st, const gchar *chan, const gchar *nick) {
+  if (!chan || !nick || !*nick) return;
+  if (!st->in_batch) {
+    userlist_apply_member(st, chan, nick);
     return;
   }
-
-  if (pfx && prefix_rank(pfx) > prefix_rank(existing[0])) {
-    gchar prefbuf[2] = {pfx, 0};
-    g_hash_table_replace(map, g_strdup(nick), g_strdup(prefbuf));
+  if (!st->dirty_members) st->dirty_members = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_hash_table_unref);
+  GHashTable *nicks = g_hash_table_lookup(st->dirty_members, chan);
+  if (!nicks) {
+    nicks = nick_set_new();
+    g_hash_table_insert(st->dirty_members, g_strdup(chan), nicks);
   }
+  g_hash_table_add(nicks, g_strdup(nick));
 }
 
-
+/* QUIT and NICK touch every channel the user is on. */
 static void
-user_remove(UiState *st, const gchar *chan, const gchar *nick) {
-  if (!st->chan_users || !is_channel_name(chan) || !nick || !*nick) return;
-  GHashTable *map = g_hash_table_lookup(st->chan_users, chan);
-  if (map) g_hash_table_remove(map, nick);
+userlist_sync_nick_everywhere(UiState *st, const gchar *nick) {
+  if (!nick || !*nick) return;
+  if (!st->dirty_nicks) st->dirty_nicks = nick_set_new();
+  g_hash_table_add(st->dirty_nicks, g_strdup(nick));
 }
 
-static void
-user_remove_everywhere(UiState *st, const gchar *nick) {
-  if (!st->chan_users || !nick || !*nick) return;
-  GHashTableIter it;
-  gpointer ck, cv;
-  g_hash_table_iter_init(&it, st->chan_users);
-  while (g_hash_table_iter_next(&it, &ck, &cv)) {
-    GHashTable *map = (GHashTable *)cv;
-    g_hash_table_remove(map, nick);
-  }
+static gboolean
+is_self_nick(UiState *st, const gchar *nick) {
+  const gchar *selfn = st->client ? zc_client_get_nick(st->client) : NULL;
+  return nick && selfn && g_ascii_strcasecmp(nick, selfn) == 0;
 }
 
 static void
-user_rename_everywhere(UiState *st, const gchar *oldnick, const gchar *newnick) {
-  if (!st->chan_users || !oldnick || !newnick || !*oldnick || !*newnick) return;
-
+userlist_rebuild_all(UiState *st) {
+  if (!st->pages) return;
   GHashTableIter it;
   gpointer ck, cv;
-  g_hash_table_iter_init(&it, st->chan_users);
+  g_hash_table_iter_init(&it, st->pages);
   while (g_hash_table_iter_next(&it, &ck, &cv)) {
-    GHashTable *map = (GHashTable *)cv;
-    gchar *pref = g_hash_table_lookup(map, oldnick);
-    if (!pref) continue;
-
-    gchar *pref_copy = g_strdup(pref);
-    g_hash_table_remove(map, oldnick);
-    g_hash_table_insert(map, g_strdup(newnick), pref_copy);
-  }
-}
-static gchar
-user_prefix_from_value(gpointer v) {
-  if (!v) return 0;
-
-  /* Some code stores prefixes as small integers (eg GINT_TO_POINTER). */
-  if ((guintptr)v < 0x100) {
-    const gchar c = (gchar)(guintptr)v;
-    if (c == '~' || c == '&' || c == '@' || c == '%' || c == '+') return c;
-    return 0;
+    if (is_channel_name((const gchar *)ck)) userlist_rebuild_channel(st, (const gchar *)ck);
   }
-
-  /* Otherwise treat as a string like "@", "+", "~", or "" */
-  const gchar *sv = (const gchar *)v;
-  if (!sv || !sv[0]) return 0;
-  if (sv[0] == '~' || sv[0] == '&' || sv[0] == '@' || sv[0] == '%' || sv[0] == '+') return sv[0];
-  return 0;
 }
 
 static void
 userlist_refresh_channel(UiState *st, const gchar *chan) {
   if (!st || !chan || !*chan) return;
+  if (!st->in_batch) {
+    userlist_rebuild_channel(st, chan);
+    return;
+  }
+  if (st->dirty_userlists_all) return;
+  if (!st->dirty_userlists) st->dirty_userlists = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  g_hash_table_add(st->dirty_userlists, g_strdup(chan));
+}
 
-  ChatPage *page = g_hash_table_lookup(st->pages, chan);
-  GHashTable *map = users_for_channel(st, chan);
-
-  if (!page) return;
-  if (!chat_page_get_userlist_view(page)) return;
-
-  chat_page_userlist_clear(page);
-  if (!map) return;
-
-  GHashTableIter it;
-  gpointer k = NULL, v = NULL;
-  g_hash_table_iter_init(&it, map);
+/* Sync the members touched during the batch on channels not rebuilt. */
+static void
+userlist_flush_members(UiState *st) {
+  GHashTableIter it, nit;
+  gpointer k, v, n;
+  if (st->dirty_members) {
+    g_hash_table_iter_init(&it, st->dirty_members);
+    while (g_hash_table_iter_next(&it, &k, &v)) {
+      if (st->dirty_userlists && g_hash_table_contains(st->dirty_userlists, k)) continue;
+      g_hash_table_iter_init(&nit, (GHashTable *)v);
+      while (g_hash_table_iter_next(&nit, &n, NULL)) userlist_apply_member(st, (const gchar *)k, (const gchar *)n);
+    }
+  }
+  if (!st->dirty_nicks || g_hash_table_size(st->dirty_nicks) == 0) return;
+  g_hash_table_iter_init(&it, st->pages);
   while (g_hash_table_iter_next(&it, &k, &v)) {
-    const gchar *nick = (const gchar *)k;
-    if (!nick || !*nick) continue;
-    const gchar px = user_prefix_from_value(v);
-    chat_page_userlist_upsert(page, nick, px);
+    if (!is_channel_name((const gchar *)k)) continue;
+    if (st->dirty_userlists && g_hash_table_contains(st->dirty_userlists, k)) continue;
+    g_hash_table_iter_init(&nit, st->dirty_nicks);
+    while (g_hash_table_iter_next(&nit, &n, NULL)) userlist_apply_member(st, (const gchar *)k, (const gchar *)n);
   }
 }
 
 static void
 userlist_refresh_all(UiState *st) {
-  if (!st->chan_users) return;
-  GHashTableIter it;
-  gpointer ck, cv;
-  g_hash_table_iter_init(&it, st->chan_users);
-  while (g_hash_table_iter_next(&it, &ck, &cv)) {
-    userlist_refresh_channel(st, (const gchar *)ck);
+  if (!st->in_batch) {
+    userlist_rebuild_all(st);
+    return;
   }
+  st->dirty_userlists_all = TRUE;
 }
 
 
@@ -505,7 +544,21 @@ on_client_connected(ZcClient *client, UiState *st) {
   set_status(st, "Connected");
 
   ChatPage *status = get_or_create_page(st, "status");
-  chat_page_append(status, "Connected.");
+  ZcConnectTimings t;
+  zc_client_get_connect_timings(st->client, &t);
+  const gchar *peer = zc_client_get_remote_address(st->client);
+  chat_page_append_fmt(status, "Connected to %s (dns %s%.0f ms, tcp %.0f ms over %u attempt%s, tls %.0f ms%s).",
+    peer ? peer : "server",
+    t.dns_cached ? "cached " : "", t.resolve_us / 1000.0,
+    t.tcp_us / 1000.0, t.attempts, t.attempts == 1 ? "" : "s",
+    t.tls_us / 1000.0, t.tls_session_offered ? ", session resumption offered" : "");
+
+  /* After an automatic reconnect the client registers and re-joins by itself. */
+  if (zc_client_is_resuming(st->client)) {
+    chat_page_append(status, "Resuming session…");
+    ui_update_connect_toggle_button(st);
+    return;
+  }
 
   zc_client_set_identity(st->client, st->nick, st->user, st->realname);
 
@@ -515,16 +568,68 @@ on_client_connected(ZcClient *client, UiState *st) {
     g_clear_error(&error);
     return;
   }
-/* Joining before registration completes is unreliable across servers.
- * Queue auto-join and perform it after we receive 001 / end-of-MOTD.
- */
-st->autojoin_pending = TRUE;
-if (st->auto_join && *st->auto_join) {
-  chat_page_append_fmt(status, "Auto-join queued: %s", st->auto_join);
+  /* The client joins these itself as soon as the server welcomes us. */
+  if (st->auto_join && *st->auto_join) chat_page_append_fmt(status, "Auto-join queued: %s", st->auto_join);
   ui_update_connect_toggle_button(st);
+}
 
+static void
+on_client_lag_notify(ZcClient *client, GParamSpec *pspec, UiState *st) {
+  (void)pspec;
+  if (!zc_client_is_connected(client)) return;
+  const guint lag = zc_client_get_lag(client);
+  gchar *text = lag ? g_strdup_printf("Connected (lag %.2f s)", lag / 1000.0) : g_strdup("Connected");
+  set_status(st, text);
+  g_free(text);
 }
+
+static void
+on_client_health_changed(ZcClient *client, ZcLinkHealth health, UiState *st) {
+  ChatPage *status = get_or_create_page(st, "status");
+  if (health == ZC_LINK_HEALTH_LAGGING) {
+    chat_page_append_fmt(status, "Server is lagging (%.1f s).", zc_client_get_lag(client) / 1000.0);
+  } else if (health == ZC_LINK_HEALTH_DEAD) {
+    chat_page_append(status, "Server stopped answering; dropping the connection.");
   }
+}
+
+static void
+on_client_send_job_progress(ZcClient *client, guint job, const gchar *target, guint sent, guint total, UiState *st) {
+  (void)client;
+  ChatPage *page = target ? g_hash_table_lookup(st->pages, target) : NULL;
+  if (page) chat_page_set_send_progress(page, job, sent, total);
+}
+
+static void
+on_client_send_job_finished(ZcClient *client, guint job, const gchar *target, gboolean completed, UiState *st) {
+  (void)client;
+  ChatPage *page = target ? g_hash_table_lookup(st->pages, target) : NULL;
+  if (!page) return;
+  if (chat_page_get_send_job(page) == job) chat_page_set_send_progress(page, 0, 0, 0);
+  if (!completed) chat_page_append(page, "Send stopped; the remaining lines were not sent.");
+}
+
+static void
+on_client_registration_phase(ZcClient *client, guint phase, gint64 elapsed_us, UiState *st) {
+  ChatPage *status = get_or_create_page(st, "status");
+  switch (phase) {
+    case ZC_REGISTRATION_PHASE_SASL: {
+      ZcRegistrationTimings t;
+      zc_client_get_registration_timings(client, &t);
+      chat_page_append_fmt(status, "SASL %s (%.0f ms).", t.sasl_succeeded ? "login succeeded" : "login failed",
+        elapsed_us / 1000.0);
+      break;
+    }
+    case ZC_REGISTRATION_PHASE_WELCOME:
+      chat_page_append_fmt(status, "Registered in %.0f ms.", elapsed_us / 1000.0);
+      break;
+    case ZC_REGISTRATION_PHASE_JOINED:
+      chat_page_append_fmt(status, "Auto-join complete %.0f ms after connect.", elapsed_us / 1000.0);
+      break;
+    default:
+      break;
+  }
+}
 
 
 static void zcl_whois_clear(void);
@@ -541,13 +646,36 @@ on_client_disconnected(ZcClient *client, gint code, gchar *message, UiState *st)
 
   g_free(status);
   ui_update_connect_toggle_button(st);
+  /* the client forgets every channel's members on disconnect */
+  userlist_refresh_all(st);
+}
 
+static void
+on_client_reconnecting(ZcClient *client, guint attempt, guint delay_ms, UiState *st) {
+  (void)client;
+  ChatPage *status = get_or_create_page(st, "status");
+  if (delay_ms == 0) {
+    chat_page_append_fmt(status, "Network changed, reconnecting now (attempt %u)…", attempt);
+  } else {
+    chat_page_append_fmt(status, "Reconnecting in %.1fs (attempt %u)…", delay_ms / 1000.0, attempt);
+  }
+  set_status(st, "Reconnecting…");
+}
+
+static void
+on_client_reconnect_failed(ZcClient *client, guint attempts, UiState *st) {
+  (void)client;
+  ChatPage *status = get_or_create_page(st, "status");
+  chat_page_append_fmt(status, "Giving up after %u reconnect attempts.", attempts);
+  set_status(st, "Disconnected");
 }
 
 static void
 append_server_line(UiState *st, const gchar *line) {
   ChatPage *status = get_or_create_page(st, "status");
-  chat_page_append_fmt(status, "← %s", line);
+  gchar *text = g_strdup_printf("← %s", line);
+  chat_page_append_at(status, st->msg_time, text);
+  g_free(text);
 }
 
 /* ZCL_WHOIS_DIALOG_V1
@@ -870,7 +998,7 @@ zcl_whois_show_dialog(UiState *st) {
 static void
 append_to_target(UiState *st, const gchar *target, const gchar *line) {
   ChatPage *page = get_or_create_page(st, target);
-  chat_page_append(page, line);
+  chat_page_append_at(page, st->msg_time, line);
 }
 
 static const gchar *
@@ -884,9 +1012,17 @@ ui_self_nick(UiState *st) {
   return "me";
 }
 
+/* With echo-message the server sends our own messages back, and they are
+ * shown when they arrive instead. */
+static gboolean
+ui_server_echoes(UiState *st) {
+  return st->client && zc_client_has_cap(st->client, "echo-message");
+}
+
 static void
 ui_echo_outgoing_privmsg(UiState *st, const gchar *target, const gchar *text) {
   if (!st || !target || !*target || !text) return;
+  if (ui_server_echoes(st)) return;
   gchar *line = g_strdup_printf("<%s> %s", ui_self_nick(st), text);
   append_to_target(st, target, line);
   g_free(line);
@@ -895,6 +1031,7 @@ ui_echo_outgoing_privmsg(UiState *st, const gchar *target, const gchar *text) {
 static void
 ui_echo_outgoing_action(UiState *st, const gchar *target, const gchar *action_text) {
   if (!st || !target || !*target || !action_text) return;
+  if (ui_server_echoes(st)) return;
   gchar *line = g_strdup_printf("* %s %s", ui_self_nick(st), action_text);
   append_to_target(st, target, line);
   g_free(line);
@@ -914,428 +1051,526 @@ ctcp_action_text(const gchar *text) {
   return g_strndup(text + 8, len - 9);
 }
 
-static void
-ui_try_autojoin(UiState *st) {
-  if (!st->autojoin_pending) return;
-  st->autojoin_pending = FALSE;
+/* Server message dispatch. Each handler returns TRUE when it fully consumed
+ * the message; FALSE falls through to the default status output. */
+typedef gboolean (*UiIrcHandler)(UiState *st, const ZcIrcMessageView *view);
 
-  if (!st->auto_join || !*st->auto_join) return;
-  if (!zc_client_is_connected(st->client)) return;
-
-  /* Accept "#a,#b" or "#a #b" */
-  gchar **parts = g_strsplit_set(st->auto_join, ", ", -1);
-  for (gint i = 0; parts && parts[i]; i++) {
-    const gchar *chan = parts[i];
-    if (!chan || !*chan) continue;
-    if (!is_channel_name(chan)) continue;
+static const gchar *
+view_trailing_or(const ZcIrcMessageView *view, const gchar *fallback) {
+  const gchar *trailing = zc_irc_message_view_get_trailing(view);
+  return trailing ? trailing : fallback;
+}
 
-    (void)get_or_create_page(st, chan);
+static gboolean
+ui_on_names_end(UiState *st, const ZcIrcMessageView *view) {
+  /* 366 RPL_ENDOFNAMES: the client has the whole reply now; the 353s
+   * themselves only go to status */
+  const gchar *chan = zc_irc_message_view_param(view, 1);
+  if (chan && is_channel_name(chan)) userlist_refresh_channel(st, chan);
+  return FALSE;
+}
 
-    GError *error = NULL;
-    gchar *raw = g_strdup_printf("JOIN %s", chan);
-    if (!zc_client_send_raw(st->client, raw, &error)) {
-      ChatPage *status = get_or_create_page(st, "status");
-      chat_page_append_fmt(status, "Auto-join JOIN %s failed: %s", chan, error ? error->message : "unknown");
-      if (error) g_clear_error(&error);
+static gboolean
+ui_on_nick(UiState *st, const ZcIrcMessageView *view) {
+  gchar *oldn = zc_irc_extract_nick(zc_irc_message_view_get_prefix(view));
+  const gchar *newn = view_trailing_or(view, zc_irc_message_view_param(view, 0));
+  if (oldn && newn && *newn) {
+    if (st->in_batch) {
+      userlist_sync_nick_everywhere(st, oldn);
+      userlist_sync_nick_everywhere(st, newn);
     } else {
-      ChatPage *status = get_or_create_page(st, "status");
-      chat_page_append_fmt(status, "Joining %s …", chan);
+      GHashTableIter it;
+      gpointer k, v;
+      g_hash_table_iter_init(&it, st->pages);
+      while (g_hash_table_iter_next(&it, &k, &v)) chat_page_userlist_rename((ChatPage *)v, oldn, newn);
     }
-    g_free(raw);
 
-    /* NAMES kick so user list can populate */
-    error = NULL;
-    raw = g_strdup_printf("NAMES %s", chan);
-    (void)zc_client_send_raw(st->client, raw, &error);
-    if (error) g_clear_error(&error);
-    g_free(raw);
+    /* If this NICK change is ours, keep the UI/client identity in sync.
+     * Some servers don't echo your own PRIVMSG, so we locally echo. That
+     * means our idea of "self nick" must stay accurate.
+     */
+    const gchar *selfn = NULL;
+    if (st && st->client) selfn = zc_client_get_nick(st->client);
+    if (!selfn || !*selfn) selfn = st ? st->nick : NULL;
+    if (selfn && *selfn && g_ascii_strcasecmp(oldn, selfn) == 0) {
+      g_free(st->nick);
+      st->nick = g_strdup(newn);
+      if (st->client) zc_client_set_identity(st->client, st->nick, st->user, st->realname);
+    }
   }
-  if (parts) g_strfreev(parts);
+  g_free(oldn);
+  /* still shown in status */
+  return FALSE;
 }
 
+/* CTCP handling:
+ * - don't open query tabs for CTCP requests (VERSION/PING/TIME/etc)
+ * - reply with NOTICE as expected
+ */
 static void
-on_client_irc_message(ZcClient *client, ZcIrcMessage *msg, UiState *st) {
-  (void)client;
-  if (!msg || !msg->command) return;
+ui_handle_ctcp_request(UiState *st, const gchar *from, const gchar *text, gsize tlen) {
+  gchar *inner = g_strndup(text + 1, tlen - 2);
+  gchar **ct = g_strsplit(inner, " ", 2);
+  const gchar *ctcp_cmd = ct[0] ? ct[0] : "";
+  const gchar *ctcp_arg = ct[1] ? ct[1] : "";
 
+  ChatPage *status = get_or_create_page(st, "status");
+  chat_page_append_fmt(status, "CTCP %s request from %s%s%s",
+    ctcp_cmd, from ? from : "?", *ctcp_arg ? " " : "", ctcp_arg);
+
+  if (from && *from) {
+    ZcIrcMessageBuilder b;
+    zc_irc_message_builder_init(&b);
+    zc_irc_message_builder_set_command(&b, "NOTICE");
+    zc_irc_message_builder_add_param(&b, from, -1);
+    gboolean reply = TRUE;
+
+    if (g_ascii_strcasecmp(ctcp_cmd, "VERSION") == 0) {
+      zc_irc_message_builder_add_trailing(&b, "VERSION ZoiteChat Lite (GTK3 + LibZoiteChat)", -1);
+    } else if (g_ascii_strcasecmp(ctcp_cmd, "PING") == 0) {
+      zc_irc_message_builder_add_trailing(&b, "PING ", -1);
+      zc_irc_message_builder_append(&b, ctcp_arg, -1);
+    } else if (g_ascii_strcasecmp(ctcp_cmd, "TIME") == 0) {
+      GDateTime *dt = g_date_time_new_now_local();
+      gchar *ts = g_date_time_format(dt, "%Y-%m-%d %H:%M:%S %z");
+      zc_irc_message_builder_add_trailing(&b, "TIME ", -1);
+      zc_irc_message_builder_append(&b, ts ? ts : "", -1);
+      g_free(ts);
+      g_date_time_unref(dt);
+    } else {
+      reply = FALSE;
+    }
 
-  if (st->autojoin_pending && (g_strcmp0(msg->command, "001") == 0 || g_strcmp0(msg->command, "376") == 0 || g_strcmp0(msg->command, "422") == 0)) {
-    ui_try_autojoin(st);
+    if (reply) (void)zc_client_send_message(st->client, &b, ZC_SEND_PRIORITY_BULK, NULL);
   }
 
-  /* NAMES (353/366) -> user list */
-  if (g_strcmp0(msg->command, "353") == 0) {
-    const gchar *chan = NULL;
-    if (msg->params && msg->params->len >= 3) chan = zc_irc_message_param(msg, 2);
-    else if (msg->params && msg->params->len >= 1) chan = zc_irc_message_param(msg, (guint)(msg->params->len - 1));
-    const gchar *names = msg->trailing ? msg->trailing : "";
-    if (chan && is_channel_name(chan) && names && *names) {
-      gchar **parts = g_strsplit(names, " ", -1);
-      for (gint i = 0; parts[i]; i++) user_add_token(st, chan, parts[i]);
-      g_strfreev(parts);
-      userlist_refresh_channel(st, chan);
-    }
-    /* keep existing status output below */
-  }
-  if (g_strcmp0(msg->command, "366") == 0) {
-    const gchar *chan = zc_irc_message_param(msg, 1);
-    if (chan && is_channel_name(chan)) userlist_refresh_channel(st, chan);
-  }
-
-  if (g_strcmp0(msg->command, "NICK") == 0) {
-    gchar *oldn = zc_irc_extract_nick(msg->prefix);
-    const gchar *newn = msg->trailing ? msg->trailing : zc_irc_message_param(msg, 0);
-    if (oldn && newn && *newn) {
-      user_rename_everywhere(st, oldn, newn);
-      userlist_refresh_all(st);
-
-      /* If this NICK change is ours, keep the UI/client identity in sync.
-       * Some servers don't echo your own PRIVMSG, so we locally echo. That
-       * means our idea of "self nick" must stay accurate.
-       */
-      const gchar *selfn = NULL;
-      if (st && st->client) selfn = zc_client_get_nick(st->client);
-      if (!selfn || !*selfn) selfn = st ? st->nick : NULL;
-      if (selfn && *selfn && g_ascii_strcasecmp(oldn, selfn) == 0) {
-        g_free(st->nick);
-        st->nick = g_strdup(newn);
-        if (st->client) zc_client_set_identity(st->client, st->nick, st->user, st->realname);
-      }
+  g_strfreev(ct);
+  g_free(inner);
+}
+
+static gboolean
+ui_on_privmsg(UiState *st, const ZcIrcMessageView *view) {
+  const gchar *to = zc_irc_message_view_param(view, 0);
+  const gchar *text = view_trailing_or(view, "");
+  gchar *from = zc_irc_extract_nick(zc_irc_message_view_get_prefix(view));
+
+  if (text[0] == '\001') {
+    gsize tlen = strlen(text);
+    if (tlen >= 2 && text[tlen - 1] == '\001' && !is_ctcp_action(text)) {
+      /* our own request echoed back: nothing to answer */
+      if (!(from && g_ascii_strcasecmp(from, ui_self_nick(st)) == 0)) ui_handle_ctcp_request(st, from, text, tlen);
+      g_free(from);
+      return TRUE;
     }
-    g_free(oldn);
   }
 
-  if (g_strcmp0(msg->command, "PRIVMSG") == 0) {
-    const gchar *to = zc_irc_message_param(msg, 0);
-    const gchar *text = msg->trailing ? msg->trailing : "";
-    gchar *from = zc_irc_extract_nick(msg->prefix);
+  const gchar *target = to ? to : "status";
+  /* private message: target becomes sender nick */
+  if (to && st->nick && g_ascii_strcasecmp(to, st->nick) == 0) target = from ? from : "status";
 
+  if (is_ctcp_action(text)) {
+    gchar *act = ctcp_action_text(text);
+    gchar *line = g_strdup_printf("* %s %s", from ? from : "?", act ? act : "");
+    append_to_target(st, target, line);
+    g_free(line);
+    g_free(act);
+  } else {
+    gchar *line = g_strdup_printf("<%s> %s", from ? from : "?", text);
+    append_to_target(st, target, line);
+    g_free(line);
+  }
 
+  g_free(from);
+  return TRUE;
+}
 
-/* CTCP handling:
- * - don't open query tabs for CTCP requests (VERSION/PING/TIME/etc)
- * - reply with NOTICE as expected
- */
-if (text && text[0] == '') {
-  gsize tlen = strlen(text);
-  if (tlen >= 2 && text[tlen - 1] == '' && !is_ctcp_action(text)) {
-    gchar *inner = g_strndup(text + 1, tlen - 2);
-    gchar **ct = g_strsplit(inner, " ", 2);
-    const gchar *ctcp_cmd = ct[0] ? ct[0] : "";
-    const gchar *ctcp_arg = ct[1] ? ct[1] : "";
-
-    ChatPage *status = get_or_create_page(st, "status");
-    chat_page_append_fmt(status, "CTCP %s request from %s%s%s",
-      ctcp_cmd, from ? from : "?", *ctcp_arg ? " " : "", ctcp_arg);
-
-    if (from && *from) {
-      gchar *reply = NULL;
-
-      if (g_ascii_strcasecmp(ctcp_cmd, "VERSION") == 0) {
-        reply = g_strdup_printf("NOTICE %s :VERSION ZoiteChat Lite (GTK3 + LibZoiteChat)", from);
-      } else if (g_ascii_strcasecmp(ctcp_cmd, "PING") == 0) {
-        reply = g_strdup_printf("NOTICE %s :PING %s", from, ctcp_arg);
-      } else if (g_ascii_strcasecmp(ctcp_cmd, "TIME") == 0) {
-        GDateTime *dt = g_date_time_new_now_local();
-        gchar *ts = g_date_time_format(dt, "%Y-%m-%d %H:%M:%S %z");
-        reply = g_strdup_printf("NOTICE %s :TIME %s", from, ts ? ts : "");
-        g_free(ts);
-        g_date_time_unref(dt);
-      }
+static gboolean
+ui_on_join(UiState *st, const ZcIrcMessageView *view) {
+  gchar *nick = zc_irc_extract_nick(zc_irc_message_view_get_prefix(view));
+  /* extended-join puts the channel first and account/realname after it */
+  const gchar *chan = zc_irc_message_view_param(view, 0);
+  if (!chan) chan = zc_irc_message_view_get_trailing(view);
+  if (chan) {
+    gchar *line = g_strdup_printf("• %s joined", nick ? nick : "?");
+    append_to_target(st, chan, line);
+    g_free(line);
+  }
+  /* the server follows our own JOIN with NAMES; 366 fills the list */
+  if (chan && is_channel_name(chan) && !is_self_nick(st, nick)) userlist_sync_member(st, chan, nick);
+  g_free(nick);
+  return TRUE;
+}
 
-      if (reply) {
-        GError *e = NULL;
-        (void)zc_client_send_raw(st->client, reply, &e);
-        if (e) g_clear_error(&e);
-        g_free(reply);
-      }
-    }
+static gboolean
+ui_on_part(UiState *st, const ZcIrcMessageView *view) {
+  gchar *nick = zc_irc_extract_nick(zc_irc_message_view_get_prefix(view));
+  const gchar *chan = zc_irc_message_view_param(view, 0);
+  const gchar *why = zc_irc_message_view_get_trailing(view);
 
-    g_strfreev(ct);
-    g_free(inner);
-    g_free(from);
-    return;
+  if (chan) {
+    gchar *line = g_strdup_printf("• %s left%s%s%s",
+      nick ? nick : "?",
+      why ? " (" : "",
+      why ? why : "",
+      why ? ")" : ""
+    );
+    append_to_target(st, chan, line);
+    g_free(line);
   }
+
+  if (chan && is_channel_name(chan)) {
+    if (is_self_nick(st, nick)) userlist_refresh_channel(st, chan);
+    else userlist_sync_member(st, chan, nick);
+  }
+  g_free(nick);
+  return TRUE;
 }
 
-    const gchar *target = to ? to : "status";
-    /* private message: target becomes sender nick */
-    if (to && st->nick && g_ascii_strcasecmp(to, st->nick) == 0) target = from ? from : "status";
+static gboolean
+ui_on_quit(UiState *st, const ZcIrcMessageView *view) {
+  gchar *nick = zc_irc_extract_nick(zc_irc_message_view_get_prefix(view));
+  const gchar *why = zc_irc_message_view_get_trailing(view);
+
+  gchar *line = g_strdup_printf("• %s quit%s%s%s",
+    nick ? nick : "?",
+    why ? " (" : "",
+    why ? why : "",
+    why ? ")" : ""
+  );
+  append_server_line(st, line);
+  g_free(line);
 
-    if (is_ctcp_action(text)) {
-      gchar *act = ctcp_action_text(text);
-      gchar *line = g_strdup_printf("* %s %s", from ? from : "?", act ? act : "");
-      append_to_target(st, target, line);
-      g_free(line);
-      g_free(act);
-    } else {
-      gchar *line = g_strdup_printf("<%s> %s", from ? from : "?", text);
-      append_to_target(st, target, line);
-      g_free(line);
-    }
+  if (nick && st->in_batch) {
+    userlist_sync_nick_everywhere(st, nick);
+  } else if (nick) {
+    /* a hash miss on every page the user wasn't in */
+    GHashTableIter it;
+    gpointer k, v;
+    g_hash_table_iter_init(&it, st->pages);
+    while (g_hash_table_iter_next(&it, &k, &v)) chat_page_userlist_remove((ChatPage *)v, nick);
+  }
+  g_free(nick);
+  return TRUE;
+}
 
-    g_free(from);
-    return;
+/* KICK and MODE keep their status output. */
+static gboolean
+ui_on_kick(UiState *st, const ZcIrcMessageView *view) {
+  const gchar *chan = zc_irc_message_view_param(view, 0);
+  const gchar *victim = zc_irc_message_view_param(view, 1);
+  if (!chan || !is_channel_name(chan) || !victim) return FALSE;
+  if (is_self_nick(st, victim)) userlist_refresh_channel(st, chan);
+  else userlist_sync_member(st, chan, victim);
+  return FALSE;
+}
+
+static gboolean
+ui_on_mode(UiState *st, const ZcIrcMessageView *view) {
+  /* Prefix changes name their members among the arguments; any other
+   * argument (mask, key, limit) just misses the user list. */
+  const gchar *chan = zc_irc_message_view_param(view, 0);
+  if (!chan || !is_channel_name(chan)) return FALSE;
+  const guint n = zc_irc_message_view_get_n_params(view);
+  for (guint i = 2; i < n; i++) userlist_sync_member(st, chan, zc_irc_message_view_param(view, i));
+  const gchar *trailing = zc_irc_message_view_get_trailing(view);
+  if (trailing && n >= 2) userlist_sync_member(st, chan, trailing);
+  return FALSE;
+}
+
+/* WHOIS dialog capture. If a /WHOIS is in progress, collect numerics for that
+ * nick and show a formatted dialog at 318 (end of WHOIS). Returns TRUE when
+ * the numeric belonged to the pending WHOIS. */
+static gboolean
+ui_whois_capture(UiState *st, const ZcIrcMessageView *view) {
+  const gchar *wnick = zc_irc_message_view_param(view, 1);
+  if (!zcl_whois || !zcl_whois->nick || !*zcl_whois->nick || !wnick ||
+      g_ascii_strcasecmp(wnick, zcl_whois->nick) != 0) {
+    return FALSE;
   }
 
-  if (g_strcmp0(msg->command, "JOIN") == 0) {
-    gchar *nick = zc_irc_extract_nick(msg->prefix);
-    const gchar *chan = msg->trailing ? msg->trailing : zc_irc_message_param(msg, 0);
-    if (chan) {
-      gchar *line = g_strdup_printf("• %s joined", nick ? nick : "?");
-      append_to_target(st, chan, line);
-      g_free(line);
+  switch ((guint)zc_irc_message_view_get_command_id(view)) {
+    case 301: /* RPL_AWAY */
+      g_free(zcl_whois->away);
+      zcl_whois->away = g_strdup(view_trailing_or(view, ""));
+      break;
+
+    case 311: { /* RPL_WHOISUSER: <me> <nick> <user> <host> * :<realname> */
+      const gchar *user = zc_irc_message_view_param(view, 2);
+      const gchar *host = zc_irc_message_view_param(view, 3);
+      g_free(zcl_whois->userhost);
+      zcl_whois->userhost = g_strdup_printf("%s@%s", user ? user : "?", host ? host : "?");
+      g_free(zcl_whois->realname);
+      zcl_whois->realname = g_strdup(view_trailing_or(view, ""));
+      break;
     }
-        if (chan && is_channel_name(chan)) {
-      user_add_token(st, chan, nick ? nick : "");
-      userlist_refresh_channel(st, chan);
-      if (nick && st->nick && g_ascii_strcasecmp(nick, st->nick) == 0) {
-        GError *e = NULL;
-        gchar *raw = g_strdup_printf("NAMES %s", chan);
-        (void)zc_client_send_raw(st->client, raw, &e);
-        g_free(raw);
-        if (e) g_clear_error(&e);
-      }
+
+    case 312: /* RPL_WHOISSERVER: <me> <nick> <server> :<info> */
+      g_free(zcl_whois->server);
+      zcl_whois->server = g_strdup(zc_irc_message_view_param(view, 2));
+      g_free(zcl_whois->server_info);
+      zcl_whois->server_info = g_strdup(view_trailing_or(view, ""));
+      break;
+
+    case 319: /* RPL_WHOISCHANNELS */
+      g_free(zcl_whois->channels_raw);
+      zcl_whois->channels_raw = g_strdup(view_trailing_or(view, ""));
+      break;
+
+    case 317: { /* RPL_WHOISIDLE: <me> <nick> <idle> <signon> :... */
+      const gchar *idle = zc_irc_message_view_param(view, 2);
+      const gchar *signon = zc_irc_message_view_param(view, 3);
+      zcl_whois->idle_secs = idle ? (guint)g_ascii_strtoull(idle, NULL, 10) : 0;
+      zcl_whois->signon_ts = signon ? (gint64)g_ascii_strtoll(signon, NULL, 10) : 0;
+      break;
     }
-    g_free(nick);
-    return;
-  }
 
-  if (g_strcmp0(msg->command, "PART") == 0) {
-    gchar *nick = zc_irc_extract_nick(msg->prefix);
-    const gchar *chan = zc_irc_message_param(msg, 0);
-    const gchar *why = msg->trailing;
+    case 313: /* operator-ish lines */
+    case 320:
+      zcl_whois->is_oper = TRUE;
+      break;
+
+    case 671: /* secure connection */
+      zcl_whois->is_secure = TRUE;
+      break;
 
-    if (chan) {
-      gchar *line = g_strdup_printf("• %s left%s%s%s",
-        nick ? nick : "?",
-        why ? " (" : "",
-        why ? why : "",
-        why ? ")" : ""
-      );
-      append_to_target(st, chan, line);
-      g_free(line);
+    case 330: /* account */
+      g_free(zcl_whois->account);
+      zcl_whois->account = g_strdup(zc_irc_message_view_param(view, 2));
+      break;
+
+    case 318: /* RPL_ENDOFWHOIS */
+      zcl_whois_show_dialog(st);
+      zcl_whois_clear();
+      break;
+
+    default:
+      /* Ignore other numerics for this WHOIS. */
+      break;
+  }
+  return TRUE;
+}
+
+/* WHOIS pretty-print (common numerics) for replies nobody is capturing.
+ * This keeps status output readable. */
+static gboolean
+ui_on_whois_numeric(UiState *st, const ZcIrcMessageView *view) {
+  const gchar *wnick = zc_irc_message_view_param(view, 1);
+  if (!wnick) wnick = zc_irc_message_view_param(view, 0);
+  if (!wnick) wnick = "";
+
+  gchar *line = NULL;
+  switch ((guint)zc_irc_message_view_get_command_id(view)) {
+    case 311: {
+      const gchar *user = zc_irc_message_view_param(view, 2);
+      const gchar *host = zc_irc_message_view_param(view, 3);
+      const gchar *real = view_trailing_or(view, "");
+      line = g_strdup_printf("WHOIS %s: %s@%s (%s)", wnick, user ? user : "?", host ? host : "?", real);
+      break;
     }
 
-        if (chan && is_channel_name(chan) && nick) {
-      user_remove(st, chan, nick);
-      userlist_refresh_channel(st, chan);
+    case 312: {
+      const gchar *srv = zc_irc_message_view_param(view, 2);
+      const gchar *info = view_trailing_or(view, "");
+      line = g_strdup_printf("WHOIS %s: server %s (%s)", wnick, srv ? srv : "?", info);
+      break;
     }
-    g_free(nick);
-    return;
-  }
 
-  if (g_strcmp0(msg->command, "QUIT") == 0) {
-    gchar *nick = zc_irc_extract_nick(msg->prefix);
-    const gchar *why = msg->trailing;
+    case 313:
+      line = g_strdup_printf("WHOIS %s: IRC operator", wnick);
+      break;
 
-    gchar *line = g_strdup_printf("• %s quit%s%s%s",
-      nick ? nick : "?",
-      why ? " (" : "",
-      why ? why : "",
-      why ? ")" : ""
-    );
-    append_server_line(st, line);
-    g_free(line);
+    case 317: {
+      const gchar *idle_s = zc_irc_message_view_param(view, 2);
+      const gchar *signon_s = zc_irc_message_view_param(view, 3);
+      gint64 signon = signon_s ? g_ascii_strtoll(signon_s, NULL, 10) : 0;
+      GDateTime *dt = (signon > 0) ? g_date_time_new_from_unix_local(signon) : NULL;
+      gchar *when = dt ? g_date_time_format(dt, "%Y-%m-%d %H:%M:%S") : NULL;
+      line = g_strdup_printf("WHOIS %s: idle %ss, signon %s", wnick, idle_s ? idle_s : "?", when ? when : "?");
+      g_free(when);
+      if (dt) g_date_time_unref(dt);
+      break;
+    }
 
-        if (nick) {
-      user_remove_everywhere(st, nick);
-      userlist_refresh_all(st);
+    case 319:
+      line = g_strdup_printf("WHOIS %s: channels %s", wnick, view_trailing_or(view, ""));
+      break;
+
+    case 330: {
+      const gchar *acct = zc_irc_message_view_param(view, 2);
+      line = g_strdup_printf("WHOIS %s: account %s", wnick, acct ? acct : "?");
+      break;
     }
-    g_free(nick);
-    return;
-  }
 
-  /* Numerics and everything else go to status */
-  {
-    const gboolean is_numeric =
-      (msg->command &&
-       strlen(msg->command) == 3 &&
-       g_ascii_isdigit((guchar)msg->command[0]) &&
-       g_ascii_isdigit((guchar)msg->command[1]) &&
-       g_ascii_isdigit((guchar)msg->command[2]));
-
-    if (is_numeric) {
-      // WHOIS pretty-print (common numerics). This keeps status output readable.
-      const gchar *wnick = zc_irc_message_param(msg, 1);
-      
-/* WHOIS dialog capture. If a /WHOIS is in progress, collect numerics for that nick
- * and show a formatted dialog at 318 (end of WHOIS). */
-if (zcl_whois && zcl_whois->nick && *zcl_whois->nick && wnick &&
-    g_ascii_strcasecmp(wnick, zcl_whois->nick) == 0) {
-
-  /* 301 RPL_AWAY */
-  if (g_strcmp0(msg->command, "301") == 0) {
-    g_free(zcl_whois->away);
-    zcl_whois->away = g_strdup(msg->trailing ? msg->trailing : "");
-    return;
-  }
+    case 671:
+      line = g_strdup_printf("WHOIS %s: secure connection", wnick);
+      break;
 
-  /* 311 RPL_WHOISUSER: <me> <nick> <user> <host> * :<realname> */
-  if (g_strcmp0(msg->command, "311") == 0) {
-    const gchar *user = zc_irc_message_param(msg, 2);
-    const gchar *host = zc_irc_message_param(msg, 3);
-    g_free(zcl_whois->userhost);
-    zcl_whois->userhost = g_strdup_printf("%s@%s", user ? user : "?", host ? host : "?");
-    g_free(zcl_whois->realname);
-    zcl_whois->realname = g_strdup(msg->trailing ? msg->trailing : "");
-    return;
-  }
+    case 378:
+      line = g_strdup_printf("WHOIS %s: %s", wnick, view_trailing_or(view, ""));
+      break;
 
-  /* 312 RPL_WHOISSERVER: <me> <nick> <server> :<info> */
-  if (g_strcmp0(msg->command, "312") == 0) {
-    g_free(zcl_whois->server);
-    zcl_whois->server = g_strdup(zc_irc_message_param(msg, 2));
-    g_free(zcl_whois->server_info);
-    zcl_whois->server_info = g_strdup(msg->trailing ? msg->trailing : "");
-    return;
+    case 318:
+      line = g_strdup_printf("WHOIS %s: end", wnick);
+      break;
+
+    default:
+      return FALSE;
   }
 
-  /* 319 RPL_WHOISCHANNELS */
-  if (g_strcmp0(msg->command, "319") == 0) {
-    g_free(zcl_whois->channels_raw);
-    zcl_whois->channels_raw = g_strdup(msg->trailing ? msg->trailing : "");
-    return;
-  }
+  append_server_line(st, line);
+  g_free(line);
+  return TRUE;
+}
+
+/* Negotiation itself is the library's business; only the outcome is shown. */
+static gboolean
+ui_on_cap(UiState *st, const ZcIrcMessageView *view) {
+  const gchar *sub = zc_irc_message_view_param(view, 1);
+  const gchar *list = view_trailing_or(view, zc_irc_message_view_param(view, 2));
+  if (!sub || !list || !*list) return TRUE;
+
+  gchar *line = NULL;
+  if (g_ascii_strcasecmp(sub, "ACK") == 0) line = g_strdup_printf("Capabilities enabled: %s", list);
+  else if (g_ascii_strcasecmp(sub, "NAK") == 0) line = g_strdup_printf("Capabilities refused: %s", list);
+  else if (g_ascii_strcasecmp(sub, "DEL") == 0) line = g_strdup_printf("Capabilities withdrawn: %s", list);
+  if (line) append_server_line(st, line);
+  g_free(line);
+  return TRUE;
+}
+
+/* Answers to the client's own lag probes. */
+static gboolean
+ui_on_pong(UiState *st, const ZcIrcMessageView *view) {
+  (void)st;
+  const gchar *token = view_trailing_or(view, zc_irc_message_view_param(view, 1));
+  return token && g_str_has_prefix(token, "zc-");
+}
+
+/* account-notify, away-notify and chghost updates; nothing to show yet. */
+static gboolean
+ui_on_silent(UiState *st, const ZcIrcMessageView *view) {
+  (void)st;
+  (void)view;
+  return TRUE;
+}
+
+/* Indexed by ZcIrcCommand; NULL entries go straight to the default output. */
+static const UiIrcHandler ui_irc_handlers[ZC_IRC_CMD_LAST] = {
+  [366] = ui_on_names_end,
+  [311] = ui_on_whois_numeric,
+  [312] = ui_on_whois_numeric,
+  [313] = ui_on_whois_numeric,
+  [317] = ui_on_whois_numeric,
+  [318] = ui_on_whois_numeric,
+  [319] = ui_on_whois_numeric,
+  [330] = ui_on_whois_numeric,
+  [378] = ui_on_whois_numeric,
+  [671] = ui_on_whois_numeric,
+  [ZC_IRC_CMD_NICK]    = ui_on_nick,
+  [ZC_IRC_CMD_PRIVMSG] = ui_on_privmsg,
+  [ZC_IRC_CMD_JOIN]    = ui_on_join,
+  [ZC_IRC_CMD_PART]    = ui_on_part,
+  [ZC_IRC_CMD_QUIT]    = ui_on_quit,
+  [ZC_IRC_CMD_KICK]    = ui_on_kick,
+  [ZC_IRC_CMD_MODE]    = ui_on_mode,
+  [ZC_IRC_CMD_CAP]     = ui_on_cap,
+  [ZC_IRC_CMD_PONG]    = ui_on_pong,
+  [ZC_IRC_CMD_ACCOUNT] = ui_on_silent,
+  [ZC_IRC_CMD_AWAY]    = ui_on_silent,
+  [ZC_IRC_CMD_CHGHOST] = ui_on_silent,
+};
 
-  /* 317 RPL_WHOISIDLE: <me> <nick> <idle> <signon> :... */
-  if (g_strcmp0(msg->command, "317") == 0) {
-    const gchar *idle = zc_irc_message_param(msg, 2);
-    const gchar *signon = zc_irc_message_param(msg, 3);
-    zcl_whois->idle_secs = idle ? (guint)g_ascii_strtoull(idle, NULL, 10) : 0;
-    zcl_whois->signon_ts = signon ? (gint64)g_ascii_strtoll(signon, NULL, 10) : 0;
-    return;
-  }
+static void
+ui_dispatch_irc_message(UiState *st, const ZcIrcMessageView *view) {
+  const ZcIrcCommand cmd = zc_irc_message_view_get_command_id(view);
+  const ZcIrcCommand id = cmd < ZC_IRC_CMD_LAST ? cmd : ZC_IRC_CMD_UNKNOWN;
+  const gboolean is_numeric = ZC_IRC_COMMAND_IS_NUMERIC(id);
 
-  /* 313 / 320: operator-ish lines */
-  if (g_strcmp0(msg->command, "313") == 0 || g_strcmp0(msg->command, "320") == 0) {
-    zcl_whois->is_oper = TRUE;
-    return;
-  }
+  if (is_numeric && ui_whois_capture(st, view)) return;
 
-  /* 671: secure connection */
-  if (g_strcmp0(msg->command, "671") == 0) {
-    zcl_whois->is_secure = TRUE;
-    return;
-  }
+  const UiIrcHandler handler = ui_irc_handlers[id];
+  if (handler && handler(st, view)) return;
 
-  /* 330: account */
-  if (g_strcmp0(msg->command, "330") == 0) {
-    g_free(zcl_whois->account);
-    zcl_whois->account = g_strdup(zc_irc_message_param(msg, 2));
-    return;
-  }
+  /* Numerics and everything else go to status */
 
-  /* 318 RPL_ENDOFWHOIS */
-  if (g_strcmp0(msg->command, "318") == 0) {
-    zcl_whois_show_dialog(st);
-    zcl_whois_clear();
+  // Cleaner default numeric output: prefer the human text.
+  const gchar *trailing = zc_irc_message_view_get_trailing(view);
+  if (is_numeric && trailing && *trailing) {
+    append_server_line(st, trailing);
     return;
   }
 
-  /* Ignore other numerics for this WHOIS. */
-  return;
+  // Fallback (non-numeric or no trailing)
+  const gchar *p0 = zc_irc_message_view_param(view, 0);
+  gchar *line = g_strdup_printf("%s %s%s%s",
+    zc_irc_message_view_get_command(view),
+    p0 ? p0 : "",
+    trailing ? " :" : "",
+    trailing ? trailing : ""
+  );
+  append_server_line(st, line);
+  g_free(line);
 }
 
-if (!wnick) wnick = zc_irc_message_param(msg, 0);
-      if (!wnick) wnick = "";
-
-      if (g_strcmp0(msg->command, "311") == 0) {
-        const gchar *user = zc_irc_message_param(msg, 2);
-        const gchar *host = zc_irc_message_param(msg, 3);
-        const gchar *real = msg->trailing ? msg->trailing : "";
-        gchar *line = g_strdup_printf("WHOIS %s: %s@%s (%s)", wnick, user ? user : "?", host ? host : "?", real);
-        append_server_line(st, line);
-        g_free(line);
-        return;
-      }
-
-      if (g_strcmp0(msg->command, "312") == 0) {
-        const gchar *srv = zc_irc_message_param(msg, 2);
-        const gchar *info = msg->trailing ? msg->trailing : "";
-        gchar *line = g_strdup_printf("WHOIS %s: server %s (%s)", wnick, srv ? srv : "?", info);
-        append_server_line(st, line);
-        g_free(line);
-        return;
-      }
+/* Handlers borrow @view for the call; anything they keep is copied out. */
+static void
+ui_handle_irc_message(UiState *st, const ZcIrcMessageView *view) {
+  if (!view || !zc_irc_message_view_get_command(view)) return;
 
-      if (g_strcmp0(msg->command, "313") == 0) {
-        gchar *line = g_strdup_printf("WHOIS %s: IRC operator", wnick);
-        append_server_line(st, line);
-        g_free(line);
-        return;
-      }
+  gchar *time_tag = zc_irc_message_view_get_tags(view) ? zc_irc_message_view_dup_tag(view, "time") : NULL;
+  st->msg_time = time_tag ? g_date_time_new_from_iso8601(time_tag, NULL) : NULL;
+  g_free(time_tag);
 
-      if (g_strcmp0(msg->command, "317") == 0) {
-        const gchar *idle_s = zc_irc_message_param(msg, 2);
-        const gchar *signon_s = zc_irc_message_param(msg, 3);
-        gint64 signon = signon_s ? g_ascii_strtoll(signon_s, NULL, 10) : 0;
-        GDateTime *dt = (signon > 0) ? g_date_time_new_from_unix_local(signon) : NULL;
-        gchar *when = dt ? g_date_time_format(dt, "%Y-%m-%d %H:%M:%S") : NULL;
-        gchar *line = g_strdup_printf("WHOIS %s: idle %ss, signon %s", wnick, idle_s ? idle_s : "?", when ? when : "?");
-        append_server_line(st, line);
-        g_free(line);
-        g_free(when);
-        if (dt) g_date_time_unref(dt);
-        return;
-      }
+  ui_dispatch_irc_message(st, view);
 
-      if (g_strcmp0(msg->command, "319") == 0) {
-        const gchar *chans = msg->trailing ? msg->trailing : "";
-        gchar *line = g_strdup_printf("WHOIS %s: channels %s", wnick, chans);
-        append_server_line(st, line);
-        g_free(line);
-        return;
-      }
+  g_clear_pointer(&st->msg_time, g_date_time_unref);
+}
 
-      if (g_strcmp0(msg->command, "330") == 0) {
-        const gchar *acct = zc_irc_message_param(msg, 2);
-        gchar *line = g_strdup_printf("WHOIS %s: account %s", wnick, acct ? acct : "?");
-        append_server_line(st, line);
-        g_free(line);
-        return;
-      }
+static void
+ui_batch_begin(UiState *st) {
+  if (st->in_batch) return;
+  st->in_batch = TRUE;
 
-      if (g_strcmp0(msg->command, "671") == 0) {
-        gchar *line = g_strdup_printf("WHOIS %s: secure connection", wnick);
-        append_server_line(st, line);
-        g_free(line);
-        return;
-      }
+  GHashTableIter it;
+  gpointer k, v;
+  g_hash_table_iter_init(&it, st->pages);
+  while (g_hash_table_iter_next(&it, &k, &v)) chat_page_hold_scroll((ChatPage *)v);
+}
 
-      if (g_strcmp0(msg->command, "378") == 0) {
-        const gchar *info = msg->trailing ? msg->trailing : "";
-        gchar *line = g_strdup_printf("WHOIS %s: %s", wnick, info);
-        append_server_line(st, line);
-        g_free(line);
-        return;
-      }
+static void
+on_client_irc_messages(ZcClient *client, GPtrArray *views, UiState *st) {
+  (void)client;
+  if (!views) return;
+  ui_batch_begin(st);
+  for (guint i = 0; i < views->len; i++) ui_handle_irc_message(st, g_ptr_array_index(views, i));
+}
 
-      if (g_strcmp0(msg->command, "318") == 0) {
-        gchar *line = g_strdup_printf("WHOIS %s: end", wnick);
-        append_server_line(st, line);
-        g_free(line);
-        return;
-      }
+static void
+on_client_batch_end(ZcClient *client, UiState *st) {
+  (void)client;
+  if (!st->in_batch) return;
+  st->in_batch = FALSE;
 
-      // Cleaner default numeric output: prefer the human text.
-      if (msg->trailing && *msg->trailing) {
-        append_server_line(st, msg->trailing);
-        return;
-      }
+  if (st->dirty_userlists_all) {
+    userlist_rebuild_all(st);
+  } else {
+    if (st->dirty_userlists) {
+      GHashTableIter it;
+      gpointer k, v;
+      g_hash_table_iter_init(&it, st->dirty_userlists);
+      while (g_hash_table_iter_next(&it, &k, &v)) userlist_rebuild_channel(st, (const gchar *)k);
     }
-
-    // Fallback (non-numeric or no trailing)
-    const gchar *p0 = (msg->params && msg->params->len > 0) ? (const gchar *)g_ptr_array_index(msg->params, 0) : "";
-    gchar *line = g_strdup_printf("%s %s%s%s",
-      msg->command,
-      p0 ? p0 : "",
-      msg->trailing ? " :" : "",
-      msg->trailing ? msg->trailing : ""
-    );
-    append_server_line(st, line);
-    g_free(line);
+    userlist_flush_members(st);
   }
+  st->dirty_userlists_all = FALSE;
+  if (st->dirty_userlists) g_hash_table_remove_all(st->dirty_userlists);
+  if (st->dirty_members) g_hash_table_remove_all(st->dirty_members);
+  if (st->dirty_nicks) g_hash_table_remove_all(st->dirty_nicks);
+
+  GHashTableIter it;
+  gpointer k, v;
+  g_hash_table_iter_init(&it, st->pages);
+  while (g_hash_table_iter_next(&it, &k, &v)) chat_page_release_scroll((ChatPage *)v);
 }
 
 static G_GNUC_UNUSED void
@@ -1345,19 +1580,59 @@ on_client_raw_line(ZcClient *client, const gchar *line, UiState *st) {
   append_server_line(st, line);
 }
 
+static UiState *
+ui_window_state_for_client(UiWindow *uw, ZcClient *client) {
+  if (!uw || !uw->nets) return NULL;
+  for (guint i = 0; i < uw->nets->len; i++) {
+    UiState *st = g_ptr_array_index(uw->nets, i);
+    if (st->client == client) return st;
+  }
+  return NULL;
+}
+
 static void
-connect_async_cb(GObject *source, GAsyncResult *res, gpointer user_data) {
-  (void)source;
-  UiState *st = (UiState *)user_data;
+on_session_connect_failed(ZcSession *session, ZcClient *client, const gchar *message, UiWindow *uw) {
+  (void)session;
+  UiState *st = ui_window_state_for_client(uw, client);
+  if (!st) return;
 
-  GError *error = NULL;
-  if (!zc_client_connect_finish(st->client, res, &error)) {
-    ChatPage *status = get_or_create_page(st, "status");
-    chat_page_append_fmt(status, "Connect failed: %s", error->message);
-    set_status(st, "Connect failed");
-    g_clear_error(&error);
-    return;
-  }
+  ChatPage *status = get_or_create_page(st, "status");
+  chat_page_append_fmt(status, "Connect failed: %s", message ? message : "");
+  set_status(st, "Connect failed");
+}
+
+/* Copies the editable connection fields of @st into the network's settings. */
+static void
+zcl_state_sync_settings(UiState *st) {
+  ZcNetworkSettings *n = st ? st->net : NULL;
+  if (!n) return;
+
+  g_free(n->host); n->host = g_strdup(st->host ? st->host : "");
+  n->port = st->port;
+  n->tls = st->tls;
+  g_free(n->nick); n->nick = g_strdup(st->nick ? st->nick : "");
+  g_free(n->user); n->user = g_strdup(st->user ? st->user : "");
+  g_free(n->realname); n->realname = g_strdup(st->realname ? st->realname : "");
+  g_free(n->auto_join); n->auto_join = g_strdup(st->auto_join ? st->auto_join : "");
+  g_free(n->sasl_account); n->sasl_account = g_strdup(st->sasl_account ? st->sasl_account : "");
+  g_free(n->sasl_password); n->sasl_password = g_strdup(st->sasl_password ? st->sasl_password : "");
+}
+
+static ZcNetworkConfig *
+zcl_state_network_config(UiState *st) {
+  ZcNetworkConfig *c = zc_network_config_new(st->net ? st->net->name : "");
+  g_free(c->host); c->host = g_strdup(st->host);
+  c->port = st->port;
+  c->tls = st->tls;
+  c->nick = g_strdup(st->nick);
+  c->user = g_strdup(st->user);
+  c->realname = g_strdup(st->realname);
+  c->auto_join = g_strdup(st->auto_join);
+  c->sasl_account = g_strdup(st->sasl_account);
+  c->sasl_password = g_strdup(st->sasl_password);
+  c->autoconnect = st->net ? st->net->autoconnect : FALSE;
+  c->charset = g_strdup(st->net ? st->net->charset : NULL);
+  return c;
 }
 
 static void
@@ -1370,7 +1645,11 @@ do_connect(UiState *st) {
 
   set_status(st, "Connecting…");
 
-  zc_client_connect_async(st->client, st->host, st->port, st->tls, NULL, connect_async_cb, st);
+  ZcNetworkConfig *c = zcl_state_network_config(st);
+  zc_session_update_network(st->uw->session, c);
+  zc_network_config_free(c);
+
+  zc_session_connect(st->uw->session, st->net->name);
 }
 
 static gboolean
@@ -1383,7 +1662,51 @@ zcl_send_raw_line(UiState *st, ChatPage *page, const gchar *raw) {
   }
 
   GError *err = NULL;
-  gboolean ok = zc_client_send_raw(st->client, raw, &err);
+  gboolean ok = zc_client_send_raw(st->client, raw, ZC_SEND_PRIORITY_USER, &err);
+  if (!ok && page) {
+    chat_page_append_fmt(page, "Send failed: %s", err ? err->message : "unknown error");
+  }
+  g_clear_error(&err);
+  return ok;
+}
+
+/* Text for a channel or query: split to fit and paced as one job; pasted
+ * lines are echoed as they were typed. */
+static gboolean
+zcl_send_text(UiState *st, ChatPage *page, const gchar *command, const gchar *target, const gchar *text) {
+  if (!st || !st->client || !zc_client_is_connected(st->client)) {
+    if (page) chat_page_append(page, "Not connected.");
+    return FALSE;
+  }
+
+  GError *err = NULL;
+  if (!zc_client_send_text(st->client, command, target, text, &err)) {
+    if (page) chat_page_append_fmt(page, "Send failed: %s", err ? err->message : "unknown error");
+    g_clear_error(&err);
+    return FALSE;
+  }
+
+  if (g_strcmp0(command, "PRIVMSG") == 0) {
+    gchar **lines = g_strsplit(text, "\n", -1);
+    for (gchar **l = lines; *l; l++) {
+      g_strchomp(*l);
+      if (**l) ui_echo_outgoing_privmsg(st, target, *l);
+    }
+    g_strfreev(lines);
+  }
+  return TRUE;
+}
+
+static gboolean
+zcl_send_message(UiState *st, ChatPage *page, const ZcIrcMessageBuilder *b) {
+  if (!st || !st->client) return FALSE;
+  if (!zc_client_is_connected(st->client)) {
+    if (page) chat_page_append(page, "Not connected.");
+    return FALSE;
+  }
+
+  GError *err = NULL;
+  gboolean ok = zc_client_send_message(st->client, b, ZC_SEND_PRIORITY_USER, &err);
   if (!ok && page) {
     chat_page_append_fmt(page, "Send failed: %s", err ? err->message : "unknown error");
   }
@@ -1410,6 +1733,40 @@ zcl_take_token(gchar **s) {
   return p;
 }
 
+/* /stats: the current network's counters, in the status tab. */
+static void
+ui_print_stats(UiState *st) {
+  ChatPage *status = get_or_create_page(st, "status");
+  ZcClientStats s;
+  zc_client_get_stats(st->client, &s);
+
+  chat_page_append_fmt(status, "Stats for %s:", st->net ? st->net->name : "this network");
+  chat_page_append_fmt(status, "  in:  %" G_GUINT64_FORMAT " lines, %" G_GUINT64_FORMAT " bytes, %" G_GUINT64_FORMAT " malformed, %" G_GUINT64_FORMAT " transcoded",
+    s.lines_in, s.bytes_in, s.malformed, s.lines_transcoded);
+  chat_page_append_fmt(status, "  out: %" G_GUINT64_FORMAT " lines, %" G_GUINT64_FORMAT " bytes; queued %u lines / %" G_GSIZE_FORMAT " bytes, %u awaiting flood tokens",
+    s.lines_out, s.bytes_out, s.write_queue_depth, s.write_queue_bytes, s.flood_queued);
+
+  GString *hist = g_string_new(NULL);
+  for (guint b = 0; b < ZC_STATS_PARSE_BUCKETS; b++) {
+    const guint64 le = zc_client_stats_parse_bucket_le_ns(b);
+    if (le == G_MAXUINT64) g_string_append_printf(hist, " >:%" G_GUINT64_FORMAT, s.parse_hist[b]);
+    else g_string_append_printf(hist, " ≤%" G_GUINT64_FORMAT "ns:%" G_GUINT64_FORMAT, le, s.parse_hist[b]);
+  }
+  chat_page_append_fmt(status, "  parse: %.0f ns/line avg;%s",
+    s.lines_in ? (gdouble)s.parse_ns_total / (gdouble)s.lines_in : 0.0, hist->str);
+  g_string_free(hist, TRUE);
+
+  chat_page_append_fmt(status, "  dispatch: %" G_GUINT64_FORMAT " reads, %.1f µs avg, %" G_GUINT64_FORMAT " µs max",
+    s.dispatches, s.dispatches ? (gdouble)s.dispatch_us_total / (gdouble)s.dispatches : 0.0, s.dispatch_us_max);
+  chat_page_append_fmt(status, "  rtt: %.1f ms ± %.1f ms; %" G_GUINT64_FORMAT " reconnects, %" G_GUINT64_FORMAT " ping timeouts, %" G_GUINT64_FORMAT " pongs sent",
+    s.rtt_us / 1000.0, s.rtt_jitter_us / 1000.0, s.reconnects, s.ping_timeouts, s.pongs_sent);
+
+  ZcIngestStats is;
+  zc_client_get_ingest_stats(st->client, &is);
+  chat_page_append_fmt(status, "  ingest: %" G_GUINT64_FORMAT " slices, %" G_GUINT64_FORMAT " yielded, %" G_GUINT64_FORMAT " µs max; backlog %" G_GSIZE_FORMAT " bytes (max %" G_GSIZE_FORMAT "), reads paused %.1f ms, %" G_GUINT64_FORMAT " I/O stalls",
+    is.slices, is.yields, is.max_slice_us, is.backlog_bytes, is.max_backlog_bytes, is.paused_us / 1000.0, is.io_stalls);
+}
+
 static void
 run_command(UiState *st, const gchar *target, const gchar *line) {
   // Clean slash-command -> raw-line dispatch.
@@ -1427,22 +1784,9 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
       return;
     }
 
-	    if (!st->client || !zc_client_is_connected(st->client)) {
-	      chat_page_append(page, "Not connected.");
-      return;
-    }
-
-
-	    GError *err = NULL;
-	    gboolean ok = zc_client_privmsg(st->client, effective_target, msg, &err);
-    if (!ok || err) {
-      chat_page_append_fmt(page, "Send failed: %s", err ? err->message : "unknown error");
-      g_clear_error(&err);
-    } else {
-      // Many IRCds do not echo your own PRIVMSG back to you.
-      // If we don't locally echo, your message "vanishes" from your own buffer.
-      ui_echo_outgoing_privmsg(st, effective_target, msg);
-    }
+    // Many IRCds do not echo your own PRIVMSG back to you; zcl_send_text()
+    // echoes locally so the message doesn't "vanish" from your own buffer.
+    zcl_send_text(st, page, "PRIVMSG", effective_target, msg);
     return;
   }
 
@@ -1453,19 +1797,7 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
       return;
     }
 
-	    if (!st->client || !zc_client_is_connected(st->client)) {
-	      chat_page_append(page, "Not connected.");
-      return;
-    }
-
-	    GError *err = NULL;
-	    gboolean ok = zc_client_privmsg(st->client, effective_target, line, &err);
-    if (!ok || err) {
-      chat_page_append_fmt(page, "Send failed: %s", err ? err->message : "unknown error");
-      g_clear_error(&err);
-    } else {
-      ui_echo_outgoing_privmsg(st, effective_target, line);
-    }
+    zcl_send_text(st, page, "PRIVMSG", effective_target, line);
     return;
   }
 
@@ -1506,6 +1838,7 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
     ZCL_CMD_QUERY_UI,           // /query nick
     ZCL_CMD_CLOSE_UI,           // /close
     ZCL_CMD_SAY_UI,             // /say text (send as message, not raw)
+    ZCL_CMD_STATS_UI,           // /stats
   } ZclCmdRule;
 
   typedef struct {
@@ -1541,6 +1874,7 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
     {"q",      ZCL_CMD_QUERY_UI,    NULL},
     {"close",  ZCL_CMD_CLOSE_UI,    NULL},
     {"say",    ZCL_CMD_SAY_UI,      NULL},
+    {"stats",  ZCL_CMD_STATS_UI,    NULL},
 
     {"whois",  ZCL_CMD_WHOIS,       "WHOIS"},
     {"names",  ZCL_CMD_NAMES,       "NAMES"},
@@ -1565,6 +1899,12 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
   }
 
   // UI-only commands can run even while disconnected.
+  if (spec->rule == ZCL_CMD_STATS_UI) {
+    ui_print_stats(st);
+    g_free(tmp);
+    return;
+  }
+
   if (spec->rule == ZCL_CMD_QUERY_UI) {
     gchar *r = rest;
     gchar *nick = zcl_take_token(&r);
@@ -1592,19 +1932,7 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
       g_free(tmp);
       return;
     }
-    if (!st->client || !zc_client_is_connected(st->client)) {
-      chat_page_append(page, "Not connected.");
-      g_free(tmp);
-      return;
-    }
-    GError *err = NULL;
-    gboolean ok = zc_client_privmsg(st->client, effective_target, rest, &err);
-    if (!ok || err) {
-      chat_page_append_fmt(page, "Send failed: %s", err ? err->message : "unknown error");
-      g_clear_error(&err);
-    } else {
-      ui_echo_outgoing_privmsg(st, effective_target, rest);
-    }
+    zcl_send_text(st, page, "PRIVMSG", effective_target, rest);
     g_free(tmp);
     return;
   }
@@ -1623,6 +1951,7 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
     case ZCL_CMD_QUERY_UI:
     case ZCL_CMD_CLOSE_UI:
     case ZCL_CMD_SAY_UI:
+    case ZCL_CMD_STATS_UI:
       return;
 
     case ZCL_CMD_RAW_REST: {
@@ -1668,12 +1997,12 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
         break;
       }
 
-      gchar *raw = NULL;
-      if (reason && *reason) raw = g_strdup_printf("PART %s :%s", chan, reason);
-      else raw = g_strdup_printf("PART %s", chan);
-
-      zcl_send_raw_line(st, page, raw);
-      g_free(raw);
+      ZcIrcMessageBuilder b;
+      zc_irc_message_builder_init(&b);
+      zc_irc_message_builder_set_command(&b, "PART");
+      zc_irc_message_builder_add_param(&b, chan, -1);
+      if (reason && *reason) zc_irc_message_builder_add_trailing(&b, reason, -1);
+      zcl_send_message(st, page, &b);
       break;
     }
 
@@ -1696,12 +2025,12 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
         break;
       }
 
-      gchar *raw = NULL;
-      if (topic && *topic) raw = g_strdup_printf("TOPIC %s :%s", chan, topic);
-      else raw = g_strdup_printf("TOPIC %s", chan);
-
-      zcl_send_raw_line(st, page, raw);
-      g_free(raw);
+      ZcIrcMessageBuilder b;
+      zc_irc_message_builder_init(&b);
+      zc_irc_message_builder_set_command(&b, "TOPIC");
+      zc_irc_message_builder_add_param(&b, chan, -1);
+      if (topic && *topic) zc_irc_message_builder_add_trailing(&b, topic, -1);
+      zcl_send_message(st, page, &b);
       break;
     }
 
@@ -1709,10 +2038,11 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
       gchar *r = rest;
       gchar *nick = zcl_take_token(&r);
       if (!nick || !*nick) { chat_page_append(page, "Usage: /whois <nick>"); break; }
-      gchar *raw = g_strdup_printf("WHOIS %s", nick);
-      gboolean ok = zcl_send_raw_line(st, page, raw);
-      if (ok) zcl_whois_begin(nick);
-      g_free(raw);
+      ZcIrcMessageBuilder b;
+      zc_irc_message_builder_init(&b);
+      zc_irc_message_builder_set_command(&b, "WHOIS");
+      zc_irc_message_builder_add_param(&b, nick, -1);
+      if (zcl_send_message(st, page, &b)) zcl_whois_begin(nick);
       break;
     }
 
@@ -1781,12 +2111,13 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
         break;
       }
 
-      gchar *raw = NULL;
-      if (reason && *reason) raw = g_strdup_printf("KICK %s %s :%s", chan, nick, reason);
-      else raw = g_strdup_printf("KICK %s %s", chan, nick);
-
-      zcl_send_raw_line(st, page, raw);
-      g_free(raw);
+      ZcIrcMessageBuilder m;
+      zc_irc_message_builder_init(&m);
+      zc_irc_message_builder_set_command(&m, "KICK");
+      zc_irc_message_builder_add_param(&m, chan, -1);
+      zc_irc_message_builder_add_param(&m, nick, -1);
+      if (reason && *reason) zc_irc_message_builder_add_trailing(&m, reason, -1);
+      zcl_send_message(st, page, &m);
       break;
     }
 
@@ -1800,20 +2131,21 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
         break;
       }
 
-      gchar *raw = g_strdup_printf("INVITE %s %s", nick, chan);
-      zcl_send_raw_line(st, page, raw);
-      g_free(raw);
+      ZcIrcMessageBuilder b;
+      zc_irc_message_builder_init(&b);
+      zc_irc_message_builder_set_command(&b, "INVITE");
+      zc_irc_message_builder_add_param(&b, nick, -1);
+      zc_irc_message_builder_add_param(&b, chan, -1);
+      zcl_send_message(st, page, &b);
       break;
     }
 
     case ZCL_CMD_AWAY: {
-      if (rest && *rest) {
-        gchar *raw = g_strdup_printf("AWAY :%s", rest);
-        zcl_send_raw_line(st, page, raw);
-        g_free(raw);
-      } else {
-        zcl_send_raw_line(st, page, "AWAY");
-      }
+      ZcIrcMessageBuilder b;
+      zc_irc_message_builder_init(&b);
+      zc_irc_message_builder_set_command(&b, "AWAY");
+      if (rest && *rest) zc_irc_message_builder_add_trailing(&b, rest, -1);
+      zcl_send_message(st, page, &b);
       break;
     }
 
@@ -1831,15 +2163,7 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
       // Open a query tab for convenience when messaging someone directly.
       zcl_ui_open_query(st, nick);
 
-      gchar *raw = NULL;
-      if (spec->rule == ZCL_CMD_NOTICE) raw = g_strdup_printf("NOTICE %s :%s", nick, msg);
-      else raw = g_strdup_printf("PRIVMSG %s :%s", nick, msg);
-
-      gboolean ok = zcl_send_raw_line(st, page, raw);
-      if (ok && spec->rule == ZCL_CMD_MSG) {
-        ui_echo_outgoing_privmsg(st, nick, msg);
-      }
-      g_free(raw);
+      zcl_send_text(st, page, spec->rule == ZCL_CMD_NOTICE ? "NOTICE" : "PRIVMSG", nick, msg);
       break;
     }
 
@@ -1847,10 +2171,15 @@ run_command(UiState *st, const gchar *target, const gchar *line) {
       if (!rest || !*rest) { chat_page_append(page, "Usage: /me <action>"); break; }
       if (g_strcmp0(effective_target, "status") == 0) { chat_page_append(page, "No target here. Switch to a channel/query tab."); break; }
 
-      gchar *raw = g_strdup_printf("PRIVMSG %s :\001ACTION %s\001", effective_target, rest);
-      gboolean ok = zcl_send_raw_line(st, page, raw);
+      ZcIrcMessageBuilder b;
+      zc_irc_message_builder_init(&b);
+      zc_irc_message_builder_set_command(&b, "PRIVMSG");
+      zc_irc_message_builder_add_param(&b, effective_target, -1);
+      zc_irc_message_builder_add_trailing(&b, "\001ACTION ", -1);
+      zc_irc_message_builder_append(&b, rest, -1);
+      zc_irc_message_builder_append(&b, "\001", 1);
+      gboolean ok = zcl_send_message(st, page, &b);
       if (ok) ui_echo_outgoing_action(st, effective_target, rest);
-      g_free(raw);
       break;
     }
   }
@@ -1909,6 +2238,17 @@ connect_dialog(UiState *st) {
   GtkWidget *join = gtk_entry_new();
   gtk_entry_set_text(GTK_ENTRY(join), st->auto_join ? st->auto_join : "#zoite");
 
+  GtkWidget *sasl_user = gtk_entry_new();
+  gtk_entry_set_text(GTK_ENTRY(sasl_user), st->sasl_account ? st->sasl_account : "");
+  gtk_entry_set_placeholder_text(GTK_ENTRY(sasl_user), "none");
+
+  GtkWidget *sasl_pass = gtk_entry_new();
+  gtk_entry_set_text(GTK_ENTRY(sasl_pass), st->sasl_password ? st->sasl_password : "");
+  gtk_entry_set_visibility(GTK_ENTRY(sasl_pass), FALSE);
+
+  GtkWidget *autoconnect = gtk_check_button_new_with_label("Connect on startup");
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(autoconnect), st->net && st->net->autoconnect);
+
   int r = 0;
   gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Host"), 0, r, 1, 1);
   gtk_grid_attach(GTK_GRID(grid), host, 1, r++, 1, 1);
@@ -1930,6 +2270,14 @@ connect_dialog(UiState *st) {
   gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Auto-join"), 0, r, 1, 1);
   gtk_grid_attach(GTK_GRID(grid), join, 1, r++, 1, 1);
 
+  gtk_grid_attach(GTK_GRID(grid), gtk_label_new("SASL account"), 0, r, 1, 1);
+  gtk_grid_attach(GTK_GRID(grid), sasl_user, 1, r++, 1, 1);
+
+  gtk_grid_attach(GTK_GRID(grid), gtk_label_new("SASL password"), 0, r, 1, 1);
+  gtk_grid_attach(GTK_GRID(grid), sasl_pass, 1, r++, 1, 1);
+
+  gtk_grid_attach(GTK_GRID(grid), autoconnect, 1, r++, 1, 1);
+
   gtk_widget_show_all(dlg);
 
   gint resp = gtk_dialog_run(GTK_DIALOG(dlg));
@@ -1939,6 +2287,8 @@ connect_dialog(UiState *st) {
     g_free(st->user);
     g_free(st->realname);
     g_free(st->auto_join);
+    g_free(st->sasl_account);
+    g_free(st->sasl_password);
 
     st->host = g_strdup(gtk_entry_get_text(GTK_ENTRY(host)));
     st->port = (guint16)gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(port));
@@ -1947,19 +2297,11 @@ connect_dialog(UiState *st) {
     st->user = g_strdup(gtk_entry_get_text(GTK_ENTRY(user)));
     st->realname = g_strdup(gtk_entry_get_text(GTK_ENTRY(real)));
     st->auto_join = g_strdup(gtk_entry_get_text(GTK_ENTRY(join)));
+    st->sasl_account = g_strdup(gtk_entry_get_text(GTK_ENTRY(sasl_user)));
+    st->sasl_password = g_strdup(gtk_entry_get_text(GTK_ENTRY(sasl_pass)));
+    if (st->net) st->net->autoconnect = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(autoconnect));
 
-    if (st->settings) {
-      g_free(st->settings->host); st->settings->host = g_strdup(st->host);
-      st->settings->port = st->port;
-      st->settings->tls = st->tls;
-      g_free(st->settings->nick); st->settings->nick = g_strdup(st->nick);
-      g_free(st->settings->user); st->settings->user = g_strdup(st->user);
-      g_free(st->settings->realname); st->settings->realname = g_strdup(st->realname);
-      g_free(st->settings->auto_join); st->settings->auto_join = g_strdup(st->auto_join);
-      GError *se = NULL;
-      (void)zc_settings_save(st->settings, &se);
-      if (se) g_clear_error(&se);
-    }
+    zcl_settings_sync_and_save(st->uw);
     do_connect(st);
   }
 
@@ -2009,58 +2351,54 @@ on_page_added(GtkNotebook *nb, GtkWidget *child, guint page_num, gpointer user_d
 
 
 static void
-zcl_window_store_size_if_reasonable(UiState *st, GtkWindow *win, gint w, gint h) {
-  if (!st) return;
+zcl_window_store_size_if_reasonable(UiWindow *uw, GtkWindow *win, gint w, gint h) {
+  if (!uw) return;
   /* Ignore bogus sizes (can happen during early realize or teardown). */
   if (w < 320 || h < 240) return;
   /* Only store the "normal" size. If the window is maximized, keep the last normal size. */
   if (win && gtk_window_is_maximized(win)) return;
-  st->last_win_w = w;
-  st->last_win_h = h;
+  uw->last_win_w = w;
+  uw->last_win_h = h;
 }
 
 static gboolean
 on_window_configure(GtkWidget *w, GdkEventConfigure *ev, gpointer user_data) {
-  UiState *st = (UiState *)user_data;
-  if (!st || !GTK_IS_WINDOW(w) || !ev) return FALSE;
-  zcl_window_store_size_if_reasonable(st, GTK_WINDOW(w), ev->width, ev->height);
+  UiWindow *uw = (UiWindow *)user_data;
+  if (!uw || !GTK_IS_WINDOW(w) || !ev) return FALSE;
+  zcl_window_store_size_if_reasonable(uw, GTK_WINDOW(w), ev->width, ev->height);
   return FALSE;
 }
 
 static void
-zcl_settings_sync_and_save(UiState *st) {
-  if (!st || !st->settings) return;
+zcl_settings_sync_and_save(UiWindow *uw) {
+  if (!uw || !uw->settings) return;
 
   /* Clamp: never persist microscopic sizes. */
-  if (st->last_win_w < 320) st->last_win_w = 980;
-  if (st->last_win_h < 240) st->last_win_h = 640;
+  if (uw->last_win_w < 320) uw->last_win_w = 980;
+  if (uw->last_win_h < 240) uw->last_win_h = 640;
 
-  st->settings->win_w = st->last_win_w;
-  st->settings->win_h = st->last_win_h;
+  uw->settings->win_w = uw->last_win_w;
+  uw->settings->win_h = uw->last_win_h;
 
-  g_free(st->settings->host); st->settings->host = g_strdup(st->host ? st->host : "");
-  st->settings->port = st->port;
-  st->settings->tls = st->tls;
-  g_free(st->settings->nick); st->settings->nick = g_strdup(st->nick ? st->nick : "");
-  g_free(st->settings->user); st->settings->user = g_strdup(st->user ? st->user : "");
-  g_free(st->settings->realname); st->settings->realname = g_strdup(st->realname ? st->realname : "");
-  g_free(st->settings->auto_join); st->settings->auto_join = g_strdup(st->auto_join ? st->auto_join : "");
+  for (guint i = 0; uw->nets && i < uw->nets->len; i++) {
+    zcl_state_sync_settings(g_ptr_array_index(uw->nets, i));
+  }
 
   GError *se = NULL;
-  (void)zc_settings_save(st->settings, &se);
+  (void)zc_settings_save(uw->settings, &se);
   if (se) g_clear_error(&se);
 }
 
 static gboolean
 on_window_delete(GtkWidget *w, GdkEvent *ev, gpointer user_data) {
   (void)ev;
-  UiState *st = (UiState *)user_data;
-  if (st && w && GTK_IS_WINDOW(w)) {
+  UiWindow *uw = (UiWindow *)user_data;
+  if (uw && w && GTK_IS_WINDOW(w)) {
     gint ww = 0, hh = 0;
     gtk_window_get_size(GTK_WINDOW(w), &ww, &hh);
-    zcl_window_store_size_if_reasonable(st, GTK_WINDOW(w), ww, hh);
+    zcl_window_store_size_if_reasonable(uw, GTK_WINDOW(w), ww, hh);
   }
-  zcl_settings_sync_and_save(st);
+  zcl_settings_sync_and_save(uw);
   /* Returning FALSE keeps default destroy behavior. */
   return FALSE;
 }
@@ -2077,22 +2415,20 @@ ui_state_free(UiState *st) {
     zc_client_disconnect(st->client);
   }
 
-  zcl_settings_sync_and_save(st);
-
   g_free(st->host);
   g_free(st->nick);
   g_free(st->user);
   g_free(st->realname);
   g_free(st->auto_join);
+  g_free(st->sasl_account);
+  g_free(st->sasl_password);
+  g_free(st->status_text);
 
-  if (st->chan_users) {
-    g_hash_table_destroy(st->chan_users);
-    st->chan_users = NULL;
-  }
-
-  if (st->settings) {
-    zc_settings_free(st->settings);
-    st->settings = NULL;
+  g_clear_pointer(&st->dirty_members, g_hash_table_destroy);
+  g_clear_pointer(&st->dirty_nicks, g_hash_table_destroy);
+  if (st->dirty_userlists) {
+    g_hash_table_destroy(st->dirty_userlists);
+    st->dirty_userlists = NULL;
   }
 
   if (st->pages) {
@@ -2109,6 +2445,26 @@ ui_state_free(UiState *st) {
   g_free(st);
 }
 
+static void
+ui_window_free(UiWindow *uw) {
+  if (!uw) return;
+
+  zcl_settings_sync_and_save(uw);
+
+  if (uw->session) g_signal_handlers_disconnect_by_data(uw->session, uw);
+  g_clear_pointer(&uw->metrics, zc_metrics_writer_free);
+  g_ptr_array_unref(uw->nets);
+  uw->nets = NULL;
+
+  g_clear_object(&uw->session);
+
+  if (uw->settings) {
+    zc_settings_free(uw->settings);
+    uw->settings = NULL;
+  }
+  g_free(uw);
+}
+
 /* userlist context menu */
 
 static gchar *
@@ -2346,10 +2702,13 @@ zcl_ui_close_target(UiState *st, const gchar *target, gboolean send_part) {
   const gchar *safe_target = chat_page_get_target(page);
   if (!safe_target || !*safe_target) safe_target = target;
 
+  /* Nothing queued for a closed tab is still wanted (NAMES, CTCP replies…). */
+  if (st->client) (void)zc_client_cancel_queued(st->client, safe_target);
+
   if (send_part && (safe_target[0] == '#' || safe_target[0] == '&' || safe_target[0] == '!' || safe_target[0] == '+')) {
     if (st->client && zc_client_is_connected(st->client)) {
       gchar *line = g_strdup_printf("PART %s :Closed", safe_target);
-      zc_client_send_raw(st->client, line, NULL);
+      zc_client_send_raw(st->client, line, ZC_SEND_PRIORITY_USER, NULL);
       g_free(line);
     }
   }
@@ -2394,37 +2753,234 @@ zcl_userlist_normalize_nick(const gchar *s) {
   if ((*s == '@' || *s == '+' || *s == '%' || *s == '~' || *s == '&') && s[1] != '\0') s++;
   return g_strdup(s);
 }
-GtkWidget *zc_ui_create_main_window(GtkApplication *app) {
-  apply_css();
+/* Networks */
+
+static UiState *
+ui_window_current(UiWindow *uw) {
+  if (!uw || !uw->networks || !uw->nets) return NULL;
+  gint idx = gtk_notebook_get_current_page(GTK_NOTEBOOK(uw->networks));
+  if (idx < 0) return NULL;
+  GtkWidget *child = gtk_notebook_get_nth_page(GTK_NOTEBOOK(uw->networks), idx);
+  return child ? (UiState *)g_object_get_data(G_OBJECT(child), "zc-state") : NULL;
+}
+
+/* Network tabs only earn their space once there is more than one network. */
+static void
+ui_window_update_tabs(UiWindow *uw) {
+  gtk_notebook_set_show_tabs(GTK_NOTEBOOK(uw->networks), uw->nets->len > 1);
+}
+
+static void
+on_network_switch_page(GtkNotebook *nb, GtkWidget *child, guint page_num, gpointer user_data) {
+  (void)nb; (void)page_num;
+  UiWindow *uw = (UiWindow *)user_data;
+  UiState *st = child ? (UiState *)g_object_get_data(G_OBJECT(child), "zc-state") : NULL;
+  if (!uw || !st) return;
+
+  /* "switch-page" runs before the current page changes; update directly. */
+  if (uw->conn_toggle_btn) {
+    gtk_button_set_label(GTK_BUTTON(uw->conn_toggle_btn), zc_client_is_connected(st->client) ? "Disconnect" : "Connect");
+  }
+  if (uw->menu_btn) {
+    const gchar *t = st->status_text ? st->status_text : "";
+    gtk_widget_set_tooltip_text(uw->menu_btn, *t ? t : "Menu");
+  }
+}
+
+static UiState *
+ui_network_new(UiWindow *uw, ZcNetworkSettings *ns) {
+  ZcNetworkConfig *c = zc_network_config_new(ns->name);
+  g_free(c->host); c->host = g_strdup(ns->host);
+  c->port = ns->port;
+  c->tls = ns->tls;
+  c->nick = g_strdup(ns->nick);
+  c->user = g_strdup(ns->user);
+  c->realname = g_strdup(ns->realname);
+  c->auto_join = g_strdup(ns->auto_join);
+  c->sasl_account = g_strdup(ns->sasl_account);
+  c->sasl_password = g_strdup(ns->sasl_password);
+  c->autoconnect = ns->autoconnect;
+  c->charset = g_strdup(ns->charset);
+  ZcClient *client = zc_session_add_network(uw->session, c);
+  zc_network_config_free(c);
+  if (!client) return NULL;
 
   UiState *st = g_new0(UiState, 1);
-  st->app = app;
-  st->client = zc_client_new();
+  st->app = uw->app;
+  st->win = uw->win;
+  st->uw = uw;
+  st->net = ns;
+  st->client = g_object_ref(client);
+
+  st->host = g_strdup(ns->host);
+  st->port = ns->port;
+  st->tls = ns->tls;
+  st->nick = g_strdup(ns->nick);
+  st->user = g_strdup(ns->user);
+  st->realname = g_strdup(ns->realname);
+  st->auto_join = g_strdup(ns->auto_join);
+  st->sasl_account = g_strdup(ns->sasl_account);
+  st->sasl_password = g_strdup(ns->sasl_password);
+  st->status_text = g_strdup("Disconnected");
+
+  st->pages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+  st->notebook = gtk_notebook_new();
+  gtk_notebook_set_scrollable(GTK_NOTEBOOK(st->notebook), TRUE);
+  g_object_set_data(G_OBJECT(st->notebook), "zc-state", st);
+  g_signal_connect(st->notebook, "page-added", G_CALLBACK(on_page_added), st);
 
-  st->settings = zc_settings_load();
+  g_ptr_array_add(uw->nets, st);
 
-  st->host = g_strdup(st->settings->host);
-  st->port = st->settings->port;
-  st->tls = st->settings->tls;
-  st->nick = g_strdup(st->settings->nick);
-  st->user = g_strdup(st->settings->user);
-  st->realname = g_strdup(st->settings->realname);
-  st->auto_join = g_strdup(st->settings->auto_join);
+  GtkWidget *tab = gtk_label_new(ns->name);
+  gtk_notebook_append_page(GTK_NOTEBOOK(uw->networks), st->notebook, tab);
+  gtk_notebook_set_tab_reorderable(GTK_NOTEBOOK(uw->networks), st->notebook, TRUE);
+  gtk_widget_show_all(st->notebook);
 
-  /* Window size persistence: start from the last saved normal size, but ignore bogus tiny values. */
-  st->last_win_w = st->settings->win_w;
-  st->last_win_h = st->settings->win_h;
-  if (st->last_win_w < 320) st->last_win_w = 980;
-  if (st->last_win_h < 240) st->last_win_h = 640;
-  st->settings->win_w = st->last_win_w;
-  st->settings->win_h = st->last_win_h;
+  /* status page */
+  get_or_create_page(st, "status");
+
+  /* connect to backend signals */
+  g_signal_connect(st->client, "connected", G_CALLBACK(on_client_connected), st);
+  g_signal_connect(st->client, "disconnected", G_CALLBACK(on_client_disconnected), st);
+  /* Raw protocol spam makes /WHOIS (and everything else) unreadable. Keep it off. */
+  /* g_signal_connect(st->client, "raw-line", G_CALLBACK(on_client_raw_line), st); */
+  g_signal_connect(st->client, "irc-messages", G_CALLBACK(on_client_irc_messages), st);
+  g_signal_connect(st->client, "batch-end", G_CALLBACK(on_client_batch_end), st);
+  g_signal_connect(st->client, "reconnecting", G_CALLBACK(on_client_reconnecting), st);
+  g_signal_connect(st->client, "reconnect-failed", G_CALLBACK(on_client_reconnect_failed), st);
+  g_signal_connect(st->client, "registration-phase", G_CALLBACK(on_client_registration_phase), st);
+  g_signal_connect(st->client, "notify::lag", G_CALLBACK(on_client_lag_notify), st);
+  g_signal_connect(st->client, "health-changed", G_CALLBACK(on_client_health_changed), st);
+  g_signal_connect(st->client, "send-job-progress", G_CALLBACK(on_client_send_job_progress), st);
+  g_signal_connect(st->client, "send-job-finished", G_CALLBACK(on_client_send_job_finished), st);
+
+  /* 1s, 2s, 4s… capped at 2 minutes, each shortened by up to 30%. */
+  const ZcReconnectPolicy policy = { 1000, 120000, 2.0, 0.3, 0 };
+  zc_client_set_reconnect_policy(st->client, &policy);
+  /* A quarter of a 60 Hz frame per slice keeps bursts from freezing redraws. */
+  zc_client_set_ingest_budget(st->client, 4000);
+  /* Socket work off the GTK thread: a modal dialog or a slow relayout must
+   * not cost us a ping timeout. */
+  zc_client_set_io_thread(st->client, TRUE);
+
+  return st;
+}
 
+static void
+on_add_network_clicked(GtkButton *btn, gpointer user_data) {
+  UiWindow *uw = (UiWindow *)user_data;
+  if (!uw) return;
 
-  st->pages = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  GtkWidget *pop = gtk_widget_get_ancestor(GTK_WIDGET(btn), GTK_TYPE_POPOVER);
+  if (pop) gtk_widget_hide(pop);
 
-  st->win = gtk_application_window_new(app);
+  GtkWidget *dlg = gtk_dialog_new_with_buttons(
+    "Add Network",
+    GTK_WINDOW(uw->win),
+    GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+    "_Cancel", GTK_RESPONSE_CANCEL,
+    "_Add", GTK_RESPONSE_OK,
+    NULL
+  );
+  gtk_dialog_set_default_response(GTK_DIALOG(dlg), GTK_RESPONSE_OK);
+
+  GtkWidget *content = gtk_dialog_get_content_area(GTK_DIALOG(dlg));
+  GtkWidget *grid = gtk_grid_new();
+  gtk_grid_set_column_spacing(GTK_GRID(grid), 10);
+  gtk_container_set_border_width(GTK_CONTAINER(grid), 12);
+  gtk_container_add(GTK_CONTAINER(content), grid);
+
+  GtkWidget *name = gtk_entry_new();
+  gtk_entry_set_activates_default(GTK_ENTRY(name), TRUE);
+  gtk_grid_attach(GTK_GRID(grid), gtk_label_new("Name"), 0, 0, 1, 1);
+  gtk_grid_attach(GTK_GRID(grid), name, 1, 0, 1, 1);
+
+  gtk_widget_show_all(dlg);
+
+  UiState *st = NULL;
+  if (gtk_dialog_run(GTK_DIALOG(dlg)) == GTK_RESPONSE_OK) {
+    gchar *n = g_strstrip(g_strdup(gtk_entry_get_text(GTK_ENTRY(name))));
+    ZcNetworkSettings *ns = *n ? zc_settings_add_network(uw->settings, n) : NULL;
+    if (ns) {
+      st = ui_network_new(uw, ns);
+      if (!st) zc_settings_remove_network(uw->settings, ns);
+    }
+    g_free(n);
+  }
+  gtk_widget_destroy(dlg);
+
+  if (!st) return;
+  ui_window_update_tabs(uw);
+  gint idx = gtk_notebook_page_num(GTK_NOTEBOOK(uw->networks), st->notebook);
+  if (idx >= 0) gtk_notebook_set_current_page(GTK_NOTEBOOK(uw->networks), idx);
+  zcl_settings_sync_and_save(uw);
+  connect_dialog(st);
+}
+
+static void
+on_remove_network_clicked(GtkButton *btn, gpointer user_data) {
+  UiWindow *uw = (UiWindow *)user_data;
+  GtkWidget *pop = gtk_widget_get_ancestor(GTK_WIDGET(btn), GTK_TYPE_POPOVER);
+  if (pop) gtk_widget_hide(pop);
+
+  UiState *st = ui_window_current(uw);
+  /* Always keep one network around to type into. */
+  if (!st || uw->nets->len < 2) return;
+
+  ZcNetworkSettings *ns = st->net;
+  gchar *name = g_strdup(ns->name);
+
+  /* ui_state_free() drops the link at once, which would discard the QUIT:
+   * let go of the client here instead. Its pending writes keep it alive
+   * until the QUIT is out or two seconds have passed. */
+  if (zc_client_is_connected(st->client)) {
+    g_signal_handlers_disconnect_by_data(st->client, st);
+    if (zc_client_quit_and_close(st->client, "Leaving", 2000, NULL)) g_clear_object(&st->client);
+  }
+
+  gint idx = gtk_notebook_page_num(GTK_NOTEBOOK(uw->networks), st->notebook);
+  if (idx >= 0) gtk_notebook_remove_page(GTK_NOTEBOOK(uw->networks), idx);
+  g_ptr_array_remove(uw->nets, st); /* frees st */
+
+  zc_session_remove_network(uw->session, name);
+  zc_settings_remove_network(uw->settings, ns);
+  g_free(name);
+
+  ui_window_update_tabs(uw);
+  zcl_settings_sync_and_save(uw);
+}
+
+static GtkWidget *
+menu_model_button(const gchar *label, GCallback cb, gpointer user_data) {
+  GtkWidget *b = gtk_model_button_new();
+  gtk_button_set_label(GTK_BUTTON(b), label);
+  gtk_widget_set_halign(b, GTK_ALIGN_START);
+  g_signal_connect(b, "clicked", cb, user_data);
+  return b;
+}
+
+GtkWidget *zc_ui_create_main_window(GtkApplication *app) {
+  apply_css();
+
+  UiWindow *uw = g_new0(UiWindow, 1);
+  uw->app = app;
+  uw->session = zc_session_new();
+  uw->nets = g_ptr_array_new_with_free_func((GDestroyNotify)ui_state_free);
+
+  uw->settings = zc_settings_load();
+
+  /* Window size persistence: start from the last saved normal size, but ignore bogus tiny values. */
+  uw->last_win_w = uw->settings->win_w;
+  uw->last_win_h = uw->settings->win_h;
+  if (uw->last_win_w < 320) uw->last_win_w = 980;
+  if (uw->last_win_h < 240) uw->last_win_h = 640;
+  uw->settings->win_w = uw->last_win_w;
+  uw->settings->win_h = uw->last_win_h;
+
+  uw->win = gtk_application_window_new(app);
 /* Icons: use the one true icon everywhere (dev + installed). */
-  ui_apply_window_icon(GTK_WINDOW(st->win));
+  ui_apply_window_icon(GTK_WINDOW(uw->win));
 
 GtkIconTheme *theme = gtk_icon_theme_get_default();
 if (theme && g_file_test("data/icons", G_FILE_TEST_IS_DIR)) {
@@ -2433,36 +2989,35 @@ if (theme && g_file_test("data/icons", G_FILE_TEST_IS_DIR)) {
 }
 
 gtk_window_set_default_icon_name("net.zoite.ZoiteChatLite");
-gtk_window_set_icon_name(GTK_WINDOW(st->win), "net.zoite.ZoiteChatLite");
+gtk_window_set_icon_name(GTK_WINDOW(uw->win), "net.zoite.ZoiteChatLite");
 
 /* Some shells ignore icon-name unless the app is installed. Set the window icon directly from the SVG in dev runs. */
 if (g_file_test("data/icons/hicolor/scalable/apps/net.zoite.ZoiteChatLite.svg", G_FILE_TEST_EXISTS)) {
   GError *e = NULL;
   GdkPixbuf *pix = gdk_pixbuf_new_from_file_at_scale("data/icons/hicolor/scalable/apps/net.zoite.ZoiteChatLite.svg", 128, 128, TRUE, &e);
   if (pix) {
-    gtk_window_set_icon(GTK_WINDOW(st->win), pix);
+    gtk_window_set_icon(GTK_WINDOW(uw->win), pix);
     g_object_unref(pix);
   } else {
     g_clear_error(&e);
   }
 }
-  gtk_window_set_default_size(GTK_WINDOW(st->win), st->last_win_w, st->last_win_h);
-  gtk_window_set_title(GTK_WINDOW(st->win), "ZoiteChat Lite");
-  gtk_window_set_position(GTK_WINDOW(st->win), GTK_WIN_POS_CENTER);
+  gtk_window_set_default_size(GTK_WINDOW(uw->win), uw->last_win_w, uw->last_win_h);
+  gtk_window_set_title(GTK_WINDOW(uw->win), "ZoiteChat Lite");
+  gtk_window_set_position(GTK_WINDOW(uw->win), GTK_WIN_POS_CENTER);
   /* Track window size while running so we don't save 1x1 at teardown. */
-  g_signal_connect(st->win, "configure-event", G_CALLBACK(on_window_configure), st);
-  g_signal_connect(st->win, "delete-event", G_CALLBACK(on_window_delete), st);
+  g_signal_connect(uw->win, "configure-event", G_CALLBACK(on_window_configure), uw);
+  g_signal_connect(uw->win, "delete-event", G_CALLBACK(on_window_delete), uw);
 
 
   GtkWidget *hb = gtk_header_bar_new();
   gtk_header_bar_set_show_close_button(GTK_HEADER_BAR(hb), TRUE);
   gtk_header_bar_set_title(GTK_HEADER_BAR(hb), "ZoiteChat Lite");
   gtk_header_bar_set_subtitle(GTK_HEADER_BAR(hb), "GTK3 frontend + LibZoiteChat backend");
-  gtk_window_set_titlebar(GTK_WINDOW(st->win), hb);
+  gtk_window_set_titlebar(GTK_WINDOW(uw->win), hb);
 
   GtkWidget *btn_connect = gtk_button_new_with_label("Connect");
-  st->conn_toggle_btn = btn_connect;
-  ui_update_connect_toggle_button(st);
+  uw->conn_toggle_btn = btn_connect;
   gtk_header_bar_pack_start(GTK_HEADER_BAR(hb), btn_connect);
 
 /* Right-side hamburger menu (replaces the old status label). */
@@ -2471,45 +3026,54 @@ GtkWidget *menu_img = gtk_image_new_from_icon_name("open-menu-symbolic", GTK_ICO
 gtk_button_set_image(GTK_BUTTON(menu_btn), menu_img);
 gtk_widget_set_tooltip_text(menu_btn, "Menu");
 gtk_header_bar_pack_end(GTK_HEADER_BAR(hb), menu_btn);
-st->menu_btn = menu_btn;
+uw->menu_btn = menu_btn;
 
 GtkWidget *popover = gtk_popover_new(menu_btn);
 GtkWidget *vb = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
 gtk_container_set_border_width(GTK_CONTAINER(vb), 10);
-GtkWidget *about_btn = gtk_model_button_new();
-gtk_button_set_label(GTK_BUTTON(about_btn), "About ZoiteChat");
-gtk_widget_set_halign(about_btn, GTK_ALIGN_START);
-g_signal_connect(about_btn, "clicked", G_CALLBACK(on_about_zoitechat), st);
-gtk_box_pack_start(GTK_BOX(vb), about_btn, FALSE, FALSE, 0);
+gtk_box_pack_start(GTK_BOX(vb), menu_model_button("Add Network…", G_CALLBACK(on_add_network_clicked), uw), FALSE, FALSE, 0);
+gtk_box_pack_start(GTK_BOX(vb), menu_model_button("Remove Network", G_CALLBACK(on_remove_network_clicked), uw), FALSE, FALSE, 0);
+gtk_box_pack_start(GTK_BOX(vb), gtk_separator_new(GTK_ORIENTATION_HORIZONTAL), FALSE, FALSE, 0);
+gtk_box_pack_start(GTK_BOX(vb), menu_model_button("About ZoiteChat", G_CALLBACK(on_about_zoitechat), uw), FALSE, FALSE, 0);
 
 gtk_container_add(GTK_CONTAINER(popover), vb);
 gtk_widget_show_all(popover);
 gtk_menu_button_set_popover(GTK_MENU_BUTTON(menu_btn), popover);
 
-set_status(st, zc_client_is_connected(st->client) ? "Connected" : "Disconnected");
   GtkWidget *root = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
-  gtk_container_add(GTK_CONTAINER(st->win), root);
+  gtk_container_add(GTK_CONTAINER(uw->win), root);
 
-  st->notebook = gtk_notebook_new();
-  gtk_notebook_set_scrollable(GTK_NOTEBOOK(st->notebook), TRUE);
-  gtk_box_pack_start(GTK_BOX(root), st->notebook, TRUE, TRUE, 0);
+  uw->networks = gtk_notebook_new();
+  gtk_notebook_set_scrollable(GTK_NOTEBOOK(uw->networks), TRUE);
+  gtk_box_pack_start(GTK_BOX(root), uw->networks, TRUE, TRUE, 0);
 
-  g_signal_connect(btn_connect, "clicked", G_CALLBACK(on_connect_toggle_clicked), st);
-  g_signal_connect(st->notebook, "page-added", G_CALLBACK(on_page_added), st);
+  g_signal_connect(btn_connect, "clicked", G_CALLBACK(on_connect_toggle_clicked), uw);
+  g_signal_connect(uw->networks, "switch-page", G_CALLBACK(on_network_switch_page), uw);
+  g_signal_connect(uw->session, "connect-failed", G_CALLBACK(on_session_connect_failed), uw);
 
-  /* status page */
-  get_or_create_page(st, "status");
+  for (guint i = 0; i < uw->settings->networks->len; i++) {
+    ui_network_new(uw, g_ptr_array_index(uw->settings->networks, i));
+  }
+  ui_window_update_tabs(uw);
+  gtk_notebook_set_current_page(GTK_NOTEBOOK(uw->networks), 0);
 
-  /* connect to backend signals */
-  g_signal_connect(st->client, "connected", G_CALLBACK(on_client_connected), st);
-  g_signal_connect(st->client, "disconnected", G_CALLBACK(on_client_disconnected), st);
-  /* Raw protocol spam makes /WHOIS (and everything else) unreadable. Keep it off. */
-  /* g_signal_connect(st->client, "raw-line", G_CALLBACK(on_client_raw_line), st); */
-  g_signal_connect(st->client, "irc-message", G_CALLBACK(on_client_irc_message), st);
+  if (uw->settings->metrics_interval > 0) uw->metrics = zc_metrics_writer_new(uw->session, uw->settings->metrics_interval);
 
-  g_object_set_data_full(G_OBJECT(st->win), "zc-state", st, (GDestroyNotify)ui_state_free);
+  g_object_set_data_full(G_OBJECT(uw->win), "zc-window", uw, (GDestroyNotify)ui_window_free);
 
-  gtk_widget_show_all(st->win);
-  return st->win;
-}
+  gtk_widget_show_all(uw->win);
+
+  /* All autoconnect networks dial out in parallel on this main context. */
+  for (guint i = 0; i < uw->nets->len; i++) {
+    UiState *st = g_ptr_array_index(uw->nets, i);
+    if (st->net->autoconnect && st->host && *st->host) {
+      ChatPage *status = get_or_create_page(st, "status");
+      chat_page_append_fmt(status, "Connecting to %s:%u (%s)…",
+        st->host, (guint)st->port, st->tls ? "TLS" : "plain");
+      set_status(st, "Connecting…");
+    }
+  }
+  zc_session_connect_all(uw->session);
 
+  return uw->win;
+}